@@ -536,6 +536,10 @@ sane_read (SANE_Handle handle, SANE_Byte *buffer,
     {
       status = fetch_image_data (s, buffer, max_length, length);
     }
+  else if (s->deskew)
+    {
+      status = fetch_deskewed_data (s, buffer, max_length, length);
+    }
   else if (s->src == &s->img)
     {
       /**/ if (!s->img.ptr)
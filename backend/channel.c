@@ -215,6 +215,10 @@ channel_recv_throttle (channel *ch, void *buffer, size_t size,
                        SANE_Status *status)
 {
   size_t max = ch->max_request_size (ch);
+
+  if (0 < ch->request_size && ch->request_size < max)
+    max = ch->request_size;
+
   return ch->recv (ch, buffer, size < max ? size : max, status);
 }
 
@@ -102,6 +102,9 @@ typedef struct channel
                    size_t buf_size, SANE_Status *status);
   size_t (*max_request_size) (const struct channel *self);
 
+  size_t request_size;  /* bytes to read in a single request, limited by
+                         * max_request_size(), zero to use the limit
+                         */
 
   char *name;
   channel_type type;
@@ -0,0 +1,341 @@
+/*  deskew.c -- line by line deskewing of streamed image data
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+|iscan
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of the SANE backend distributed with Image Scan!
+ *
+ *  Image Scan!'s SANE backend is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Linking Image Scan!'s SANE backend statically or dynamically with
+ *  other modules is making a combined work based on this SANE backend.
+ *  Thus, the terms and conditions of the GNU General Public License
+ *  cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  SANE frontends that communicate with Image Scan!'s SANE backend
+ *  solely through the SANE Application Programming Interface,
+ *  regardless of the license terms of these SANE frontends, and to
+ *  copy and distribute the resulting combined work under terms of your
+ *  choice, provided that every copy of the combined work is
+ *  accompanied by a complete copy of the source code of Image Scan!'s
+ *  SANE backend (the version of Image Scan!'s SANE backend used to
+ *  produce the combined work), being distributed under the terms of
+ *  the GNU General Public License plus this exception.  An independent
+ *  module is a module which is not derived from or based on Image
+ *  Scan!'s SANE backend.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  independent modules that communicate with Image Scan!'s SANE
+ *  backend solely through the "Interpreter" interface, regardless of
+ *  the license terms of these independent modules, and to copy and
+ *  distribute the resulting combined work under terms of your choice,
+ *  provided that every copy of the combined work is accompanied by a
+ *  complete copy of the source code of Image Scan!'s SANE backend (the
+ *  version of Image Scan!'s SANE backend used to produce the combined
+ *  work), being distributed under the terms of the GNU General Public
+ *  License plus this exception.  An independent module is a module
+ *  which is not derived from or based on Image Scan!'s SANE backend.
+ *
+ *  Note that people who make modified versions of Image Scan!'s SANE
+ *  backend are not obligated to grant special exceptions for their
+ *  modified versions; it is their choice whether to do so.  The GNU
+ *  General Public License gives permission to release a modified
+ *  version without this exception; this exception also makes it
+ *  possible to release a modified version which carries forward this
+ *  exception.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "deskew.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "include/sane/sanei_magic.h"
+#include "message.h"
+
+/*! Height of the band used to estimate the skew, in inches.
+ *  It has to hold the leading edge of the sheet with some margin.
+ */
+#define DESKEW_BAND 2
+
+/*! Pixels are filled with this where there is nothing to rotate in.
+ *  Same as what dip_deskew() uses.
+ */
+#define BACKGROUND 0xff
+
+/*! Tells whether image data in \a ctx can be deskewed.
+ *  These are the formats that sanei_magic_rotate() supports.
+ */
+bool
+deskew_supports (const SANE_Parameters *ctx)
+{
+  require (ctx);
+
+  return ((SANE_FRAME_RGB == ctx->format && 8 == ctx->depth)
+          || (SANE_FRAME_GRAY == ctx->format
+              && (8 == ctx->depth || 1 == ctx->depth)));
+}
+
+deskew *
+deskew_create (const SANE_Parameters *ctx, int res_y)
+{
+  deskew *self;
+
+  require (ctx && deskew_supports (ctx) && 0 < res_y);
+
+  self = t_calloc (1, deskew);
+  if (!self) return NULL;
+
+  memcpy (&self->ctx, ctx, sizeof (self->ctx));
+  self->band_lines = DESKEW_BAND * res_y;
+  if (self->band_lines > ctx->lines)
+    self->band_lines = ctx->lines;
+
+  self->window_lines = self->band_lines;
+  self->window = t_malloc (self->window_lines * ctx->bytes_per_line,
+                           SANE_Byte);
+  if (!self->window)
+    {
+      delete (self);
+      return NULL;
+    }
+  return self;
+}
+
+deskew *
+deskew_destroy (deskew *self)
+{
+  if (self)
+    {
+      delete (self->window);
+      delete (self);
+    }
+  return NULL;
+}
+
+/*! Returns where the leading band of the image goes, and its \a size
+ *  in bytes.  The band has to be filled before the skew can be
+ *  estimated.
+ */
+SANE_Byte *
+deskew_band (deskew *self, size_t *size)
+{
+  require (self && size && 0 == self->lines_in);
+
+  *size = self->band_lines * self->ctx.bytes_per_line;
+  return self->window;
+}
+
+/*! Estimates the skew from the leading band.
+ *  Lines are passed on as is if no skew can be found.
+ */
+SANE_Status
+deskew_estimate (deskew *self, int res_x, int res_y)
+{
+  SANE_Parameters band;
+  SANE_Status status;
+  int center_x, center_y;
+  double angle;
+
+  require (self && 0 == self->lines_in);
+
+  self->lines_in = self->band_lines;
+
+  memcpy (&band, &self->ctx, sizeof (band));
+  band.lines = self->band_lines;
+
+  status = sanei_magic_findSkew (&band, self->window, res_x, res_y,
+                                 &center_x, &center_y, &angle);
+  if (SANE_STATUS_GOOD != status)
+    {
+      log_info ("no skew found in leading %d lines", band.lines);
+      return SANE_STATUS_GOOD;
+    }
+
+  /* same as what dip_deskew() passes to sanei_magic_rotate() */
+  deskew_set_angle (self, center_x, center_y, -angle);
+
+  return (self->window ? SANE_STATUS_GOOD : SANE_STATUS_NO_MEM);
+}
+
+/*! Sets up rotation by the angle of \a slope around the centre
+ *  given, which may well be outside of the image.
+ *  The number of lines kept is grown as needed for the rotation.
+ */
+void
+deskew_set_angle (deskew *self, int center_x, int center_y, double slope)
+{
+  double rad = -atan (slope);
+  double dx, dy;
+  int lines;
+
+  require (self && self->lines_in <= self->window_lines);
+
+  self->turn = true;
+  self->center_x = center_x;
+  self->center_y = center_y;
+  self->sin = sin (rad);
+  self->cos = cos (rad);
+
+  /* A pixel moves by at most its distance from the centre times the
+   * sine, plus a bit for the cosine, plus one for truncation.
+   */
+  dx = center_x;
+  if (fabs (dx - (self->ctx.pixels_per_line - 1)) > fabs (dx))
+    dx -= self->ctx.pixels_per_line - 1;
+  dy = center_y;
+  if (fabs (dy - (self->ctx.lines - 1)) > fabs (dy))
+    dy -= self->ctx.lines - 1;
+  self->reach = ceil (fabs (dx * self->sin) + fabs (dy * (1 - self->cos)))
+    + 2;
+
+  lines = 2 * self->reach + 1;
+  if (lines > self->ctx.lines)
+    lines = self->ctx.lines;
+
+  log_info ("deskewing with %d lines of context", self->reach);
+
+  if (lines > self->window_lines)
+    {
+      SANE_Byte *window = realloc (self->window,
+                                   lines * self->ctx.bytes_per_line);
+      if (!window)
+        {
+          err_major ("%s", strerror (ENOMEM));
+          delete (self->window);
+          return;
+        }
+      /* lines so far have not wrapped around, so they stay put */
+      self->window = window;
+      self->window_lines = lines;
+    }
+}
+
+/*! Tells whether another input line is needed before the next output
+ *  line can be made.
+ */
+bool
+deskew_needs_input (const deskew *self)
+{
+  int need;
+
+  require (self);
+
+  need = self->lines_out + (self->turn ? self->reach : 0) + 1;
+  if (need > self->ctx.lines)
+    need = self->ctx.lines;
+
+  return (self->lines_in < need);
+}
+
+/*! Returns where the next input line goes.
+ */
+SANE_Byte *
+deskew_input (deskew *self)
+{
+  SANE_Byte *line;
+
+  require (self && self->window && deskew_needs_input (self));
+
+  line = self->window + ((self->lines_in % self->window_lines)
+                         * self->ctx.bytes_per_line);
+  ++self->lines_in;
+
+  return line;
+}
+
+bool
+deskew_done (const deskew *self)
+{
+  require (self);
+
+  return (self->lines_out == self->ctx.lines);
+}
+
+static inline const SANE_Byte *
+window_line (const deskew *self, int line)
+{
+  return self->window + ((line % self->window_lines)
+                         * self->ctx.bytes_per_line);
+}
+
+/*! Makes the next output \a line.
+ *  This is sanei_magic_rotate() for a single line with the input
+ *  taken from the ring of lines.
+ */
+void
+deskew_output (deskew *self, SANE_Byte *line)
+{
+  const int pwidth = self->ctx.pixels_per_line;
+  const int bwidth = self->ctx.bytes_per_line;
+  const int height = self->ctx.lines;
+  int i, j, k;
+  int depth = (SANE_FRAME_RGB == self->ctx.format ? 3 : 1);
+
+  require (self && self->window && line);
+  require (!deskew_done (self) && !deskew_needs_input (self));
+
+  i = self->lines_out++;
+
+  if (!self->turn)
+    {
+      memcpy (line, window_line (self, i), bwidth);
+      return;
+    }
+
+  memset (line, BACKGROUND, bwidth);
+
+  for (j = 0; j < pwidth; ++j)
+    {
+      int shiftY = self->center_y - i;
+      int shiftX = self->center_x - j;
+      int sourceX, sourceY;
+      const SANE_Byte *src;
+
+      sourceX = self->center_x - (int) (shiftX * self->cos
+                                        + shiftY * self->sin);
+      if (sourceX < 0 || sourceX >= pwidth)
+        continue;
+
+      sourceY = self->center_y + (int) (-shiftY * self->cos
+                                        + shiftX * self->sin);
+      if (sourceY < 0 || sourceY >= height)
+        continue;
+
+      src = window_line (self, sourceY);
+
+      if (1 == self->ctx.depth)
+        {
+          line[j / 8] &= ~(1 << (7 - (j % 8)));
+          line[j / 8] |= (((src[sourceX / 8] >> (7 - (sourceX % 8))) & 1)
+                          << (7 - (j % 8)));
+        }
+      else
+        {
+          for (k = 0; k < depth; ++k)
+            line[j * depth + k] = src[sourceX * depth + k];
+        }
+    }
+}
@@ -0,0 +1,139 @@
+/*  deskew.h -- line by line deskewing of streamed image data
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+|iscan
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of the SANE backend distributed with Image Scan!
+ *
+ *  Image Scan!'s SANE backend is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Linking Image Scan!'s SANE backend statically or dynamically with
+ *  other modules is making a combined work based on this SANE backend.
+ *  Thus, the terms and conditions of the GNU General Public License
+ *  cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  SANE frontends that communicate with Image Scan!'s SANE backend
+ *  solely through the SANE Application Programming Interface,
+ *  regardless of the license terms of these SANE frontends, and to
+ *  copy and distribute the resulting combined work under terms of your
+ *  choice, provided that every copy of the combined work is
+ *  accompanied by a complete copy of the source code of Image Scan!'s
+ *  SANE backend (the version of Image Scan!'s SANE backend used to
+ *  produce the combined work), being distributed under the terms of
+ *  the GNU General Public License plus this exception.  An independent
+ *  module is a module which is not derived from or based on Image
+ *  Scan!'s SANE backend.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  independent modules that communicate with Image Scan!'s SANE
+ *  backend solely through the "Interpreter" interface, regardless of
+ *  the license terms of these independent modules, and to copy and
+ *  distribute the resulting combined work under terms of your choice,
+ *  provided that every copy of the combined work is accompanied by a
+ *  complete copy of the source code of Image Scan!'s SANE backend (the
+ *  version of Image Scan!'s SANE backend used to produce the combined
+ *  work), being distributed under the terms of the GNU General Public
+ *  License plus this exception.  An independent module is a module
+ *  which is not derived from or based on Image Scan!'s SANE backend.
+ *
+ *  Note that people who make modified versions of Image Scan!'s SANE
+ *  backend are not obligated to grant special exceptions for their
+ *  modified versions; it is their choice whether to do so.  The GNU
+ *  General Public License gives permission to release a modified
+ *  version without this exception; this exception also makes it
+ *  possible to release a modified version which carries forward this
+ *  exception.
+ */
+
+
+#ifndef deskew_h_included
+#define deskew_h_included
+
+/*! \file
+ *  \brief  Line by line deskewing of streamed image data.
+ *
+ *  Deskewing the whole image at once means nothing can be passed on
+ *  to the frontend until the last line has been scanned.  A rotation
+ *  by a small angle only moves pixels a limited number of lines up or
+ *  down though.  So once the angle is known, each output line can be
+ *  made as soon as the input lines within that reach have come in,
+ *  keeping just those in a ring of lines.
+ *
+ *  The angle is estimated from a leading band of the image with the
+ *  same analysis that sanei_magic_findSkew() does on the whole image.
+ *  For a sheet that comes in top edge first, that edge is what the
+ *  estimate is based on anyway.  Lines are rotated with the same
+ *  arithmetic as sanei_magic_rotate(), so for a given angle and
+ *  centre the result is identical to rotating the whole image.
+ *
+ *  Rotation does not change the image size, so the frontend can be
+ *  told the image parameters before the first line is made.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sane/sane.h>
+
+#include "defines.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef struct deskew
+  {
+    SANE_Parameters ctx;        /* of the whole image */
+
+    bool   turn;                /* false if no skew was found */
+    int    center_x;
+    int    center_y;
+    double sin;
+    double cos;
+    int    reach;               /* lines a pixel may move up or down */
+
+    SANE_Byte *window;          /* ring of input lines */
+    int        window_lines;
+    int        band_lines;      /* used to estimate the skew */
+    int        lines_in;
+    int        lines_out;
+  } deskew;
+
+  bool deskew_supports (const SANE_Parameters *ctx);
+
+  deskew * deskew_create (const SANE_Parameters *ctx, int res_y);
+  deskew * deskew_destroy (deskew *self);
+
+  SANE_Byte * deskew_band (deskew *self, size_t *size);
+  SANE_Status deskew_estimate (deskew *self, int res_x, int res_y);
+  void deskew_set_angle (deskew *self, int center_x, int center_y,
+                         double slope);
+
+  bool deskew_needs_input (const deskew *self);
+  SANE_Byte * deskew_input (deskew *self);
+  bool deskew_done (const deskew *self);
+  void deskew_output (deskew *self, SANE_Byte *line);
+
+#ifdef __cplusplus
+}       /* extern "C" */
+#endif
+
+#endif  /* !defined (deskew_h_included) */
@@ -72,6 +72,7 @@
 
 #include "channel.h"
 #include "extension.h"
+#include "tuner.h"
 
 #define DEVNAME_LENGTH	16
 
@@ -222,6 +223,8 @@ struct device
 
   bool uses_locking;
   bool is_locked;
+
+  tuner *tuner;         /* shared with all devices of the same model */
 };
 
 typedef struct device device;
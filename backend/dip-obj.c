@@ -71,9 +71,12 @@
 
 #include "dip-obj.h"
 #include "defines.h"
+#include "deskew.h"
 #include "hw-data.h"
 #include "include/sane/sanei_magic.h"
 #include "ipc.h"
+#include "kernel.h"
+#include "matrix.h"
 
 #ifndef ENABLE_SANEI_MAGIC
 #define ENABLE_SANEI_MAGIC 0
@@ -185,6 +188,49 @@ dip_needs_whole_image (const void *self, const Option_Value *val,
               && val[OPT_AUTOCROP].b));
 }
 
+/*! \brief  Allocates memory for a whole image.
+ *
+ *  The esdip plugin processes images in such memory without copying
+ *  them if it can.  Release with dip_free().
+ */
+void *
+dip_alloc (const void *self, size_t size)
+{
+  require (dip == self);
+
+  return ipc_dip_alloc (dip->plugin, size);
+}
+
+void
+dip_free (const void *self, void *ptr)
+{
+  require (dip == self);
+
+  ipc_dip_free (dip->plugin, ptr);
+}
+
+/*! \brief  Tells whether deskewing can be done as image data comes in.
+ *
+ *  This is only possible for deskew on its own.  Autocrop needs to
+ *  know where the bottom edge of the document is before it can pass
+ *  anything on.  The esdip plugin only works on whole images.
+ */
+bool
+dip_can_stream_deskew (const void *self, const Option_Value *val,
+                       const SANE_Option_Descriptor *opt,
+                       const SANE_Parameters *ctx)
+{
+  require (dip == self && val && opt && ctx);
+
+  if (!dip_needs_whole_image (self, val, opt))
+    return false;
+  if (SANE_OPTION_IS_ACTIVE (opt[OPT_AUTOCROP].cap)
+      && val[OPT_AUTOCROP].b)
+    return false;
+
+  return (magic_turn == dip->deskew && deskew_supports (ctx));
+}
+
 void
 dip_apply_LUT (const void *self, const buffer *buf,
                const LUT *m)
@@ -193,31 +239,18 @@ dip_apply_LUT (const void *self, const buffer *buf,
   require (m->depth == buf->ctx.depth);
 
   /**/ if (16 == buf->ctx.depth)
-    {
-      uint16_t *p = (uint16_t *) buf->ptr;
-      uint16_t *e = (uint16_t *) buf->end;
-
-      while (p < e)
-        {
-          *p = * (uint16_t *) (m->lut + 2 * *p);
-          ++p;
-        }
-    }
+    kernel_lut_16 ((uint16_t *) buf->ptr,
+                   (buf->end - buf->ptr) / sizeof (uint16_t),
+                   (const uint16_t *) m->lut);
   else if ( 8 == buf->ctx.depth)
-    {
-      SANE_Byte *p = buf->ptr;
-      SANE_Byte *e = buf->end;
-
-      while (p < e)
-        {
-          *p = m->lut[*p];
-          ++p;
-        }
-    }
+    kernel_lut_8 (buf->ptr, buf->end - buf->ptr, m->lut);
   else
     err_major ("noop: unsupported bit depth %d", buf->ctx.depth);
 }
 
+/*! \remark  The backend itself only ever builds a single LUT, so
+ *           nothing calls this at the moment.
+ */
 void
 dip_apply_LUT_RGB (const void *self, const buffer *buf,
                    const LUT *r, const LUT *g, const LUT *b)
@@ -234,31 +267,14 @@ dip_apply_LUT_RGB (const void *self, const buffer *buf,
     }
 
   /**/ if (16 == buf->ctx.depth)
-    {
-      uint16_t *p = (uint16_t *) buf->ptr;
-      uint16_t *e = (uint16_t *) buf->end;
-
-      while (p < e)
-        {
-          p[0] = * (uint16_t *) (r->lut + 2 * p[0]);
-          p[1] = * (uint16_t *) (g->lut + 2 * p[1]);
-          p[2] = * (uint16_t *) (b->lut + 2 * p[2]);
-          p += 3;
-        }
-    }
+    kernel_lut_rgb_16 ((uint16_t *) buf->ptr,
+                       (buf->end - buf->ptr) / sizeof (uint16_t),
+                       (const uint16_t *) r->lut,
+                       (const uint16_t *) g->lut,
+                       (const uint16_t *) b->lut);
   else if ( 8 == buf->ctx.depth)
-    {
-      SANE_Byte *p = buf->ptr;
-      SANE_Byte *e = buf->end;
-
-      while (p < e)
-        {
-          p[0] = r->lut[p[0]];
-          p[1] = g->lut[p[1]];
-          p[2] = b->lut[p[2]];
-          p += 3;
-        }
-    }
+    kernel_lut_rgb_8 (buf->ptr, buf->end - buf->ptr,
+                      r->lut, g->lut, b->lut);
   else
     err_major ("noop: unsupported bit depth %d", buf->ctx.depth);
 }
@@ -485,16 +501,9 @@ dip_gimp_BC_LUT (const void *self, int depth,
 void
 dip_flip_bits (const void *self, const buffer *buf)
 {
-  SANE_Byte *p;
-
   require (dip == self && buf);
 
-  p = buf->ptr;
-  while (p != buf->end)
-    {
-      *p = ~*p;
-      ++p;
-    }
+  kernel_invert (buf->ptr, buf->end - buf->ptr);
 }
 
 static
@@ -555,45 +564,173 @@ dip_change_GRB_to_RGB (const void *self, const buffer *buf)
   return;
 }
 
-/*! \todo Add support for 16 bit color values (#816).
- */
 void
 dip_apply_color_profile (const void *self, const buffer *buf,
                          const double profile[9])
 {
-  SANE_Int i;
-  SANE_Byte *r_buf, *g_buf, *b_buf;
-  double red, grn, blu;
-
-  SANE_Byte *data;
-  SANE_Int size;
+  matrix m;
 
   require (dip == self && buf && profile);
-  require (8 == buf->ctx.depth);
 
   if (SANE_FRAME_RGB != buf->ctx.format)
     return;
 
-  data = buf->ptr;
-  size = buf->end - buf->ptr;
-
-  for (i = 0; i < size / 3; i++)
-  {
-    r_buf = data;
-    g_buf = data + 1;
-    b_buf = data + 2;
-
-    red =
-      profile[0] * (*r_buf) + profile[1] * (*g_buf) + profile[2] * (*b_buf);
-    grn =
-      profile[3] * (*r_buf) + profile[4] * (*g_buf) + profile[5] * (*b_buf);
-    blu =
-      profile[6] * (*r_buf) + profile[7] * (*g_buf) + profile[8] * (*b_buf);
-
-    *data++ = clamp (red, 0, 255);
-    *data++ = clamp (grn, 0, 255);
-    *data++ = clamp (blu, 0, 255);
-  }
+  matrix_init (&m, profile);
+
+  /**/ if (16 == buf->ctx.depth)
+    matrix_apply_16 (&m, (uint16_t *) buf->ptr,
+                     (buf->end - buf->ptr) / sizeof (uint16_t));
+  else if ( 8 == buf->ctx.depth)
+    matrix_apply_8 (&m, buf->ptr, buf->end - buf->ptr);
+  else
+    err_major ("unsupported bit depth");
+}
+
+/*! Runs the enabled processing steps on the image data in [p,e).
+ *  The steps are done in the order of the separate dip_*() calls
+ *  they replace, each by the same dispatched kernel those use, one
+ *  tile at a time while it is in cache.  The GRB to RGB reordering
+ *  is folded into the colour profile's matrix when there is one.
+ *  Kernels are instantiated from this for every combination of
+ *  steps so that the compiler can drop the ones not needed.
+ */
+static inline void
+pipeline_steps (SANE_Byte *p, SANE_Byte *e, const pipeline *pl,
+                bool reorder, bool profile, bool lut, bool flip)
+{
+  /**/ if (profile)
+    {
+      matrix_apply_8 (&pl->profile[reorder], p, e - p);
+    }
+  else if (reorder)             /* 8 bit RGB, a pixel at a time */
+    {
+      SANE_Byte *q;
+
+      for (q = p; q < e; q += 3)
+        {
+          SANE_Byte tmp = q[0];
+          q[0] = q[1];
+          q[1] = tmp;
+        }
+    }
+
+  if (lut)  kernel_lut_8 (p, e - p, pl->lut);
+  if (flip) kernel_invert (p, e - p);
+}
+
+#define pipeline_kernel_def(name,reorder,profile,lut,flip)             \
+  static void                                                         \
+  name (SANE_Byte *p, SANE_Byte *e, const pipeline *pl)               \
+  {                                                                   \
+    pipeline_steps (p, e, pl, reorder, profile, lut, flip);           \
+  }                                                                   \
+  /**/
+
+pipeline_kernel_def (kernel_0001, false, false, false, true )
+pipeline_kernel_def (kernel_0010, false, false, true , false)
+pipeline_kernel_def (kernel_0011, false, false, true , true )
+pipeline_kernel_def (kernel_0100, false, true , false, false)
+pipeline_kernel_def (kernel_0101, false, true , false, true )
+pipeline_kernel_def (kernel_0110, false, true , true , false)
+pipeline_kernel_def (kernel_0111, false, true , true , true )
+pipeline_kernel_def (kernel_1000, true , false, false, false)
+pipeline_kernel_def (kernel_1001, true , false, false, true )
+pipeline_kernel_def (kernel_1010, true , false, true , false)
+pipeline_kernel_def (kernel_1011, true , false, true , true )
+pipeline_kernel_def (kernel_1100, true , true , false, false)
+pipeline_kernel_def (kernel_1101, true , true , false, true )
+pipeline_kernel_def (kernel_1110, true , true , true , false)
+pipeline_kernel_def (kernel_1111, true , true , true , true )
+
+/*! Kernels indexed by reorder, profile, LUT and flip bits, in that
+ *  order from most to least significant.  Nothing to do is a NULL.
+ */
+static const pipeline_kernel pipeline_kernels[16] = {
+  NULL,        kernel_0001, kernel_0010, kernel_0011,
+  kernel_0100, kernel_0101, kernel_0110, kernel_0111,
+  kernel_1000, kernel_1001, kernel_1010, kernel_1011,
+  kernel_1100, kernel_1101, kernel_1110, kernel_1111,
+};
+
+static pipeline_kernel
+pipeline_kernel_for (bool reorder, bool profile, bool lut, bool flip)
+{
+  return pipeline_kernels[(reorder << 3) | (profile << 2)
+                          | (lut << 1) | flip];
+}
+
+/*! \brief  Picks the kernels to process image data of a scan with.
+ *
+ *  The steps are GRB to RGB reordering (decided per block), applying
+ *  a colour \a profile and a \a lut and flipping all bits.  Pass \c
+ *  NULL for the steps that are not needed.  When \a split is set,
+ *  the steps up to and including the profile go in the \c pre and
+ *  the others in the \c post kernel so that the interpreter can do
+ *  its bit in between.
+ *
+ *  Only 8 bit data, and 1 bit data without profile and LUT, can be
+ *  fused.  For anything else \c false is returned and the separate
+ *  dip_*() functions need to be used.
+ */
+bool
+dip_compile_pipeline (const void *self, pipeline *pl,
+                      const SANE_Parameters *ctx,
+                      const double *profile, const LUT *lut,
+                      bool flip, bool split)
+{
+  bool rgb   = (SANE_FRAME_RGB == ctx->format);
+  bool cct   = (NULL != profile);
+  bool table = (NULL != lut);
+  int r;
+
+  require (dip == self && pl && ctx);
+
+  memset (pl, 0, sizeof (*pl));
+
+  if (!(8 == ctx->depth || (1 == ctx->depth && !profile && !lut)))
+    return false;
+  if (profile && !rgb)
+    return false;
+  if (lut && lut->depth != ctx->depth)
+    return false;
+
+  for (r = 0; r < 2; ++r)
+    {
+      bool reorder = (r && rgb);
+
+      if (split)
+        pl->pre[r] = pipeline_kernel_for (reorder, cct, false, false);
+      else
+        pl->pre[r] = pipeline_kernel_for (reorder, cct, table, flip);
+    }
+  if (split)
+    pl->post = pipeline_kernel_for (false, false, table, flip);
+
+  pl->lut     = (lut ? lut->lut : NULL);
+  if (profile)
+    {
+      double grb[9];
+
+      /* reordering swaps the first two samples of every pixel */
+      for (r = 0; r < 9; r += 3)
+        {
+          grb[r]     = profile[r + 1];
+          grb[r + 1] = profile[r];
+          grb[r + 2] = profile[r + 2];
+        }
+      matrix_init (&pl->profile[0], profile);
+      matrix_init (&pl->profile[1], grb);
+    }
+  pl->tile    = ctx->bytes_per_line;
+  if (0 < pl->tile && pl->tile < 16 * 1024)
+    pl->tile *= (16 * 1024) / pl->tile;
+  pl->fused   = true;
+
+  log_info ("fused pipeline:%s%s%s%s", (profile ? " profile" : ""),
+            (lut ? " LUT" : ""), (flip ? " flip" : ""),
+            (split ? " (split)" : ""));
+
+  return true;
 }
 
 bool
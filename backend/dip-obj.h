@@ -84,6 +84,12 @@ extern "C"
 
   bool dip_needs_whole_image (const void *self, const Option_Value *val,
                               const SANE_Option_Descriptor *opt);
+  bool dip_can_stream_deskew (const void *self, const Option_Value *val,
+                              const SANE_Option_Descriptor *opt,
+                              const SANE_Parameters *ctx);
+
+  void * dip_alloc (const void *self, size_t size);
+  void dip_free (const void *self, void *ptr);
 
   void dip_apply_LUT (const void *self, const buffer *buf, const LUT *m);
   void dip_apply_LUT_RGB (const void *self, const buffer *buf,
@@ -104,6 +110,11 @@ extern "C"
   void dip_apply_color_profile (const void *self, const buffer *buf,
                                 const double profile[9]);
 
+  bool dip_compile_pipeline (const void *self, pipeline *pl,
+                             const SANE_Parameters *ctx,
+                             const double *profile, const LUT *lut,
+                             bool flip, bool split);
+
   bool dip_has_deskew (const void *self, const device *hw);
   bool dip_has_autocrop (const void *self, const device *hw);
 
@@ -74,6 +74,12 @@
 #include  <unistd.h>
 #include  <errno.h>
 #include  <math.h>
+#include  <pthread.h>
+#include  <sys/time.h>
+
+#ifdef __SSE2__
+#include  <emmintrin.h>
+#endif
 
 #include  <sane/saneopts.h>
 
@@ -87,6 +93,7 @@
 #include "utils.h"
 #include "timing.h"
 #include "cfg-obj.h"
+#include "deskew.h"
 #include "dip-obj.h"
 #include "model-info.h"
 #include "utils.h"
@@ -647,6 +654,9 @@ static void setOptionState (Epson_Scanner * s, SANE_Bool state,
 			    SANE_Int option, SANE_Bool * change);
 static void filter_resolution_list (Epson_Scanner * s);
 static void scan_finish (Epson_Scanner * s);
+static void prefetch_stop (Epson_Scanner *s);
+static void compile_pipeline (Epson_Scanner *s);
+static SANE_Status start_deskew (Epson_Scanner *s);
 
 static void get_colorcoeff_from_profile (double *profile,
 					 unsigned char *color_coeff);
@@ -1345,6 +1355,7 @@ create_epson_device (device **devp, channel* ch)
       dev->scan_hard = model_info_get_profile (info);
       model_info_customise_commands (info, dev->cmd);
       dev->uses_locking = model_info_has_lock_commands (info);
+      dev->tuner = model_info_cache_get_tuner (dev->fw_name);
     }
     else
     {
@@ -2618,7 +2629,6 @@ void
 sane_close (SANE_Handle handle)
 {
   Epson_Scanner *s, *prev;
-  size_t i;
 
   /* Test if there is still data pending from the scanner. If so, then
    * do a cancel.
@@ -2648,6 +2658,7 @@ sane_close (SANE_Handle handle)
   else
     first_handle = s->next;
 
+  prefetch_stop (s);
   s->hw = dev_dtor (s->hw);
 
   const_delete (s->opt[OPT_BIT_DEPTH].constraint.word_list, SANE_Word *);
@@ -2656,9 +2667,10 @@ sane_close (SANE_Handle handle)
 
   /* image data acquisition related resources */
   delete (s->raw.buf);
-  delete (s->img.buf);
-  for (i = 0; i < LINES_SHUFFLE_MAX; ++i)
-    delete (s->line_buffer[i]);
+  dip_free (s->dip, s->img.buf);
+  s->img.buf = NULL;
+  delete (s->line_buffer);
+  deskew_destroy (s->deskew);
 
   dip_destroy_LUT (s->dip, s->lut);
 
@@ -4591,6 +4603,8 @@ set_line_count (Epson_Scanner *s)
 
   int lcount = 1;
   s->hw->block_mode = SANE_FALSE;
+  s->tune_index = -1;
+  s->tune_blocks = 0;
 
   log_call ();
 
@@ -4604,8 +4618,21 @@ set_line_count (Epson_Scanner *s)
       || (s->hw->cmd->level[0] == 'D'))
   {
     channel *ch = s->hw->channel; /* for the sake of brevity */
+    size_t block_size = ch->max_request_size (ch);
+
     s->hw->block_mode = SANE_TRUE;
-    lcount = ch->max_request_size (ch) / s->raw.ctx.bytes_per_line;
+    if (s->hw->tuner)
+    {
+      /* the limits applied below, with 255 rounded down to an even
+       * count so that no two candidates end up with the same count
+       */
+      size_t max_lines = (using (s->hw, tpu) ? 32 : 254);
+
+      block_size = tuner_block_size (s->hw->tuner, block_size,
+                                     s->raw.ctx.bytes_per_line, max_lines,
+                                     s->hw->using_fs, &s->tune_index);
+    }
+    lcount = block_size / s->raw.ctx.bytes_per_line;
 
     if (0 >= lcount) lcount = 1;
 
@@ -4783,7 +4810,6 @@ device_sheet_setup (Epson_Scanner *s)
    */
 
   s->hw->color_shuffle = SANE_FALSE;
-  s->current_output_line = 0;
   s->color_shuffle_line = 0;
 
   mparam = mode_params + s->val[OPT_MODE].w;
@@ -4935,6 +4961,7 @@ sane_start (SANE_Handle handle)
   s->img.transfer_stopped = false;
 
   s->src = &s->raw;
+  s->deskew = deskew_destroy (s->deskew);
 
   if (0 == s->frame_count)
   {
@@ -5021,37 +5048,18 @@ sane_start (SANE_Handle handle)
 
   if (s->hw->color_shuffle == SANE_TRUE)
   {
-    size_t len_line_buffer = s->raw.ctx.bytes_per_line;
+    size_t len_line_buffer
+      = (2 * s->line_distance + 1) * s->raw.ctx.bytes_per_line;
 
     if (resize_warranted (len_line_buffer, s->cap_line_buffer))
       {
-        size_t i;
-
-        for (i = 0; i < 2 * s->line_distance + 1; ++i)
-          delete (s->line_buffer[i]);
+        delete (s->line_buffer);
         s->cap_line_buffer = 0;
 
-        for (i = 0; i < 2 * s->line_distance + 1; ++i)
-          {
-            SANE_Byte *p = t_malloc (len_line_buffer, SANE_Byte);
-
-            if (p)
-              {
-                s->line_buffer[i] = p;
-              }
-            else                /* clean up and bail */
-              {
-                size_t j;
-
-                for (j = 0; j < i; ++i)
-                  delete (s->line_buffer[i]);
+        if (!(s->line_buffer = t_malloc (len_line_buffer, SANE_Byte)))
+          return SANE_STATUS_NO_MEM;
 
-                s->cap_line_buffer = 0;
-
-                return SANE_STATUS_NO_MEM;
-              }
-            s->cap_line_buffer = len_line_buffer;
-          }
+        s->cap_line_buffer = len_line_buffer;
       }
   }
 
@@ -5068,6 +5076,7 @@ sane_start (SANE_Handle handle)
       len_raw = s->line_count * s->raw.ctx.bytes_per_line;
     }
 
+  prefetch_stop (s);             /* in case the last scan was abandoned */
   if (resize_warranted (len_raw, s->raw.cap))
     {
       delete (s->raw.buf);
@@ -5079,13 +5088,20 @@ sane_start (SANE_Handle handle)
       s->raw.cap = len_raw;
     }
   s->raw.ptr = s->raw.end = s->raw.buf;
+  compile_pipeline (s);
 
-  /* This here will block sane_start() until the whole image has been
-   * scanned and pre-processed.  The assumption made here is that the
+  /* Deskew on its own only needs the leading part of the image before
+   * the frontend can be given data.  Otherwise, this here will block
+   * sane_start() until the whole image has been scanned and
+   * pre-processed.  The assumption made here is that the
    * pre-processing can not be done in place and that the resulting
    * image is no larger than the image acquired.
    */
-  if (dip_needs_whole_image (s->dip, s->val, s->opt))
+  if (dip_can_stream_deskew (s->dip, s->val, s->opt, &s->raw.ctx))
+    {
+      return start_deskew (s);
+    }
+  else if (dip_needs_whole_image (s->dip, s->val, s->opt))
     {
       SANE_Int len_img = s->raw.ctx.bytes_per_line * s->raw.ctx.lines;
       SANE_Int max = len_img;
@@ -5095,10 +5111,11 @@ sane_start (SANE_Handle handle)
 
       if (resize_warranted (len_img, s->img.cap))
         {
-          delete (s->img.buf);
+          dip_free (s->dip, s->img.buf);
+          s->img.buf = NULL;
           s->img.cap = 0;
 
-          if (!(s->img.buf = t_malloc (len_img, SANE_Byte)))
+          if (!(s->img.buf = dip_alloc (s->dip, len_img)))
             return SANE_STATUS_NO_MEM;
 
           s->img.cap = len_img;
@@ -5352,258 +5369,485 @@ adf_handle_manual_centering (Epson_Scanner *s, SANE_Bool finalize)
 
 #define GET_COLOR(x)	(((x) >> 2) & 0x03)
 
-SANE_Status
-fetch_image_data (Epson_Scanner *s, SANE_Byte * data, SANE_Int max_length,
-             SANE_Int * length)
+/*! Outcome of receiving an image data block from the device.
+ */
+typedef struct
 {
-  SANE_Status status;
-  int index = 0;
-  SANE_Bool reorder = SANE_FALSE;
-  SANE_Bool needStrangeReorder = SANE_FALSE;
+  size_t len;                   /*!< bytes of image data received */
+  u_char status;                /*!< device status for the block */
+  bool   last;                  /*!< no more blocks will follow */
+  bool   cancel;                /*!< device asked to cancel the scan */
+  bool   finish;                /*!< call scan_finish() on failure */
+  bool   ext_status;            /*!< failure reason in extended status */
+} block_info;
+
+/*! Read-ahead of image data blocks.
+ *  The ESC/I image handshake is strictly serial: the device does not
+ *  send the next block until the current one has been acknowledged.
+ *  A reader thread keeps that handshake going, receiving into one of
+ *  two buffers, while the block in the other is post-processed and
+ *  handed to the frontend.  This keeps the link busy while the
+ *  frontend deals with the image data it got from sane_read().
+ */
+struct prefetch
+{
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
 
-  log_call ();
+  Epson_Scanner  *s;
+  bool            cancel;       /*!< cancel at the next block boundary */
 
-  if (s->raw.transfer_stopped && s->raw.cancel_requested)
-    return SANE_STATUS_CANCELLED;
+  SANE_Byte      *buf[2];
+  bool            full[2];
+  SANE_Status     status[2];
+  block_info      info[2];
 
-START_READ:
-  if (s->raw.ptr == s->raw.end)
+  int next;                     /*!< buffer to hand out next */
+  int held;                     /*!< buffer in use as s->raw.buf */
+};
+
+static int
+line_index (u_char status, int index)
+{
+  switch (GET_COLOR (status))
   {
-    size_t buf_len;
+  case 1:
+    return 1;
+  case 2:
+    return 0;
+  case 3:
+    return 2;
+  }
+  return index;
+}
 
-    if (s->raw.all_data_fetched)
+/*! Receives the next image data block from the device into \a buf.
+ *  The block is acknowledged right away so the device can prepare
+ *  the next one, unless \a cancel is set, in which case the scan is
+ *  cancelled instead.
+ */
+static SANE_Status
+recv_image_block (Epson_Scanner *s, SANE_Byte *buf, bool cancel,
+                  block_info *info)
+{
+  SANE_Status status = SANE_STATUS_GOOD;
+  size_t buf_len;
+
+  memset (info, 0, sizeof (*info));
+  info->finish = true;
+
+  if (!s->hw->using_fs)
     {
-      *length = 0;
-      return SANE_STATUS_EOF;
+      status = read_image_info_block (s->hw);
+      if (SANE_STATUS_GOOD != status) return status;
+
+      buf_len = s->hw->image_block_size;
     }
+  else
+    {
+      buf_len = s->hw->image_block_size;
+      if (s->hw->block_count >= s->hw->block_total)
+        buf_len = s->hw->final_block_size;
+      ++buf_len; /* include error byte */
+    }
+
+  if (!s->hw->block_mode && SANE_FRAME_RGB == s->raw.ctx.format)
+  {
+    /* Read color data in line mode */
+
+    /* read the three color lines - the number of bytes to read for
+     * the first one is already known (from the call above).
+     * We determine where to write the line from the color information
+     * in the data block. At the end we want the order RGB, but the
+     * way the data is delivered does not guarantee this - actually it's
+     * most likely that the order is GRB if it's not RGB!
+     */
+    int index = 0;
+    int i;
 
-    if (!s->hw->using_fs)
+    for (i = 0; i < 3; ++i)
+    {
+      if (0 < i)
       {
+        /* send the ACK signal to the scanner in order to make
+         * it ready for the next image info block ...
+         */
+        channel_send (s->hw->channel, S_ACK, 1, &status);
+
+        /* ... and request it
+         */
         status = read_image_info_block (s->hw);
-        if (SANE_STATUS_GOOD != status)
-          {
-            *length = 0;
-            scan_finish (s);
-            return status;
-          }
-        buf_len = s->hw->image_block_size;
-      }
-    else
-      {
+        if (SANE_STATUS_GOOD != status) return status;
+
         buf_len = s->hw->image_block_size;
-        if (s->hw->block_count >= s->hw->block_total)
-          buf_len = s->hw->final_block_size;
-        ++buf_len; /* include error byte */
       }
 
-    if (!s->hw->block_mode && SANE_FRAME_RGB == s->raw.ctx.format)
+      index = line_index (s->hw->status, index);
+      channel_recv (s->hw->channel,
+                    buf + index * s->raw.ctx.pixels_per_line,
+                    buf_len, &status);
+      if (SANE_STATUS_GOOD != status) return status;
+    }
+  }
+  else
+  {
+    /* Read image data in block mode */
+
+    channel *ch = s->hw->channel;
+    struct timeval start, stop;
+
+    if (0 <= s->tune_index)
+      ch->request_size = tuner_request_size (s->hw->tuner, s->tune_blocks);
+
+    gettimeofday (&start, NULL);
+    channel_recv_all_retry (ch, buf, buf_len, MAX_READ_ATTEMPTS, &status);
+    gettimeofday (&stop, NULL);
+
+    if (0 <= s->tune_index && 0 < s->tune_blocks
+        && SANE_STATUS_GOOD == status)
+      tuner_record (s->hw->tuner, s->tune_index, ch->request_size, buf_len,
+                    (stop.tv_sec - start.tv_sec)
+                    + (stop.tv_usec - start.tv_usec) / 1e6);
+    ch->request_size = 0;
+    ++s->tune_blocks;
+
+    if (SANE_STATUS_GOOD != status) return status;
+  }
+  info->status = s->hw->status;
+
+  if (s->hw->using_fs)
     {
-      /* Read color data in line mode */
+      u_char err = 0;
 
-      /* read the first color line - the number of bytes to read
-       * is already known (from last call to read_image_info_block()
-       * We determine where to write the line from the color information
-       * in the data block. At the end we want the order RGB, but the
-       * way the data is delivered does not guarantee this - actually it's
-       * most likely that the order is GRB if it's not RGB!
-       */
-      switch (GET_COLOR (s->hw->status))
-      {
-      case 1:
-	index = 1;
-	break;
-      case 2:
-	index = 0;
-	break;
-      case 3:
-	index = 2;
-	break;
-      }
+      if (s->hw->block_count >= s->hw->block_total)
+        info->last = true;
+      ++(s->hw->block_count);
+      log_info ("read image block %u/%u",
+                s->hw->block_count, s->hw->block_total + 1);
 
-      channel_recv (s->hw->channel, s->raw.buf + index * s->raw.ctx.pixels_per_line,
-                    buf_len, &status);
+      err = buf[--buf_len]; /* drop error byte */
+      log_info ("image block error byte: %x", err);
 
-      if (SANE_STATUS_GOOD != status)
-      {
-	*length = 0;
-	scan_finish (s);
-	return status;
-      }
+      if ((FSG_FATAL_ERROR | FSG_NOT_READY) & err)
+        {
+          info->ext_status = true;
+          return SANE_STATUS_IO_ERROR;
+        }
+      else if (FSG_CANCEL_REQUEST & err)
+        {
+          info->cancel = true;
+          cancel = true;
+        }
+      else if (FSG_PAGE_END & err)
+        {
+          if (FSI_CAP_PED & s->hw->fsi_cap_2)
+            {
+              log_info ("paper end flag raised");
+            }
+          else
+            {
+              err_minor ("invalid paper end flag raised");
+            }
+        }
+      else if (0 != err)
+        {
+          log_info ("unknown error flag(s) raised");
+          info->ext_status = true;
+          return SANE_STATUS_IO_ERROR;
+        }
+    }
+  else
+    {
+      info->last = (STATUS_AREA_END & s->hw->status);
+    }
 
-      /* send the ACK signal to the scanner in order to make
-       * it ready for the next image info block.
-       */
+  if (info->last
+      && ENABLE_TIMING && TIME_PASS_MAX > time_pass_count)
+    {
+      time_stamp (time_pass[time_pass_count], stop);
+      ++time_pass_count;
+    }
+
+  if (!info->last)
+  {
+    info->finish = false;
+
+    if (cancel)
+    {
+      channel_send (s->hw->channel, S_CAN, 1, &status);
+      if (SANE_STATUS_GOOD != status) return status;
+
+      status = expect_ack (s->hw);
+      if (SANE_STATUS_GOOD != status) return status;
+
+      info->finish = true;
+      return SANE_STATUS_CANCELLED;
+    }
+    else
+    {
       channel_send (s->hw->channel, S_ACK, 1, &status);
+      if (SANE_STATUS_GOOD != status) return status;
+    }
+  }
 
-      /* ... and request the next image info block
-       */
-      if (SANE_STATUS_GOOD != (status = read_image_info_block (s->hw)))
-      {
-	*length = 0;
-	scan_finish (s);
-	return status;
-      }
+  info->len = buf_len;
+  return SANE_STATUS_GOOD;
+}
 
-      buf_len = s->hw->image_block_size;
+static void *
+prefetch_loop (void *arg)
+{
+  struct prefetch *pf = (struct prefetch *) arg;
+  int i = 0;
 
-      switch (GET_COLOR (s->hw->status))
-      {
-      case 1:
-	index = 1;
-	break;
-      case 2:
-	index = 0;
-	break;
-      case 3:
-	index = 2;
-	break;
-      }
+  for (;;)
+    {
+      SANE_Status status;
+      block_info info;
+      bool cancel;
 
-      channel_recv (s->hw->channel, s->raw.buf + index * s->raw.ctx.pixels_per_line,
-                    buf_len, &status);
+      pthread_mutex_lock (&pf->lock);
+      while (pf->full[i])
+        pthread_cond_wait (&pf->cond, &pf->lock);
+      cancel = pf->cancel;
+      pthread_mutex_unlock (&pf->lock);
 
-      if (SANE_STATUS_GOOD != status)
-      {
-	*length = 0;
-	scan_finish (s);
-	return status;
-      }
+      status = recv_image_block (pf->s, pf->buf[i], cancel, &info);
 
-      channel_send (s->hw->channel, S_ACK, 1, &status);
+      pthread_mutex_lock (&pf->lock);
+      pf->status[i] = status;
+      pf->info[i] = info;
+      pf->full[i] = true;
+      pthread_cond_broadcast (&pf->cond);
+      pthread_mutex_unlock (&pf->lock);
 
-      /* ... and the last image info block
-       */
-      if (SANE_STATUS_GOOD != (status = read_image_info_block (s->hw)))
-      {
-	*length = 0;
-	scan_finish (s);
-	return status;
-      }
+      if (SANE_STATUS_GOOD != status || info.last)
+        break;
+      i ^= 1;
+    }
+  return NULL;
+}
 
-      buf_len = s->hw->image_block_size;
+/*! Starts reading ahead, if possible.
+ *  Interpreter based devices are left alone as the interpreter also
+ *  gets to work on the image data while it is being post-processed.
+ *  Failure to start is not an error, blocks are simply read on demand
+ *  as before.
+ */
+static void
+prefetch_start (Epson_Scanner *s)
+{
+  struct prefetch *pf;
 
-      switch (GET_COLOR (s->hw->status))
-      {
-      case 1:
-	index = 1;
-	break;
-      case 2:
-	index = 0;
-	break;
-      case 3:
-	index = 2;
-	break;
-      }
+  if (s->prefetch || s->hw->channel->interpreter) return;
 
-      channel_recv (s->hw->channel, s->raw.buf + index * s->raw.ctx.pixels_per_line,
-                    buf_len, &status);
+  pf = t_calloc (1, struct prefetch);
+  if (!pf) return;
 
-      if (SANE_STATUS_GOOD != status)
-      {
-	*length = 0;
-	scan_finish (s);
-	return status;
-      }
+  pf->buf[0] = s->raw.buf;
+  pf->buf[1] = t_malloc (s->raw.cap, SANE_Byte);
+  pf->s      = s;
+  pf->cancel = s->raw.cancel_requested;
+  pf->held   = -1;
+
+  if (!pf->buf[1])
+    {
+      delete (pf);
+      return;
     }
-    else
+
+  pthread_mutex_init (&pf->lock, NULL);
+  pthread_cond_init (&pf->cond, NULL);
+
+  if (0 != pthread_create (&pf->thread, NULL, prefetch_loop, pf))
     {
-      /* Read image data in block mode */
+      err_minor ("%s", strerror (errno));
+      pthread_cond_destroy (&pf->cond);
+      pthread_mutex_destroy (&pf->lock);
+      delete (pf->buf[1]);
+      delete (pf);
+      return;
+    }
+  s->prefetch = pf;
+}
 
-      /* do we have to reorder the image data ? */
-      if (GET_COLOR (s->hw->status) == 0x01)
-      {
-	reorder = SANE_TRUE;
-      }
+/*! Stops reading ahead and releases the buffer not in use.
+ *  This waits for the reader thread.  If it has not finished yet, it
+ *  is told to cancel the scan at the next block boundary.
+ */
+static void
+prefetch_stop (Epson_Scanner *s)
+{
+  struct prefetch *pf = s->prefetch;
+  int held;
+
+  if (!pf) return;
+
+  pthread_mutex_lock (&pf->lock);
+  pf->cancel = true;
+  pf->full[0] = pf->full[1] = false;
+  pthread_cond_broadcast (&pf->cond);
+  pthread_mutex_unlock (&pf->lock);
+
+  pthread_join (pf->thread, NULL);
+  pthread_cond_destroy (&pf->cond);
+  pthread_mutex_destroy (&pf->lock);
+
+  held = (0 > pf->held ? 0 : pf->held);
+  s->raw.buf = pf->buf[held];
+  delete (pf->buf[held ^ 1]);
+  delete (pf);
+  s->prefetch = NULL;
+}
 
-      channel_recv_all_retry (s->hw->channel, s->raw.buf, buf_len,
-                              MAX_READ_ATTEMPTS, &status);
+/*! Gets the next image data block into \c s->raw.buf.
+ *  The block that was there before is returned to the reader thread
+ *  so it can be refilled.
+ */
+static SANE_Status
+next_image_block (Epson_Scanner *s, block_info *info)
+{
+  struct prefetch *pf;
+  SANE_Status status;
+  int i;
 
-      if (SANE_STATUS_GOOD != status)
-      {
-	*length = 0;
-	scan_finish (s);
-	return status;
-      }
+  prefetch_start (s);
+  if (!(pf = s->prefetch))
+    return recv_image_block (s, s->raw.buf, s->raw.cancel_requested, info);
+
+  pthread_mutex_lock (&pf->lock);
+  pf->cancel = s->raw.cancel_requested;
+  if (0 <= pf->held)
+    {
+      pf->full[pf->held] = false;
+      pthread_cond_broadcast (&pf->cond);
     }
+  i = pf->next;
+  while (!pf->full[i])
+    pthread_cond_wait (&pf->cond, &pf->lock);
+  status = pf->status[i];
+  *info = pf->info[i];
+  pf->held = i;
+  pf->next = i ^ 1;
+  pthread_mutex_unlock (&pf->lock);
 
-    if (s->hw->using_fs)
-      {
-        u_char err = 0;
+  s->raw.buf = pf->buf[i];
+
+  if (SANE_STATUS_GOOD != status || info->last)
+    prefetch_stop (s);
+
+  return status;
+}
 
-        if (s->hw->block_count >= s->hw->block_total)
-          s->raw.all_data_fetched = true;
-        ++(s->hw->block_count);
-        log_info ("read image block %u/%u",
-                  s->hw->block_count, s->hw->block_total + 1);
+static bool
+applies_color_profile (const Epson_Scanner *s)
+{
+  return ((SANE_CAP_EMULATED & s->opt[OPT_CCT_1].cap)
+          && s->hw->color_user_defined[s->val[OPT_COLOR_CORRECTION].w]
+          && SANE_FRAME_RGB == s->raw.ctx.format);
+}
 
-        err = s->raw.buf[--buf_len]; /* drop error byte */
-        log_info ("image block error byte: %x", err);
+/* WARNING: The SANE specification normally uses zero to indicate
+ * minimum intensity.  However, SANE_FRAME_GRAY images with a bit
+ * depth of one use zero to indicate *maximum* intensity.
+ * The device always uses zero for minimum intensity, irrespective
+ * of the color mode and bit depth.
+ */
+static bool
+flips_bits (const Epson_Scanner *s)
+{
+  if (1 == s->raw.ctx.depth && SANE_FRAME_GRAY == s->raw.ctx.format)
+    return !s->invert_image;
 
-        if ((FSG_FATAL_ERROR | FSG_NOT_READY) & err)
-          {
-	    *length = 0;
-	    scan_finish (s);
-	    return check_ext_status (s->hw);
-          }
-        else if (FSG_CANCEL_REQUEST & err)
-          {
-            s->raw.cancel_requested = true;
-          }
-        else if (FSG_PAGE_END & err)
-          {
-            if (FSI_CAP_PED & s->hw->fsi_cap_2)
-              {
-                log_info ("paper end flag raised");
-              }
-            else
-              {
-                err_minor ("invalid paper end flag raised");
-              }
-          }
-        else if (0 != err)
-          {
-            log_info ("unknown error flag(s) raised");
-            *length = 0;
-            scan_finish (s);
-            return check_ext_status (s->hw);
-          }
-      }
-    else
-      {
-        s->raw.all_data_fetched = (STATUS_AREA_END & s->hw->status);
-      }
+  return s->invert_image;
+}
 
-    if (s->raw.all_data_fetched
-        && ENABLE_TIMING && TIME_PASS_MAX > time_pass_count)
-      {
-        time_stamp (time_pass[time_pass_count], stop);
-        ++time_pass_count;
-      }
+/*! Sets up the image processing for a scan.
+ *  When the steps can be fused, fetch_image_data() makes a single
+ *  pass over each tile of image data instead of one per step.
+ */
+static void
+compile_pipeline (Epson_Scanner *s)
+{
+  dip_compile_pipeline (s->dip, &s->pipeline, &s->raw.ctx,
+                        (applies_color_profile (s) ? s->cct : NULL),
+                        s->lut, flips_bits (s),
+                        NULL != s->hw->channel->interpreter);
+}
 
-    if (!s->raw.all_data_fetched)
+/*! Processes the image data in \c s->raw a tile at a time.
+ *  Each tile is small enough to stay in cache while the interpreter
+ *  has a go at it in between the \c pre and \c post kernels.
+ */
+static void
+run_pipeline (Epson_Scanner *s, bool reorder)
+{
+  const pipeline *pl = &s->pipeline;
+  channel *ch = s->hw->channel;
+  SANE_Byte *p = s->raw.ptr;
+
+  while (p < s->raw.end)
     {
-      if (s->raw.cancel_requested)
-      {
-	channel_send (s->hw->channel, S_CAN, 1, &status);
-	if (SANE_STATUS_GOOD != status) return status;
+      SANE_Byte *e = p + pl->tile;
+
+      if (e > s->raw.end) e = s->raw.end;
 
-	status = expect_ack (s->hw);
-	if (SANE_STATUS_GOOD != status) return status;
+      if (pl->pre[reorder])
+        pl->pre[reorder] (p, e, pl);
+      if (ch->interpreter)
+        ch->interpreter->ftor0 (ch, &s->raw.ctx, p, e);
+      if (pl->post)
+        pl->post (p, e, pl);
 
-	*length = 0;
+      p = e;
+    }
+}
 
-	scan_finish (s);
+SANE_Status
+fetch_image_data (Epson_Scanner *s, SANE_Byte * data, SANE_Int max_length,
+             SANE_Int * length)
+{
+  SANE_Status status;
+  SANE_Bool reorder = SANE_FALSE;
+  SANE_Bool needStrangeReorder = SANE_FALSE;
 
-	return SANE_STATUS_CANCELLED;
-      }
-      else
-      {
-	channel_send (s->hw->channel, S_ACK, 1, &status);
-	if (SANE_STATUS_GOOD != status) return status;
-      }
+  log_call ();
+
+  if (s->raw.transfer_stopped && s->raw.cancel_requested)
+    return SANE_STATUS_CANCELLED;
+
+START_READ:
+  if (s->raw.ptr == s->raw.end)
+  {
+    block_info info;
+
+    if (s->raw.all_data_fetched)
+    {
+      *length = 0;
+      return SANE_STATUS_EOF;
+    }
+
+    status = next_image_block (s, &info);
+    if (info.cancel)
+      s->raw.cancel_requested = true;
+
+    if (SANE_STATUS_GOOD != status)
+    {
+      *length = 0;
+      if (info.finish)
+        scan_finish (s);
+      if (info.ext_status)
+        return check_ext_status (s->hw);
+      return status;
     }
+    s->raw.all_data_fetched = info.last;
 
-    s->raw.end = s->raw.buf + buf_len;
+    /* do we have to reorder the image data ? */
+    if (s->hw->block_mode || SANE_FRAME_RGB != s->raw.ctx.format)
+      reorder = (GET_COLOR (info.status) == 0x01);
+
+    s->raw.end = s->raw.buf + info.len;
     s->raw.ptr = s->raw.buf;
 
     /* if we have to re-order the color components (GRB->RGB) we
@@ -5638,10 +5882,14 @@ START_READ:
     if (s->raw.ctx.format != SANE_FRAME_RGB)
       reorder = SANE_FALSE;	/* don't reorder for BW or gray */
 
-    if (reorder)
+    /* The fused pipeline reorders along with everything else, unless
+     * color shuffling needs to see reordered data first.
+     */
+    if (reorder && (!s->pipeline.fused || s->hw->color_shuffle))
     {
       s->raw.ptr = s->raw.buf;
       dip_change_GRB_to_RGB (s->dip, &s->raw);
+      reorder = SANE_FALSE;
     }
 
     /* Do the color_shuffle if everything else is correct - at this
@@ -5667,41 +5915,34 @@ START_READ:
       s->raw.ptr = s->raw.buf;
     }
 
-    if ((SANE_CAP_EMULATED & s->opt[OPT_CCT_1].cap)
-        && s->hw->color_user_defined[s->val[OPT_COLOR_CORRECTION].w]
-        && SANE_FRAME_RGB == s->raw.ctx.format)
+    if (s->pipeline.fused)
     {
-      dip_apply_color_profile (s->dip, &s->raw, s->cct);
+      run_pipeline (s, reorder);
     }
-
-    if (s->hw->channel->interpreter)
+    else
     {
-      s->hw->channel->interpreter->ftor0 (s->hw->channel,
-                                         &s->raw.ctx,
-                                          s->raw.ptr, s->raw.end);
-    }
-
-    if (s->lut)
+      if (applies_color_profile (s))
       {
-        dip_apply_LUT (s->dip, &s->raw, s->lut);
+        dip_apply_color_profile (s->dip, &s->raw, s->cct);
       }
 
-    /* WARNING: The SANE specification normally uses zero to indicate
-     * minimum intensity.  However, SANE_FRAME_GRAY images with a bit
-     * depth of one use zero to indicate *maximum* intensity.
-     * The device always uses zero for minimum intensity, irrespective
-     * of the color mode and bit depth.
-     */
-    if (1 == s->raw.ctx.depth && SANE_FRAME_GRAY == s->raw.ctx.format)
+      if (s->hw->channel->interpreter)
       {
-        if (!s->invert_image)
-          dip_flip_bits (s->dip, &s->raw);
+        s->hw->channel->interpreter->ftor0 (s->hw->channel,
+                                            &s->raw.ctx,
+                                            s->raw.ptr, s->raw.end);
       }
-    else
-      {
-        if (s->invert_image)
+
+      if (s->lut)
+        {
+          dip_apply_LUT (s->dip, &s->raw, s->lut);
+        }
+
+      if (flips_bits (s))
+        {
           dip_flip_bits (s->dip, &s->raw);
-      }
+        }
+    }
   }
 
   /* copy the image data to the data memory area
@@ -5765,6 +6006,187 @@ START_READ:
 }
 
 
+/*! Fills \a data with exactly \a size bytes of image data.
+ */
+static SANE_Status
+fetch_lines (Epson_Scanner *s, SANE_Byte *data, size_t size)
+{
+  SANE_Status status = SANE_STATUS_GOOD;
+
+  while (0 < size && SANE_STATUS_GOOD == status)
+    {
+      SANE_Int max = (size < INT_MAX ? size : INT_MAX);
+      SANE_Int len = 0;
+
+      status = fetch_image_data (s, data, max, &len);
+      data += len;
+      size -= len;
+    }
+
+  if (SANE_STATUS_EOF == status && 0 < size)
+    status = SANE_STATUS_IO_ERROR;
+
+  return status;
+}
+
+/*! Reads the leading band of the image and estimates its skew.
+ *  From here on the frontend gets its image data a deskewed line at
+ *  a time from fetch_deskewed_data(), without having to wait for the
+ *  whole image to be scanned first.
+ */
+static SANE_Status
+start_deskew (Epson_Scanner *s)
+{
+  SANE_Status status;
+  SANE_Byte *band;
+  size_t size;
+
+  log_info ("deskewing image data as it comes in");
+
+  s->deskew = deskew_create (&s->raw.ctx, s->val[OPT_Y_RESOLUTION].w);
+  if (!s->deskew)
+    return SANE_STATUS_NO_MEM;
+
+  if (resize_warranted (s->raw.ctx.bytes_per_line, s->img.cap))
+    {
+      dip_free (s->dip, s->img.buf);
+      s->img.buf = NULL;
+      s->img.cap = 0;
+
+      if (!(s->img.buf = t_malloc (s->raw.ctx.bytes_per_line, SANE_Byte)))
+        return SANE_STATUS_NO_MEM;
+
+      s->img.cap = s->raw.ctx.bytes_per_line;
+    }
+  s->img.ptr = s->img.end = s->img.buf;
+
+  band = deskew_band (s->deskew, &size);
+  status = fetch_lines (s, band, size);
+  if (SANE_STATUS_GOOD != status)
+    return status;
+
+  status = deskew_estimate (s->deskew, s->val[OPT_X_RESOLUTION].w,
+                            s->val[OPT_Y_RESOLUTION].w);
+  if (SANE_STATUS_GOOD != status)
+    return status;
+
+  memcpy (&s->img.ctx, &s->raw.ctx, sizeof (s->raw.ctx));
+  s->img.transfer_started = true;
+  s->src = &s->img;
+
+  return SANE_STATUS_GOOD;
+}
+
+/*! Provides the frontend with deskewed image data.
+ *  Lines are made one at a time in \c s->img as soon as the device
+ *  has sent enough lines to do so.
+ */
+SANE_Status
+fetch_deskewed_data (Epson_Scanner *s, SANE_Byte *data, SANE_Int max_length,
+                     SANE_Int *length)
+{
+  SANE_Status status = SANE_STATUS_GOOD;
+  deskew *d = s->deskew;
+  SANE_Int len;
+
+  require (d && s->src == &s->img);
+
+  if (s->img.cancel_requested)
+    {
+      s->img.transfer_stopped = true;
+      return SANE_STATUS_CANCELLED;
+    }
+
+  if (s->img.ptr == s->img.end)
+    {
+      if (deskew_done (d))
+        {
+          SANE_Byte dumpster[1024];
+
+          /* let the device finish the scan */
+          while (SANE_STATUS_GOOD == status && !s->raw.transfer_stopped)
+            status = fetch_image_data (s, dumpster, num_of (dumpster),
+                                       &len);
+
+          s->img.all_data_fetched = true;
+          return (SANE_STATUS_GOOD == status || SANE_STATUS_EOF == status
+                  ? SANE_STATUS_EOF
+                  : status);
+        }
+
+      while (deskew_needs_input (d) && SANE_STATUS_GOOD == status)
+        status = fetch_lines (s, deskew_input (d), d->ctx.bytes_per_line);
+      if (SANE_STATUS_GOOD != status)
+        return status;
+
+      deskew_output (d, s->img.buf);
+      s->img.ptr = s->img.buf;
+      s->img.end = s->img.buf + d->ctx.bytes_per_line;
+    }
+
+  if (!data || 0 >= max_length)
+    return SANE_STATUS_NO_MEM;
+
+  len = s->img.end - s->img.ptr;
+  if (len > max_length) len = max_length;
+  memcpy (data, s->img.ptr, len);
+  s->img.ptr += len;
+  if (length) *length = len;
+
+  return SANE_STATUS_GOOD;
+}
+
+
+/*! Merges three lines of RGB data into \a out.
+    The first byte of each pixel is taken from \a a, the second from
+    \a b and the third from \a c.  Pixel boundaries line up with the
+    vector lanes every 48 bytes so the SSE2 path works on three
+    vectors at a time, picking bytes with a repeating set of masks.
+ */
+static void
+merge_lines (SANE_Byte *out, const SANE_Byte *a, const SANE_Byte *b,
+             const SANE_Byte *c, size_t size)
+{
+  size_t i = 0;
+
+#ifdef __SSE2__
+  SANE_Byte pick[3][48];
+  size_t k;
+
+  for (k = 0; k < 48; ++k)
+  {
+    pick[0][k] = (0 == k % 3 ? 0xff : 0x00);
+    pick[1][k] = (1 == k % 3 ? 0xff : 0x00);
+    pick[2][k] = (2 == k % 3 ? 0xff : 0x00);
+  }
+
+  for (; i + 48 <= size; i += 48)
+  {
+    for (k = 0; k < 48; k += 16)
+    {
+      __m128i va = _mm_loadu_si128 ((const __m128i *) (a + i + k));
+      __m128i vb = _mm_loadu_si128 ((const __m128i *) (b + i + k));
+      __m128i vc = _mm_loadu_si128 ((const __m128i *) (c + i + k));
+      __m128i ma = _mm_loadu_si128 ((const __m128i *) (pick[0] + k));
+      __m128i mb = _mm_loadu_si128 ((const __m128i *) (pick[1] + k));
+      __m128i mc = _mm_loadu_si128 ((const __m128i *) (pick[2] + k));
+
+      _mm_storeu_si128 ((__m128i *) (out + i + k),
+                        _mm_or_si128 (_mm_and_si128 (ma, va),
+                                      _mm_or_si128 (_mm_and_si128 (mb, vb),
+                                                    _mm_and_si128 (mc, vc))));
+    }
+  }
+#endif
+
+  for (; i + 3 <= size; i += 3)
+  {
+    out[i    ] = a[i    ];
+    out[i + 1] = b[i + 1];
+    out[i + 2] = c[i + 2];
+  }
+}
+
 /*! Puts raw scan data into the correct scan line.
 
     When scanning with a non-zero line distance, the RGB data is \e
@@ -5775,6 +6197,12 @@ START_READ:
     This function reorganises raw scan data so that the RGB channels
     are no longer separated and all data is on the same scan line.
 
+    Raw lines are kept in a ring of 2 * line_distance + 1 lines.  Once
+    raw line \c n is in, output line \c n - line_distance has all its
+    channels and is merged straight into the raw buffer, behind the
+    raw data still to be processed.  The first and last line_distance
+    output lines lack a channel and are dropped.
+
     \note
     It seems that the Perfection 610 and 640U both report a maximum
     scan area with the two line distances included (based on 11.7"
@@ -5791,123 +6219,50 @@ color_shuffle (Epson_Scanner *s, int *new_length)
 
   if (s->hw->color_shuffle == SANE_TRUE)
   {
+    size_t bpl   = s->raw.ctx.bytes_per_line;
+    int distance = s->line_distance;
+    int ring     = 2 * distance + 1;
     SANE_Byte *data_ptr;	/* ptr to data to process */
     SANE_Byte *data_end;	/* ptr to end of processed data */
     SANE_Byte *out_data_ptr;	/* ptr to memory when writing data */
-    int i;			/* loop counter */
-
-    log_call ();
-
-    /* Initialize the variables we are going to use for the 
-     * copying of the data. data_ptr is the pointer to
-     * the currently worked on scan line. data_end is the
-     * end of the data area as calculated from adding *length 
-     * to the start of data.
-     * out_data_ptr is used when writing out the processed data
-     * and always points to the beginning of the next line to
-     * write.
-     */
 
     data_ptr = out_data_ptr = buf;
     data_end = data_ptr + length;
 
-    /* The image data is in *raw.buf, we know that the buffer contains
-     * s->raw.end - s->raw.buf ( = length) bytes of data. The width of
-     * one line is in s->raw.ctx.bytes_per_line
-     */
-
     /* The buffer area is supposed to have a number of full scan
      * lines, let's test if this is the case. 
      */
 
-    if (length % s->raw.ctx.bytes_per_line != 0)
+    if (length % bpl != 0)
     {
-      err_major ("ERROR in size of buffer: %d / %d",
-                 length, s->raw.ctx.bytes_per_line);
+      err_major ("ERROR in size of buffer: %d / %zd", length, bpl);
       return SANE_STATUS_INVAL;
     }
 
     while (data_ptr < data_end)
     {
-      SANE_Byte *source_ptr, *dest_ptr;
-      int loop;
-
-      /* copy the green information into the current line */
+      int n = s->color_shuffle_line;  /* raw line number */
+      int line = n - distance;        /* output line completed */
 
-      source_ptr = data_ptr + 1;
-      dest_ptr = s->line_buffer[s->color_shuffle_line] + 1;
+      memcpy (s->line_buffer + (n % ring) * bpl, data_ptr, bpl);
 
-      for (i = 0; i < s->raw.ctx.bytes_per_line / 3; i++)
+      if (line >= distance && line < s->raw.ctx.lines + distance)
       {
-	*dest_ptr = *source_ptr;
-	dest_ptr += 3;
-	source_ptr += 3;
+        merge_lines (out_data_ptr,
+                     s->line_buffer + ((line - distance) % ring) * bpl,
+                     s->line_buffer + ( line             % ring) * bpl,
+                     s->line_buffer + ( n                % ring) * bpl,
+                     bpl);
+        out_data_ptr += bpl;
       }
 
-      /* copy the red information n lines back */
-
-      if (s->color_shuffle_line >= s->line_distance)
-      {
-	source_ptr = data_ptr + 2;
-	dest_ptr =
-	  s->line_buffer[s->color_shuffle_line - s->line_distance] + 2;
-
-	for (loop = 0; loop < s->raw.ctx.bytes_per_line / 3; loop++)
-	{
-	  *dest_ptr = *source_ptr;
-	  dest_ptr += 3;
-	  source_ptr += 3;
-	}
-      }
-
-      /* copy the blue information n lines forward */
-
-      source_ptr = data_ptr;
-      dest_ptr = s->line_buffer[s->color_shuffle_line + s->line_distance];
-
-      for (loop = 0; loop < s->raw.ctx.bytes_per_line / 3; loop++)
-      {
-	*dest_ptr = *source_ptr;
-	dest_ptr += 3;
-	source_ptr += 3;
-      }
-
-      data_ptr   += s->raw.ctx.bytes_per_line;
-      s->raw.ptr += s->raw.ctx.bytes_per_line;
-
-      if (s->color_shuffle_line == s->line_distance)
-      {
-        /* We just finished shuffling the line in line_buffer[0] -
-	 * write the RGB image data in it to the output buffer and
-	 * cyclically shift the line_buffers up by one.
-	 */
-
-        SANE_Byte *first;
-
-	if ((s->current_output_line >= s->line_distance) &&
-	    (s->current_output_line < s->raw.ctx.lines + s->line_distance))
-	{
-	  memcpy (out_data_ptr, s->line_buffer[0], s->raw.ctx.bytes_per_line);
-	  out_data_ptr += s->raw.ctx.bytes_per_line;
-	}
-
-	s->current_output_line++;
-
-        first = s->line_buffer[0];
-        for (i = 0; i < 2 * s->line_distance; ++i)
-        {
-          s->line_buffer[i] = s->line_buffer[i + 1];
-        }
-        s->line_buffer[2 * s->line_distance] = first;
-      }
-      else
-      {
-	s->color_shuffle_line++;	/* increase the buffer number */
-      }
+      data_ptr   += bpl;
+      s->raw.ptr += bpl;
+      s->color_shuffle_line++;
     }
 
     /* At this time we've used up all the new data from the scanner,
-     * some of it is still in the line_buffers, but we are ready to
+     * some of it is still in the line_buffer, but we are ready to
      * return some of it to the front end software. To do so we have
      * to adjust the size of the data area and the *new_length
      * variable.
@@ -6077,7 +6432,7 @@ sane_cancel (SANE_Handle handle)
     SANE_Byte dumpster[1024];
     int len;
 
-    if (s->src == &s->raw)
+    if (s->src == &s->raw || s->deskew)
     {
       s->raw.cancel_requested = true;
       do
@@ -6118,8 +6473,10 @@ sane_cancel (SANE_Handle handle)
     }
 
   /* release resource hogs between scan sequences */
-  delete (s->img.buf);
+  dip_free (s->dip, s->img.buf);
+  s->img.buf = NULL;
   s->img.cap = 0;
+  s->deskew = deskew_destroy (s->deskew);
 }
 
 /* Request the push button status returns SANE_TRUE if the button was
@@ -66,6 +66,7 @@
 #endif
 
 #include "device.h"
+#include "matrix.h"
 
 typedef struct
 {
@@ -74,6 +75,27 @@ typedef struct
 
 } LUT;
 
+/*! Image processing steps for a scan, done in one go per tile.
+ *  Set up by dip_compile_pipeline() when a scan starts.  The kernels
+ *  work on whole lines of image data, \a tile bytes at a time.
+ */
+typedef struct pipeline pipeline;
+
+typedef void (*pipeline_kernel) (SANE_Byte *p, SANE_Byte *e,
+                                 const pipeline *pl);
+
+struct pipeline
+{
+  bool fused;                   /*!< whether to use the kernels at all */
+
+  pipeline_kernel pre[2];       /*!< indexed by whether to reorder GRB */
+  pipeline_kernel post;         /*!< steps after the interpreter's */
+  size_t tile;
+
+  const SANE_Byte *lut;
+  matrix           profile[2];  /*!< indexed like \c pre */
+};
+
 
 /* convenience union to access option values given to the backend
  */
@@ -136,8 +158,6 @@ Option_Value;
 #define SANE_EPSON_CLEAN_TITLE SANE_I18N("Clean")
 #define SANE_EPSON_CLEAN_DESC SANE_I18N("Cleans the scanners reading section.")
 
-#define LINES_SHUFFLE_MAX	(17)	/* 2 x 8 lines plus 1 */
-
 #define SANE_EPSON_MAX_RETRIES	(120)	/* how often do we retry during warmup ? */
 
 #define MAX_READ_ATTEMPTS       10      /* maximum number of attempts at
@@ -255,18 +275,20 @@ struct Epson_Scanner
   buffer *src;                  /*!< buffer to provide data to frontend */
   buffer  raw;                  /*!< device image data blocks */
   buffer  img;                  /*!< complete in-memory image */
+  struct prefetch *prefetch;    /*!< read-ahead of raw image data */
+  struct deskew   *deskew;      /*!< deskewing of streamed image data */
 
-  SANE_Byte *line_buffer[LINES_SHUFFLE_MAX];
+  SANE_Byte *line_buffer;	/* ring of 2 * line_distance + 1 lines */
   size_t     cap_line_buffer;
 
-  SANE_Int color_shuffle_line;	/* current line number for color shuffling */
+  SANE_Int color_shuffle_line;	/* raw lines color shuffled so far */
   SANE_Int line_distance;	/* current line distance */
-  SANE_Int current_output_line;	/* line counter when color shuffling */
 
   SANE_Bool invert_image;
   SANE_Word gamma_table[3][256];
   double    cct[9];
   LUT      *lut;
+  pipeline  pipeline;
   double    brightness;
   double    contrast;
 
@@ -280,6 +302,13 @@ struct Epson_Scanner
    *  This corresponds to the \c ESC_d parameter.
    */
   unsigned int line_count;
+
+  /*! Transfer size tuning state for the current scan.
+   *  The index of the block size candidate in use, -1 when not
+   *  tuning, and the number of image blocks read so far.
+   */
+  int tune_index;
+  unsigned int tune_blocks;
 };
 
 typedef struct Epson_Scanner Epson_Scanner;
@@ -287,5 +316,7 @@ typedef struct Epson_Scanner Epson_Scanner;
 SANE_Status estimate_parameters (Epson_Scanner *, SANE_Parameters *);
 SANE_Status fetch_image_data (Epson_Scanner *, SANE_Byte *, SANE_Int,
                               SANE_Int *);
+SANE_Status fetch_deskewed_data (Epson_Scanner *, SANE_Byte *, SANE_Int,
+                                 SANE_Int *);
 
 #endif /* not epkowa_h */
@@ -28,9 +28,26 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 #include "defines.h"
 #include "message.h"
 
+/*! Image data is passed to child processes in anonymous shared memory
+ *  when the system supports it.  Other systems only use TCP.
+ */
+#ifdef SYS_memfd_create
+#define IPC_USE_SHM 1
+#include <sys/mman.h>
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#else
+#define IPC_USE_SHM 0
+#endif
+
 
 /*! Attempts to read all the data up to \a size bytes.
  *  MERR is returned if an error, such as a timeout, occurs.
@@ -97,6 +114,49 @@ send_all (int fd, const void *buf, size_t size)
   return n;
 }
 
+/*! Passes the file descriptor \a fd along with a single byte.
+ *  MERR is returned if an error occurs.  Otherwise, returns one.
+ */
+static ssize_t
+send_fd (int sock, int fd)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  char byte = 0;
+  ssize_t n;
+
+  memset (&msg, 0, sizeof (msg));
+  memset (&control, 0, sizeof (control));
+
+  iov.iov_base = &byte;
+  iov.iov_len  = sizeof (byte);
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &fd, sizeof (int));
+
+  errno = 0;
+  n = sendmsg (sock, &msg, 0);
+  if (1 != n)
+    {
+      err_major ("sendmsg failed: %s", strerror (errno));
+      return MERR;
+    }
+  return n;
+}
+
 /*! MERR is returned if an error, such as a timeout, occurs.
  *  MERR is also returned if writing the ipc header failed.
  *  Otherwise, the number of bytes of the payload that were successfully
@@ -199,6 +259,7 @@ ipc_fork (process *child)
   SANE_Status s = SANE_STATUS_GOOD;
 
   int pipe_fd[2];
+  int shm_fd[2] = { -1, -1 };
 
   require (child);
 
@@ -208,12 +269,27 @@ ipc_fork (process *child)
       return SANE_STATUS_ACCESS_DENIED;
     }
 
+  if (IPC_USE_SHM
+      && 0 != socketpair (AF_UNIX, SOCK_STREAM, 0, shm_fd))
+    {
+      err_minor ("socketpair: %s", strerror (errno));
+      shm_fd[0] = shm_fd[1] = -1;
+    }
+
   child->pid = fork ();
   if (0 == child->pid)
     {
       /*  replace child process with a plugin program
        */
       close (pipe_fd[0]);           /* unused read end */
+      if (0 <= shm_fd[1])
+        {
+          char fd[16];
+
+          close (shm_fd[0]);
+          sprintf (fd, "%d", shm_fd[1]);
+          setenv (IPC_SHM_FD_ENV, fd, 1);
+        }
       if (0 <= dup2 (pipe_fd[1], STDOUT_FILENO))
         {
           log_info ("%s[%d]: starting", child->name, getpid ());
@@ -280,9 +356,57 @@ ipc_fork (process *child)
   if (0 > child->port)
     s = SANE_STATUS_CANCELLED;
 
+  /*  A child that takes shared memory has said so before it printed
+      its port, so there is no need to wait for it here.
+   */
+  if (0 <= shm_fd[1])
+    close (shm_fd[1]);
+  if (0 <= shm_fd[0])
+    {
+      char hello = 0;
+
+      if (SANE_STATUS_GOOD == s
+          && 1 == recv (shm_fd[0], &hello, 1, MSG_DONTWAIT)
+          && IPC_SHM_HELLO == hello)
+        {
+          log_info ("%s[%d]: takes shared memory", child->name, child->pid);
+          child->shm_socket = shm_fd[0];
+        }
+      else
+        {
+          close (shm_fd[0]);
+        }
+    }
+
   return s;
 }
 
+/*! \brief  Keeps a hung up child from blocking us forever
+ */
+static
+void
+set_timeouts (int socket)
+{
+  struct timeval t;
+  int rv;
+
+  t.tv_sec = 30;
+  t.tv_usec = 0;
+  errno = 0;
+  rv = setsockopt (socket, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof (t));
+  if (0 > rv)
+    {
+      err_minor ("socket option: %s", strerror (errno));
+    }
+
+  errno = 0;
+  rv = setsockopt (socket, SOL_SOCKET, SO_SNDTIMEO, &t, sizeof (t));
+  if (0 > rv)
+    {
+      err_minor ("socket option: %s", strerror (errno));
+    }
+}
+
 /*! \brief  Requests a connection to a \a child
  */
 static
@@ -290,8 +414,6 @@ SANE_Status
 ipc_connect (process *child)
 {
   struct sockaddr_in addr;
-  struct timeval t;
-  int rv;
 
   require (child);
 
@@ -305,21 +427,9 @@ ipc_connect (process *child)
       return SANE_STATUS_IO_ERROR;
     }
 
-  t.tv_sec = 30;
-  t.tv_usec = 0;
-  errno = 0;
-  rv = setsockopt (child->socket, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof (t));
-  if (0 > rv)
-    {
-      err_minor ("socket option: %s", strerror (errno));
-    }
-
-  errno = 0;
-  rv = setsockopt (child->socket, SOL_SOCKET, SO_SNDTIMEO, &t, sizeof (t));
-  if (0 > rv)
-    {
-      err_minor ("socket option: %s", strerror (errno));
-    }
+  set_timeouts (child->socket);
+  if (0 <= child->shm_socket)
+    set_timeouts (child->shm_socket);
 
   memset (&addr, 0, sizeof (addr));
   addr.sin_family      = AF_INET;
@@ -353,6 +463,8 @@ ipc_exec (const char *program, const char *pkglibdir, SANE_Status *status)
   child->pid    = -1;
   child->port   = -1;
   child->socket = -1;
+  child->shm_socket = -1;
+  child->segment = NULL;
   child->name   = NULL;
 
   if (!pkglibdir)
@@ -421,6 +533,71 @@ ipc_exec (const char *program, const char *pkglibdir, SANE_Status *status)
   return child;
 }
 
+/*! \brief  Anonymous shared memory holding image data
+ */
+typedef struct ipc_segment
+{
+  int    fd;
+  void  *map;
+  size_t size;
+  bool   busy;                  /* handed out by ipc_dip_alloc() */
+
+} segment;
+
+static
+bool
+segment_create (segment *seg, size_t size)
+{
+  seg->fd   = -1;
+  seg->map  = NULL;
+  seg->size = size;
+  seg->busy = false;
+
+#if IPC_USE_SHM
+  errno = 0;
+  seg->fd = syscall (SYS_memfd_create, "iscan-dip", MFD_CLOEXEC);
+  if (0 > seg->fd)
+    {
+      err_minor ("memfd_create: %s", strerror (errno));
+      return false;
+    }
+  if (0 != ftruncate (seg->fd, size))
+    {
+      err_minor ("ftruncate: %s", strerror (errno));
+      close (seg->fd);
+      seg->fd = -1;
+      return false;
+    }
+  seg->map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   seg->fd, 0);
+  if (MAP_FAILED == seg->map)
+    {
+      err_minor ("mmap: %s", strerror (errno));
+      seg->map = NULL;
+      close (seg->fd);
+      seg->fd = -1;
+      return false;
+    }
+  return true;
+#else
+  return false;
+#endif
+}
+
+static
+void
+segment_destroy (segment *seg)
+{
+#if IPC_USE_SHM
+  if (seg->map)
+    munmap (seg->map, seg->size);
+  if (0 <= seg->fd)
+    close (seg->fd);
+#endif
+  seg->map = NULL;
+  seg->fd  = -1;
+}
+
 process *
 ipc_kill (process *child)
 {
@@ -439,6 +616,18 @@ ipc_kill (process *child)
               err_minor ("%s", strerror (errno));
             }
         }
+      if (0 <= child->shm_socket)
+        {
+          if (0 != close (child->shm_socket))
+            {
+              err_minor ("%s", strerror (errno));
+            }
+        }
+      if (child->segment)
+        {
+          segment_destroy (child->segment);
+          delete (child->segment);
+        }
       if (1 < child->pid)
         {
           if (0 != kill (child->pid, SIGHUP))
@@ -472,6 +661,12 @@ ipc_kill (process *child)
   return child;
 }
 
+/*! The image goes to the child in shared memory if it takes that.
+ *  A buffer from ipc_dip_alloc() already lives there and is processed
+ *  in place, anything else is copied into a temporary segment first.
+ *  Otherwise, or if no memory segment can be had, it is sent over TCP
+ *  and a copy of the result is received back.
+ */
 void
 ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
               SANE_Parameters *ctx, void **buffer)
@@ -480,6 +675,8 @@ ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
   uint8_t  status = STATUS_NG;
   uint16_t id     = 0;
   ssize_t  n;
+  segment  tmp;
+  segment *seg = NULL;
 
   require (child);
   socket = child->socket;
@@ -487,6 +684,27 @@ ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
   require (TYPE_DIP_SKEW_FLAG == flag || TYPE_DIP_CROP_FLAG == flag);
   require (0 < socket && p && ctx && buffer && *buffer);
 
+  if (0 <= child->shm_socket)
+    {
+      size_t size = ctx->bytes_per_line * ctx->lines;
+
+      if (child->segment && child->segment->busy
+          && child->segment->map == *buffer
+          && size <= child->segment->size)
+        {
+          seg = child->segment;
+        }
+      else if (segment_create (&tmp, size))
+        {
+          seg = &tmp;
+          memcpy (seg->map, *buffer, seg->size);
+        }
+    }
+  if (seg)
+    {
+      socket = child->shm_socket;
+    }
+
   /* inter-process procedure call, status will be STATUS_NG in case
    * anything goes wrong during IPC call sequence
    */
@@ -510,8 +728,19 @@ ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
                   {
                     ssize_t size = ctx->bytes_per_line * ctx->lines;
 
-                    if (size != ipc_send (socket, id, flag | TYPE_DIP_DATA,
-                                          size, *buffer))
+                    if (seg)
+                      {
+                        if (sizeof (seg->size)
+                            != ipc_send (socket, id, flag | TYPE_DIP_SHM,
+                                         sizeof (seg->size), &seg->size)
+                            || 0 > send_fd (socket, seg->fd))
+                          {
+                            status = STATUS_NG;
+                          }
+                      }
+                    else if (size != ipc_send (socket, id,
+                                               flag | TYPE_DIP_DATA,
+                                               size, *buffer))
                       {
                         err_minor ("image truncated");
                         status = STATUS_NG;
@@ -526,6 +755,7 @@ ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
     {
       ipc_send (socket, id, flag | TYPE_DIP_DTOR, 0, NULL);
       ipc_recv (socket, &id, &status, NULL);
+      if (&tmp == seg) segment_destroy (&tmp);
       return;
     }
 
@@ -545,7 +775,21 @@ ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
         req = flag | TYPE_DIP_DATA;
         delete (buf);
 
-        if (size == ipc_recv (socket, &id, &req, &buf))
+        if (seg)
+          {
+            /* the result is never larger than what we started with */
+            if (0 <= size && (size_t) size <= seg->size)
+              {
+                memcpy (ctx, &par.parms, sizeof (*ctx));
+                if (seg->map != *buffer)
+                  memcpy (*buffer, seg->map, size);
+              }
+            else
+              {
+                err_minor ("image too large");
+              }
+          }
+        else if (size == ipc_recv (socket, &id, &req, &buf))
           {
             memcpy (ctx, &par.parms, sizeof (*ctx));
             delete (*buffer);
@@ -560,4 +804,49 @@ ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
   }
   ipc_send (socket, id, flag | TYPE_DIP_DTOR, 0, NULL);
   ipc_recv (socket, &id, &status, NULL);
+  if (&tmp == seg) segment_destroy (&tmp);
+}
+
+void *
+ipc_dip_alloc (process *child, size_t size)
+{
+  segment *seg;
+
+  if (!child || 0 > child->shm_socket)
+    return malloc (size);
+
+  if (!child->segment)
+    {
+      child->segment = t_malloc (1, segment);
+      if (!child->segment)
+        return malloc (size);
+      child->segment->fd  = -1;
+      child->segment->map = NULL;
+      child->segment->busy = false;
+    }
+  seg = child->segment;
+
+  if (seg->busy)
+    return malloc (size);
+
+  if (!seg->map || seg->size < size)
+    {
+      segment_destroy (seg);
+      if (!segment_create (seg, size))
+        return malloc (size);
+    }
+  seg->busy = true;
+
+  return seg->map;
+}
+
+void
+ipc_dip_free (process *child, void *ptr)
+{
+  if (child && child->segment && child->segment->map == ptr)
+    {
+      child->segment->busy = false;
+      return;
+    }
+  delete (ptr);
 }
@@ -47,6 +47,7 @@ enum {
   TYPE_DIP_DTOR = 0x02,
   TYPE_DIP_PARM = 0x03,
   TYPE_DIP_DATA = 0x04,
+  TYPE_DIP_SHM  = 0x05,
   TYPE_DIP_MASK = 0x0f,
   TYPE_DIP_FLAG = 0xf0,
 
@@ -55,6 +56,7 @@ enum {
   TYPE_DIP_SKEW_DTOR = TYPE_DIP_SKEW_FLAG | TYPE_DIP_DTOR,
   TYPE_DIP_SKEW_PARM = TYPE_DIP_SKEW_FLAG | TYPE_DIP_PARM,
   TYPE_DIP_SKEW_DATA = TYPE_DIP_SKEW_FLAG | TYPE_DIP_DATA,
+  TYPE_DIP_SKEW_SHM  = TYPE_DIP_SKEW_FLAG | TYPE_DIP_SHM,
   TYPE_DIP_SKEW_MASK = TYPE_DIP_SKEW_FLAG | TYPE_DIP_MASK,
 
   TYPE_DIP_CROP_FLAG = 0x20,
@@ -62,6 +64,7 @@ enum {
   TYPE_DIP_CROP_DTOR = TYPE_DIP_CROP_FLAG | TYPE_DIP_DTOR,
   TYPE_DIP_CROP_PARM = TYPE_DIP_CROP_FLAG | TYPE_DIP_PARM,
   TYPE_DIP_CROP_DATA = TYPE_DIP_CROP_FLAG | TYPE_DIP_DATA,
+  TYPE_DIP_CROP_SHM  = TYPE_DIP_CROP_FLAG | TYPE_DIP_SHM,
   TYPE_DIP_CROP_MASK = TYPE_DIP_CROP_FLAG | TYPE_DIP_MASK,
 };
 
@@ -75,11 +78,33 @@ ssize_t ipc_send (int sock, uint16_t id, uint8_t type_status,
 ssize_t ipc_recv (int sock, uint16_t *id, uint8_t *type_status,
                   void** payload);
 
+/*! \brief Shared memory transport for image data
+ *
+ *  A child process finds one end of a Unix domain socket at the file
+ *  descriptor given in the #IPC_SHM_FD_ENV environment variable.  If
+ *  it can work on image data in shared memory, it writes a single
+ *  #IPC_SHM_HELLO byte to that socket \e before it prints its port.
+ *  Child processes that do not know about this never write anything
+ *  there and are talked to over TCP as before.
+ *
+ *  With shared memory, the whole image processing dialog takes place
+ *  on the Unix domain socket.  Instead of a \c TYPE_DIP_DATA packet,
+ *  a \c TYPE_DIP_SHM packet with the size of the memory segment as
+ *  its payload is sent, followed by a single byte that carries the
+ *  segment's file descriptor (\c SCM_RIGHTS).  The child processes
+ *  the image in place and replies with only a \c TYPE_DIP_PARM
+ *  packet.  The resulting image is at the start of the segment.
+ */
+#define IPC_SHM_FD_ENV  "ISCAN_IPC_SHM_FD"
+#define IPC_SHM_HELLO   'S'
+
   typedef struct
   {
     pid_t pid;
     int   port;
     int   socket;
+    int   shm_socket;     /* -1 unless the child takes shared memory */
+    struct ipc_segment *segment;  /* image memory shared with the child */
 
     const char *name;
 
@@ -110,10 +135,29 @@ ssize_t ipc_recv (int sock, uint16_t *id, uint8_t *type_status,
    *  If any of the IPC messaging signals an error, the original image
    *  data will not be modified at all.  That is, \a ctx and \a buffer
    *  remain unchanged in such a case.
+   *
+   *  A \a buffer obtained from ipc_dip_alloc() is processed in place
+   *  by a child that takes shared memory.  Any other buffer is copied
+   *  to the child and back.
    */
   void ipc_dip_proc (process *child, int flag, const ipc_dip_parms *p,
                      SANE_Parameters *ctx, void **buffer);
 
+  /*! \brief  Allocates memory for an image to be processed
+   *
+   *  If the \a child takes shared memory, the image is put in memory
+   *  it shares with the \a child so that ipc_dip_proc() need not copy
+   *  it.  Only one such image at a time is supported.  Heap memory is
+   *  returned in all other cases.
+   *
+   *  Memory obtained this way must be released with ipc_dip_free().
+   */
+  void * ipc_dip_alloc (process *child, size_t size);
+
+  /*! \brief  Releases memory obtained from ipc_dip_alloc()
+   */
+  void ipc_dip_free (process *child, void *ptr);
+
 #ifdef __cplusplus
 }       /* extern "C" */
 #endif
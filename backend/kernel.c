@@ -0,0 +1,262 @@
+/*  kernel.c -- per-sample image processing kernels
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+|iscan
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of the SANE backend distributed with Image Scan!
+ *
+ *  Image Scan!'s SANE backend is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Linking Image Scan!'s SANE backend statically or dynamically with
+ *  other modules is making a combined work based on this SANE backend.
+ *  Thus, the terms and conditions of the GNU General Public License
+ *  cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  SANE frontends that communicate with Image Scan!'s SANE backend
+ *  solely through the SANE Application Programming Interface,
+ *  regardless of the license terms of these SANE frontends, and to
+ *  copy and distribute the resulting combined work under terms of your
+ *  choice, provided that every copy of the combined work is
+ *  accompanied by a complete copy of the source code of Image Scan!'s
+ *  SANE backend (the version of Image Scan!'s SANE backend used to
+ *  produce the combined work), being distributed under the terms of
+ *  the GNU General Public License plus this exception.  An independent
+ *  module is a module which is not derived from or based on Image
+ *  Scan!'s SANE backend.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  independent modules that communicate with Image Scan!'s SANE
+ *  backend solely through the "Interpreter" interface, regardless of
+ *  the license terms of these independent modules, and to copy and
+ *  distribute the resulting combined work under terms of your choice,
+ *  provided that every copy of the combined work is accompanied by a
+ *  complete copy of the source code of Image Scan!'s SANE backend (the
+ *  version of Image Scan!'s SANE backend used to produce the combined
+ *  work), being distributed under the terms of the GNU General Public
+ *  License plus this exception.  An independent module is a module
+ *  which is not derived from or based on Image Scan!'s SANE backend.
+ *
+ *  Note that people who make modified versions of Image Scan!'s SANE
+ *  backend are not obligated to grant special exceptions for their
+ *  modified versions; it is their choice whether to do so.  The GNU
+ *  General Public License gives permission to release a modified
+ *  version without this exception; this exception also makes it
+ *  possible to release a modified version which carries forward this
+ *  exception.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "kernel.h"
+
+#include <string.h>
+
+#include "defines.h"
+
+#ifdef KERNEL_BUILD_AVX2
+#include <immintrin.h>
+#endif
+
+static kernel_isa detected = -1;
+static kernel_isa selected = -1;
+
+/*! Returns the instruction set the kernels use.
+ *  This is the best one the CPU supports unless kernel_set_isa() has
+ *  been used to pick a lesser one.
+ */
+kernel_isa
+kernel_get_isa (void)
+{
+  if (0 > (int) detected)
+    {
+      detected = KERNEL_ISA_SCALAR;
+#ifdef KERNEL_BUILD_AVX2
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        detected = KERNEL_ISA_AVX2;
+#endif
+    }
+  if (0 > (int) selected)
+    selected = detected;
+
+  return selected;
+}
+
+/*! Makes the kernels use \a isa or the best the CPU supports if that
+ *  is less.  Meant for tests and benchmarks.  Returns the instruction
+ *  set that will be used.
+ */
+kernel_isa
+kernel_set_isa (kernel_isa isa)
+{
+  kernel_get_isa ();
+  selected = (isa < detected ? isa : detected);
+  return selected;
+}
+
+#ifdef KERNEL_BUILD_AVX2
+
+/*! Looks up 32 samples at a time with byte shuffles.
+ *  A shuffle does a lookup in a 16 entry table and yields zero for
+ *  indices with the high bit set.  The 256 entry table is split in
+ *  16 such parts.  Lower and upper halves of the table are done with
+ *  separate indices, the upper one with the high bit flipped so that
+ *  each index is only "live" for one of the halves.  Indices move on
+ *  to the next part by subtracting 16, with signed saturation so
+ *  that once negative they stay that way.  Each index hence picks up
+ *  an entry from every part up to and including its own one, and
+ *  the parts are stored as the XOR with their predecessor so that
+ *  combining all with XOR leaves just the entry we want.
+ */
+__attribute__ ((target ("avx2")))
+static size_t
+lut_8_avx2 (uint8_t *p, size_t size, const uint8_t *lut)
+{
+  __m256i part[16];
+  __m256i step = _mm256_set1_epi8 (16);
+  __m256i flip = _mm256_set1_epi8 ((char) 0x80);
+  size_t n = 0;
+  int i;
+
+  for (i = 0; i < 16; ++i)
+    {
+      uint8_t v[16];
+      int j;
+
+      for (j = 0; j < 16; ++j)
+        {
+          int k = 16 * i + j;
+          v[j] = lut[k] ^ (16 <= k % 128 ? lut[k - 16] : 0);
+        }
+      part[i] = _mm256_broadcastsi128_si256
+        (_mm_loadu_si128 ((const __m128i *) v));
+    }
+
+  for (; n + 32 <= size; n += 32)
+    {
+      __m256i lo = _mm256_loadu_si256 ((const __m256i *) (p + n));
+      __m256i hi = _mm256_xor_si256 (lo, flip);
+      __m256i v  = _mm256_setzero_si256 ();
+
+      for (i = 0; i < 8; ++i)
+        {
+          v = _mm256_xor_si256 (v, _mm256_shuffle_epi8 (part[i], lo));
+          v = _mm256_xor_si256 (v, _mm256_shuffle_epi8 (part[i + 8], hi));
+          lo = _mm256_subs_epi8 (lo, step);
+          hi = _mm256_subs_epi8 (hi, step);
+        }
+      _mm256_storeu_si256 ((__m256i *) (p + n), v);
+    }
+  return n;
+}
+
+#endif  /* KERNEL_BUILD_AVX2 */
+
+void
+kernel_lut_8 (uint8_t *data, size_t size, const uint8_t *lut)
+{
+  size_t n = 0;
+
+  require (data && lut);
+
+#ifdef KERNEL_BUILD_AVX2
+  if (KERNEL_ISA_AVX2 == kernel_get_isa ())
+    n = lut_8_avx2 (data, size, lut);
+#endif
+  for (; n < size; ++n)
+    data[n] = lut[data[n]];
+}
+
+/*! Samples are taken to be in host byte order, as are table entries.
+ *  There is no SIMD variant.  A 16 bit table is too large for shuffles
+ *  and AVX2 gathers turned out no faster than this loop.
+ */
+void
+kernel_lut_16 (uint16_t *data, size_t size, const uint16_t *lut)
+{
+  size_t n;
+
+  require (data && lut);
+
+  for (n = 0; n < size; ++n)
+    data[n] = lut[data[n]];
+}
+
+/*! Any trailing samples that do not make up a whole pixel are left
+ *  as they are.  Shuffles would need a pass per table here and that
+ *  ends up slower than this loop.
+ */
+void
+kernel_lut_rgb_8 (uint8_t *data, size_t size,
+                  const uint8_t *r, const uint8_t *g, const uint8_t *b)
+{
+  size_t n;
+
+  require (data && r && g && b);
+
+  size -= size % 3;
+  for (n = 0; n < size; n += 3)
+    {
+      data[n    ] = r[data[n    ]];
+      data[n + 1] = g[data[n + 1]];
+      data[n + 2] = b[data[n + 2]];
+    }
+}
+
+void
+kernel_lut_rgb_16 (uint16_t *data, size_t size,
+                   const uint16_t *r, const uint16_t *g, const uint16_t *b)
+{
+  size_t n;
+
+  require (data && r && g && b);
+
+  size -= size % 3;
+  for (n = 0; n < size; n += 3)
+    {
+      data[n    ] = r[data[n    ]];
+      data[n + 1] = g[data[n + 1]];
+      data[n + 2] = b[data[n + 2]];
+    }
+}
+
+/*! Flips all bits a machine word at a time.  Compilers turn this into
+ *  vector code where they can, so no SIMD variants are needed.
+ */
+void
+kernel_invert (uint8_t *data, size_t size)
+{
+  size_t n = 0;
+
+  require (data);
+
+  for (; n + sizeof (uint64_t) <= size; n += sizeof (uint64_t))
+    {
+      uint64_t w;
+
+      memcpy (&w, data + n, sizeof (w));
+      w = ~w;
+      memcpy (data + n, &w, sizeof (w));
+    }
+  for (; n < size; ++n)
+    data[n] = ~data[n];
+}
@@ -0,0 +1,127 @@
+/*  kernel.h -- per-sample image processing kernels
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+|iscan
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of the SANE backend distributed with Image Scan!
+ *
+ *  Image Scan!'s SANE backend is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Linking Image Scan!'s SANE backend statically or dynamically with
+ *  other modules is making a combined work based on this SANE backend.
+ *  Thus, the terms and conditions of the GNU General Public License
+ *  cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  SANE frontends that communicate with Image Scan!'s SANE backend
+ *  solely through the SANE Application Programming Interface,
+ *  regardless of the license terms of these SANE frontends, and to
+ *  copy and distribute the resulting combined work under terms of your
+ *  choice, provided that every copy of the combined work is
+ *  accompanied by a complete copy of the source code of Image Scan!'s
+ *  SANE backend (the version of Image Scan!'s SANE backend used to
+ *  produce the combined work), being distributed under the terms of
+ *  the GNU General Public License plus this exception.  An independent
+ *  module is a module which is not derived from or based on Image
+ *  Scan!'s SANE backend.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  independent modules that communicate with Image Scan!'s SANE
+ *  backend solely through the "Interpreter" interface, regardless of
+ *  the license terms of these independent modules, and to copy and
+ *  distribute the resulting combined work under terms of your choice,
+ *  provided that every copy of the combined work is accompanied by a
+ *  complete copy of the source code of Image Scan!'s SANE backend (the
+ *  version of Image Scan!'s SANE backend used to produce the combined
+ *  work), being distributed under the terms of the GNU General Public
+ *  License plus this exception.  An independent module is a module
+ *  which is not derived from or based on Image Scan!'s SANE backend.
+ *
+ *  Note that people who make modified versions of Image Scan!'s SANE
+ *  backend are not obligated to grant special exceptions for their
+ *  modified versions; it is their choice whether to do so.  The GNU
+ *  General Public License gives permission to release a modified
+ *  version without this exception; this exception also makes it
+ *  possible to release a modified version which carries forward this
+ *  exception.
+ */
+
+
+#ifndef kernel_h_included
+#define kernel_h_included
+
+/*! \file
+ *  \brief  Per-sample image processing kernels.
+ *
+ *  Table lookups and bit flipping touch every byte of every scan.
+ *  The kernels here do that work for the dip_*() functions, using
+ *  SIMD instructions where the CPU has them and where that is worth
+ *  it.  The instruction set to use is detected at run time, so
+ *  binaries built for a generic target still make use of newer CPUs.
+ *  Every kernel produces the same result, bit for bit, whichever
+ *  instruction set is in use.
+ *
+ *  The tests directory has a micro-benchmark, kernel-bench, that
+ *  compares the scalar and SIMD variants.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*! Set when the compiler can build AVX2 code for use after a run
+ *  time check.
+ */
+#if defined (__GNUC__) && !defined (__clang__) \
+  && (4 < __GNUC__ || (4 == __GNUC__ && 9 <= __GNUC_MINOR__)) \
+  && (defined (__x86_64__) || defined (__i386__))
+#define KERNEL_BUILD_AVX2 1
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  typedef enum
+    {
+      KERNEL_ISA_SCALAR,
+      KERNEL_ISA_AVX2,
+    } kernel_isa;
+
+  kernel_isa kernel_get_isa (void);
+  kernel_isa kernel_set_isa (kernel_isa isa);
+
+  void kernel_lut_8  (uint8_t *data, size_t size, const uint8_t *lut);
+  void kernel_lut_16 (uint16_t *data, size_t size, const uint16_t *lut);
+  void kernel_lut_rgb_8  (uint8_t *data, size_t size,
+                          const uint8_t *r, const uint8_t *g,
+                          const uint8_t *b);
+  void kernel_lut_rgb_16 (uint16_t *data, size_t size,
+                          const uint16_t *r, const uint16_t *g,
+                          const uint16_t *b);
+  void kernel_invert (uint8_t *data, size_t size);
+
+#ifdef __cplusplus
+}       /* extern "C" */
+#endif
+
+#endif  /* !defined (kernel_h_included) */
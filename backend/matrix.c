@@ -0,0 +1,321 @@
+/*  matrix.c -- fixed-point colour matrix kernels
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+|iscan
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of the SANE backend distributed with Image Scan!
+ *
+ *  Image Scan!'s SANE backend is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Linking Image Scan!'s SANE backend statically or dynamically with
+ *  other modules is making a combined work based on this SANE backend.
+ *  Thus, the terms and conditions of the GNU General Public License
+ *  cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  SANE frontends that communicate with Image Scan!'s SANE backend
+ *  solely through the SANE Application Programming Interface,
+ *  regardless of the license terms of these SANE frontends, and to
+ *  copy and distribute the resulting combined work under terms of your
+ *  choice, provided that every copy of the combined work is
+ *  accompanied by a complete copy of the source code of Image Scan!'s
+ *  SANE backend (the version of Image Scan!'s SANE backend used to
+ *  produce the combined work), being distributed under the terms of
+ *  the GNU General Public License plus this exception.  An independent
+ *  module is a module which is not derived from or based on Image
+ *  Scan!'s SANE backend.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  independent modules that communicate with Image Scan!'s SANE
+ *  backend solely through the "Interpreter" interface, regardless of
+ *  the license terms of these independent modules, and to copy and
+ *  distribute the resulting combined work under terms of your choice,
+ *  provided that every copy of the combined work is accompanied by a
+ *  complete copy of the source code of Image Scan!'s SANE backend (the
+ *  version of Image Scan!'s SANE backend used to produce the combined
+ *  work), being distributed under the terms of the GNU General Public
+ *  License plus this exception.  An independent module is a module
+ *  which is not derived from or based on Image Scan!'s SANE backend.
+ *
+ *  Note that people who make modified versions of Image Scan!'s SANE
+ *  backend are not obligated to grant special exceptions for their
+ *  modified versions; it is their choice whether to do so.  The GNU
+ *  General Public License gives permission to release a modified
+ *  version without this exception; this exception also makes it
+ *  possible to release a modified version which carries forward this
+ *  exception.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "matrix.h"
+
+#include <math.h>
+
+#include "defines.h"
+#include "kernel.h"
+
+#ifdef KERNEL_BUILD_AVX2
+#include <immintrin.h>
+#endif
+
+/*! Coefficients are limited to this magnitude.  Option values do not
+ *  get anywhere near it but it keeps the sums of products of 8 bit
+ *  values within 32 bits.
+ */
+#define MATRIX_LIMIT 32
+
+/*! Pixel data is processed in chunks that hold a whole number of
+ *  pixels as well as of SIMD vectors.
+ */
+#define CHUNK 24
+
+/*! Returns the floor of \a k / 65536, clamped to [0,\a hi].
+ *  We rely on >> being an arithmetic shift for negative values.
+ */
+static inline int32_t
+fix (int64_t k, int32_t hi)
+{
+  k >>= 16;
+  return (k < 0 ? 0 : (k > hi ? hi : k));
+}
+
+static inline void
+pixel_8 (const int32_t *k, uint8_t *p)
+{
+  int32_t r = p[0], g = p[1], b = p[2];
+
+  p[0] = fix (k[0] * r + k[1] * g + k[2] * b, 255);
+  p[1] = fix (k[3] * r + k[4] * g + k[5] * b, 255);
+  p[2] = fix (k[6] * r + k[7] * g + k[8] * b, 255);
+}
+
+static inline void
+pixel_16 (const int32_t *k, uint16_t *p)
+{
+  int64_t r = p[0], g = p[1], b = p[2];
+
+  p[0] = fix (k[0] * r + k[1] * g + k[2] * b, 65535);
+  p[1] = fix (k[3] * r + k[4] * g + k[5] * b, 65535);
+  p[2] = fix (k[6] * r + k[7] * g + k[8] * b, 65535);
+}
+
+#ifdef KERNEL_BUILD_AVX2
+
+/*! Returns the coefficient that sample \a q of a chunk gets for the
+ *  sample \a d positions away from it.  Seen that way, a matrix is a
+ *  five tap filter whose taps repeat every three samples, which is
+ *  what lets the SIMD kernels work on interleaved data as is.
+ */
+static int32_t
+tap (const matrix *self, int q, int d)
+{
+  int c = q % 3;
+
+  if (c + d < 0 || 2 < c + d) return 0;
+  return self->k[3 * c + c + d];
+}
+
+#endif
+
+void
+matrix_init (matrix *self, const double profile[9])
+{
+  int i;
+
+  require (self && profile);
+
+  for (i = 0; i < 9; ++i)
+    {
+      double v = profile[i];
+
+      if (v < -MATRIX_LIMIT) v = -MATRIX_LIMIT;
+      if (v >  MATRIX_LIMIT) v =  MATRIX_LIMIT;
+      self->k[i] = lround (v * 65536);
+    }
+}
+
+#ifdef KERNEL_BUILD_AVX2
+
+/*! Handles whole chunks of 8 bit samples in [p,e).
+ *  Loads reach two samples beyond either end of a chunk, something
+ *  the caller has to allow for.  Those samples get a zero coefficient
+ *  so it does no harm that one of the neighbouring chunks has already
+ *  been done.
+ */
+__attribute__ ((target ("avx2")))
+static uint8_t *
+matrix_apply_8_avx2 (const matrix *self, uint8_t *p, uint8_t *e)
+{
+  __m256i k[3][5];
+  __m256i zero = _mm256_setzero_si256 ();
+  __m256i max = _mm256_set1_epi32 (255);
+  __m256i gather = _mm256_setr_epi32 (0, 4, 0, 0, 0, 0, 0, 0);
+  int s, t, l;
+
+  for (s = 0; s < 3; ++s)
+    for (t = 0; t < 5; ++t)
+      {
+        int32_t v[8];
+
+        for (l = 0; l < 8; ++l)
+          v[l] = tap (self, 8 * s + l, t - 2);
+        k[s][t] = _mm256_loadu_si256 ((const __m256i *) v);
+      }
+
+  for (; p + CHUNK <= e; p += CHUNK)
+    {
+      __m256i out[3];
+
+      for (s = 0; s < 3; ++s)
+        {
+          const uint8_t *q = p + 8 * s;
+          __m256i sum = zero;
+
+          for (t = 0; t < 5; ++t)
+            {
+              __m256i x = _mm256_cvtepu8_epi32
+                (_mm_loadl_epi64 ((const __m128i *) (q + t - 2)));
+
+              sum = _mm256_add_epi32 (sum, _mm256_mullo_epi32 (x, k[s][t]));
+            }
+          sum = _mm256_srai_epi32 (sum, 16);
+          sum = _mm256_min_epi32 (_mm256_max_epi32 (sum, zero), max);
+          sum = _mm256_packus_epi32 (sum, sum);
+          sum = _mm256_packus_epi16 (sum, sum);
+          out[s] = _mm256_permutevar8x32_epi32 (sum, gather);
+        }
+      for (s = 0; s < 3; ++s)
+        _mm_storel_epi64 ((__m128i *) (p + 8 * s),
+                          _mm256_castsi256_si128 (out[s]));
+    }
+  return p;
+}
+
+/*! Handles whole chunks of 16 bit samples in [p,e).
+ *  Products of 16 bit samples and coefficients need more than 32
+ *  bits.  Samples are therefore split in a high and a low byte and
+ *  the two sums combined in a way that gives the same floor as the
+ *  full precision sum would.
+ */
+__attribute__ ((target ("avx2")))
+static uint16_t *
+matrix_apply_16_avx2 (const matrix *self, uint16_t *p, uint16_t *e)
+{
+  __m256i k[3][5];
+  __m256i zero = _mm256_setzero_si256 ();
+  __m256i max = _mm256_set1_epi32 (65535);
+  __m256i mask = _mm256_set1_epi32 (0xff);
+  int s, t, l;
+
+  for (s = 0; s < 3; ++s)
+    for (t = 0; t < 5; ++t)
+      {
+        int32_t v[8];
+
+        for (l = 0; l < 8; ++l)
+          v[l] = tap (self, 8 * s + l, t - 2);
+        k[s][t] = _mm256_loadu_si256 ((const __m256i *) v);
+      }
+
+  for (; p + CHUNK <= e; p += CHUNK)
+    {
+      __m256i out[3];
+
+      for (s = 0; s < 3; ++s)
+        {
+          const uint16_t *q = p + 8 * s;
+          __m256i k_hi = zero, k_lo = zero;
+
+          for (t = 0; t < 5; ++t)
+            {
+              __m256i x = _mm256_cvtepu16_epi32
+                (_mm_loadu_si128 ((const __m128i *) (q + t - 2)));
+
+              k_hi = _mm256_add_epi32 (k_hi, _mm256_mullo_epi32
+                                       (_mm256_srli_epi32 (x, 8), k[s][t]));
+              k_lo = _mm256_add_epi32 (k_lo, _mm256_mullo_epi32
+                                       (_mm256_and_si256 (x, mask), k[s][t]));
+            }
+          /* floor ((256 * k_hi + k_lo) / 65536) without overflow */
+          k_hi = _mm256_add_epi32 (k_hi, _mm256_srai_epi32 (k_lo, 8));
+          k_hi = _mm256_srai_epi32 (k_hi, 8);
+          k_hi = _mm256_min_epi32 (_mm256_max_epi32 (k_hi, zero), max);
+          k_hi = _mm256_packus_epi32 (k_hi, k_hi);
+          out[s] = _mm256_permute4x64_epi64 (k_hi, 0x08);
+        }
+      for (s = 0; s < 3; ++s)
+        _mm_storeu_si128 ((__m128i *) (p + 8 * s),
+                          _mm256_castsi256_si128 (out[s]));
+    }
+  return p;
+}
+
+#endif  /* KERNEL_BUILD_AVX2 */
+
+/*! Applies the matrix to \a size 8 bit samples of RGB data in place.
+ *  The first and last pixels are done by the scalar code so that the
+ *  SIMD kernels can safely reach a little outside of their chunks.
+ */
+void
+matrix_apply_8 (const matrix *self, uint8_t *data, size_t size)
+{
+  uint8_t *p = data;
+  uint8_t *e = data + size - size % 3;
+
+  require (self && data);
+
+  if (p == e) return;
+  pixel_8 (self->k, p);
+  p += 3;
+
+#ifdef KERNEL_BUILD_AVX2
+  if (CHUNK + 2 < e - p && KERNEL_ISA_AVX2 == kernel_get_isa ())
+    p = matrix_apply_8_avx2 (self, p, e - 3);
+#endif
+
+  for (; p < e; p += 3)
+    pixel_8 (self->k, p);
+}
+
+/*! Applies the matrix to \a size 16 bit samples of RGB data in place.
+ *  Samples are taken to be in host byte order.
+ */
+void
+matrix_apply_16 (const matrix *self, uint16_t *data, size_t size)
+{
+  uint16_t *p = data;
+  uint16_t *e = data + size - size % 3;
+
+  require (self && data);
+
+  if (p == e) return;
+  pixel_16 (self->k, p);
+  p += 3;
+
+#ifdef KERNEL_BUILD_AVX2
+  if (CHUNK + 2 < e - p && KERNEL_ISA_AVX2 == kernel_get_isa ())
+    p = matrix_apply_16_avx2 (self, p, e - 3);
+#endif
+
+  for (; p < e; p += 3)
+    pixel_16 (self->k, p);
+}
@@ -112,6 +112,8 @@ typedef struct
 
   capability_data_t *dfault;
   capability_data_t *adf_duplex;
+
+  tuner tuner;                  /* transfer sizes that work best */
 } _model_info_t;
 
 typedef enum
@@ -265,6 +267,32 @@ model_info_cache_get_model (const char *fw_name)
 }
 
 
+/*! \brief  Returns the transfer size tuner of the model for \a fw_name.
+ *
+ *  The cached model information is not handed out for modification,
+ *  so this is the way to get at the tuner it owns.  Note that \c NULL
+ *  may be returned.
+ */
+tuner *
+model_info_cache_get_tuner (const char *fw_name)
+{
+  SANE_Status    s = SANE_STATUS_GOOD;
+  _model_info_t *m = NULL;
+
+  log_call ("(%s)", fw_name);
+  require (_cache && _datadir);
+
+  m = _model_info_cache_get_info (fw_name, &s);
+  if (!m)
+    {
+      err_minor ("%s", sane_strstatus (s));
+      return NULL;
+    }
+
+  return model_info_get_tuner (m);
+}
+
+
 /*! \brief  Returns a reference to the model name.
  *
  *  Resources associated with the reference are owned by \a self.  The
@@ -677,6 +705,19 @@ model_info_has_lock_commands (const void *self)
   return (self_->command->lock && self_->command->unlock);
 }
 
+/*! \brief  Returns the model's transfer size tuner.
+ *
+ *  The tuner is owned by \a self and shared by all devices of the
+ *  model so its measurements last as long as the model info cache.
+ */
+tuner *
+model_info_get_tuner (void *self)
+{
+  require (self);
+
+  return &((_model_info_t *) self)->tuner;
+}
+
 scan_area_t 
 model_info_max_scan_area(const void *self, const char *option, const char *mode)
 {
@@ -127,6 +127,7 @@ extern "C"
 
   /* Model info cache convenience methods */
   char * model_info_cache_get_model (const char *fw_name);
+  tuner * model_info_cache_get_tuner (const char *fw_name);
   /* ?FIXME? add convenience methods for vendor and type? */
 
   /* Model info accessors */
@@ -134,6 +135,7 @@ extern "C"
   const EpsonScanHard model_info_get_profile (const void *self);
   bool model_info_customise_commands (const void *self, EpsonCmd cmd);
   bool model_info_has_lock_commands (const void *self);
+  tuner * model_info_get_tuner (void *self);
 
   scan_area_t model_info_max_scan_area(const void *self, const char *option, const char *mode);
   /* :FIXME: add more accessors */
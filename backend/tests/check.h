@@ -0,0 +1,58 @@
+/*  check.h -- minimal checking harness for the C unit tests
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef tests_check_h_included
+#define tests_check_h_included
+
+/*! \file
+ *  \brief  Counts failed checks and turns them into an exit status.
+ *
+ *  Tests in plain C, that is those that do not need CxxTest, call
+ *  check() as they go and end main() with \c return check_status().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures;
+
+#define check(cond)                                             \
+  do {                                                          \
+    if (!(cond))                                                \
+      {                                                         \
+        fprintf (stderr, "%s:%d: check failed: %s\n",           \
+                 __FILE__, __LINE__, #cond);                    \
+        ++failures;                                             \
+      }                                                         \
+  } while (0)
+
+static inline int
+check_status (void)
+{
+  if (failures)
+    fprintf (stderr, "%d check(s) failed\n", failures);
+
+  return (failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+#endif  /* !defined (tests_check_h_included) */
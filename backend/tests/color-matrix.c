@@ -0,0 +1,157 @@
+/*  color-matrix.c -- unit tests for the colour matrix kernels
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../kernel.h"
+#include "../matrix.h"
+#include "check.h"
+
+
+#define SIZE 4096
+
+/*  Profiles are made from option values, i.e. SANE_Fixed numbers
+ *  within the option's [-2,2] range.
+ */
+static void
+random_profile (double profile[9])
+{
+  int i;
+
+  for (i = 0; i < 9; ++i)
+    profile[i] = (rand () % (4 * 65536 + 1) - 2 * 65536) / 65536.0;
+}
+
+/*  What the colour profile code has always computed.
+ */
+static double
+reference (const double *k, double r, double g, double b, double hi)
+{
+  double v = k[0] * r + k[1] * g + k[2] * b;
+
+  return (v < 0 ? 0 : (v > hi ? hi : v));
+}
+
+static void
+test_8 (const double profile[9], size_t size)
+{
+  uint8_t data[SIZE], orig[SIZE];
+  matrix m;
+  size_t i;
+  int bad = 0;
+
+  for (i = 0; i < size; ++i)
+    orig[i] = data[i] = (0 == rand () % 8 ? 255 * (rand () % 2) : rand ());
+
+  matrix_init (&m, profile);
+  matrix_apply_8 (&m, data, size);
+
+  for (i = 0; i < size - size % 3; ++i)
+    {
+      const uint8_t *p = orig + i - i % 3;
+      uint8_t v = reference (profile + 3 * (i % 3), p[0], p[1], p[2], 255);
+
+      if (v != data[i]) ++bad;
+    }
+  for (; i < size; ++i)
+    if (orig[i] != data[i]) ++bad;
+
+  check (0 == bad);
+}
+
+static void
+test_16 (const double profile[9], size_t size)
+{
+  uint16_t data[SIZE], orig[SIZE];
+  matrix m;
+  size_t i;
+  int bad = 0;
+
+  for (i = 0; i < size; ++i)
+    orig[i] = data[i] = (0 == rand () % 8
+                         ? 65535 * (rand () % 2)
+                         : rand () % 65536);
+
+  matrix_init (&m, profile);
+  matrix_apply_16 (&m, data, size);
+
+  for (i = 0; i < size - size % 3; ++i)
+    {
+      const uint16_t *p = orig + i - i % 3;
+      uint16_t v = reference (profile + 3 * (i % 3), p[0], p[1], p[2], 65535);
+
+      if (v != data[i]) ++bad;
+    }
+  for (; i < size; ++i)
+    if (orig[i] != data[i]) ++bad;
+
+  check (0 == bad);
+}
+
+static void
+test_kernels (void)
+{
+  const double identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+  const double extreme[9] = { 2, -2, 2, -2, 2, -2, 2, 2, 2 };
+  double profile[9];
+  int i;
+
+  test_8 (identity, SIZE);
+  test_16 (identity, SIZE);
+  test_8 (extreme, SIZE);
+  test_16 (extreme, SIZE);
+
+  /* sizes around the point where the SIMD kernels kick in and ones
+   * that do not hold a whole number of pixels */
+  for (i = 0; i < 1000; ++i)
+    {
+      size_t size = (i < 100 ? (size_t) i : (size_t) rand () % SIZE);
+
+      random_profile (profile);
+      test_8 (profile, size);
+      test_16 (profile, size);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  srand (0);
+
+  check (KERNEL_ISA_SCALAR == kernel_set_isa (KERNEL_ISA_SCALAR));
+  test_kernels ();
+
+  if (KERNEL_ISA_AVX2 == kernel_set_isa (KERNEL_ISA_AVX2))
+    test_kernels ();
+  else
+    fprintf (stderr, "AVX2 kernels not tested\n");
+
+  return check_status ();
+}
@@ -0,0 +1,176 @@
+/*  deskew-stream.c -- unit tests for line by line deskewing
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../deskew.h"
+#include "../../include/sane/sanei_magic.h"
+#include "check.h"
+
+
+static void
+make_params (SANE_Parameters *ctx, SANE_Frame format, int depth,
+             int width, int height)
+{
+  memset (ctx, 0, sizeof (*ctx));
+  ctx->format = format;
+  ctx->last_frame = SANE_TRUE;
+  ctx->depth = depth;
+  ctx->pixels_per_line = width;
+  ctx->lines = height;
+  ctx->bytes_per_line = (SANE_FRAME_RGB == format ? 3 : 1) * width;
+  if (1 == depth)
+    ctx->bytes_per_line /= 8;
+}
+
+/*  Passes \a image through a deskew object a line at a time and
+ *  compares the result with what sanei_magic_rotate() makes of it.
+ */
+static void
+test_rotate (const SANE_Parameters *ctx, const SANE_Byte *image,
+             int center_x, int center_y, double slope)
+{
+  size_t size = ctx->bytes_per_line * ctx->lines;
+  SANE_Byte *expect = malloc (size);
+  SANE_Byte *result = malloc (size);
+  SANE_Parameters p;
+  deskew *d;
+  int in = 0, out = 0;
+
+  memcpy (expect, image, size);
+  memcpy (&p, ctx, sizeof (p));
+  sanei_magic_rotate (&p, expect, center_x, center_y, slope, 0xff);
+
+  /* a low resolution keeps the ring smaller than the image */
+  d = deskew_create (ctx, 25);
+  check (NULL != d);
+  if (!d) return;
+
+  deskew_set_angle (d, center_x, center_y, slope);
+
+  while (!deskew_done (d))
+    {
+      while (deskew_needs_input (d))
+        memcpy (deskew_input (d),
+                image + (in++) * ctx->bytes_per_line, ctx->bytes_per_line);
+      deskew_output (d, result + (out++) * ctx->bytes_per_line);
+    }
+  check (ctx->lines == in && ctx->lines == out);
+  check (0 == memcmp (expect, result, size));
+
+  deskew_destroy (d);
+  free (result);
+  free (expect);
+}
+
+static void
+test_format (SANE_Frame format, int depth)
+{
+  static const double slope[] = { 0, 0.01, -0.03, 0.1, -0.25 };
+  static const int center[][2] = {
+    { 250, 300 }, { 0, 0 }, { -40, 900 }, { 1200, -500 },
+  };
+  SANE_Parameters ctx;
+  SANE_Byte *image;
+  size_t i, j, size;
+
+  make_params (&ctx, format, depth, 512, 700);
+  size = ctx.bytes_per_line * ctx.lines;
+  image = malloc (size);
+  for (i = 0; i < size; ++i)
+    image[i] = rand ();
+
+  for (i = 0; i < sizeof (slope) / sizeof (*slope); ++i)
+    for (j = 0; j < sizeof (center) / sizeof (*center); ++j)
+      test_rotate (&ctx, image, center[j][0], center[j][1], slope[i]);
+
+  free (image);
+}
+
+/*  A dark sheet skewed on a white background should have its skew
+ *  found from the leading band the same as from the whole image.
+ */
+static void
+test_estimate (void)
+{
+  const int res = 300;
+  const double slope = 0.05;
+  SANE_Parameters ctx;
+  SANE_Byte *image, *band;
+  deskew *d;
+  size_t size;
+  int i, j, center_x, center_y;
+  double angle;
+
+  make_params (&ctx, SANE_FRAME_GRAY, 8, 600, 800);
+  image = malloc (ctx.bytes_per_line * ctx.lines);
+  for (i = 0; i < ctx.lines; ++i)
+    for (j = 0; j < ctx.pixels_per_line; ++j)
+      {
+        double y = i - 20 - slope * j;
+        double x = j - 10 + slope * (i - 20);
+
+        image[i * ctx.bytes_per_line + j]
+          = (0 <= y && y < 650 && 0 <= x && x < 580 ? 0xf0 : 0x20);
+      }
+
+  check (SANE_STATUS_GOOD
+         == sanei_magic_findSkew (&ctx, image, res, res,
+                                  &center_x, &center_y, &angle));
+
+  d = deskew_create (&ctx, res);
+  check (NULL != d);
+  if (!d) return;
+
+  band = deskew_band (d, &size);
+  check (size < (size_t) ctx.bytes_per_line * ctx.lines);
+  memcpy (band, image, size);
+  check (SANE_STATUS_GOOD == deskew_estimate (d, res, res));
+  check (d->turn);
+  check (fabs (d->sin - sin (atan (angle))) < 0.005);
+
+  deskew_destroy (d);
+  free (image);
+}
+
+int
+main (int argc, char *argv[])
+{
+  srand (0);
+  sanei_magic_init ();
+
+  test_format (SANE_FRAME_RGB, 8);
+  test_format (SANE_FRAME_GRAY, 8);
+  test_format (SANE_FRAME_GRAY, 1);
+  test_estimate ();
+
+  return check_status ();
+}
@@ -0,0 +1,176 @@
+/*  image-kernels.c -- unit tests for the image processing kernels
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../kernel.h"
+#include "check.h"
+
+
+#define SIZE 4096
+
+static uint8_t  lut_8[3][256];
+static uint16_t lut_16[3][65536];
+
+/*  Sample values are mostly random but hit both ends of the range
+ *  often enough to matter.  The very last table entry needs special
+ *  care in the AVX2 kernels.
+ */
+static unsigned int
+sample (unsigned int max)
+{
+  switch (rand () % 8)
+    {
+    case 0: return 0;
+    case 1: return max;
+    default: return rand () % (max + 1);
+    }
+}
+
+static void
+test_8 (size_t size, int tables)
+{
+  uint8_t data[SIZE], orig[SIZE];
+  size_t i;
+  int bad = 0;
+
+  for (i = 0; i < size; ++i)
+    orig[i] = data[i] = sample (255);
+
+  if (1 == tables)
+    kernel_lut_8 (data, size, lut_8[0]);
+  else
+    kernel_lut_rgb_8 (data, size, lut_8[0], lut_8[1], lut_8[2]);
+
+  for (i = 0; i < size; ++i)
+    {
+      uint8_t v = (1 == tables
+                   ? lut_8[0][orig[i]]
+                   : (i < size - size % 3
+                      ? lut_8[i % 3][orig[i]]
+                      : orig[i]));
+
+      if (v != data[i]) ++bad;
+    }
+  check (0 == bad);
+}
+
+static void
+test_16 (size_t size, int tables)
+{
+  uint16_t data[SIZE], orig[SIZE];
+  size_t i;
+  int bad = 0;
+
+  for (i = 0; i < size; ++i)
+    orig[i] = data[i] = sample (65535);
+
+  if (1 == tables)
+    kernel_lut_16 (data, size, lut_16[0]);
+  else
+    kernel_lut_rgb_16 (data, size, lut_16[0], lut_16[1], lut_16[2]);
+
+  for (i = 0; i < size; ++i)
+    {
+      uint16_t v = (1 == tables
+                    ? lut_16[0][orig[i]]
+                    : (i < size - size % 3
+                       ? lut_16[i % 3][orig[i]]
+                       : orig[i]));
+
+      if (v != data[i]) ++bad;
+    }
+  check (0 == bad);
+}
+
+static void
+test_invert (size_t size)
+{
+  uint8_t data[SIZE + 1], orig[SIZE + 1];
+  size_t i;
+  int bad = 0;
+
+  for (i = 0; i < size + 1; ++i)
+    orig[i] = data[i] = rand ();
+
+  kernel_invert (data + 1, size); /* unaligned on purpose */
+
+  for (i = 0; i < size; ++i)
+    {
+      uint8_t v = ~orig[i + 1];
+
+      if (v != data[i + 1]) ++bad;
+    }
+  check (0 == bad && orig[0] == data[0]);
+}
+
+static void
+test_kernels (void)
+{
+  int i;
+
+  for (i = 0; i < 500; ++i)
+    {
+      size_t size = (i < 100 ? (size_t) i : (size_t) rand () % SIZE);
+
+      test_8 (size, 1);
+      test_8 (size, 3);
+      test_16 (size, 1);
+      test_16 (size, 3);
+      test_invert (size);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  int i, t;
+
+  srand (0);
+
+  for (t = 0; t < 3; ++t)
+    {
+      for (i = 0; i < 256; ++i)
+        lut_8[t][i] = rand ();
+      for (i = 0; i < 65536; ++i)
+        lut_16[t][i] = rand ();
+    }
+
+  /* the scalar kernels are the reference for the others */
+  check (KERNEL_ISA_SCALAR == kernel_set_isa (KERNEL_ISA_SCALAR));
+  test_kernels ();
+
+  if (KERNEL_ISA_AVX2 == kernel_set_isa (KERNEL_ISA_AVX2))
+    test_kernels ();
+  else
+    fprintf (stderr, "AVX2 kernels not tested\n");
+
+  return check_status ();
+}
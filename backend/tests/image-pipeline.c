@@ -0,0 +1,205 @@
+/*  image-pipeline.c -- unit tests for the fused image processing steps
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../dip-obj.h"
+#include "../kernel.h"
+#include "check.h"
+
+
+#define LINES 16
+
+static const void *dip;
+
+/*  What the separate steps make of a pixel, done the way they were
+ *  before any of them had fixed-point or SIMD kernels.
+ */
+static void
+reference (uint8_t *p, size_t size, bool rgb, bool reorder,
+           const double *cct, const LUT *lut, bool flip)
+{
+  size_t i;
+
+  for (i = 0; rgb && i + 3 <= size; i += 3)
+    {
+      double r = p[i + (reorder ? 1 : 0)];
+      double g = p[i + (reorder ? 0 : 1)];
+      double b = p[i + 2];
+
+      if (cct)
+        {
+          double v[3];
+          int c;
+
+          for (c = 0; c < 3; ++c)
+            {
+              v[c] = cct[3 * c] * r + cct[3 * c + 1] * g + cct[3 * c + 2] * b;
+              if (v[c] < 0)   v[c] = 0;
+              if (v[c] > 255) v[c] = 255;
+            }
+          r = v[0];
+          g = v[1];
+          b = v[2];
+        }
+      p[i]     = r;
+      p[i + 1] = g;
+      p[i + 2] = b;
+    }
+  for (i = 0; i < size; ++i)
+    {
+      if (lut)  p[i] = lut->lut[p[i]];
+      if (flip) p[i] = ~p[i];
+    }
+}
+
+/*  Profiles are SANE_Fixed option values, so 16.16 to begin with.
+ */
+static void
+random_profile (double *cct)
+{
+  int i;
+
+  for (i = 0; i < 9; ++i)
+    cct[i] = (rand () % (4 << 16) - (1 << 16)) / 65536.0;
+}
+
+static void
+run (const pipeline *pl, bool reorder, uint8_t *p, uint8_t *e)
+{
+  uint8_t *t;
+
+  for (; p < e; p = t)
+    {
+      t = p + pl->tile;
+      if (t > e) t = e;
+      if (pl->pre[reorder]) pl->pre[reorder] (p, t, pl);
+      if (pl->post) pl->post (p, t, pl);
+    }
+}
+
+static void
+test_steps (SANE_Frame format, int depth, int width,
+            bool cct, bool table, bool flip, bool split)
+{
+  SANE_Parameters ctx;
+  pipeline pl;
+  double profile[9];
+  LUT lut;
+  uint8_t *data, *want, map[256];
+  size_t i, size;
+  int reorder;
+  bool rgb = (SANE_FRAME_RGB == format);
+
+  memset (&ctx, 0, sizeof (ctx));
+  ctx.format = format;
+  ctx.depth = depth;
+  ctx.pixels_per_line = width;
+  ctx.bytes_per_line = (rgb ? 3 : 1) * width * depth / 8;
+  ctx.lines = LINES;
+  size = ctx.bytes_per_line * ctx.lines;
+
+  data = malloc (size);
+  want = malloc (size);
+
+  random_profile (profile);
+  for (i = 0; i < 256; ++i)
+    map[i] = rand ();
+  lut.lut = map;
+  lut.depth = depth;
+
+  check (dip_compile_pipeline (dip, &pl, &ctx, (cct ? profile : NULL),
+                               (table ? &lut : NULL), flip, split));
+
+  for (reorder = 0; reorder < 1 + rgb; ++reorder)
+    {
+      int bad = 0;
+
+      for (i = 0; i < size; ++i)
+        want[i] = data[i] = rand ();
+
+      reference (want, size, rgb, reorder, (cct ? profile : NULL),
+                 (table ? &lut : NULL), flip);
+      run (&pl, reorder, data, data + size);
+
+      for (i = 0; i < size; ++i)
+        if (want[i] != data[i]) ++bad;
+      check (0 == bad);
+    }
+
+  free (want);
+  free (data);
+}
+
+static void
+test_pipelines (void)
+{
+  int i, steps, split;
+
+  for (i = 0; i < 20; ++i)
+    {
+      int width = 8 * (1 + (i < 10 ? i : rand () % 500));
+
+      for (split = 0; split < 2; ++split)
+        {
+          for (steps = 0; steps < 8; ++steps)
+            {
+              bool cct   = (0 != (steps & 4));
+              bool table = (0 != (steps & 2));
+              bool flip  = (0 != (steps & 1));
+
+              test_steps (SANE_FRAME_RGB, 8, width, cct, table, flip, split);
+              if (!cct)
+                test_steps (SANE_FRAME_GRAY, 8, width,
+                            false, table, flip, split);
+            }
+          test_steps (SANE_FRAME_GRAY, 1, width, false, false, true, split);
+        }
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  srand (0);
+
+  dip = dip_init ("/nonexistent", NULL);
+  check (NULL != dip);
+  if (!dip) return check_status ();
+
+  check (KERNEL_ISA_SCALAR == kernel_set_isa (KERNEL_ISA_SCALAR));
+  test_pipelines ();
+
+  if (KERNEL_ISA_AVX2 == kernel_set_isa (KERNEL_ISA_AVX2))
+    test_pipelines ();
+
+  dip_exit ((void *) dip);
+
+  return check_status ();
+}
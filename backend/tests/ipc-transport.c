@@ -0,0 +1,291 @@
+/*  ipc-transport.c -- unit tests for passing images to child processes
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../ipc.h"
+#include "check.h"
+
+
+/*  When this is set in the environment, the test program plays the
+ *  part of the image processing plugin.  Its value says whether the
+ *  plugin takes image data in shared memory ("shm") or not ("tcp").
+ */
+#define PLUGIN_ENV "IPC_TRANSPORT_PLUGIN"
+
+/*  The plugin inverts all samples.  Cropping also drops the bottom
+ *  half of the image so that a change of parameters shows.
+ */
+static void
+transform (int flag, ipc_dip_parms *p, uint8_t *data)
+{
+  size_t i, size;
+
+  if (TYPE_DIP_CROP_FLAG == flag)
+    p->parms.lines /= 2;
+
+  size = p->parms.bytes_per_line * p->parms.lines;
+  for (i = 0; i < size; ++i)
+    data[i] = ~data[i];
+}
+
+static int
+recv_fd (int sock)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE (sizeof (int))];
+  } control;
+  char byte;
+  int fd = -1;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = &byte;
+  iov.iov_len  = sizeof (byte);
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  if (1 != recvmsg (sock, &msg, 0))
+    return -1;
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  if (cmsg && SOL_SOCKET == cmsg->cmsg_level
+      && SCM_RIGHTS == cmsg->cmsg_type)
+    memcpy (&fd, CMSG_DATA (cmsg), sizeof (fd));
+
+  return fd;
+}
+
+static void
+serve (int sock)
+{
+  ipc_dip_parms p;
+
+  memset (&p, 0, sizeof (p));
+
+  for (;;)
+    {
+      uint16_t id;
+      uint8_t  type;
+      void    *payload = NULL;
+      ssize_t  n = ipc_recv (sock, &id, &type, &payload);
+      int      flag = type & TYPE_DIP_FLAG;
+
+      if (0 > n) exit (EXIT_FAILURE);
+
+      switch (type & TYPE_DIP_MASK)
+        {
+        case TYPE_DIP_PARM:
+          memcpy (&p, payload, sizeof (p));
+          /* fall through */
+        case TYPE_DIP_CTOR:
+        case TYPE_DIP_DTOR:
+          ipc_send (sock, id, STATUS_OK, 0, NULL);
+          break;
+        case TYPE_DIP_DATA:
+          transform (flag, &p, payload);
+          ipc_send (sock, id, flag | TYPE_DIP_PARM, sizeof (p), &p);
+          ipc_send (sock, id, flag | TYPE_DIP_DATA,
+                    p.parms.bytes_per_line * p.parms.lines, payload);
+          break;
+        case TYPE_DIP_SHM:
+          {
+            size_t size;
+            int fd = recv_fd (sock);
+            void *map;
+
+            memcpy (&size, payload, sizeof (size));
+            map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+            if (MAP_FAILED == map) exit (EXIT_FAILURE);
+            transform (flag, &p, map);
+            munmap (map, size);
+            close (fd);
+            ipc_send (sock, id, flag | TYPE_DIP_PARM, sizeof (p), &p);
+          }
+          break;
+        default:
+          exit (EXIT_FAILURE);
+        }
+      free (payload);
+    }
+}
+
+static int
+plugin (const char *mode)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof (addr);
+  const char *shm_fd = getenv (IPC_SHM_FD_ENV);
+  int server, sock;
+
+  server = socket (AF_INET, SOCK_STREAM, 0);
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (0 > server
+      || 0 != bind (server, (struct sockaddr *) &addr, sizeof (addr))
+      || 0 != listen (server, 1)
+      || 0 != getsockname (server, (struct sockaddr *) &addr, &len))
+    {
+      printf ("-1\n");
+      return EXIT_FAILURE;
+    }
+
+  sock = (shm_fd ? atoi (shm_fd) : -1);
+  if (0 == strcmp (mode, "shm") && 0 <= sock)
+    {
+      char hello = IPC_SHM_HELLO;
+      if (1 != write (sock, &hello, 1))
+        return EXIT_FAILURE;
+    }
+  else
+    sock = -1;
+
+  printf ("%d\n", ntohs (addr.sin_port));
+  fflush (stdout);
+
+  {
+    int conn = accept (server, NULL, NULL);
+
+    if (0 > conn) return EXIT_FAILURE;
+    serve (0 <= sock ? sock : conn);
+  }
+  return EXIT_SUCCESS;
+}
+
+static void
+test_transport (const char *self, const char *mode)
+{
+  SANE_Parameters ctx;
+  ipc_dip_parms p;
+  process *child;
+  uint8_t *image, *orig, *alloc;
+  size_t i, size;
+  int bad = 0;
+
+  setenv (PLUGIN_ENV, mode, 1);
+  child = ipc_exec (self, NULL, NULL);
+  unsetenv (PLUGIN_ENV);
+
+  check (NULL != child);
+  if (!child) return;
+
+  if (0 == strcmp (mode, "shm"))
+    check (0 <= child->shm_socket);
+  else
+    check (0 > child->shm_socket);
+
+  memset (&ctx, 0, sizeof (ctx));
+  ctx.format = SANE_FRAME_GRAY;
+  ctx.depth = 8;
+  ctx.pixels_per_line = ctx.bytes_per_line = 300;
+  ctx.lines = 200;
+  size = ctx.bytes_per_line * ctx.lines;
+
+  image = ipc_dip_alloc (child, size);
+  orig  = malloc (size);
+  alloc = image;
+  for (i = 0; i < size; ++i)
+    orig[i] = image[i] = rand ();
+
+  memset (&p, 0, sizeof (p));
+  memcpy (&p.parms, &ctx, sizeof (ctx));
+  strcpy (p.fw_name, "TEST");
+
+  ipc_dip_proc (child, TYPE_DIP_SKEW_FLAG, &p, &ctx, (void **) &image);
+  check (200 == ctx.lines);
+  for (i = 0; i < size; ++i)
+    {
+      uint8_t inverse = (uint8_t) ~orig[i];
+      if (inverse != image[i]) ++bad;
+    }
+  check (0 == bad);
+
+  /* with shared memory the plugin works on the caller's buffer */
+  if (0 <= child->shm_socket)
+    check (alloc == image);
+
+  memcpy (&p.parms, &ctx, sizeof (ctx));
+  ipc_dip_proc (child, TYPE_DIP_CROP_FLAG, &p, &ctx, (void **) &image);
+  check (100 == ctx.lines);
+  bad = 0;
+  for (i = 0; i < (size_t) ctx.bytes_per_line * ctx.lines; ++i)
+    if (orig[i] != image[i]) ++bad;
+  check (0 == bad);
+  if (0 <= child->shm_socket)
+    check (alloc == image);
+
+  /* a buffer from elsewhere is copied to and fro */
+  memcpy (&p.parms, &ctx, sizeof (ctx));
+  alloc = malloc (size);
+  memcpy (alloc, orig, size);
+  ipc_dip_proc (child, TYPE_DIP_SKEW_FLAG, &p, &ctx, (void **) &alloc);
+  check (100 == ctx.lines);
+  bad = 0;
+  for (i = 0; i < (size_t) ctx.bytes_per_line * ctx.lines; ++i)
+    {
+      uint8_t inverse = (uint8_t) ~orig[i];
+      if (inverse != alloc[i]) ++bad;
+    }
+  check (0 == bad);
+
+  free (alloc);
+  free (orig);
+  ipc_dip_free (child, image);
+  ipc_kill (child);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *mode = getenv (PLUGIN_ENV);
+
+  if (mode)
+    return plugin (mode);
+
+  srand (0);
+
+  test_transport (argv[0], "tcp");
+  test_transport (argv[0], "shm");
+
+  return check_status ();
+}
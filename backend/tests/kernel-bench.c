@@ -0,0 +1,135 @@
+/*  kernel-bench.c -- micro-benchmark for the image processing kernels
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../kernel.h"
+#include "../matrix.h"
+
+
+/*  Roughly the size of an image data block.
+ */
+#define SIZE (512 * 1024)
+#define RUNS 50
+
+static uint8_t  data[SIZE];
+static uint8_t  lut_8[3][256];
+static uint16_t lut_16[3][65536];
+static matrix   m;
+
+static void lut_8_1  (void) { kernel_lut_8 (data, SIZE, lut_8[0]); }
+static void lut_8_3  (void) { kernel_lut_rgb_8 (data, SIZE, lut_8[0],
+                                                lut_8[1], lut_8[2]); }
+static void lut_16_1 (void) { kernel_lut_16 ((uint16_t *) data, SIZE / 2,
+                                             lut_16[0]); }
+static void lut_16_3 (void) { kernel_lut_rgb_16 ((uint16_t *) data, SIZE / 2,
+                                                 lut_16[0], lut_16[1],
+                                                 lut_16[2]); }
+static void invert   (void) { kernel_invert (data, SIZE); }
+static void matrix_8 (void) { matrix_apply_8 (&m, data, SIZE); }
+static void matrix_16 (void) { matrix_apply_16 (&m, (uint16_t *) data,
+                                                SIZE / 2); }
+
+static const struct
+{
+  const char *name;
+  void (*run) (void);
+} bench[] = {
+  { "LUT, 8 bit",             lut_8_1   },
+  { "LUT, 8 bit RGB",         lut_8_3   },
+  { "LUT, 16 bit",            lut_16_1  },
+  { "LUT, 16 bit RGB",        lut_16_3  },
+  { "invert",                 invert    },
+  { "colour matrix, 8 bit",   matrix_8  },
+  { "colour matrix, 16 bit",  matrix_16 },
+};
+
+/*  Returns the best throughput in MB/s over a number of runs.  The
+ *  data is refilled before each run as the kernels work in place.
+ */
+static double
+measure (void (*run) (void))
+{
+  double best = 0;
+  int i, r;
+
+  for (r = 0; r < RUNS; ++r)
+    {
+      struct timeval start, stop;
+      double seconds;
+
+      for (i = 0; i < SIZE; ++i)
+        data[i] = rand ();
+
+      gettimeofday (&start, NULL);
+      run ();
+      gettimeofday (&stop, NULL);
+
+      seconds = (stop.tv_sec - start.tv_sec)
+        + (stop.tv_usec - start.tv_usec) / 1e6;
+      if (0 < seconds && SIZE / seconds / 1e6 > best)
+        best = SIZE / seconds / 1e6;
+    }
+  return best;
+}
+
+int
+main (int argc, char *argv[])
+{
+  const double profile[9] = { 1.2, -0.1, -0.1, -0.2, 1.3, -0.1,
+                              0.0, -0.3,  1.3 };
+  size_t i;
+  int t;
+
+  for (t = 0; t < 3; ++t)
+    {
+      for (i = 0; i < 256; ++i)
+        lut_8[t][i] = rand ();
+      for (i = 0; i < 65536; ++i)
+        lut_16[t][i] = rand ();
+    }
+  matrix_init (&m, profile);
+
+  printf ("%-24s %10s %10s\n", "kernel [MB/s]", "scalar", "AVX2");
+  for (i = 0; i < sizeof (bench) / sizeof (*bench); ++i)
+    {
+      printf ("%-24s", bench[i].name);
+
+      kernel_set_isa (KERNEL_ISA_SCALAR);
+      printf (" %10.0f", measure (bench[i].run));
+
+      if (KERNEL_ISA_AVX2 == kernel_set_isa (KERNEL_ISA_AVX2))
+        printf (" %10.0f", measure (bench[i].run));
+      else
+        printf (" %10s", "n/a");
+      printf ("\n");
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/*  libusb.h -- a mock of the libusb-1.0 asynchronous I/O API
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*  Only the parts of the API needed by sanei_usb_read_ahead.c are
+ *  declared.  The implementation lives in the test program, which
+ *  plays the part of the device and the host controller.
+ */
+
+#ifndef mock_libusb_h
+#define mock_libusb_h
+
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef struct libusb_context libusb_context;
+typedef struct libusb_device_handle libusb_device_handle;
+
+enum libusb_transfer_status
+{
+  LIBUSB_TRANSFER_COMPLETED,
+  LIBUSB_TRANSFER_ERROR,
+  LIBUSB_TRANSFER_TIMED_OUT,
+  LIBUSB_TRANSFER_CANCELLED,
+  LIBUSB_TRANSFER_STALL,
+  LIBUSB_TRANSFER_NO_DEVICE,
+  LIBUSB_TRANSFER_OVERFLOW
+};
+
+enum libusb_transfer_type
+{
+  LIBUSB_TRANSFER_TYPE_BULK = 2
+};
+
+struct libusb_transfer;
+typedef void (*libusb_transfer_cb_fn) (struct libusb_transfer *);
+
+struct libusb_transfer
+{
+  libusb_device_handle *dev_handle;
+  uint8_t flags;
+  unsigned char endpoint;
+  unsigned char type;
+  unsigned int timeout;
+  enum libusb_transfer_status status;
+  int length;
+  int actual_length;
+  libusb_transfer_cb_fn callback;
+  void *user_data;
+  unsigned char *buffer;
+  int num_iso_packets;
+};
+
+static inline void
+libusb_fill_bulk_transfer (struct libusb_transfer *transfer,
+                           libusb_device_handle *dev_handle,
+                           unsigned char endpoint, unsigned char *buffer,
+                           int length, libusb_transfer_cb_fn callback,
+                           void *user_data, unsigned int timeout)
+{
+  transfer->dev_handle = dev_handle;
+  transfer->endpoint = endpoint;
+  transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+  transfer->timeout = timeout;
+  transfer->buffer = buffer;
+  transfer->length = length;
+  transfer->user_data = user_data;
+  transfer->callback = callback;
+}
+
+struct libusb_transfer *libusb_alloc_transfer (int iso_packets);
+void libusb_free_transfer (struct libusb_transfer *transfer);
+int  libusb_submit_transfer (struct libusb_transfer *transfer);
+int  libusb_cancel_transfer (struct libusb_transfer *transfer);
+int  libusb_handle_events_timeout (libusb_context *ctx, struct timeval *tv);
+int  libusb_clear_halt (libusb_device_handle *dev, unsigned char endpoint);
+
+#endif /* mock_libusb_h */
@@ -0,0 +1,167 @@
+/*  transfer-tuning.c -- unit tests for transfer size auto-tuning
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../tuner.h"
+#include "check.h"
+
+
+#define LIMIT (128 * 1024)
+#define MAX_LINES 1024
+
+/*  Pretends to read the blocks of a scan where every block and every
+ *  request cost some overhead seconds on top of the time needed to
+ *  move the data.  Returns the request size used for the last block.
+ */
+static size_t
+scan (tuner *t, int index, unsigned int blocks, size_t block_size,
+      double block_overhead, double overhead)
+{
+  size_t request = 0;
+  unsigned int i;
+
+  for (i = 0; i < blocks; ++i)
+    {
+      double requests;
+
+      request  = tuner_request_size (t, i);
+      requests = (block_size + request - 1) / request;
+      if (0 < i)
+        tuner_record (t, index, request, block_size,
+                      block_size / 1e7 + block_overhead + requests * overhead);
+    }
+  return request;
+}
+
+static void
+test_request_size (void)
+{
+  tuner t = { 0 };
+  int index;
+
+  tuner_block_size (&t, LIMIT, 1000, MAX_LINES, false, &index);
+  check (0 == index);
+
+  /* first block of a scan always uses the limit */
+  check (LIMIT == tuner_request_size (&t, 0));
+
+  /* large requests win when requests are expensive */
+  check (LIMIT == scan (&t, index, 20, LIMIT, 0, 1e-2));
+
+  /* smaller requests win once they are clearly faster */
+  tuner_block_size (&t, LIMIT, 2000, MAX_LINES, false, &index);
+  check (LIMIT / 4 == scan (&t, index, 20, LIMIT, 0, -3e-3));
+
+  /* equal rates keep the limit */
+  tuner_block_size (&t, LIMIT, 3000, MAX_LINES, false, &index);
+  check (LIMIT == scan (&t, index, 20, LIMIT, 0, 0));
+}
+
+static void
+test_block_size (void)
+{
+  tuner t = { 0 };
+  size_t size;
+  int index;
+  int i;
+
+  /* without larger blocks the limit is all there is */
+  for (i = 0; i < 3; ++i)
+    {
+      size = tuner_block_size (&t, LIMIT, 1000, MAX_LINES, false, &index);
+      check (LIMIT == size && 0 == index);
+      scan (&t, index, 10, size, 1e-2, 1e-4);
+    }
+
+  /* one scan per candidate, then the fastest */
+  for (i = 0; i < TUNER_SIZES; ++i)
+    {
+      size = tuner_block_size (&t, LIMIT, 4000, MAX_LINES, true, &index);
+      check (i == index && (size_t) LIMIT << i == size);
+      scan (&t, index, 10, size, 1e-2, 1e-4);
+    }
+  size = tuner_block_size (&t, LIMIT, 4000, MAX_LINES, true, &index);
+  check (TUNER_SIZES - 1 == index);
+
+  /* a different line size starts over */
+  tuner_block_size (&t, LIMIT, 5000, MAX_LINES, true, &index);
+  check (0 == index);
+
+  /* and so does a different limit */
+  tuner_block_size (&t, LIMIT / 2, 5000, MAX_LINES, true, &index);
+  check (0 == index);
+  check (LIMIT / 2 == tuner_request_size (&t, 0));
+}
+
+static void
+test_line_limit (void)
+{
+  tuner t = { 0 };
+  size_t size;
+  int index;
+  int i;
+
+  /* 131 lines at the limit, the larger candidates both come to 254 */
+  for (i = 0; i < 2; ++i)
+    {
+      size = tuner_block_size (&t, LIMIT, 1000, 254, true, &index);
+      check (i == index);
+      scan (&t, index, 10, size, 1e-2, 1e-4);
+    }
+  check (254 * 1000 == size);
+  size = tuner_block_size (&t, LIMIT, 1000, 254, true, &index);
+  check (1 == index && 254 * 1000 == size);
+
+  /* a lower limit leaves a single candidate */
+  for (i = 0; i < 3; ++i)
+    {
+      size = tuner_block_size (&t, LIMIT, 1000, 32, true, &index);
+      check (0 == index && 32 * 1000 == size);
+      scan (&t, index, 10, size, 1e-2, 1e-4);
+    }
+
+  /* and so do lines that do not fit in any of the blocks */
+  for (i = 0; i < 3; ++i)
+    {
+      tuner_block_size (&t, LIMIT, 5 * LIMIT, 254, true, &index);
+      check (0 == index);
+      scan (&t, index, 10, 5 * LIMIT, 1e-2, 1e-4);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  test_request_size ();
+  test_block_size ();
+  test_line_limit ();
+
+  return check_status ();
+}
@@ -0,0 +1,327 @@
+/*  usb-read-ahead.c -- unit tests for asynchronous USB bulk reads
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan!'s SANE backend test suite.
+ *
+ *  Image Scan!'s SANE backend test suite is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libusb.h"
+#include "../../sanei/sanei_usb_read_ahead.h"
+#include "check.h"
+
+
+/*  The mock device sends a stream of bytes, each one more than the
+ *  one before, in packets that the test queues with transmit().  The mock
+ *  host controller completes submitted transfers in order, one per
+ *  call to libusb_handle_events_timeout(), and just waits when there
+ *  is nothing to deliver.
+ */
+
+#define MAX_XFERS  16
+#define MAX_EVENTS 64
+
+typedef struct
+{
+  int length;                   /* bytes, or -1 for a stall */
+} event;
+
+static struct libusb_transfer *queue[MAX_XFERS];
+static int queued;
+
+static event events[MAX_EVENTS];
+static int num_events;
+
+static unsigned char next_byte;
+
+static int allocs;
+static int frees;
+static int cancels;
+static int halts_cleared;
+
+/* a transfer that ignores cancellation, as seen with some broken
+   host controller drivers */
+static struct libusb_transfer *hung;
+
+static void
+transmit (int length)
+{
+  events[num_events++].length = length;
+}
+
+static void
+complete (int i, enum libusb_transfer_status status, int length)
+{
+  struct libusb_transfer *xfer = queue[i];
+  int k;
+
+  for (k = 0; k < length; ++k)
+    xfer->buffer[k] = next_byte++;
+  xfer->actual_length = length;
+  xfer->status = status;
+
+  --queued;
+  memmove (queue + i, queue + i + 1, (queued - i) * sizeof (*queue));
+  xfer->callback (xfer);
+}
+
+struct libusb_transfer *
+libusb_alloc_transfer (int iso_packets)
+{
+  ++allocs;
+  return calloc (1, sizeof (struct libusb_transfer));
+}
+
+void
+libusb_free_transfer (struct libusb_transfer *transfer)
+{
+  ++frees;
+  free (transfer);
+}
+
+int
+libusb_submit_transfer (struct libusb_transfer *transfer)
+{
+  if (MAX_XFERS == queued) return -1;
+  queue[queued++] = transfer;
+  return 0;
+}
+
+int
+libusb_cancel_transfer (struct libusb_transfer *transfer)
+{
+  int i;
+
+  for (i = 0; i < queued; ++i)
+    if (queue[i] == transfer)
+      {
+        ++cancels;
+        if (transfer != hung)
+          transfer->status = LIBUSB_TRANSFER_CANCELLED;
+        return 0;
+      }
+  return -5;                    /* LIBUSB_ERROR_NOT_FOUND */
+}
+
+int
+libusb_handle_events_timeout (libusb_context *ctx, struct timeval *tv)
+{
+  int i;
+
+  for (i = 0; i < queued; ++i)
+    if (LIBUSB_TRANSFER_CANCELLED == queue[i]->status)
+      {
+        complete (i, LIBUSB_TRANSFER_CANCELLED, 0);
+        return 0;
+      }
+
+  if (0 == queued || 0 == num_events)
+    {
+      usleep (tv->tv_sec * 1000000 + tv->tv_usec);
+      return 0;
+    }
+
+  if (0 > events[0].length)
+    complete (0, LIBUSB_TRANSFER_STALL, 0);
+  else
+    {
+      int length = events[0].length;
+
+      if (length > queue[0]->length)
+        {
+          /* the rest of the packet goes into the next transfer */
+          events[0].length -= queue[0]->length;
+          complete (0, LIBUSB_TRANSFER_COMPLETED, queue[0]->length);
+          return 0;
+        }
+      complete (0, LIBUSB_TRANSFER_COMPLETED, length);
+    }
+
+  --num_events;
+  memmove (events, events + 1, num_events * sizeof (*events));
+  return 0;
+}
+
+int
+libusb_clear_halt (libusb_device_handle *dev, unsigned char endpoint)
+{
+  ++halts_cleared;
+  return 0;
+}
+
+
+/*  Reads size bytes and checks that they continue the stream.
+ */
+static unsigned char expected;
+
+static SANE_Status
+read_some (sanei_usb_read_ahead *ra, size_t *size, unsigned int timeout)
+{
+  SANE_Byte buf[4096];
+  SANE_Status status;
+  size_t i;
+
+  status = sanei_usb_read_ahead_read (ra, buf, size, timeout);
+  for (i = 0; i < *size; ++i)
+    check (buf[i] == expected++);
+  return status;
+}
+
+static void
+test_stream (void)
+{
+  sanei_usb_read_ahead *ra = sanei_usb_read_ahead_new (NULL, NULL, 0x81,
+                                                       4, 512);
+  SANE_Status status;
+  size_t n;
+
+  check (ra);
+  check (4 == queued);
+
+  /* a single read never returns data from more than one transfer */
+  transmit (100);
+  n = 64;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 64 == n);
+  n = 64;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 36 == n);
+  check (4 == queued);
+
+  /* transfers fill up while the caller is busy elsewhere */
+  transmit (1300);
+  transmit (14);
+  libusb_handle_events_timeout (NULL, &(struct timeval) {0, 0});
+  libusb_handle_events_timeout (NULL, &(struct timeval) {0, 0});
+  libusb_handle_events_timeout (NULL, &(struct timeval) {0, 0});
+  libusb_handle_events_timeout (NULL, &(struct timeval) {0, 0});
+  check (0 == queued);
+
+  n = 2048;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 512 == n);
+  check (1 == queued);
+  n = 2048;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 512 == n);
+  n = 2048;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 276 == n);
+  n = 2048;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 14 == n);
+  check (4 == queued);
+
+  /* zero length packet */
+  transmit (0);
+  n = 2048;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_EOF == status && 0 == n);
+
+  sanei_usb_read_ahead_free (ra);
+  check (0 == queued);
+  check (4 == cancels);
+  check (allocs == frees);
+}
+
+static void
+test_errors (void)
+{
+  sanei_usb_read_ahead *ra = sanei_usb_read_ahead_new (NULL, NULL, 0x81,
+                                                       2, 512);
+  SANE_Status status;
+  size_t n;
+
+  check (ra);
+
+  /* nothing to read */
+  n = 16;
+  status = read_some (ra, &n, 20);
+  check (SANE_STATUS_IO_ERROR == status && 0 == n);
+  check (2 == queued);
+
+  /* the data arrives after all */
+  transmit (16);
+  n = 16;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 16 == n);
+
+  /* a stalled endpoint is cleared and reading carries on */
+  transmit (-1);
+  transmit (8);
+  n = 16;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_IO_ERROR == status && 0 == n);
+  check (1 == halts_cleared);
+  check (2 == queued);
+  n = 16;
+  status = read_some (ra, &n, 1000);
+  check (SANE_STATUS_GOOD == status && 8 == n);
+
+  sanei_usb_read_ahead_free (ra);
+  check (0 == queued);
+  check (allocs == frees);
+}
+
+/*  Kept reachable so that the deliberately leaked memory does not
+ *  show up as a leak under the address sanitizer.
+ */
+static sanei_usb_read_ahead *leaked;
+
+static void
+test_hung_transfer (void)
+{
+  int allocated = allocs;
+  int freed = frees;
+
+  leaked = sanei_usb_read_ahead_new (NULL, NULL, 0x81, 2, 512);
+  check (leaked);
+  check (2 == queued);
+
+  /* the second transfer never calls back, not even after cancelling */
+  hung = queue[1];
+  sanei_usb_read_ahead_free (leaked);
+  check (2 == allocs - allocated);
+  check (1 == frees - freed);
+  check (1 == queued && hung == queue[0]);
+
+  /* its late completion must not write into freed memory */
+  complete (0, LIBUSB_TRANSFER_CANCELLED, 0);
+  check (0 == queued);
+}
+
+int
+main (int argc, char *argv[])
+{
+  check (!sanei_usb_read_ahead_new (NULL, NULL, 0x81, 0, 512));
+  test_stream ();
+  test_errors ();
+  test_hung_transfer ();
+
+  return check_status ();
+}
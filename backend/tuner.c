@@ -0,0 +1,248 @@
+/*  tuner.c -- transfer size auto-tuning
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+|iscan
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of the SANE backend distributed with Image Scan!
+ *
+ *  Image Scan!'s SANE backend is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Linking Image Scan!'s SANE backend statically or dynamically with
+ *  other modules is making a combined work based on this SANE backend.
+ *  Thus, the terms and conditions of the GNU General Public License
+ *  cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  SANE frontends that communicate with Image Scan!'s SANE backend
+ *  solely through the SANE Application Programming Interface,
+ *  regardless of the license terms of these SANE frontends, and to
+ *  copy and distribute the resulting combined work under terms of your
+ *  choice, provided that every copy of the combined work is
+ *  accompanied by a complete copy of the source code of Image Scan!'s
+ *  SANE backend (the version of Image Scan!'s SANE backend used to
+ *  produce the combined work), being distributed under the terms of
+ *  the GNU General Public License plus this exception.  An independent
+ *  module is a module which is not derived from or based on Image
+ *  Scan!'s SANE backend.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  independent modules that communicate with Image Scan!'s SANE
+ *  backend solely through the "Interpreter" interface, regardless of
+ *  the license terms of these independent modules, and to copy and
+ *  distribute the resulting combined work under terms of your choice,
+ *  provided that every copy of the combined work is accompanied by a
+ *  complete copy of the source code of Image Scan!'s SANE backend (the
+ *  version of Image Scan!'s SANE backend used to produce the combined
+ *  work), being distributed under the terms of the GNU General Public
+ *  License plus this exception.  An independent module is a module
+ *  which is not derived from or based on Image Scan!'s SANE backend.
+ *
+ *  Note that people who make modified versions of Image Scan!'s SANE
+ *  backend are not obligated to grant special exceptions for their
+ *  modified versions; it is their choice whether to do so.  The GNU
+ *  General Public License gives permission to release a modified
+ *  version without this exception; this exception also makes it
+ *  possible to release a modified version which carries forward this
+ *  exception.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "tuner.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#include "message.h"
+
+/*! Number of blocks to measure each request size candidate with.
+ */
+#define TUNER_PROBES 4
+
+/*! A candidate has to beat the current choice by this factor.
+ *  This keeps us with the tried and tested defaults, the first
+ *  candidates, unless something else is noticeably faster.
+ */
+#define TUNER_MARGIN 1.05
+
+/*! Tuners are shared by all devices of a model and get used from the
+ *  image data read-ahead threads as well.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double
+rate (const tuner_sample *sample)
+{
+  return (0 < sample->seconds ? sample->bytes / sample->seconds : 0);
+}
+
+static int
+fastest (const tuner_sample *sample, int n)
+{
+  int i;
+  int best = 0;
+
+  for (i = 1; i < n; ++i)
+    {
+      if (rate (sample + i) > TUNER_MARGIN * rate (sample + best))
+        best = i;
+    }
+  return best;
+}
+
+/*! Returns the number of lines a block of \a size bytes ends up with.
+ */
+static size_t
+lines (const tuner *self, size_t size)
+{
+  size_t n = size / self->line_bytes;
+
+  if (1 > n) n = 1;
+  if (self->max_lines < n) n = self->max_lines;
+  return n;
+}
+
+/*! Starts measurements afresh for a new \a limit or line size.
+ *  Request sizes are taken down from the channel's limit, the block
+ *  sizes up from it.  The limit itself comes first in both cases as
+ *  that is what has been used all along.  Block sizes are capped at
+ *  \a max_lines and those that give the same line count as a smaller
+ *  one are dropped, as measuring them would only repeat a scan.
+ */
+static void
+tuner_reset (tuner *self, size_t limit, size_t line_bytes,
+             size_t max_lines)
+{
+  int i;
+
+  memset (self, 0, sizeof (*self));
+  self->limit = limit;
+  self->line_bytes = line_bytes;
+  self->max_lines = max_lines;
+
+  for (i = 0; i < TUNER_SIZES; ++i)
+    {
+      size_t size = limit << i;
+
+      self->request[i].size = limit >> i;
+
+      if (max_lines * line_bytes < size)
+        size = max_lines * line_bytes;
+      if (0 < self->blocks
+          && (lines (self, size)
+              == lines (self, self->block[self->blocks - 1].size)))
+        continue;
+      self->block[self->blocks++].size = size;
+    }
+}
+
+/*! Picks the block size to use for the next scan.
+ *  The block size candidates are tried one scan at a time and the
+ *  fastest one is used once all of them have been measured.  Only
+ *  the first candidate is considered unless \a larger is set.  No
+ *  candidate holds more than \a max_lines lines.  The candidate's
+ *  \a index needs to be passed to tuner_record().
+ */
+size_t
+tuner_block_size (tuner *self, size_t limit, size_t line_bytes,
+                  size_t max_lines, bool larger, int *index)
+{
+  size_t size;
+  int n;
+  int i;
+
+  require (self && index && 0 < line_bytes && 0 < max_lines);
+
+  pthread_mutex_lock (&lock);
+  if (limit != self->limit || line_bytes != self->line_bytes
+      || max_lines != self->max_lines)
+    tuner_reset (self, limit, line_bytes, max_lines);
+
+  n = (larger ? self->blocks : 1);
+
+  for (i = 0; i < n && 0 < self->block[i].seconds; ++i)
+    ;
+  if (n == i)
+    i = fastest (self->block, n);
+  *index = i;
+  size = self->block[i].size;
+  log_info ("block size %zd (%s)", size,
+            (0 < self->block[i].seconds ? "tuned" : "probing"));
+  pthread_mutex_unlock (&lock);
+
+  return size;
+}
+
+/*! Picks the request size to read image block \a block_no with.
+ *  The first block of a scan includes the time it takes the device
+ *  to get going and is always read with the channel's limit.  The
+ *  blocks after that cycle through the candidates until all have
+ *  been measured often enough.
+ */
+size_t
+tuner_request_size (tuner *self, unsigned int block_no)
+{
+  size_t size;
+  int i;
+
+  require (self);
+
+  pthread_mutex_lock (&lock);
+  i = (0 < block_no ? (block_no - 1) % TUNER_SIZES : 0);
+  if (0 < block_no && TUNER_PROBES <= self->request[i].count)
+    i = fastest (self->request, TUNER_SIZES);
+  size = self->request[i].size;
+  pthread_mutex_unlock (&lock);
+
+  return size;
+}
+
+/*! Adds a measurement of \a bytes read in \a seconds using \a request
+ *  sized reads during a scan with the block size at \a index.
+ */
+void
+tuner_record (tuner *self, int index, size_t request, size_t bytes,
+              double seconds)
+{
+  int i;
+
+  require (self && 0 <= index && TUNER_SIZES > index);
+
+  if (0 >= seconds) return;
+
+  pthread_mutex_lock (&lock);
+  for (i = 0; i < TUNER_SIZES; ++i)
+    {
+      if (request == self->request[i].size)
+        {
+          self->request[i].bytes   += bytes;
+          self->request[i].seconds += seconds;
+          ++self->request[i].count;
+        }
+    }
+  self->block[index].bytes   += bytes;
+  self->block[index].seconds += seconds;
+  ++self->block[index].count;
+  pthread_mutex_unlock (&lock);
+
+  log_data ("%zd bytes in %.6fs with %zd byte requests", bytes, seconds,
+            request);
+}
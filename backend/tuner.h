@@ -0,0 +1,138 @@
+/*  tuner.h -- transfer size auto-tuning
+ *  Copyright (C) 2009  SEIKO EPSON CORPORATION
+ *
+ *  License: GPLv2+|iscan
+ *  Authors: AVASYS CORPORATION
+ *
+ *  This file is part of the SANE backend distributed with Image Scan!
+ *
+ *  Image Scan!'s SANE backend is free software.
+ *  You can redistribute it and/or modify it under the terms of the GNU
+ *  General Public License as published by the Free Software Foundation;
+ *  either version 2 of the License or at your option any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *  You ought to have received a copy of the GNU General Public License
+ *  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *  Linking Image Scan!'s SANE backend statically or dynamically with
+ *  other modules is making a combined work based on this SANE backend.
+ *  Thus, the terms and conditions of the GNU General Public License
+ *  cover the whole combination.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  SANE frontends that communicate with Image Scan!'s SANE backend
+ *  solely through the SANE Application Programming Interface,
+ *  regardless of the license terms of these SANE frontends, and to
+ *  copy and distribute the resulting combined work under terms of your
+ *  choice, provided that every copy of the combined work is
+ *  accompanied by a complete copy of the source code of Image Scan!'s
+ *  SANE backend (the version of Image Scan!'s SANE backend used to
+ *  produce the combined work), being distributed under the terms of
+ *  the GNU General Public License plus this exception.  An independent
+ *  module is a module which is not derived from or based on Image
+ *  Scan!'s SANE backend.
+ *
+ *  As a special exception, the copyright holders of Image Scan!'s SANE
+ *  backend give you permission to link Image Scan!'s SANE backend with
+ *  independent modules that communicate with Image Scan!'s SANE
+ *  backend solely through the "Interpreter" interface, regardless of
+ *  the license terms of these independent modules, and to copy and
+ *  distribute the resulting combined work under terms of your choice,
+ *  provided that every copy of the combined work is accompanied by a
+ *  complete copy of the source code of Image Scan!'s SANE backend (the
+ *  version of Image Scan!'s SANE backend used to produce the combined
+ *  work), being distributed under the terms of the GNU General Public
+ *  License plus this exception.  An independent module is a module
+ *  which is not derived from or based on Image Scan!'s SANE backend.
+ *
+ *  Note that people who make modified versions of Image Scan!'s SANE
+ *  backend are not obligated to grant special exceptions for their
+ *  modified versions; it is their choice whether to do so.  The GNU
+ *  General Public License gives permission to release a modified
+ *  version without this exception; this exception also makes it
+ *  possible to release a modified version which carries forward this
+ *  exception.
+ */
+
+
+#ifndef tuner_h_included
+#define tuner_h_included
+
+/*! \file
+ *  \brief  Transfer size auto-tuning.
+ *
+ *  How much image data to ask for in one go is a trade-off between
+ *  the per request overhead of the link and how long the device and
+ *  the host sit idle waiting for each other.  The best values differ
+ *  per model and per connection, so rather than guessing, a tuner
+ *  measures the effective throughput of a few candidate sizes while
+ *  image data is being read and settles on the fastest.
+ *
+ *  Two sizes are tuned.  The request size is the most a channel reads
+ *  in a single request.  It is probed during the first blocks of each
+ *  scan.  The block size is the amount of image data per block, set
+ *  via the line count.  That can only change between scans, so each
+ *  scan tries one block size until all have been measured.  Block
+ *  sizes beyond the channel's request limit are only tried with the
+ *  extended (FS) commands, where the device reports the block size it
+ *  actually uses.  Block sizes that come to the same number of lines
+ *  once the device's line count limit is applied are only tried once.
+ *
+ *  Throughput depends on the scan settings, so measurements are only
+ *  compared for scans with the same number of bytes per line.  The
+ *  tuner itself is kept with the model info so that results carry
+ *  over from one scan and one device handle to the next.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include "defines.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define TUNER_SIZES 3
+
+  typedef struct
+  {
+    size_t size;
+    double bytes;
+    double seconds;
+    unsigned int count;         /* number of measurements */
+  } tuner_sample;
+
+  typedef struct
+  {
+    size_t limit;               /* the channel's max_request_size */
+    size_t line_bytes;          /* bytes per line the samples are for */
+    size_t max_lines;           /* most lines the device puts in a block */
+    int    blocks;              /* number of distinct block sizes */
+
+    tuner_sample request[TUNER_SIZES];
+    tuner_sample block[TUNER_SIZES];
+  } tuner;
+
+  size_t tuner_block_size (tuner *self, size_t limit, size_t line_bytes,
+                           size_t max_lines, bool larger, int *index);
+  size_t tuner_request_size (tuner *self, unsigned int block_no);
+  void   tuner_record (tuner *self, int index, size_t request,
+                       size_t bytes, double seconds);
+
+#ifdef __cplusplus
+}       /* extern "C" */
+#endif
+
+#endif  /* !defined (tuner_h_included) */
@@ -0,0 +1,117 @@
+/* batch-job.cc -- jobs for unattended scanning
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "batch-job.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+bool
+parse_option (job& j, const string& opt)
+{
+  string::size_type eq = opt.find ('=');
+  string name  = opt.substr (0, eq);
+  string value = (string::npos == eq ? string () : opt.substr (eq + 1));
+
+  if ("--device" == name)
+    j.device = value;
+  else if ("--source" == name)
+    j.source = value;
+  else if ("--mode" == name)
+    j.mode = value;
+  else if ("--resolution" == name)
+    j.resolution = atol (value.c_str ());
+  else if ("--format" == name)
+    j.format = value;
+  else if ("--output" == name)
+    j.output = value;
+  else if ("--pages" == name)
+    j.pages = atol (value.c_str ());
+  else if ("--binding" == name)
+    j.top_binding = ("top" == value);
+  else if ("--area" == name)
+    {
+      if (4 != sscanf (value.c_str (), "%lf,%lf,%lf,%lf",
+                       &j.area[0], &j.area[1], &j.area[2], &j.area[3]))
+        return false;
+      j.whole_area = false;
+    }
+  else
+    return false;
+
+  return true;
+}
+
+// Cuts a comment off the end of line.  A `#' inside a word, such as
+// in "--output=scan-###.pdf", is left alone.
+static string
+strip_comment (const string& line)
+{
+  string::size_type pos = line.find ('#');
+
+  while (string::npos != pos
+         && 0 != pos && !isspace ((unsigned char) line[pos - 1]))
+    pos = line.find ('#', pos + 1);
+
+  return line.substr (0, pos);
+}
+
+bool
+read_jobs (std::istream& in, const job& defaults,
+           vector<job>& jobs, long& lineno, string& opt)
+{
+  string line;
+
+  lineno = 0;
+  while (std::getline (in, line))
+    {
+      ++lineno;
+
+      std::istringstream words (strip_comment (line));
+      job j = defaults;
+      bool empty = true;
+
+      while (words >> opt)
+        {
+          empty = false;
+          if (!parse_option (j, opt))
+            return false;
+        }
+      if (!empty)
+        jobs.push_back (j);
+    }
+  return true;
+}
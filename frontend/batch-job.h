@@ -0,0 +1,66 @@
+/* batch-job.h -- jobs for unattended scanning		-*- C++ -*-
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+ */
+
+#ifndef ISCAN_BATCH_JOB_H
+#define ISCAN_BATCH_JOB_H
+
+#include <istream>
+#include <string>
+#include <vector>
+
+struct job
+{
+  std::string device;
+  std::string source;
+  std::string mode;
+  long        resolution;
+  double      area[4];          // left, top, width, height [inch]
+  bool        whole_area;
+  std::string format;
+  std::string output;
+  long        pages;
+  bool        top_binding;
+
+  job (void)
+    : source ("flatbed"), mode ("color-photo"), resolution (300),
+      whole_area (true), format ("png"), pages (0), top_binding (false)
+  {
+    area[0] = area[1] = area[2] = area[3] = 0.0;
+  }
+};
+
+// Updates j with a single "--name=value" option.  Returns false if
+// the option is not a job option.
+bool parse_option (job& j, const std::string& opt);
+
+// Appends one job per non-empty line of in to jobs, starting from the
+// defaults.  A `#' at the start of a word starts a comment, so that it
+// can still be used in file names.  Returns false on an invalid
+// option, leaving its line number in lineno and the option in opt.
+bool read_jobs (std::istream& in, const job& defaults,
+                std::vector<job>& jobs, long& lineno, std::string& opt);
+
+#endif /* !defined (ISCAN_BATCH_JOB_H) */
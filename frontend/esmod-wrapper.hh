@@ -69,16 +69,7 @@ namespace iscan
     scale (struct resize_img_info parms);
   };
 
-  // WARNING: These quite likely modify global state in libesmod.
-  void auto_expose (int, int, const pisa_image_info&, const _rectL&,
-                    marquee&, bool, bool is_dumb);
-  void build_LUT (int, int, const settings&, marquee&, bool is_dumb);
-
-  esmod::type_type esmod_film_type (int iscan_film_type);
   esmod::type_type esmod_focus_type (int iscan_focus_type);
-  esmod::type_type esmod_image_type (int iscan_image_type);
-  esmod::type_type esmod_option_type (int iscan_option_type);
-  esmod::type_type esmod_pixel_type (int iscan_pixel_type);
   esmod::type_type esmod_scale_type (int iscan_scale_type);
 
 } // namespace iscan
@@ -118,56 +109,6 @@ iscan::scale::scale (const struct resize_img_info info)
 {
 }
 
-inline void
-iscan::auto_expose (int option_type, int film_type,
-                    const pisa_image_info& info, const _rectL& r,
-                    marquee& m, bool is_doc, bool is_dumb)
-{
-  esmod::auto_expose (esmod_option_type (option_type),
-                      esmod_film_type (film_type), info.m_img,
-                      info.m_width, info.m_height, info.m_rowbytes,
-                      r.top, r.left, r.bottom, r.right,
-                      &m.gamma, &m.highlight, &m.shadow, &m.graybalance,
-                      m.film_gamma, m.film_yp, m.grayl,
-                      is_doc, is_dumb);
-}
-
-inline void
-iscan::build_LUT (int option_type, int film_type, const settings& s,
-                  marquee& m, bool is_dumb)
-{
-  esmod::build_LUT (esmod_option_type (option_type),
-                    esmod_film_type (film_type),
-                    esmod_pixel_type (s.imgtype.pixeltype),
-                    esmod_image_type (s.imgtype.ae_option),
-                    m.gamma, m.highlight, m.shadow, m.graybalance,
-                    m.film_gamma, m.film_yp, m.grayl,
-                    m.gamma_table[0], m.gamma_table[1], m.lut.gamma_r,
-                    is_dumb);
-}
-
-inline esmod::type_type
-iscan::esmod_film_type (int iscan_film_type)
-{
-  esmod::type_type val;
-
-  switch (iscan_film_type)
-    {
-    case PISA_FT_POSI:
-      val = ESMOD_FILM_POSITIVE;
-      break;
-    case PISA_FT_NEGA:
-      val = ESMOD_FILM_NEGATIVE;
-      break;
-    case PISA_FT_REFLECT:
-      val = -1;
-      break;
-    default:
-      throw;
-    }
-  return val;
-}
-
 inline esmod::type_type
 iscan::esmod_focus_type (int iscan_focus_type)
 {
@@ -190,73 +131,6 @@ iscan::esmod_focus_type (int iscan_focus_type)
   return val;
 }
 
-inline esmod::type_type
-iscan::esmod_image_type (int iscan_image_type)
-{
-  esmod::type_type val;
-
-  switch (iscan_image_type)
-    {
-    case PISA_AE_PHOTO:
-      val = ESMOD_IMAGE_PHOTO;
-      break;
-    case PISA_AE_DOC:
-      val = ESMOD_IMAGE_DOCUMENT;
-      break;
-    case PISA_AE_GRAYED:
-      val = ESMOD_IMAGE_LINE_ART;
-      break;
-    default:
-      throw;
-    }
-  return val;
-}
-
-inline esmod::type_type
-iscan::esmod_option_type (int iscan_option_type)
-{
-  esmod::type_type val;
-
-  switch (iscan_option_type)
-    {
-    case PISA_OP_FLATBED:
-      val = ESMOD_OPTION_FLATBED;
-      break;
-    case PISA_OP_ADF:
-    case PISA_OP_ADFDPLX:
-      val = ESMOD_OPTION_ADF;
-      break;
-    case PISA_OP_TPU:
-      val = ESMOD_OPTION_TPU;
-      break;
-    default:
-      throw;
-    }
-  return val;
-}
-
-inline esmod::type_type
-iscan::esmod_pixel_type (int iscan_pixel_type)
-{
-  esmod::type_type val;
-
-  switch (iscan_pixel_type)
-    {
-    case PISA_PT_BW:
-      val = ESMOD_PIXEL_MONO;
-      break;
-    case PISA_PT_GRAY:
-      val = ESMOD_PIXEL_GRAY;
-      break;
-    case PISA_PT_RGB:
-      val = ESMOD_PIXEL_RGB;
-      break;
-    default:
-      throw;
-    }
-  return val;
-}
-
 inline esmod::type_type
 iscan::esmod_scale_type (int iscan_scale_type)
 {
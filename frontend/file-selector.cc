@@ -134,17 +134,15 @@ _change_format (GtkWidget *, struct menu_info *id)
       gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (id->widget[0]), false);
     }
 
-  // adjust "binding edge" selector sensitivity
-  // We only support this for file formats (i.e. `imgstream` classes)
-  // that support "easy" rotation.  Yes, this is utterly flawed.  The
-  // "binding edge" selector _should_ be in the main part of the GUI.
-  // It has no dependency on saving to file whatsoever, it is an issue
-  // that depends on device capabilities and document characteristics
-  // only.
-  make_active = (iscan::PDF == id->fs->get_type ());
-  gtk_widget_set_sensitive (id->widget[1], make_active);
-  gtk_widget_set_sensitive (id->widget[2], make_active);
-  gtk_widget_set_sensitive (id->widget[3], make_active);
+  // "binding edge" selector sensitivity
+  // All file formats support rotation of back pages now, either via
+  // the format itself or by spooling the page, so the selector stays
+  // active.  It _should_ be in the main part of the GUI.  It has no
+  // dependency on saving to file whatsoever, it is an issue that
+  // depends on device capabilities and document characteristics only.
+  gtk_widget_set_sensitive (id->widget[1], true);
+  gtk_widget_set_sensitive (id->widget[2], true);
+  gtk_widget_set_sensitive (id->widget[3], true);
 }
 
 static void
@@ -0,0 +1,469 @@
+/* iscan-batch.cc -- unattended scanning from the command line
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+ */
+
+// This driver runs the same acquisition and encoding path as the
+// `iscan' file destination, minus the preview, dialogs and event
+// pumping.  Jobs are given as options on the command line or, one per
+// line, in a job file.  Options given on the command line serve as
+// defaults for the jobs in the file.
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <sys/time.h>
+
+#include <exception>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "batch-job.h"
+#include "pisa_scan_manager.h"
+#include "pisa_settings.h"
+#include "pisa_marquee.h"
+#include "pisa_error.h"
+#include "imgstream.hh"
+
+using std::string;
+using std::vector;
+
+#define num_of(p)  (sizeof (p) / sizeof (*p))
+
+struct mode_entry
+{
+  const char *name;
+  imagetype   type;
+};
+
+// mirrors the image type menu of the main window
+static const mode_entry mode_list[] =
+{
+  { "color-photo",    { 0, PISA_PT_RGB,  PISA_BD_8, PISA_DESCREEN_OFF,
+                        PISA_AE_PHOTO,  PISA_DO_NONE, PISA_MO_NONE,
+                        PISA_HT_NONE } },
+  { "color-document", { 0, PISA_PT_RGB,  PISA_BD_8, PISA_DESCREEN_ON,
+                        PISA_AE_DOC,    PISA_DO_NONE, PISA_MO_NONE,
+                        PISA_HT_NONE } },
+  { "gray-photo",     { 0, PISA_PT_GRAY, PISA_BD_8, PISA_DESCREEN_OFF,
+                        PISA_AE_PHOTO,  PISA_DO_NONE, PISA_MO_NONE,
+                        PISA_HT_NONE } },
+  { "gray-document",  { 0, PISA_PT_GRAY, PISA_BD_8, PISA_DESCREEN_ON,
+                        PISA_AE_DOC,    PISA_DO_NONE, PISA_MO_NONE,
+                        PISA_HT_NONE } },
+  { "lineart",        { 0, PISA_PT_BW,   PISA_BD_1, PISA_DESCREEN_OFF,
+                        PISA_AE_GRAYED, PISA_DO_NONE, PISA_MO_NONE,
+                        PISA_HT_NONE } },
+};
+
+struct format_entry
+{
+  const char         *name;
+  iscan::file_format  format;
+  bool                multi_page;
+};
+
+static const format_entry format_list[] =
+{
+  { "pnm",  iscan::PNM, false },
+  { "png",  iscan::PNG, false },
+  { "jpeg", iscan::JPG, false },
+  { "jpg",  iscan::JPG, false },
+  { "pdf",  iscan::PDF, true  },
+  { "tiff", iscan::TIF, true  },
+  { "tif",  iscan::TIF, true  },
+};
+
+static const char *program = "iscan-batch";
+static bool verbose = false;
+
+static void
+usage (FILE *fp)
+{
+  fprintf (fp,
+           "Usage: %s [OPTION]... [--job-file=FILE]\n"
+           "Scan documents without user interaction.\n"
+           "\n"
+           "  --device=NAME        SANE device to use (default: first EPSON)\n"
+           "  --source=SOURCE      flatbed, adf, adf-duplex, tpu-positive or\n"
+           "                       tpu-negative (default: flatbed)\n"
+           "  --mode=MODE          color-photo, color-document, gray-photo,\n"
+           "                       gray-document or lineart\n"
+           "  --resolution=DPI     scan resolution (default: 300)\n"
+           "  --area=X,Y,W,H       scan area in inches (default: maximum)\n"
+           "  --format=FORMAT      pnm, png, jpeg, pdf or tiff (default: png)\n"
+           "  --output=FILE        output file, use a run of `#' in the name\n"
+           "                       to get one numbered file per page\n"
+           "  --pages=N            stop after N pages (default: 0, i.e. until\n"
+           "                       the document feeder is empty)\n"
+           "  --binding=EDGE       left or top, for duplex back sides\n"
+           "  --job-file=FILE      run one job per line of FILE, a word that\n"
+           "                       starts with `#' begins a comment\n"
+           "  --verbose            report per page and per job timings\n"
+           "  --help               display this message and exit\n",
+           program);
+}
+
+static double
+now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static bool
+select_source (scan_manager& sm, const string& source)
+{
+  if ("flatbed" == source && sm.has_flatbed ())
+    sm.select_flatbed ();
+  else if ("adf" == source && sm.has_adf ())
+    sm.select_adf (false);
+  else if ("adf-duplex" == source && sm.has_duplex ())
+    sm.select_adf (true);
+  else if ("tpu-positive" == source && sm.has_tpu ())
+    sm.select_tpu (true);
+  else if ("tpu-negative" == source && sm.has_tpu ())
+    sm.select_tpu (false);
+  else
+    return false;
+
+  return true;
+}
+
+// Scans a single page into is.  Returns false when the document
+// feeder ran out of paper before the page was started.
+static bool
+scan_page (scan_manager& sm, iscan::imgstream& is, const settings& set,
+           bool first_time_around, long *rows)
+{
+  int width, height;
+
+  try
+    {
+      sm.init_scan (&width, &height, first_time_around);
+    }
+  catch (pisa_error& oops)
+    {
+      if (!first_time_around
+          && PISA_STATUS_NO_DOCS == oops.get_error_id ())
+        return false;
+      throw;
+    }
+
+  int rowbytes;
+  iscan::colour_space cs;
+
+  switch (set.imgtype.pixeltype)
+    {
+    case PISA_PT_RGB:
+      rowbytes = width * 3;
+      cs = iscan::RGB;
+      break;
+    case PISA_PT_GRAY:
+      rowbytes = width;
+      cs = iscan::gray;
+      break;
+    case PISA_PT_BW:
+      rowbytes = (width + 7) / 8;
+      cs = iscan::mono;
+      break;
+    default:
+      sm.acquire_image (0, 0, 1, 1);
+      throw pisa_error (PISA_ERR_PARAMETER);
+    }
+
+  is.next ();
+  is.size (width, height);
+  is.depth (PISA_PT_BW == set.imgtype.pixeltype ? 1 : 8);
+  is.colour (cs);
+  is.resolution (set.resolution, set.resolution);
+
+  // The scan_manager filters deliver a row per call, but the image
+  // stream is fed in strips to keep its per call overhead down.
+  const int strip = 64;
+  unsigned char *img = new unsigned char[rowbytes * strip];
+
+  try
+    {
+      for (int i = 0; i < height; i += strip)
+        {
+          int n = (height - i < strip ? height - i : strip);
+
+          for (int k = 0; k < n; ++k)
+            sm.acquire_image (img + k * rowbytes, rowbytes, 1, 0);
+          is.write ((const char *) img, rowbytes * n);
+        }
+    }
+  catch (...)
+    {
+      delete[] img;
+      throw;
+    }
+  delete[] img;
+
+  sm.acquire_image (0, 1, 1, 0);
+  is.flush ();
+
+  *rows += height;
+  return true;
+}
+
+static int
+run_job (scan_manager& sm, const job& j, string& device, bool& opened)
+{
+  const mode_entry *mode = mode_list;
+  const mode_entry *mode_end = mode_list + num_of (mode_list);
+  while (mode != mode_end && j.mode != mode->name) ++mode;
+
+  const format_entry *fmt = format_list;
+  const format_entry *fmt_end = format_list + num_of (format_list);
+  while (fmt != fmt_end && j.format != fmt->name) ++fmt;
+
+  if (mode == mode_end || fmt == fmt_end
+      || j.output.empty () || j.resolution <= 0)
+    {
+      fprintf (stderr, "%s: incomplete or invalid job for `%s'\n",
+               program, j.output.c_str ());
+      return EXIT_FAILURE;
+    }
+
+  if (!opened || j.device != device)
+    {
+      if (opened)
+        sm.close_device ();
+      opened = false;
+      sm.open_device (j.device.empty ()
+                      ? 0 : const_cast<char *> (j.device.c_str ()));
+      opened = true;
+      device = j.device;
+    }
+
+  if (!select_source (sm, j.source))
+    {
+      fprintf (stderr, "%s: unsupported document source `%s'\n",
+               program, j.source.c_str ());
+      return EXIT_FAILURE;
+    }
+
+  // same initialisation as view_manager::init_img_info()
+  float  brightness, contrast;
+  double max_width, max_height;
+  settings set;
+
+  sm.set_brightness_method (br_iscan);
+  sm.get_value (SANE_NAME_BRIGHTNESS, &brightness);
+  sm.get_value (SANE_NAME_CONTRAST, &contrast);
+  sm.get_current_max_size (&max_width, &max_height);
+  sm.get_color_profile (set.coef);
+
+  marquee marq (max_width, max_height, (sm.using_tpu () ? 25 : 0),
+                (long) brightness, (long) contrast);
+
+  if (!j.whole_area)
+    {
+      marq.offset.x = j.area[0];
+      marq.offset.y = j.area[1];
+      marq.area.x   = j.area[2];
+      marq.area.y   = j.area[3];
+    }
+
+  set.destination         = PISA_DE_FILE;
+  set.imgtype             = mode->type;
+  set.resolution          = j.resolution;
+  set.enable_start_button = false;
+  set.enable_draft_mode   = false;
+  set.usm                 = 1;
+  set.unit                = PISA_UNIT_INCHES;
+  set.max_area[0]         = max_width;
+  set.max_area[1]         = max_height;
+
+  sm.set_color_mode (set.imgtype.pixeltype, set.imgtype.bitdepth);
+
+  long res[2] = { set.resolution, set.resolution };
+  sm.get_valid_resolution (&res[0], &res[1], true);
+  sm.set_scan_resolution (res[0], res[1]);
+
+  // there is no preview, so leave gamma to the device as the GUI does
+  sm.has_prev_img (0);
+
+  pisa_error_id err = sm.set_scan_parameters (set, marq);
+  if (PISA_ERR_SUCCESS != err)
+    throw pisa_error (err);
+
+  bool numbered = (string::npos != j.output.find (iscan::file_opener::hash_mark));
+  long max_pages = j.pages;
+
+  if (!numbered && !fmt->multi_page)
+    max_pages = 1;
+  if (!sm.using_adf () && 0 == max_pages)
+    max_pages = 1;
+
+  bool rotate = false;
+  if (sm.using_duplex ())
+    rotate = (sm.adf_duplex_direction_matches () ? j.top_binding
+              : !j.top_binding);
+
+  iscan::file_opener *fo = (numbered
+                            ? new iscan::file_opener (j.output, 1)
+                            : new iscan::file_opener (j.output));
+  iscan::imgstream *is = 0;
+
+  long pages = 0, rows = 0;
+  double start = now ();
+
+  try
+    {
+      is = iscan::create_imgstream (*fo, fmt->format, rotate);
+
+      while (0 == max_pages || pages < max_pages)
+        {
+          double t = now ();
+
+          if (!scan_page (sm, *is, set, 0 == pages, &rows))
+            break;
+          ++pages;
+
+          if (verbose)
+            fprintf (stderr, "%s: page %ld done in %.2f s\n",
+                     program, pages, now () - t);
+        }
+    }
+  catch (...)
+    {
+      delete is;
+      delete fo;
+      sm.release_memory ();
+      sm.finish_acquire ();
+      throw;
+    }
+  delete is;
+  delete fo;
+
+  sm.release_memory ();
+  sm.finish_acquire (sm.using_adf ());
+
+  if (verbose)
+    {
+      double elapsed = now () - start;
+      fprintf (stderr, "%s: %s: %ld pages, %ld rows in %.2f s"
+               " (%.2f pages/min)\n", program, j.output.c_str (),
+               pages, rows, elapsed,
+               (0 < elapsed ? 60 * pages / elapsed : 0.0));
+    }
+
+  return EXIT_SUCCESS;
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  job defaults;
+  string job_file;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      string opt (argv[i]);
+
+      if ("--help" == opt)
+        {
+          usage (stdout);
+          return EXIT_SUCCESS;
+        }
+      else if ("--verbose" == opt)
+        verbose = true;
+      else if (0 == opt.find ("--job-file="))
+        job_file = opt.substr (strlen ("--job-file="));
+      else if (!parse_option (defaults, opt))
+        {
+          fprintf (stderr, "%s: invalid option `%s'\n", program, argv[i]);
+          usage (stderr);
+          return EXIT_FAILURE;
+        }
+    }
+
+  vector<job> jobs;
+
+  if (job_file.empty ())
+    jobs.push_back (defaults);
+  else
+    {
+      std::ifstream in (job_file.c_str ());
+      long lineno;
+      string opt;
+
+      if (!in)
+        {
+          fprintf (stderr, "%s: cannot read `%s'\n", program,
+                   job_file.c_str ());
+          return EXIT_FAILURE;
+        }
+      if (!read_jobs (in, defaults, jobs, lineno, opt))
+        {
+          fprintf (stderr, "%s:%ld: invalid option `%s'\n",
+                   job_file.c_str (), lineno, opt.c_str ());
+          return EXIT_FAILURE;
+        }
+    }
+
+  int status = EXIT_SUCCESS;
+  scan_manager sm;
+  string device;
+  bool opened = false;
+
+  for (vector<job>::size_type i = 0; i < jobs.size (); ++i)
+    {
+      try
+        {
+          if (EXIT_SUCCESS != run_job (sm, jobs[i], device, opened))
+            status = EXIT_FAILURE;
+        }
+      catch (pisa_error& oops)
+        {
+          fprintf (stderr, "%s: %s: %s\n", program, jobs[i].output.c_str (),
+                   oops.get_error_string ());
+          status = EXIT_FAILURE;
+        }
+      catch (std::exception& oops)
+        {
+          fprintf (stderr, "%s: %s: %s\n", program, jobs[i].output.c_str (),
+                   oops.what ());
+          status = EXIT_FAILURE;
+        }
+    }
+
+  if (opened)
+    sm.close_device ();
+
+  return status;
+}
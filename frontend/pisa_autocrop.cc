@@ -0,0 +1,166 @@
+/* pisa_autocrop.cc
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+/*------------------------------------------------------------*/
+#include <string.h>
+
+/*------------------------------------------------------------*/
+#include "pisa_autocrop.h"
+
+/*------------------------------------------------------------*/
+// width of the frame along the image edges that shows the background
+static const long g_frame		= 2;
+
+// summed channel difference from the background that marks content
+static const int g_contrast		= 48;
+
+// fraction of a row or column that has to differ from the background
+// for it to count, so that dust and sensor noise are ignored
+static const double g_min_content	= 0.01;
+
+// cropping is skipped when it would keep more than this fraction of
+// the image in both directions
+static const double g_max_coverage	= 0.9;
+
+/*------------------------------------------------------------*/
+static void add_pixels ( unsigned long hist [ 3 ] [ 256 ],
+			 const unsigned char * p, long n )
+{
+  for ( ; 0 < n; n--, p += 3 )
+    {
+      hist [ 0 ] [ p [ 0 ] ]++;
+      hist [ 1 ] [ p [ 1 ] ]++;
+      hist [ 2 ] [ p [ 2 ] ]++;
+    }
+}
+
+/*------------------------------------------------------------*/
+static int median ( const unsigned long hist [ 256 ] )
+{
+  unsigned long total = 0, count = 0;
+  int i;
+
+  for ( i = 0; i < 256; i++ )
+    total += hist [ i ];
+
+  for ( i = 0; i < 255; i++ )
+    {
+      count += hist [ i ];
+      if ( 2 * count >= total )
+	break;
+    }
+  return i;
+}
+
+/*------------------------------------------------------------*/
+static bool find_extent ( const long * count, long n, long min_count,
+			  long & first, long & last )
+{
+  for ( first = 0; first < n && count [ first ] <= min_count; first++ )
+    ;
+  for ( last = n - 1; first <= last && count [ last ] <= min_count; last-- )
+    ;
+  return first <= last;
+}
+
+namespace iscan
+{
+
+/*------------------------------------------------------------*/
+bool find_document ( const pisa_image_info & info, _rectL & r )
+{
+  long width  = info.m_width;
+  long height = info.m_height;
+  long x, y;
+  int c;
+
+  if ( width <= 2 * g_frame || height <= 2 * g_frame )
+    return false;
+
+  // the background shows along most of the frame, unless the image
+  // is all document, which the coverage check below catches
+  unsigned long hist [ 3 ] [ 256 ];
+  int bg [ 3 ];
+
+  ::memset ( hist, 0, sizeof ( hist ) );
+  for ( y = 0; y < height; y++ )
+    {
+      const unsigned char * p = info.m_img + y * info.m_rowbytes;
+
+      if ( y < g_frame || height - g_frame <= y )
+	add_pixels ( hist, p, width );
+      else
+	{
+	  add_pixels ( hist, p, g_frame );
+	  add_pixels ( hist, p + ( width - g_frame ) * 3, g_frame );
+	}
+    }
+  for ( c = 0; c < 3; c++ )
+    bg [ c ] = median ( hist [ c ] );
+
+  // project the content onto the axes
+  long * col = new long [ width ];
+  long * row = new long [ height ];
+
+  ::memset ( col, 0, width * sizeof ( long ) );
+  ::memset ( row, 0, height * sizeof ( long ) );
+
+  for ( y = 0; y < height; y++ )
+    {
+      const unsigned char * p = info.m_img + y * info.m_rowbytes;
+
+      for ( x = 0; x < width; x++, p += 3 )
+	{
+	  int d0 = p [ 0 ] - bg [ 0 ];
+	  int d1 = p [ 1 ] - bg [ 1 ];
+	  int d2 = p [ 2 ] - bg [ 2 ];
+
+	  if ( ( d0 < 0 ? -d0 : d0 ) + ( d1 < 0 ? -d1 : d1 )
+	       + ( d2 < 0 ? -d2 : d2 ) > g_contrast )
+	    {
+	      col [ x ]++;
+	      row [ y ]++;
+	    }
+	}
+    }
+
+  bool found = ( find_extent ( col, width, ( long ) ( height * g_min_content ),
+			       r.left, r.right )
+		 && find_extent ( row, height,
+				  ( long ) ( width * g_min_content ),
+				  r.top, r.bottom ) );
+
+  delete [] col;
+  delete [] row;
+
+  if ( ! found )
+    return false;
+
+  return ( r.right - r.left + 1 <= g_max_coverage * width
+	   || r.bottom - r.top + 1 <= g_max_coverage * height );
+}
+
+} // namespace iscan
@@ -0,0 +1,50 @@
+/* pisa_autocrop.h
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+#ifndef ___PISA_AUTOCROP_H
+#define ___PISA_AUTOCROP_H
+
+#include "pisa_structs.h"
+
+namespace iscan
+{
+
+  /* Finds the area of a preview image that is taken up by documents
+     or photos.  The scanner lid or platen background is estimated
+     from the pixels along the edges of the image, per channel, and
+     everything that stands out from it is taken as content.  On
+     success the (inclusive) bounding rectangle of the content is
+     stored in r.
+
+     The function fails when nothing stands out or when the content
+     covers so much of the image that cropping is not worthwhile.
+     Image data must be 24 bit RGB.
+   */
+  bool find_document ( const pisa_image_info & info, _rectL & r );
+
+} // namespace iscan
+
+#endif // ___PISA_AUTOCROP_H
@@ -34,6 +34,7 @@
 #include "esmod-wrapper.hh"
 
 #define PREFERENCE	".iscan_preference"
+#define PREVIEW_STORE	".iscan_preview"
 
 // gamma
 #define DEFGAMMA	ISCAN_DEFAULT_GAMMA
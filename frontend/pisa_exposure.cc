@@ -0,0 +1,488 @@
+/* pisa_exposure.cc
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+/*------------------------------------------------------------*/
+#include <math.h>
+#include <string.h>
+
+/*------------------------------------------------------------*/
+#include "pisa_exposure.h"
+#include "pisa_enums.h"
+#include "pisa_default_val.h"
+
+/*------------------------------------------------------------*/
+// fraction of the pixels clipped to black and white
+static const double g_photo_clip_lo	= 0.005;
+static const double g_photo_clip_hi	= 0.995;
+static const double g_doc_clip_lo	= 0.01;
+static const double g_doc_clip_hi	= 0.98;
+
+// film mask and base are found at these fractions
+static const double g_film_clip_hi	= 0.999;
+
+// narrowest shadow..highlight span that is trusted
+static const long g_min_span		= 32;
+
+// limit on the automatic midtone correction
+static const double g_max_auto_gamma	= 2.0;
+
+/*------------------------------------------------------------*/
+// The scatter into the histogram does not vectorise, and a single
+// table serialises on repeated values (think paper white).  Spread
+// consecutive pixels over a few private tables instead and merge
+// them at the end.
+#define NUM_SUBHIST	4
+
+typedef unsigned long histogram [ 256 ];
+
+/*------------------------------------------------------------*/
+static void collect_rgb ( const pisa_image_info & info, const _rectL & r,
+			  histogram hist [ 3 ] )
+{
+  histogram	sub [ NUM_SUBHIST ] [ 3 ];
+  long		x, y, c, k;
+  long		width;
+
+  ::memset ( sub, 0, sizeof ( sub ) );
+
+  width = r.right - r.left + 1;
+
+  for ( y = r.top; y <= r.bottom; y++ )
+    {
+      const unsigned char * p = info.m_img + y * info.m_rowbytes
+	+ r.left * 3;
+
+      for ( x = 0; x + NUM_SUBHIST <= width; x += NUM_SUBHIST )
+	{
+	  sub [ 0 ] [ 0 ] [ p [  0 ] ]++;
+	  sub [ 0 ] [ 1 ] [ p [  1 ] ]++;
+	  sub [ 0 ] [ 2 ] [ p [  2 ] ]++;
+	  sub [ 1 ] [ 0 ] [ p [  3 ] ]++;
+	  sub [ 1 ] [ 1 ] [ p [  4 ] ]++;
+	  sub [ 1 ] [ 2 ] [ p [  5 ] ]++;
+	  sub [ 2 ] [ 0 ] [ p [  6 ] ]++;
+	  sub [ 2 ] [ 1 ] [ p [  7 ] ]++;
+	  sub [ 2 ] [ 2 ] [ p [  8 ] ]++;
+	  sub [ 3 ] [ 0 ] [ p [  9 ] ]++;
+	  sub [ 3 ] [ 1 ] [ p [ 10 ] ]++;
+	  sub [ 3 ] [ 2 ] [ p [ 11 ] ]++;
+	  p += 3 * NUM_SUBHIST;
+	}
+      for ( ; x < width; x++ )
+	{
+	  sub [ 0 ] [ 0 ] [ p [ 0 ] ]++;
+	  sub [ 0 ] [ 1 ] [ p [ 1 ] ]++;
+	  sub [ 0 ] [ 2 ] [ p [ 2 ] ]++;
+	  p += 3;
+	}
+    }
+
+  for ( c = 0; c < 3; c++ )
+    for ( x = 0; x < 256; x++ )
+      {
+	hist [ c ] [ x ] = 0;
+	for ( k = 0; k < NUM_SUBHIST; k++ )
+	  hist [ c ] [ x ] += sub [ k ] [ c ] [ x ];
+      }
+}
+
+/*------------------------------------------------------------*/
+static void collect_gray ( const pisa_image_info & info, const _rectL & r,
+			   histogram & hist )
+{
+  histogram	sub [ NUM_SUBHIST ];
+  long		x, y, k;
+  long		width;
+
+  ::memset ( sub, 0, sizeof ( sub ) );
+
+  width = r.right - r.left + 1;
+
+  for ( y = r.top; y <= r.bottom; y++ )
+    {
+      const unsigned char * p = info.m_img + y * info.m_rowbytes + r.left;
+
+      for ( x = 0; x + NUM_SUBHIST <= width; x += NUM_SUBHIST )
+	{
+	  sub [ 0 ] [ p [ 0 ] ]++;
+	  sub [ 1 ] [ p [ 1 ] ]++;
+	  sub [ 2 ] [ p [ 2 ] ]++;
+	  sub [ 3 ] [ p [ 3 ] ]++;
+	  p += NUM_SUBHIST;
+	}
+      for ( ; x < width; x++ )
+	sub [ 0 ] [ *p++ ]++;
+    }
+
+  for ( x = 0; x < 256; x++ )
+    {
+      hist [ x ] = 0;
+      for ( k = 0; k < NUM_SUBHIST; k++ )
+	hist [ x ] += sub [ k ] [ x ];
+    }
+}
+
+/*------------------------------------------------------------*/
+// Returns the lowest level at or below which at least the given
+// fraction of the pixels lie.
+static long percentile ( const histogram & hist, double fraction )
+{
+  unsigned long	total, sum, limit;
+  long		i;
+
+  total = 0;
+  for ( i = 0; i < 256; i++ )
+    total += hist [ i ];
+
+  if ( total == 0 )
+    return 0;
+
+  limit = ( unsigned long ) ( fraction * total );
+  if ( limit < 1 )
+    limit = 1;
+
+  sum = 0;
+  for ( i = 0; i < 255; i++ )
+    {
+      sum += hist [ i ];
+      if ( sum >= limit )
+	break;
+    }
+
+  return i;
+}
+
+/*------------------------------------------------------------*/
+// Inverts a negative film channel and removes the mask, giving a
+// value in 0..1.
+static double film_level ( long v, double yp, double gamma )
+{
+  double x;
+
+  x = ( 1.0 - v / 255.0 - yp ) / ( 1.0 - yp );
+
+  if ( x <= 0.0 )
+    return 0.0;
+  if ( 1.0 <= x )
+    return 1.0;
+
+  return ::pow ( x, 1.0 / gamma );
+}
+
+/*------------------------------------------------------------*/
+// Works out the black point and gamma per channel of a negative
+// film from its raw histograms, then replaces the histograms with
+// those of the corrected (positive) image.
+static void expose_film ( histogram hist [ 3 ], marquee & m )
+{
+  histogram	out;
+  double	n [ 3 ];
+  double	target;
+  long		c, v;
+
+  target = 1.0;
+  for ( c = 0; c < 3; c++ )
+    {
+      long hi  = percentile ( hist [ c ], g_film_clip_hi );
+      long mid = percentile ( hist [ c ], 0.5 );
+
+      m.film_yp [ c ] = 1.0 - hi / 255.0;
+      if ( 0.9 < m.film_yp [ c ] )
+	m.film_yp [ c ] = 0.9;
+
+      n [ c ] = film_level ( mid, m.film_yp [ c ], 1.0 );
+      if ( n [ c ] < 0.01 )
+	n [ c ] = 0.01;
+      if ( 0.99 < n [ c ] )
+	n [ c ] = 0.99;
+
+      target *= n [ c ];
+    }
+  target = ::pow ( target, 1.0 / 3 );
+
+  for ( c = 0; c < 3; c++ )
+    {
+      double g = ::log ( n [ c ] ) / ::log ( target );
+
+      if ( g < 0.25 )
+	g = 0.25;
+      if ( 4.0 < g )
+	g = 4.0;
+
+      m.film_gamma [ c ] = g;
+
+      ::memset ( out, 0, sizeof ( out ) );
+      for ( v = 0; v < 256; v++ )
+	{
+	  long y = ( long ) ( 255 * film_level ( v, m.film_yp [ c ], g )
+			      + 0.5 );
+	  out [ y ] += hist [ c ] [ v ];
+	}
+      ::memcpy ( hist [ c ], out, sizeof ( out ) );
+    }
+}
+
+/*------------------------------------------------------------*/
+void iscan::auto_expose ( int option_type, int film_type,
+			  const pisa_image_info & info, const _rectL & r,
+			  marquee & m, bool is_photo, bool is_dumb )
+{
+  histogram	hist [ 3 ];
+  histogram	all;
+  _rectL	clip = r;
+  long		channels, c, i;
+  double	clip_lo, clip_hi;
+
+  ( void ) is_dumb;
+
+  channels = ( info.m_bits_per_pixel == 8 ) ? 1 : 3;
+
+  for ( c = 0; c < 3; c++ )
+    {
+      m.film_gamma [ c ]	= 1.0;
+      m.film_yp [ c ]		= 0.0;
+      m.grayl [ c ]		= 255.0;
+    }
+  m.gamma	= ( long ) ( 100 * DEFGAMMA );
+  m.highlight	= DEFHIGHLIGHT;
+  m.shadow	= DEFSHADOW;
+  m.graybalance	= DEFGRAYBALANCE;
+
+  if ( clip.left < 0 )
+    clip.left = 0;
+  if ( clip.top < 0 )
+    clip.top = 0;
+  if ( info.m_width <= clip.right )
+    clip.right = info.m_width - 1;
+  if ( info.m_height <= clip.bottom )
+    clip.bottom = info.m_height - 1;
+
+  if ( 0 == info.m_img
+       || clip.right < clip.left || clip.bottom < clip.top )
+    return;
+
+  if ( 1 == channels )
+    {
+      collect_gray ( info, clip, hist [ 0 ] );
+      ::memcpy ( hist [ 1 ], hist [ 0 ], sizeof ( histogram ) );
+      ::memcpy ( hist [ 2 ], hist [ 0 ], sizeof ( histogram ) );
+    }
+  else
+    {
+      collect_rgb ( info, clip, hist );
+      if ( PISA_OP_TPU == option_type && PISA_FT_NEGA == film_type )
+	expose_film ( hist, m );
+    }
+
+  clip_lo = is_photo ? g_photo_clip_lo : g_doc_clip_lo;
+  clip_hi = is_photo ? g_photo_clip_hi : g_doc_clip_hi;
+
+  for ( i = 0; i < 256; i++ )
+    all [ i ] = hist [ 0 ] [ i ] + hist [ 1 ] [ i ] + hist [ 2 ] [ i ];
+
+  long shadow    = percentile ( all, clip_lo );
+  long highlight = percentile ( all, clip_hi );
+
+  if ( shadow < MINSHADOW )
+    shadow = MINSHADOW;
+  if ( MAXSHADOW < shadow )
+    shadow = MAXSHADOW;
+  if ( highlight < MINHIGHLIGHT )
+    highlight = MINHIGHLIGHT;
+  if ( 255 < highlight )
+    highlight = 255;
+
+  if ( highlight - shadow < g_min_span )
+    return;
+
+  m.shadow	= shadow;
+  m.highlight	= highlight;
+
+  for ( c = 0; c < 3; c++ )
+    m.grayl [ c ] = percentile ( hist [ c ], clip_hi );
+
+  if ( ! is_photo )
+    return;
+
+  // Move the median to mid-gray, going only half of the way there
+  // in the log domain so dark or light scenes keep their mood.
+  double mid = ( percentile ( all, 0.5 ) - shadow )
+    / ( double ) ( highlight - shadow );
+
+  if ( mid < 0.02 )
+    mid = 0.02;
+  if ( 0.98 < mid )
+    mid = 0.98;
+
+  double gamma = ::sqrt ( ::log ( mid ) / ::log ( 0.5 ) );
+
+  if ( gamma < MINGAMMA )
+    gamma = MINGAMMA;
+  if ( g_max_auto_gamma < gamma )
+    gamma = g_max_auto_gamma;
+
+  m.gamma = ( long ) ( 100 * gamma + 0.5 );
+}
+
+/*------------------------------------------------------------*/
+void iscan::build_LUT ( int film_type, int pixel_type, const marquee & m,
+			gamma_struct & lut )
+{
+  unsigned char	* table [ 3 ];
+  double	yp [ 3 ], fg [ 3 ], gb [ 3 ];
+  double	span, exponent;
+  long		channels, c, v;
+
+  table [ 0 ] = lut.gamma_r;
+  table [ 1 ] = lut.gamma_g;
+  table [ 2 ] = lut.gamma_b;
+
+  channels = ( PISA_PT_RGB == pixel_type ) ? 3 : 1;
+
+  for ( c = 0; c < 3; c++ )
+    {
+      yp [ c ] = m.film_yp [ c ];
+      fg [ c ] = m.film_gamma [ c ];
+      gb [ c ] = 1.0;
+    }
+
+  if ( 1 == channels )
+    {
+      yp [ 0 ] = ( yp [ 0 ] + yp [ 1 ] + yp [ 2 ] ) / 3;
+      fg [ 0 ] = ( fg [ 0 ] + fg [ 1 ] + fg [ 2 ] ) / 3;
+    }
+  else if ( 0 < m.graybalance
+	    && 0 < m.grayl [ 0 ] && 0 < m.grayl [ 1 ] && 0 < m.grayl [ 2 ] )
+    {
+      double neutral = ( m.grayl [ 0 ] + m.grayl [ 1 ] + m.grayl [ 2 ] ) / 3;
+
+      for ( c = 0; c < 3; c++ )
+	gb [ c ] = 1.0 + m.graybalance / 100.0
+	  * ( neutral / m.grayl [ c ] - 1.0 );
+    }
+
+  span = m.highlight - m.shadow;
+  if ( span < 1 )
+    span = 1;
+
+  exponent = ( 0 < m.gamma ) ? 100.0 / m.gamma : 1.0;
+
+  for ( c = 0; c < channels; c++ )
+    {
+      const unsigned char * curve = m.gamma_table [ ( 1 == channels )
+						    ? 0 : c + 1 ];
+
+      for ( v = 0; v < 256; v++ )
+	{
+	  double x;
+	  long   e;
+
+	  if ( PISA_FT_NEGA == film_type )
+	    x = film_level ( v, yp [ c ], fg [ c ] );
+	  else
+	    x = v / 255.0;
+
+	  x = ( 255 * x * gb [ c ] - m.shadow ) / span;
+
+	  if ( x <= 0.0 )
+	    x = 0.0;
+	  else if ( 1.0 <= x )
+	    x = 1.0;
+	  else
+	    x = ::pow ( x, exponent );
+
+	  e = ( long ) ( 255 * x + 0.5 );
+
+	  if ( 1 == channels )
+	    table [ c ] [ v ] = curve [ e ];
+	  else
+	    table [ c ] [ v ] = curve [ m.gamma_table [ 0 ] [ e ] ];
+	}
+    }
+
+  if ( 1 == channels )
+    {
+      ::memcpy ( table [ 1 ], table [ 0 ], 256 );
+      ::memcpy ( table [ 2 ], table [ 0 ], 256 );
+    }
+}
+
+/*------------------------------------------------------------*/
+iscan::lut_cache::lut_cache ( void )
+{
+  m_num_entries = 0;
+  m_clock = 0;
+}
+
+/*------------------------------------------------------------*/
+const gamma_struct & iscan::lut_cache::lookup ( int film_type,
+						int pixel_type,
+						const marquee & m )
+{
+  key	k;
+  int	i, victim;
+
+  // clear the padding too, keys are compared bytewise
+  ::memset ( & k, 0, sizeof ( k ) );
+
+  k.film_type	= film_type;
+  k.pixel_type	= pixel_type;
+  k.gamma	= m.gamma;
+  k.highlight	= m.highlight;
+  k.shadow	= m.shadow;
+  k.graybalance	= m.graybalance;
+  ::memcpy ( k.film_gamma, m.film_gamma, sizeof ( k.film_gamma ) );
+  ::memcpy ( k.film_yp, m.film_yp, sizeof ( k.film_yp ) );
+  ::memcpy ( k.grayl, m.grayl, sizeof ( k.grayl ) );
+  ::memcpy ( k.curve, m.gamma_table, sizeof ( k.curve ) );
+
+  m_clock++;
+
+  for ( i = 0; i < m_num_entries; i++ )
+    {
+      if ( 0 == ::memcmp ( & m_entry [ i ].k, & k, sizeof ( k ) ) )
+	{
+	  m_entry [ i ].used = m_clock;
+	  return m_entry [ i ].lut;
+	}
+    }
+
+  if ( m_num_entries < max_entries )
+    victim = m_num_entries++;
+  else
+    {
+      victim = 0;
+      for ( i = 1; i < m_num_entries; i++ )
+	if ( m_entry [ i ].used < m_entry [ victim ].used )
+	  victim = i;
+    }
+
+  ::memcpy ( & m_entry [ victim ].k, & k, sizeof ( k ) );
+  m_entry [ victim ].used = m_clock;
+  build_LUT ( film_type, pixel_type, m, m_entry [ victim ].lut );
+
+  return m_entry [ victim ].lut;
+}
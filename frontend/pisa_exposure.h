@@ -0,0 +1,121 @@
+/* pisa_exposure.h
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+#ifndef ___PISA_EXPOSURE_H
+#define ___PISA_EXPOSURE_H
+
+#include "pisa_structs.h"
+#include "pisa_marquee.h"
+
+namespace iscan
+{
+
+  /* Computes the exposure settings of a marquee from the histogram of
+     the image data inside the (inclusive) rectangle r.  Only the AE
+     fields of the marquee are written:
+
+       shadow, highlight  input levels, on a 0..255 scale, that are
+                          mapped to black and white
+       gamma              midtone gamma times 100, chosen so that the
+                          median lands on mid-gray for photos and left
+                          at its default for documents
+       graybalance        reset to its default; grayl[] holds the
+                          per-channel level of the brightest neutral
+                          area, on a 0..255 scale, for the gray balance
+                          slider to work with
+       film_yp[]          per-channel black point after inversion of a
+                          negative film, normalised to 0..1
+       film_gamma[]       per-channel gamma that removes the colour
+                          cast of a negative film's mask
+
+     For anything but negative film the film parameters are neutral
+     (a gamma of 1.0 and a black point of 0.0).
+
+     The function only touches its arguments and the stack, so it may
+     be called from any number of threads at once.  Image data must be
+     8 bit gray or 24 bit RGB.  The is_dumb flag is accepted for
+     compatibility with the esmod interface and ignored.
+   */
+  void auto_expose (int option_type, int film_type,
+                    const pisa_image_info& info, const _rectL& r,
+                    marquee& m, bool is_photo, bool is_dumb);
+
+  /* Builds the per-channel lookup table for the exposure settings of
+     marquee m as described above.  Each channel goes through the film
+     correction (negative film only), the gray balance, the shadow and
+     highlight levels and the midtone gamma, in that order, and then
+     through the user's master and channel curves in gamma_table[].
+     For anything but RGB pixels the channels are treated as one.  The
+     table is computed from its arguments only.
+   */
+  void build_LUT (int film_type, int pixel_type, const marquee& m,
+                  gamma_struct& lut);
+
+  /* Remembers the most recently built lookup tables so that going
+     back and forth between settings, or between marquees, does not
+     recompute them.  Each instance is independent; share one between
+     threads only with external locking.
+   */
+  class lut_cache
+  {
+  public:
+    lut_cache (void);
+
+    const gamma_struct& lookup (int film_type, int pixel_type,
+                                const marquee& m);
+
+  private:
+    struct key
+    {
+      int		film_type;
+      int		pixel_type;
+      long		gamma;
+      long		highlight;
+      long		shadow;
+      long		graybalance;
+      double		film_gamma [3];
+      double		film_yp [3];
+      double		grayl [3];
+      unsigned char	curve [4][256];
+    };
+
+    struct entry
+    {
+      key		k;
+      gamma_struct	lut;
+      unsigned long	used;
+    };
+
+    static const int max_entries = 8;
+
+    entry		m_entry [max_entries];
+    int			m_num_entries;
+    unsigned long	m_clock;
+  };
+
+} // namespace iscan
+
+#endif // ___PISA_EXPOSURE_H
@@ -92,7 +92,7 @@ static void click_reset ( GtkWidget * widget,
   preview_window *prev_cls =
     (preview_window *) ::g_view_manager->get_window_cls (ID_WINDOW_PREV);
 
-  prev_cls->update_img ( );
+  prev_cls->queue_update ( );
 }
 
 /*------------------------------------------------------------*/
@@ -332,7 +332,7 @@ gint gamma_correction::event ( GtkWidget * widget, GdkEvent * event )
       preview_window *prev_cls =
 	(preview_window *) ::g_view_manager->get_window_cls (ID_WINDOW_PREV);
 
-      prev_cls->update_img ( );
+      prev_cls->queue_update ( );
       }
       break;
 
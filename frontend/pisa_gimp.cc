@@ -62,6 +62,8 @@ typedef void lib_gimp_install_procedure ( gchar * name,
 					  GimpParamDef * params,
 					  GimpParamDef * return_vals );
 typedef guint lib_gimp_tile_height ( void );
+typedef guint lib_gimp_tile_width ( void );
+typedef void lib_gimp_tile_cache_ntiles ( gulong ntiles );
 typedef gint32 lib_gimp_image_new ( gint width,
 				    gint height,
 				    GimpImageBaseType type );
@@ -128,6 +130,8 @@ lib_gimp_main * plib_gimp_main;
 lib_gimp_quit * plib_gimp_quit;
 lib_gimp_install_procedure * plib_gimp_install_procedure;
 lib_gimp_tile_height * plib_gimp_tile_height;
+lib_gimp_tile_width * plib_gimp_tile_width;
+lib_gimp_tile_cache_ntiles * plib_gimp_tile_cache_ntiles;
 lib_gimp_image_new * plib_gimp_image_new;
 lib_gimp_layer_new * plib_gimp_layer_new;
 lib_gimp_image_add_layer * plib_gimp_image_add_layer;
@@ -264,6 +268,8 @@ gint pisa_gimp_main ( gint argc, gchar * argv [ ] )
   plib_gimp_version                = ( lib_gimp_version * ) dlsym ( handle_libgimp, "gimp_version" );
   plib_gimp_quit                   = ( lib_gimp_quit * ) dlsym ( handle_libgimp, "gimp_quit" );
   plib_gimp_tile_height            = ( lib_gimp_tile_height * ) dlsym ( handle_libgimp, "gimp_tile_height" );
+  plib_gimp_tile_width             = ( lib_gimp_tile_width * ) dlsym ( handle_libgimp, "gimp_tile_width" );
+  plib_gimp_tile_cache_ntiles      = ( lib_gimp_tile_cache_ntiles * ) dlsym ( handle_libgimp, "gimp_tile_cache_ntiles" );
   plib_gimp_image_new              = ( lib_gimp_image_new * ) dlsym ( handle_libgimp, "gimp_image_new" );
   plib_gimp_layer_new              = ( lib_gimp_layer_new * ) dlsym ( handle_libgimp, "gimp_layer_new" );
   plib_gimp_image_add_layer        = ( lib_gimp_image_add_layer * ) dlsym ( handle_libgimp, "gimp_image_add_layer" );
@@ -320,6 +326,28 @@ gboolean pisa_gimp_use_xshm ( void )
   return plib_gimp_use_xshm ( );
 }
 
+/*----------------------------------------------------------*/
+// largest strip handed to GIMP in one go, in bytes
+static const long g_max_strip_size = 4 * 1024 * 1024;
+
+// B/W to gray expansion of all 256 bytes, set bits are black
+class bw_expansion
+{
+ public:
+  unsigned char	pixels [ 256 ] [ 8 ];
+
+  bw_expansion ( void )
+    {
+      int i, k;
+
+      for ( i = 0; i < 256; i++ )
+	for ( k = 0; k < 8; k++ )
+	  pixels [ i ] [ k ] = ( i & ( 0x80 >> k ) ) ? 0x00 : 0xff;
+    }
+};
+
+static const bw_expansion g_bw_expansion;
+
 /*----------------------------------------------------------*/
 static void query ( void )
 {
@@ -503,9 +531,9 @@ int gimp_scan::create_gimp_image ( int width,
 				   int pixeltype,
 				   int depth )
 {
-  size_t		tile_size;
   GimpImageBaseType	image_type;
   GimpImageType		drawable_type;
+  int			tile_height, tiles;
 
   // initialize member variable
   m_rows	= 0;
@@ -515,14 +543,10 @@ int gimp_scan::create_gimp_image ( int width,
   m_depth	= depth;
   m_rowbytes	= 0;
 
-  m_tile	= 0;
   m_drawable	= 0;
 
-  tile_size = width * ::plib_gimp_tile_height ( );
-
   if ( pixeltype == PISA_PT_RGB )
     {
-      tile_size		*= 3;
       image_type	= GIMP_RGB;
       drawable_type	= GIMP_RGB_IMAGE;
       m_rowbytes	= width * 3;
@@ -536,6 +560,23 @@ int gimp_scan::create_gimp_image ( int width,
   else
     return PISA_ERR_PARAMETER;
 
+  // Hand GIMP as many whole rows of tiles at a time as fit in a
+  // strip, and let its tile cache hold all of them so a strip does
+  // not evict its own tiles while it is being written.
+  tile_height = ::plib_gimp_tile_height ( );
+  tiles = g_max_strip_size / ( tile_height * m_rowbytes );
+  if ( tiles < 1 )
+    tiles = 1;
+  m_strip_rows = tiles * tile_height;
+
+  if ( ::plib_gimp_tile_width && ::plib_gimp_tile_cache_ntiles )
+    {
+      int tile_width = ::plib_gimp_tile_width ( );
+
+      ::plib_gimp_tile_cache_ntiles ( tiles * ( ( width + tile_width - 1 )
+						/ tile_width ) );
+    }
+
   m_image_id = ::plib_gimp_image_new ( m_width, m_height, image_type );
   
   m_layer_id = ::plib_gimp_layer_new ( m_image_id, "Background",
@@ -549,115 +590,72 @@ int gimp_scan::create_gimp_image ( int width,
 			      m_drawable->width, m_drawable->height,
 			      TRUE, FALSE );
 
-  m_tile = g_new ( guchar, tile_size );
-
-  if ( m_tile == 0 )
-    return PISA_ERR_OUTOFMEMORY;
-
   return PISA_ERR_SUCCESS;
 } 
 
 /*----------------------------------------------------------*/
-unsigned char * gimp_scan::get_next_buf ( void )
+// Takes the next rows of the image, get_rowstride() bytes apart.
+// B/W rows are packed at the start of each row and are expanded in
+// place.
+int gimp_scan::set_strip ( unsigned char * buf, int rows )
 {
-  int	tile_height = ::plib_gimp_tile_height ( );
+  if ( m_height < m_rows + rows )
+    rows = m_height - m_rows;
 
-  return & m_tile [ ( m_rows % tile_height ) * m_rowbytes ];
-}
+  if ( rows <= 0 )
+    return PISA_ERR_SUCCESS;
 
-/*----------------------------------------------------------*/
-int gimp_scan::set_image_rect ( void )
-{
-  int	tile_height = ::plib_gimp_tile_height ( );
+  if ( m_depth == 1 )
+    bw2gray ( buf, rows );
 
-  m_rows++;
+  ::plib_gimp_pixel_rgn_set_rect ( & m_region, buf,
+				  0, m_rows, m_width, rows );
+  m_rows += rows;
 
-  if ( m_rows % tile_height == 0 )
-    {
-      if ( m_depth == 1 )
-	bw2gray ( );
-      
-      ::plib_gimp_pixel_rgn_set_rect ( & m_region, m_tile,
-				      0, m_rows - tile_height,
-				      m_width, tile_height );
-    }
-  
   return PISA_ERR_SUCCESS;
 }
 
 /*----------------------------------------------------------*/
 int gimp_scan::finish_scan ( int cancel )
 {
-  int	remaining;
-
   if ( cancel )
     {
       ::plib_gimp_image_remove_layer ( m_image_id, m_layer_id );
       ::plib_gimp_image_delete ( m_image_id );
-      ::free ( m_tile );
     }
   else
     {
-      remaining = m_rows % ::plib_gimp_tile_height ( );
-      
-      if ( remaining )
-	{
-	  if ( m_depth == 1 )
-	    bw2gray ( );
-	  
-	  ::plib_gimp_pixel_rgn_set_rect ( & m_region, m_tile,
-					  0, m_rows - remaining,
-					  m_width, remaining );
-	}
-      
       ::plib_gimp_drawable_flush ( m_drawable );
       ::plib_gimp_display_new ( m_image_id );
       ::plib_gimp_drawable_detach ( m_drawable );
-      ::free ( m_tile );
     }
   
   return PISA_ERR_SUCCESS;
 }
 
 /*----------------------------------------------------------*/
-int gimp_scan::bw2gray ( void )
+// Expands each byte to eight pixels with a single table lookup and
+// an eight byte copy.  Working from the end of the row backwards, a
+// byte is always read before its pixels overwrite it.
+void gimp_scan::bw2gray ( unsigned char * buf, int rows )
 {
-  unsigned char	* tmp;
-  unsigned char * bw_buf;
-  long		bw_buf_size;
-  long		i, j, k, tile_height;
+  unsigned char	* row;
+  long		i, j, full, rest;
 
-  tile_height = ::plib_gimp_tile_height ( );
-  bw_buf_size = ( ( m_width + 7 ) / 8 );
+  full = m_width / 8;
+  rest = m_width % 8;
 
-  bw_buf = new unsigned char [ bw_buf_size ];
+  for ( i = 0; i < rows; i++ )
+    {
+      row = buf + i * m_rowbytes;
 
-  if ( ! bw_buf )
-    return PISA_ERR_OUTOFMEMORY;
+      if ( rest )
+	::memcpy ( row + full * 8,
+		   g_bw_expansion.pixels [ row [ full ] ], rest );
 
-  for ( i = 0; i < tile_height; i++ )
-    {
-      ::memcpy ( bw_buf, m_tile + m_width * i, bw_buf_size );
-      
-      tmp = bw_buf;
-      
-      for ( j = 0; j < m_width; j += 8 )
-	{
-	  for ( k = 7; k >= 0; k-- )
-	    {
-	      if ( j + 7 - k < m_width )
-		{
-		  m_tile [ i * m_width + j + ( 7 - k ) ] = ( * tmp & ( 1 << k ) ) ?
-		    0x00 : 0xff;
-		}
-	    }
-	  tmp++;
-	}
+      for ( j = full - 1; 0 <= j; j-- )
+	::memcpy ( row + j * 8, g_bw_expansion.pixels [ row [ j ] ], 8 );
     }
-  
-  delete [ ] bw_buf;
-  
-  return PISA_ERR_SUCCESS;
 }
 
 #endif // HAVE_ANY_GIMP
@@ -77,17 +77,19 @@ class gimp_scan
 							int pixeltype,
 							int depth );
 
-  unsigned char *		get_next_buf ( void );
-  int	set_image_rect ( void );
+  int	get_strip_rows ( void ) const { return m_strip_rows; }
+  int	get_rowstride ( void ) const { return m_rowbytes; }
+  int	set_strip ( unsigned char * buf, int rows );
   int	finish_scan ( int cancel );
 
  private:
 
   // operation
-  int bw2gray ( void );
+  void bw2gray ( unsigned char * buf, int rows );
 
   // attribute  
   int			m_rows;
+  int			m_strip_rows;
 
   int			m_width;
   int			m_height;
@@ -97,7 +99,6 @@ class gimp_scan
 
   int			m_image_id;
   int			m_layer_id;
-  guchar		* m_tile;
   GimpDrawable	* m_drawable;
   GimpPixelRgn	m_region;
 
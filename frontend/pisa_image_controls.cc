@@ -172,7 +172,7 @@ static void value_changed ( GtkAdjustment * adjust, gpointer data )
       preview_window *prev_cls =
 	(preview_window *) ::g_view_manager->get_window_cls (ID_WINDOW_PREV);
 
-      prev_cls->update_img ( );
+      prev_cls->queue_update ( );
     }
 }
 
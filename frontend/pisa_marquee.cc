@@ -28,6 +28,9 @@
    code used other then esmod.
 */
 
+/*--------------------------------------------------------------*/
+#include <string.h>
+
 /*--------------------------------------------------------------*/
 #include "pisa_marquee.h"
 #include "pisa_default_val.h"
@@ -49,11 +52,9 @@ marquee::marquee (const double w, const double h,
   saturation (DEFSATURATION),
   focus (f)
 {
-  int		i, j;
+  int		i;
 
-  for ( i = 0; i < 4; i++ )
-    for ( j = 0; j < 256; j++ )
-      gamma_table [ i ] [ j ] = j;
+  reset_gamma_table ( );
 
   for ( i = 0; i < 3; i++ )
     {
@@ -74,7 +75,7 @@ marquee & marquee::operator= ( const marquee & x )
 {
   if ( & x != this )
     {
-      int i, j;
+      int i;
 
       active		= x.active;
       offset		= x.offset;
@@ -87,9 +88,7 @@ marquee & marquee::operator= ( const marquee & x )
       brightness	= x.brightness;
       contrast		= x.contrast;
       
-      for ( i = 0; i < 4; i++ )
-	for ( j = 0; j < 256; j++ )
-	  gamma_table [ i ] [ j ] = x.gamma_table [ i ] [ j ];
+      ::memcpy ( gamma_table, x.gamma_table, sizeof ( gamma_table ) );
 
       graybalance	= x.graybalance;
       saturation	= x.saturation;
@@ -115,3 +114,14 @@ marquee & marquee::operator= ( const marquee & x )
 }
 
 /*--------------------------------------------------------------*/
+void marquee::reset_gamma_table ( void )
+{
+  int i;
+
+  for ( i = 0; i < 256; i++ )
+    gamma_table [ 0 ] [ i ] = i;
+
+  for ( i = 1; i < 4; i++ )
+    ::memcpy ( gamma_table [ i ], gamma_table [ 0 ],
+	       sizeof ( gamma_table [ 0 ] ) );
+}
@@ -69,6 +69,8 @@ class marquee
            const long f = 0, const long b = 0, const long c = 0);
 
   marquee & operator= ( const marquee & x );
+
+  void reset_gamma_table ( void );
 };
 
 
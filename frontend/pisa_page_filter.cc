@@ -0,0 +1,417 @@
+/* pisa_page_filter.cc
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+/*------------------------------------------------------------*/
+#include <math.h>
+#include <string.h>
+
+/*------------------------------------------------------------*/
+#include "pisa_page_filter.h"
+#include "pisa_enums.h"
+#include "pisa_error.h"
+
+/*------------------------------------------------------------*/
+// fraction of the page on each side that is not inspected
+static const double g_margin		= 0.05;
+
+// how much darker than the paper a pixel has to be to count as ink
+static const int g_ink_contrast		= 48;
+
+// largest standard deviation of the pixel values on a blank page
+static const double g_max_deviation	= 24.0;
+
+// a pixel whose channels differ this much is chromatic, and a page
+// needs more than this fraction of chromatic pixels to stay colour
+static const int g_chroma_level		= 48;
+static const double g_colour_fraction	= 0.005;
+
+// largest fraction of pixels between ink and paper on a page that is
+// converted to black and white
+static const double g_max_midtones	= 0.06;
+
+/*------------------------------------------------------------*/
+// ITU-R BT.601 luma weights, scaled to add up to 256
+static inline int luma ( const unsigned char * p )
+{
+  return ( 77 * p [ 0 ] + 150 * p [ 1 ] + 29 * p [ 2 ] ) >> 8;
+}
+
+/*------------------------------------------------------------*/
+static unsigned char g_bit_count [ 256 ];
+
+static void init_bit_count ( void )
+{
+  static bool initialised = false;
+
+  if ( initialised )
+    return;
+
+  for ( int i = 0; i < 256; i++ )
+    for ( int k = 0; k < 8; k++ )
+      if ( i & ( 1 << k ) )
+	g_bit_count [ i ]++;
+
+  initialised = true;
+}
+
+namespace iscan
+{
+
+/*------------------------------------------------------------*/
+// Converts spooled rows to a lower pixel type on their way to the
+// image stream.
+class reducer : public basic_imgstream
+{
+public:
+  reducer ( imgstream & is, int width, int from, int to, int level )
+    : m_is ( is ), m_width ( width ), m_from ( from ), m_to ( to ),
+      m_level ( level )
+  {
+    m_row = new unsigned char [ PISA_PT_BW == to ? ( width + 7 ) / 8
+				: width ];
+  }
+
+  ~reducer ( void )
+  {
+    delete [] m_row;
+  }
+
+  basic_imgstream & write ( const byte_type * line, size_type )
+  {
+    const unsigned char * p = ( const unsigned char * ) line;
+    int step = ( PISA_PT_RGB == m_from ? 3 : 1 );
+    int x;
+
+    if ( PISA_PT_GRAY == m_to )
+      {
+	for ( x = 0; x < m_width; x++, p += 3 )
+	  m_row [ x ] = luma ( p );
+	m_is.write ( ( const byte_type * ) m_row, m_width );
+	return * this;
+      }
+
+    ::memset ( m_row, 0, ( m_width + 7 ) / 8 );
+    for ( x = 0; x < m_width; x++, p += step )
+      {
+	int v = ( 3 == step ? luma ( p ) : * p );
+	if ( v < m_level )
+	  m_row [ x / 8 ] |= 0x80 >> ( x % 8 );
+      }
+    m_is.write ( ( const byte_type * ) m_row, ( m_width + 7 ) / 8 );
+    return * this;
+  }
+
+private:
+  imgstream &		m_is;
+  int			m_width;
+  int			m_from;
+  int			m_to;
+  int			m_level;
+  unsigned char *	m_row;
+};
+
+/*------------------------------------------------------------*/
+page_filter::page_filter ( void )
+  : m_width ( 0 ), m_height ( 0 ), m_pixel_type ( PISA_PT_RGB ),
+    m_rowbytes ( 0 ), m_threshold ( 0.0 ), m_reduce_to ( PISA_PT_RGB ),
+    m_left ( 0 ), m_right ( 0 ), m_top ( 0 ), m_bottom ( 0 ), m_row ( 0 ),
+    m_ink ( 0 ), m_chromatic ( 0 )
+{
+  ::memset ( m_hist, 0, sizeof ( m_hist ) );
+  init_bit_count ( );
+}
+
+/*------------------------------------------------------------*/
+void page_filter::begin ( int width, int height, int pixel_type,
+			  double blank_threshold, int reduce_to )
+{
+  m_width	= width;
+  m_height	= height;
+  m_pixel_type	= pixel_type;
+  m_threshold	= blank_threshold;
+  m_reduce_to	= ( reduce_to < pixel_type ? reduce_to : pixel_type );
+
+  m_left	= ( int ) ( width * g_margin );
+  m_right	= width - m_left;
+  m_top		= ( int ) ( height * g_margin );
+  m_bottom	= height - m_top;
+  m_row		= 0;
+
+  ::memset ( m_hist, 0, sizeof ( m_hist ) );
+  m_ink		= 0;
+  m_chromatic	= 0;
+
+  try
+    {
+      switch ( pixel_type )
+	{
+	case PISA_PT_RGB:
+	  m_rowbytes = width * 3;
+	  m_spool.open ( width, height, 8, RGB );
+	  break;
+	case PISA_PT_GRAY:
+	  m_rowbytes = width;
+	  m_spool.open ( width, height, 8, gray );
+	  break;
+	case PISA_PT_BW:
+	  m_rowbytes = ( width + 7 ) / 8;
+	  m_spool.open ( width, height, 1, mono );
+	  break;
+	default:
+	  throw pisa_error ( PISA_ERR_PARAMETER );
+	}
+    }
+  catch ( std::exception & oops )
+    {
+      throw pisa_error ( PISA_ERR_OUTOFMEMORY );
+    }
+}
+
+/*------------------------------------------------------------*/
+void page_filter::write ( const unsigned char * rows, int num_rows )
+{
+  for ( int i = 0; i < num_rows; i++, rows += m_rowbytes, m_row++ )
+    {
+      m_spool.write ( ( const page_spool::byte_type * ) rows, m_rowbytes );
+
+      if ( m_row < m_top || m_bottom <= m_row )
+	continue;
+
+      if ( PISA_PT_BW == m_pixel_type )
+	add_bw ( rows );
+      else if ( PISA_PT_GRAY == m_pixel_type )
+	add_gray ( rows );
+      else
+	add_rgb ( rows );
+    }
+}
+
+/*------------------------------------------------------------*/
+bool page_filter::commit ( imgstream & is )
+{
+  if ( is_blank ( ) )
+    {
+      m_spool.close ( );
+      is.skip_page ( );
+      return false;
+    }
+
+  int type = classify ( );
+
+  if ( type == m_pixel_type )
+    {
+      m_spool.replay ( is );
+      return 0 < m_row;
+    }
+
+  int paper = paper_level ( );
+  reducer out ( is, m_width, m_pixel_type, type,
+		( paper + ink_level ( paper ) + 1 ) / 2 );
+
+  is.colour ( PISA_PT_BW == type ? mono : gray );
+  is.depth ( PISA_PT_BW == type ? 1 : 8 );
+  m_spool.replay ( out );
+  return 0 < m_row;
+}
+
+/*------------------------------------------------------------*/
+bool page_filter::is_blank ( void ) const
+{
+  if ( m_threshold <= 0.0 )
+    return false;
+
+  if ( PISA_PT_BW == m_pixel_type )
+    {
+      int rows = ( m_row < m_bottom ? m_row : m_bottom ) - m_top;
+      double pixels = ( double ) ( m_right - m_left ) * rows;
+
+      if ( pixels <= 0 )
+	return true;
+
+      return 100.0 * m_ink / pixels <= m_threshold;
+    }
+
+  unsigned long total = 0;
+  double sum = 0.0, sum2 = 0.0;
+  int i;
+
+  for ( i = 0; i < 256; i++ )
+    {
+      total += m_hist [ i ];
+      sum  += ( double ) i * m_hist [ i ];
+      sum2 += ( double ) i * i * m_hist [ i ];
+    }
+  if ( 0 == total )
+    return true;
+
+  int paper = paper_level ( );
+  unsigned long ink = 0;
+  for ( i = 0; i < paper - g_ink_contrast; i++ )
+    ink += m_hist [ i ];
+
+  double mean = sum / total;
+  double deviation = ::sqrt ( sum2 / total - mean * mean );
+
+  return ( 100.0 * ink / total <= m_threshold
+	   && deviation <= g_max_deviation );
+}
+
+/*------------------------------------------------------------*/
+int page_filter::classify ( void ) const
+{
+  if ( m_reduce_to == m_pixel_type || PISA_PT_BW == m_pixel_type )
+    return m_pixel_type;
+
+  unsigned long total = 0;
+  int i;
+
+  for ( i = 0; i < 256; i++ )
+    total += m_hist [ i ];
+  if ( 0 == total )
+    return m_reduce_to;
+
+  if ( PISA_PT_RGB == m_pixel_type
+       && m_chromatic > g_colour_fraction * total )
+    return PISA_PT_RGB;
+
+  if ( PISA_PT_GRAY == m_reduce_to )
+    return PISA_PT_GRAY;
+
+  // text and line art have little besides ink and paper
+  int paper = paper_level ( );
+  int ink   = ink_level ( paper );
+  unsigned long midtones = 0;
+
+  for ( i = ink + g_ink_contrast / 2; i < paper - g_ink_contrast / 2; i++ )
+    midtones += m_hist [ i ];
+
+  if ( midtones > g_max_midtones * total )
+    return PISA_PT_GRAY;
+
+  return PISA_PT_BW;
+}
+
+/*------------------------------------------------------------*/
+// JPEG has no use for black and white.
+int page_filter::reduced_type ( file_format format )
+{
+  return ( JPG == format ? PISA_PT_GRAY : PISA_PT_BW );
+}
+
+/*------------------------------------------------------------*/
+// The paper makes up the bulk of any page that is blank or could do
+// with fewer colours, so take the median.
+int page_filter::paper_level ( void ) const
+{
+  unsigned long total = 0, count = 0;
+  int paper;
+
+  for ( paper = 0; paper < 256; paper++ )
+    total += m_hist [ paper ];
+
+  for ( paper = 0; paper < 255; paper++ )
+    {
+      count += m_hist [ paper ];
+      if ( 2 * count >= total )
+	break;
+    }
+  return paper;
+}
+
+/*------------------------------------------------------------*/
+// Returns the median of the pixels that count as ink, or black when
+// there are none.
+int page_filter::ink_level ( int paper ) const
+{
+  unsigned long total = 0, count = 0;
+  int ink;
+
+  for ( ink = 0; ink < paper - g_ink_contrast; ink++ )
+    total += m_hist [ ink ];
+
+  for ( ink = 0; ink < paper - g_ink_contrast; ink++ )
+    {
+      count += m_hist [ ink ];
+      if ( 2 * count >= total )
+	return ink;
+    }
+  return 0;
+}
+
+/*------------------------------------------------------------*/
+void page_filter::add_bw ( const unsigned char * row )
+{
+  int first = m_left / 8;
+  int last  = ( m_right - 1 ) / 8;
+
+  if ( m_right <= m_left )
+    return;
+
+  unsigned char head = 0xff >> ( m_left % 8 );
+  unsigned char tail = 0xff << ( 7 - ( m_right - 1 ) % 8 );
+
+  if ( first == last )
+    {
+      m_ink += g_bit_count [ row [ first ] & head & tail ];
+      return;
+    }
+
+  m_ink += g_bit_count [ row [ first ] & head ];
+  for ( int i = first + 1; i < last; i++ )
+    m_ink += g_bit_count [ row [ i ] ];
+  m_ink += g_bit_count [ row [ last ] & tail ];
+}
+
+/*------------------------------------------------------------*/
+void page_filter::add_gray ( const unsigned char * row )
+{
+  const unsigned char * p   = row + m_left;
+  const unsigned char * end = row + m_right;
+
+  while ( p < end )
+    m_hist [ *p++ ]++;
+}
+
+/*------------------------------------------------------------*/
+void page_filter::add_rgb ( const unsigned char * row )
+{
+  const unsigned char * p   = row + m_left * 3;
+  const unsigned char * end = row + m_right * 3;
+
+  for ( ; p < end; p += 3 )
+    {
+      int lo = p [ 0 ], hi = p [ 0 ];
+
+      if ( p [ 1 ] < lo ) lo = p [ 1 ]; else if ( hi < p [ 1 ] ) hi = p [ 1 ];
+      if ( p [ 2 ] < lo ) lo = p [ 2 ]; else if ( hi < p [ 2 ] ) hi = p [ 2 ];
+
+      if ( g_chroma_level < hi - lo )
+	m_chromatic++;
+      m_hist [ luma ( p ) ]++;
+    }
+}
+
+} // namespace iscan
@@ -0,0 +1,108 @@
+/* pisa_page_filter.h
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+#ifndef ___PISA_PAGE_FILTER_H
+#define ___PISA_PAGE_FILTER_H
+
+#include "imgstream.hh"
+#include "page-spool.hh"
+
+namespace iscan
+{
+
+  /* Holds on to a scanned page while collecting statistics on its
+     content so that the page can be dropped when it turns out to be
+     blank, or stored with fewer colours when that loses nothing.
+     Rows are passed to write() as they come in from the scanner and
+     the page is spooled to a temporary file.  When the page is
+     complete, commit() either passes it on to an image stream or
+     tells the stream to skip it.
+
+     Only the part of the page inside a margin of 5% on all sides is
+     looked at, so that sheet edges, punch holes and scanner shadows do
+     not count as content.  A page is blank when its ink coverage, the
+     percentage of the inspected pixels that are clearly darker than
+     the paper, does not exceed the threshold and, for gray and colour
+     pages, the spread of the pixel values is small enough to rule out
+     faint, low contrast content.  A threshold of zero turns blank
+     page detection off.
+
+     Pages may be reduced down to the reduce_to pixel type.  A colour
+     page without a noticeable share of chromatic pixels is converted
+     to gray.  A gray page, or a colour page that was found to be
+     gray, with hardly any pixels between ink and paper is converted
+     to black and white.  The image stream is told about the reduced
+     colour space and bit depth before the page is passed on, so that
+     the stream can pick a suitable encoding.  reduced_type() tells
+     how far pages for a given file format can be reduced.
+   */
+  class page_filter
+  {
+  public:
+    page_filter ( void );
+
+    void	begin ( int width, int height, int pixel_type,
+			double blank_threshold, int reduce_to );
+    void	write ( const unsigned char * rows, int num_rows );
+    bool	commit ( imgstream & is );
+
+    bool	is_blank ( void ) const;
+    int		classify ( void ) const;
+
+    static int	reduced_type ( file_format format );
+
+  private:
+    int		paper_level ( void ) const;
+    int		ink_level ( int paper ) const;
+
+    void	add_bw ( const unsigned char * row );
+    void	add_gray ( const unsigned char * row );
+    void	add_rgb ( const unsigned char * row );
+
+    page_spool		m_spool;
+
+    int			m_width;
+    int			m_height;
+    int			m_pixel_type;
+    int			m_rowbytes;
+    double		m_threshold;
+    int			m_reduce_to;
+
+    // inspected area
+    int			m_left;
+    int			m_right;
+    int			m_top;
+    int			m_bottom;
+    int			m_row;
+
+    unsigned long	m_hist [ 256 ];
+    unsigned long	m_ink;
+    unsigned long	m_chromatic;
+  };
+
+} // namespace iscan
+
+#endif // ___PISA_PAGE_FILTER_H
@@ -0,0 +1,490 @@
+/* pisa_preview_cache.cc
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+/*------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*------------------------------------------------------------*/
+#include "pisa_preview_cache.h"
+#include "pisa_default_val.h"
+
+/*------------------------------------------------------------*/
+// slack when comparing areas, in inches
+static const double g_area_slack = 0.005;
+
+/*------------------------------------------------------------*/
+preview_cache::preview_cache ( )
+{
+  m_num_entries = 0;
+}
+
+/*------------------------------------------------------------*/
+preview_cache::~preview_cache ( )
+{
+  clear ( );
+}
+
+/*------------------------------------------------------------*/
+void preview_cache::clear ( void )
+{
+  long i;
+
+  for ( i = 0; i < m_num_entries; i++ )
+    free_entry ( m_entry [ i ] );
+
+  m_num_entries = 0;
+}
+
+/*------------------------------------------------------------*/
+void preview_cache::free_entry ( entry & e )
+{
+  long i;
+
+  for ( i = 0; i < e.num_levels; i++ )
+    delete [ ] e.lv [ i ].img;
+
+  e.num_levels = 0;
+}
+
+/*------------------------------------------------------------*/
+// Adds an acquisition of the given area.  The oldest entry is
+// dropped when the cache is full.
+void preview_cache::store ( const unsigned char * img,
+			    long width, long height, long rowbytes,
+			    const _rectD & area )
+{
+  long		i, x, y;
+  double	area_w, area_h;
+
+  area_w = area.right - area.left;
+  area_h = area.bottom - area.top;
+
+  if ( img == 0 || width < 1 || height < 1 || area_w <= 0 || area_h <= 0 )
+    return;
+
+  if ( MAX_ENTRIES == m_num_entries )
+    {
+      free_entry ( m_entry [ 0 ] );
+      for ( i = 1; i < MAX_ENTRIES; i++ )
+	m_entry [ i - 1 ] = m_entry [ i ];
+      m_num_entries--;
+    }
+
+  entry & e = m_entry [ m_num_entries ];
+
+  e.area	= area;
+  e.num_levels	= 1;
+
+  e.lv [ 0 ].width	= width;
+  e.lv [ 0 ].height	= height;
+  e.lv [ 0 ].res_x	= width / area_w;
+  e.lv [ 0 ].res_y	= height / area_h;
+  e.lv [ 0 ].img	= new unsigned char [ width * height * 3 ];
+
+  for ( y = 0; y < height; y++ )
+    ::memcpy ( e.lv [ 0 ].img + y * width * 3,
+	       img + y * rowbytes, width * 3 );
+
+  // build the reduced copies by 2x2 averaging
+  while ( e.num_levels < MAX_LEVELS )
+    {
+      const level & src = e.lv [ e.num_levels - 1 ];
+      level & dst = e.lv [ e.num_levels ];
+
+      if ( src.width < 32 || src.height < 32 )
+	break;
+
+      dst.width		= src.width / 2;
+      dst.height	= src.height / 2;
+      dst.res_x		= dst.width / area_w;
+      dst.res_y		= dst.height / area_h;
+      dst.img		= new unsigned char [ dst.width * dst.height * 3 ];
+
+      for ( y = 0; y < dst.height; y++ )
+	{
+	  const unsigned char * s0 = src.img + 2 * y * src.width * 3;
+	  const unsigned char * s1 = s0 + src.width * 3;
+	  unsigned char * d = dst.img + y * dst.width * 3;
+
+	  for ( x = 0; x < dst.width * 3; x += 3 )
+	    {
+	      for ( i = 0; i < 3; i++ )
+		d [ x + i ] = ( s0 [ 2 * x + i ] + s0 [ 2 * x + 3 + i ]
+				+ s1 [ 2 * x + i ] + s1 [ 2 * x + 3 + i ]
+				+ 2 ) / 4;
+	    }
+	}
+
+      e.num_levels++;
+    }
+
+  m_num_entries++;
+}
+
+/*------------------------------------------------------------*/
+// Returns the highest resolution at which the given area can be
+// produced from the cache, or zero when no entry covers it.
+double preview_cache::get_resolution ( const _rectD & area ) const
+{
+  const entry	* e = find_entry ( area );
+
+  if ( e == 0 )
+    return 0.0;
+
+  return ( e->lv [ 0 ].res_x < e->lv [ 0 ].res_y
+	   ? e->lv [ 0 ].res_x : e->lv [ 0 ].res_y );
+}
+
+/*------------------------------------------------------------*/
+// Returns the covering entry with the highest resolution.  Later
+// entries win ties as they are the more recent acquisitions.
+const preview_cache::entry *
+preview_cache::find_entry ( const _rectD & area ) const
+{
+  const entry	* best = 0;
+  long		i;
+
+  for ( i = 0; i < m_num_entries; i++ )
+    {
+      const entry & e = m_entry [ i ];
+
+      if ( area.left   < e.area.left   - g_area_slack
+	   || area.top    < e.area.top    - g_area_slack
+	   || area.right  > e.area.right  + g_area_slack
+	   || area.bottom > e.area.bottom + g_area_slack )
+	continue;
+
+      if ( best == 0 || best->lv [ 0 ].res_x <= e.lv [ 0 ].res_x )
+	best = & e;
+    }
+
+  return best;
+}
+
+/*------------------------------------------------------------*/
+// Renders the given area into a width x height RGB image, using the
+// smallest pyramid level that still has enough resolution and
+// bilinear interpolation from there.  Returns false when no entry
+// covers the area.
+bool preview_cache::extract ( const _rectD & area,
+			      unsigned char * img,
+			      long width, long height, long rowbytes ) const
+{
+  const entry	* e = find_entry ( area );
+  long		i, x, y, c;
+  double	res_x, res_y;
+
+  if ( e == 0 || img == 0 || width < 1 || height < 1 )
+    return false;
+
+  res_x = width / ( area.right - area.left );
+  res_y = height / ( area.bottom - area.top );
+
+  for ( i = e->num_levels - 1; 0 < i; i-- )
+    {
+      if ( res_x <= e->lv [ i ].res_x && res_y <= e->lv [ i ].res_y )
+	break;
+    }
+
+  const level & lv = e->lv [ i ];
+
+  for ( y = 0; y < height; y++ )
+    {
+      double	sy = ( ( area.top - e->area.top + ( y + 0.5 ) / res_y )
+		       * lv.res_y - 0.5 );
+      long	y0, y1;
+      double	fy;
+
+      if ( sy < 0 )
+	sy = 0;
+      if ( sy > lv.height - 1 )
+	sy = lv.height - 1;
+      y0 = ( long ) sy;
+      y1 = ( y0 + 1 < lv.height ? y0 + 1 : y0 );
+      fy = sy - y0;
+
+      const unsigned char * r0 = lv.img + y0 * lv.width * 3;
+      const unsigned char * r1 = lv.img + y1 * lv.width * 3;
+      unsigned char * out = img + y * rowbytes;
+
+      for ( x = 0; x < width; x++ )
+	{
+	  double	sx = ( ( area.left - e->area.left + ( x + 0.5 ) / res_x )
+			       * lv.res_x - 0.5 );
+	  long		x0, x1;
+	  double	fx;
+
+	  if ( sx < 0 )
+	    sx = 0;
+	  if ( sx > lv.width - 1 )
+	    sx = lv.width - 1;
+	  x0 = ( long ) sx;
+	  x1 = ( x0 + 1 < lv.width ? x0 + 1 : x0 );
+	  fx = sx - x0;
+
+	  for ( c = 0; c < 3; c++ )
+	    {
+	      double top = ( r0 [ x0 * 3 + c ] * ( 1 - fx )
+			     + r0 [ x1 * 3 + c ] * fx );
+	      double bot = ( r1 [ x0 * 3 + c ] * ( 1 - fx )
+			     + r1 [ x1 * 3 + c ] * fx );
+
+	      out [ x * 3 + c ] = ( unsigned char ) ( top * ( 1 - fy )
+						      + bot * fy + 0.5 );
+	    }
+	}
+    }
+
+  return true;
+}
+
+/*------------------------------------------------------------*/
+typedef struct
+{
+  char		magic [ 8 ];
+  long		header_size;
+  char		key [ 256 ];
+  long		width;
+  long		height;
+  double	area [ 4 ];
+  long		gamma;
+  long		highlight;
+  long		shadow;
+  long		graybalance;
+  double	film_gamma [ 3 ];
+  double	film_yp [ 3 ];
+  double	grayl [ 3 ];
+} store_header;
+
+static const char g_store_magic [ 8 ] = { 'i', 's', 'c', 'a', 'n', 'p', 'v', '1' };
+
+/*------------------------------------------------------------*/
+preview_store::preview_store ( const std::string & key )
+  : m_key ( key ), m_map ( 0 ), m_map_size ( 0 )
+{
+  const char	* home = ::getenv ( "HOME" );
+  unsigned long	hash = 2166136261UL;
+  char		name [ 16 ];
+  std::string::size_type i;
+
+  if ( ! home || m_key.size ( ) >= sizeof ( ( ( store_header * ) 0 )->key ) )
+    return;
+
+  // FNV-1a, the key itself is checked against the file header
+  for ( i = 0; i < m_key.size ( ); i++ )
+    {
+      hash ^= ( unsigned char ) m_key [ i ];
+      hash = ( hash * 16777619UL ) & 0xffffffffUL;
+    }
+  ::sprintf ( name, "%08lx", hash );
+
+  m_path = home;
+  m_path += "/";
+  m_path += PREVIEW_STORE;
+  m_path += "/";
+  m_path += name;
+}
+
+/*------------------------------------------------------------*/
+preview_store::~preview_store ( )
+{
+  close ( );
+}
+
+/*------------------------------------------------------------*/
+void preview_store::close ( void )
+{
+  if ( m_map )
+    ::munmap ( m_map, m_map_size );
+
+  m_map		= 0;
+  m_map_size	= 0;
+}
+
+/*------------------------------------------------------------*/
+// Writes the preview to a temporary file that is renamed over the
+// old one, so readers never see a partial file.
+bool preview_store::save ( const unsigned char * img,
+			   long width, long height, long rowbytes,
+			   const _rectD & area, const marquee & marq ) const
+{
+  store_header	hdr;
+  std::string	dir, tmp;
+  long		y;
+  int		fd, i;
+  bool		ok;
+
+  if ( m_path.empty ( ) || img == 0 || width < 1 || height < 1 )
+    return false;
+
+  dir = m_path.substr ( 0, m_path.rfind ( '/' ) );
+  if ( ::mkdir ( dir.c_str ( ), 0700 ) && EEXIST != errno )
+    return false;
+
+  ::memset ( & hdr, 0, sizeof ( hdr ) );
+  ::memcpy ( hdr.magic, g_store_magic, sizeof ( hdr.magic ) );
+  ::strcpy ( hdr.key, m_key.c_str ( ) );
+  hdr.header_size	= sizeof ( hdr );
+  hdr.width		= width;
+  hdr.height		= height;
+  hdr.area [ 0 ]	= area.left;
+  hdr.area [ 1 ]	= area.top;
+  hdr.area [ 2 ]	= area.right;
+  hdr.area [ 3 ]	= area.bottom;
+  hdr.gamma		= marq.gamma;
+  hdr.highlight		= marq.highlight;
+  hdr.shadow		= marq.shadow;
+  hdr.graybalance	= marq.graybalance;
+  for ( i = 0; i < 3; i++ )
+    {
+      hdr.film_gamma [ i ]	= marq.film_gamma [ i ];
+      hdr.film_yp [ i ]		= marq.film_yp [ i ];
+      hdr.grayl [ i ]		= marq.grayl [ i ];
+    }
+
+  tmp = m_path + ".tmp";
+  fd = ::open ( tmp.c_str ( ), O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+  if ( fd < 0 )
+    return false;
+
+  ok = ( ( ssize_t ) sizeof ( hdr ) == ::write ( fd, & hdr, sizeof ( hdr ) ) );
+  for ( y = 0; ok && y < height; y++ )
+    ok = ( width * 3 == ::write ( fd, img + y * rowbytes, width * 3 ) );
+
+  if ( ::close ( fd ) )
+    ok = false;
+
+  if ( ok && ::rename ( tmp.c_str ( ), m_path.c_str ( ) ) )
+    ok = false;
+
+  if ( ! ok )
+    ::unlink ( tmp.c_str ( ) );
+
+  return ok;
+}
+
+/*------------------------------------------------------------*/
+// Maps the stored preview when the file matches the key and area and
+// fits into max_width x max_height, and puts its size in width and
+// height.  Returns false if there is no usable file.  Nothing needs
+// a preview buffer until this succeeds.
+bool preview_store::open ( long max_width, long max_height,
+			   const _rectD & area,
+			   long * width, long * height )
+{
+  const store_header	* hdr;
+  struct stat		st;
+  void			* map;
+  int			fd;
+  bool			ok;
+
+  close ( );
+
+  if ( m_path.empty ( ) )
+    return false;
+
+  fd = ::open ( m_path.c_str ( ), O_RDONLY );
+  if ( fd < 0 )
+    return false;
+
+  if ( ::fstat ( fd, & st )
+       || st.st_size < ( off_t ) sizeof ( store_header ) )
+    {
+      ::close ( fd );
+      return false;
+    }
+
+  map = ::mmap ( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  ::close ( fd );
+  if ( MAP_FAILED == map )
+    return false;
+
+  hdr = static_cast < const store_header * > ( map );
+
+  ok = ( 0 == ::memcmp ( hdr->magic, g_store_magic, sizeof ( hdr->magic ) )
+	 && ( long ) sizeof ( *hdr ) == hdr->header_size
+	 && 0 == ::strncmp ( hdr->key, m_key.c_str ( ), sizeof ( hdr->key ) )
+	 && 0 < hdr->width && hdr->width <= max_width
+	 && 0 < hdr->height && hdr->height <= max_height
+	 && st.st_size == ( off_t ) ( sizeof ( *hdr )
+				      + hdr->width * hdr->height * 3 )
+	 && area.left == hdr->area [ 0 ] && area.top == hdr->area [ 1 ]
+	 && area.right == hdr->area [ 2 ] && area.bottom == hdr->area [ 3 ] );
+
+  if ( ! ok )
+    {
+      ::munmap ( map, st.st_size );
+      return false;
+    }
+
+  m_map		= map;
+  m_map_size	= st.st_size;
+
+  * width	= hdr->width;
+  * height	= hdr->height;
+
+  return true;
+}
+
+/*------------------------------------------------------------*/
+// Copies the preview mapped by a successful open() into img and its
+// auto exposure results into marq, then lets go of the file.
+void preview_store::load ( unsigned char * img, long rowbytes,
+			   marquee * marq ) const
+{
+  const store_header	* hdr;
+  const unsigned char	* data;
+  long			y;
+  int			i;
+
+  if ( ! m_map || img == 0 || marq == 0 )
+    return;
+
+  hdr  = static_cast < const store_header * > ( m_map );
+  data = static_cast < const unsigned char * > ( m_map ) + sizeof ( *hdr );
+
+  for ( y = 0; y < hdr->height; y++ )
+    ::memcpy ( img + y * rowbytes, data + y * hdr->width * 3,
+	       hdr->width * 3 );
+
+  marq->gamma		= hdr->gamma;
+  marq->highlight	= hdr->highlight;
+  marq->shadow		= hdr->shadow;
+  marq->graybalance	= hdr->graybalance;
+  for ( i = 0; i < 3; i++ )
+    {
+      marq->film_gamma [ i ]	= hdr->film_gamma [ i ];
+      marq->film_yp [ i ]	= hdr->film_yp [ i ];
+      marq->grayl [ i ]		= hdr->grayl [ i ];
+    }
+}
@@ -0,0 +1,130 @@
+/* pisa_preview_cache.h
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+#ifndef ___PISA_PREVIEW_CACHE_H
+#define ___PISA_PREVIEW_CACHE_H
+
+#include <string>
+
+#include "pisa_structs.h"
+#include "pisa_marquee.h"
+
+/*------------------------------------------------------------*/
+/* Keeps the raw RGB data of the most recent preview acquisitions,
+   each with a pyramid of 2x2 reduced copies, so that a zoom into an
+   area that has already been scanned at a sufficient resolution can
+   be served without moving the scan head again.  Areas are given in
+   inches, resolutions in pixels per inch.
+ */
+class preview_cache
+{
+ public:
+
+  preview_cache ( );
+  ~preview_cache ( );
+
+  void	clear ( void );
+
+  void	store ( const unsigned char * img,
+		long width, long height, long rowbytes,
+		const _rectD & area );
+
+  double	get_resolution ( const _rectD & area ) const;
+
+  bool	extract ( const _rectD & area,
+		  unsigned char * img,
+		  long width, long height, long rowbytes ) const;
+
+ private:
+
+  enum { MAX_ENTRIES = 4, MAX_LEVELS = 8 };
+
+  typedef struct
+  {
+    unsigned char	* img;
+    long		width;
+    long		height;
+    double		res_x;
+    double		res_y;
+  } level;
+
+  typedef struct
+  {
+    _rectD		area;
+    long		num_levels;
+    level		lv [ MAX_LEVELS ];
+  } entry;
+
+  const entry * find_entry ( const _rectD & area ) const;
+  void	free_entry ( entry & e );
+
+  entry		m_entry [ MAX_ENTRIES ];
+  long		m_num_entries;
+
+  // undefined to prevent copying
+  preview_cache ( const preview_cache & );
+  preview_cache & operator= ( const preview_cache & );
+};
+
+/*------------------------------------------------------------*/
+/* On-disk copy of the last full preview and its auto exposure
+   results, kept across sessions in one file per validity key.  The
+   file is a fixed size header followed by the raw RGB rows so that it
+   can be mapped and copied straight into the preview buffer.  open()
+   checks the file before the caller commits to a buffer for load().
+ */
+class preview_store
+{
+ public:
+
+  preview_store ( const std::string & key );
+  ~preview_store ( );
+
+  bool	save ( const unsigned char * img,
+	       long width, long height, long rowbytes,
+	       const _rectD & area, const marquee & marq ) const;
+
+  bool	open ( long max_width, long max_height, const _rectD & area,
+	       long * width, long * height );
+
+  void	load ( unsigned char * img, long rowbytes, marquee * marq ) const;
+
+ private:
+
+  std::string	m_key;
+  std::string	m_path;
+
+  void		* m_map;
+  long		m_map_size;
+
+  void	close ( void );
+
+  // undefined to prevent copying
+  preview_store ( const preview_store & );
+  preview_store & operator= ( const preview_store & );
+};
+
+#endif // ___PISA_PREVIEW_CACHE_H
@@ -38,6 +38,8 @@
 #include "pisa_default_val.h"
 #include "pisa_aleart_dialog.h"
 #include "pisa_change_unit.h"
+#include "pisa_exposure.h"
+#include "pisa_autocrop.h"
 
 /*------------------------------------------------------------*/
 long g_prev_max_x		= 320;
@@ -45,6 +47,9 @@ long g_prev_max_y		= 440;
 
 const double g_min_marq_size	= 0.4;
 
+// inches kept around documents found on the preview
+const double g_crop_margin	= 0.1;
+
 /*------------------------------------------------------------*/
 static gint expose_event ( GtkWidget * widget,
 			   GdkEventExpose * event )
@@ -68,6 +73,16 @@ static gint event ( GtkWidget * widget,
   return prev_cls->event ( widget, event );
 }
 
+/*------------------------------------------------------------*/
+static gint update_timeout ( gpointer data )
+{
+  preview_window	* prev_cls;
+
+  prev_cls = ( preview_window * ) data;
+
+  return prev_cls->flush_update ( );
+}
+
 /*------------------------------------------------------------*/
 static void size_allocate ( GtkWidget * widget )
 {
@@ -91,19 +106,18 @@ int preview_window::init ( void )
   m_is_prev	= 0;
   m_drag	= 0;
 
+  m_tables_valid = false;
+  m_dirty_top	 = 0;
+  m_dirty_bottom = g_prev_max_y;
+  m_update_id	 = 0;
+
   m_img		= new unsigned char [ g_prev_max_x * g_prev_max_y * 3 ];
 
   if ( m_img == 0 )
     return PISA_ERR_OUTOFMEMORY;
 
-  m_img_org	= new unsigned char [ g_prev_max_x * g_prev_max_y * 3 ];
-
-  if ( m_img_org == 0 )
-    {
-      delete [ ] m_img;
-      m_img = 0;
-      return PISA_ERR_OUTOFMEMORY;
-    }
+  // raw data is not needed until there is a preview
+  m_img_org	= 0;
 
   for ( i = 0; i < 11; i++ )
     m_cursor [ i ] = 0;
@@ -130,6 +144,12 @@ int preview_window::close_window ( int destroy )
 {
   destroy = destroy;
 
+  if ( m_update_id )
+    {
+      ::gtk_timeout_remove ( m_update_id );
+      m_update_id = 0;
+    }
+
   if ( m_gc )
     {
       ::gdk_gc_destroy ( m_gc );
@@ -148,22 +168,43 @@ int preview_window::close_window ( int destroy )
       m_img_org = 0;
     }
 
+  m_cache.clear ( );
+
   return PISA_ERR_SUCCESS;
 }
 
 /*------------------------------------------------------------*/
 int preview_window::resize_window ( void )
 {
+  m_cache.clear ( );
+
   get_preview_resolution ( );
   resize_preview_window ( 0, 0 );
 
   clear_image ( );
+  load_stored_preview ( );
 
   return 0;
 }
 
 /*------------------------------------------------------------*/
 int preview_window::auto_exposure ( void )
+{
+  if ( m_is_prev == 0 ||
+       g_view_manager->get_settings ().imgtype.pixeltype == PISA_PT_BW )
+    {
+      return PISA_ERR_SUCCESS;
+    }
+
+  expose_rows ( m_img_height );
+
+  return PISA_ERR_SUCCESS;
+}
+
+/*------------------------------------------------------------*/
+// Runs auto exposure on the first rows of the preview image only.
+// Used while the preview is still streaming in.
+void preview_window::expose_rows ( long rows )
 {
   pisa_image_info	info;
   _rectL		region;
@@ -172,15 +213,12 @@ int preview_window::auto_exposure ( void )
 
   scan_manager	*scan_mgr = g_view_manager->get_scan_manager ();
 
-  if ( m_is_prev == 0 ||
-       g_view_manager->get_settings ().imgtype.pixeltype == PISA_PT_BW )
-    {
-      return PISA_ERR_SUCCESS;
-    }
+  if ( rows > m_img_height )
+    rows = m_img_height;
 
   info.m_img	= m_img_org;
   info.m_width	= m_img_width;
-  info.m_height	= m_img_height;
+  info.m_height	= rows;
   info.m_rowbytes = g_prev_max_x * 3;
 
   marq_num = g_view_manager->get_marquee_size ();
@@ -205,6 +243,11 @@ int preview_window::auto_exposure ( void )
       region.bottom	= pt_rb.y;
     }
 
+  if ( region.bottom > rows - 1 )
+    region.bottom = rows - 1;
+  if ( region.bottom < region.top )
+    return;
+
   settings set = g_view_manager->get_settings ();
   scan_manager *sm = g_view_manager->get_scan_manager ();
   iscan::auto_expose (sm->get_scan_source (),
@@ -227,14 +270,11 @@ int preview_window::auto_exposure ( void )
 
   ::g_view_manager->sensitive ( );
   ::g_view_manager->update_lut ( );
-
-  return PISA_ERR_SUCCESS;
 }
 
 /*------------------------------------------------------------*/
 int preview_window::update_img ( bool left )
 {
-  int			i;
   pisa_image_info	img_info;
   marquee		* marq;
   double                delta;
@@ -265,48 +305,161 @@ int preview_window::update_img ( bool left )
   if ( m_img == 0 || m_img_org == 0 )
     return PISA_ERR_OUTOFMEMORY;
 
-  ::memcpy ( m_img, m_img_org, g_prev_max_x * g_prev_max_y * 3 );
+  // Only rows whose source data changed need work unless the
+  // rendering parameters changed.  Unsharp masking and B/W error
+  // diffusion look at neighbouring pixels, so they always redo it all.
+  bool full = prepare_tables ( set, * marq );
+  if ( set.usm || PISA_PT_BW == set.imgtype.pixeltype )
+    full = true;
 
-  img_info.m_img	= m_img;
-  img_info.m_width	= m_img_width;
-  img_info.m_height	= m_img_height;
-  img_info.m_rowbytes	= g_prev_max_x * 3;
+  long top	= ( full ? 0 : m_dirty_top );
+  long bottom	= ( full ? m_img_height : m_dirty_bottom );
+
+  if ( bottom > m_img_height )
+    bottom = m_img_height;
 
-  ::tool_lut ( & img_info, & marq->lut );
+  m_dirty_top	 = m_img_height;
+  m_dirty_bottom = 0;
 
-  switch (set.imgtype.pixeltype)
+  if ( top < bottom )
     {
-    case PISA_PT_RGB:
-      tool_matrix (&img_info, marq->saturation, set.coef);
-      if (set.usm)
-	tool_usm (img_info);
-      break;
+      pisa_image_info	org_info;
 
-    case PISA_PT_GRAY:
-      build_gray (&img_info, set.imgtype.dropout);
-      if (set.usm)
-	tool_usm (img_info);
-      break;
+      org_info.m_img		= m_img_org;
+      org_info.m_width		= m_img_width;
+      org_info.m_height		= m_img_height;
+      org_info.m_rowbytes	= g_prev_max_x * 3;
 
-    case PISA_PT_BW:
-      build_bw (&img_info,
-		set.imgtype.dropout,
-		set.imgtype.halftone,
-		marq->threshold);
-      break;
+      img_info.m_img		= m_img;
+      img_info.m_width		= m_img_width;
+      img_info.m_height		= m_img_height;
+      img_info.m_rowbytes	= g_prev_max_x * 3;
+
+      ::tool_preview ( & img_info, & org_info, & m_tables, top, bottom );
+
+      switch (set.imgtype.pixeltype)
+	{
+	case PISA_PT_RGB:
+	case PISA_PT_GRAY:
+	  if (set.usm)
+	    tool_usm (img_info);
+	  break;
+
+	case PISA_PT_BW:
+	  build_bw (&img_info,
+		    set.imgtype.dropout,
+		    set.imgtype.halftone,
+		    marq->threshold);
+	  break;
+	}
     }
 
-  for ( i = 0; i < m_img_height; i++ )
-    ::gtk_preview_draw_row ( GTK_PREVIEW ( m_prev ),
-			     m_img + i * g_prev_max_x * 3,
-			     0, i, m_img_width );
-  
-  ::gtk_widget_draw ( m_prev, 0 );
-  ::gdk_flush ( );
+  present_rows ( top, bottom );
 
   return PISA_ERR_SUCCESS;
 }
 
+/*------------------------------------------------------------*/
+// Schedules an update_img() for the next display frame.  Slider and
+// curve callbacks fire far more often than the screen refreshes, so
+// all requests made in the meantime are folded into a single pass.
+void preview_window::queue_update ( void )
+{
+  if ( m_update_id )
+    return;
+
+  m_update_id = ::gtk_timeout_add ( 1000 / 60, ::update_timeout, this );
+}
+
+/*------------------------------------------------------------*/
+gint preview_window::flush_update ( void )
+{
+  m_update_id = 0;
+
+  update_img ( );
+
+  return FALSE;
+}
+
+/*------------------------------------------------------------*/
+// Rebuilds the preview kernel tables when any of the parameters they
+// depend on changed since the last call.  Returns true in that case,
+// meaning that every row has to be recomputed.
+bool preview_window::prepare_tables ( const settings & set,
+				      const marquee & marq )
+{
+  int i;
+
+  if ( m_tables_valid
+       && m_key_saturation == marq.saturation
+       && m_key_pixeltype == set.imgtype.pixeltype
+       && m_key_dropout == set.imgtype.dropout
+       && m_key_halftone == set.imgtype.halftone
+       && m_key_threshold == marq.threshold
+       && m_key_usm == set.usm
+       && 0 == ::memcmp ( & m_key_lut, & marq.lut, sizeof ( m_key_lut ) ) )
+    {
+      for ( i = 0; i < 9; i++ )
+	if ( m_key_coef [ i ] != set.coef [ i ] )
+	  break;
+      if ( 9 == i )
+	return false;
+    }
+
+  ::build_preview_tables ( & m_tables, & marq.lut,
+			   set.imgtype.pixeltype,
+			   marq.saturation, set.coef,
+			   set.imgtype.dropout );
+
+  m_key_lut		= marq.lut;
+  m_key_saturation	= marq.saturation;
+  m_key_pixeltype	= set.imgtype.pixeltype;
+  m_key_dropout		= set.imgtype.dropout;
+  m_key_halftone	= set.imgtype.halftone;
+  m_key_threshold	= marq.threshold;
+  m_key_usm		= set.usm;
+  for ( i = 0; i < 9; i++ )
+    m_key_coef [ i ] = set.coef [ i ];
+
+  m_tables_valid = true;
+
+  return true;
+}
+
+/*------------------------------------------------------------*/
+// Renders rows [top, bottom) of m_img_org into m_img with the current
+// kernel tables and puts them on screen.  Neighbourhood operations
+// are left to update_img().
+void preview_window::render_rows ( long top, long bottom )
+{
+  pisa_image_info	org_info, img_info;
+
+  org_info.m_img	= m_img_org;
+  org_info.m_width	= m_img_width;
+  org_info.m_height	= m_img_height;
+  org_info.m_rowbytes	= g_prev_max_x * 3;
+
+  img_info.m_img	= m_img;
+  img_info.m_width	= m_img_width;
+  img_info.m_height	= m_img_height;
+  img_info.m_rowbytes	= g_prev_max_x * 3;
+
+  ::tool_preview ( & img_info, & org_info, & m_tables, top, bottom );
+
+  present_rows ( top, bottom );
+}
+
+/*------------------------------------------------------------*/
+// Marks rows [top, bottom) of m_img_org as modified so that the next
+// update_img() recomputes them.
+void preview_window::invalidate_rows ( long top, long bottom )
+{
+  if ( top < m_dirty_top )
+    m_dirty_top = top;
+  if ( bottom > m_dirty_bottom )
+    m_dirty_bottom = bottom;
+}
+
 void
 preview_window::start_preview (bool zooming)
 {
@@ -317,12 +470,32 @@ preview_window::start_preview (bool zooming)
 
   cancel = 0;
 
+  alloc_img_org ( );
+
   m_is_prev = 0;
 
   m_on_preview = true;
   m_allocate_width = 0;
   m_allocate_height = 0;
 
+  set_preview_param (zooming);
+
+  reset_settings (zooming);
+  ::g_view_manager->sensitive ( );
+
+  if (zooming && zoom_from_cache ())
+    {
+      revert_resolution ();
+
+      ::g_view_manager->sensitive ( );
+
+      gint x, y;
+      ::gdk_window_get_pointer ( m_prev->window, & x, & y, 0 );
+      set_mouse_cursor ( x, y );
+      change_cursor ( );
+      return;
+    }
+
   progress_window feedback
     (static_cast <main_window *> (g_view_manager
 				  ->get_window_cls (ID_WINDOW_MAIN))
@@ -340,12 +513,6 @@ preview_window::start_preview (bool zooming)
   while ( ::gtk_events_pending ( ) )
     ::gtk_main_iteration ( );
 
-  // preview
-  set_preview_param (zooming);
-
-  reset_settings (zooming);
-  ::g_view_manager->sensitive ( );
-
   try
     {
       if (scan_mgr->push_button_needs_polling ())
@@ -375,10 +542,31 @@ preview_window::start_preview (bool zooming)
 
       resize_preview_window ( width, height );
       clear_image ( );
-      
+
+      // show what we already have of the area while the refinement
+      // scan overwrites it row by row
+      if ( zooming
+	   && m_cache.extract ( m_img_rect, m_img_org,
+				width, height, g_prev_max_x * 3 ) )
+	{
+	  for ( int i = 0; i < height; i++ )
+	    ::memcpy ( m_img + i * g_prev_max_x * 3,
+		       m_img_org + i * g_prev_max_x * 3, width * 3 );
+	  present_rows ( 0, height );
+	}
+
       while ( ::gtk_events_pending ( ) )
 	::gtk_main_iteration ( );
 
+      // Auto exposure is first run on a small band of rows and then
+      // redone each time the amount of data doubles, so that a
+      // corrected image shows up long before the preview completes.
+      // Rows arriving in between are rendered with the latest tables.
+      bool	progressive = ( PISA_PT_BW != ::g_view_manager
+				->get_settings ( ).imgtype.pixeltype );
+      long	next_exposure = height / 16 + 1;
+      bool	exposed = false;
+
       for (int i = 0; i < height; i++ )
 	{
 	  scan_mgr->acquire_image ( m_img_org + i * g_prev_max_x * 3,
@@ -394,22 +582,35 @@ preview_window::start_preview (bool zooming)
 
 	  feedback.set_progress (i, height);
 	  cancel = feedback.is_cancelled ();
-	  
-	  ::gtk_preview_draw_row ( GTK_PREVIEW ( m_prev ),
-				   m_img_org + i * g_prev_max_x * 3,
-				   0, i, width );
-	  if ( i % 20 == 0 )
+
+	  if ( progressive && i + 1 == next_exposure )
 	    {
-	      ::gtk_preview_put ( GTK_PREVIEW ( m_prev ),
-				  m_prev->window,
-				  m_prev->style->black_gc,
-				  0, 0, 0, 0, width, height );
+	      expose_rows ( i + 1 );
+	      exposed = true;
+	      next_exposure *= 2;
+
+	      if ( prepare_tables ( ::g_view_manager->get_settings ( ),
+				    ::g_view_manager->get_marquee ( ) ) )
+		render_rows ( 0, i + 1 );
+	      else
+		render_rows ( i, i + 1 );
 	    }
-	  
+	  else if ( exposed )
+	    {
+	      render_rows ( i, i + 1 );
+	    }
+	  else
+	    {
+	      ::memcpy ( m_img + i * g_prev_max_x * 3,
+			 m_img_org + i * g_prev_max_x * 3, width * 3 );
+	      present_rows ( i, i + 1 );
+	    }
+
 	  while ( ::gtk_events_pending ( ) )
 	    ::gtk_main_iteration ( );
 	}
       scan_mgr->acquire_image (0, 1, 1, cancel);
+      invalidate_rows ( 0, height );
       feedback.set_progress (height, height);
       cancel = feedback.is_cancelled ();
       if (cancel)
@@ -423,12 +624,26 @@ preview_window::start_preview (bool zooming)
       else
 	{
 	  m_is_prev = 1;
-	  ::gtk_widget_draw ( m_prev, 0 );
-	  ::gdk_flush ( );
+
+	  if ( ! zooming )
+	    m_cache.clear ( );
+	  m_cache.store ( m_img_org, width, height, g_prev_max_x * 3,
+			  m_img_rect );
 
 	  m_on_preview = false;
 
+	  if ( ! zooming )
+	    crop_to_document ( );
+
 	  auto_exposure ( );
+
+	  if ( ! zooming )
+	    {
+	      preview_store store ( store_key ( ) );
+
+	      store.save ( m_img_org, width, height, g_prev_max_x * 3,
+			   m_img_rect, g_view_manager->get_marquee ( ) );
+	    }
 	  update_img ( );
 	  change_max_disp_area ( m_allocate_width, m_allocate_height );
 	  m_allocate_width = 0;
@@ -471,16 +686,119 @@ preview_window::start_preview (bool zooming)
   }
 }
 
+/*------------------------------------------------------------*/
+// Renders a zoom from the preview cache when it holds the requested
+// area at the resolution the preview window needs.  Returns false if
+// the area has to be scanned.
+bool
+preview_window::zoom_from_cache (void)
+{
+  double	res = m_cache.get_resolution ( m_img_rect );
+  double	need_x, need_y;
+
+  need_x = m_img_width / ( m_img_rect.right - m_img_rect.left );
+  need_y = m_img_height / ( m_img_rect.bottom - m_img_rect.top );
+
+  // allow for rounding of the scan area by the device
+  if ( res < 0.98 * need_x || res < 0.98 * need_y )
+    return false;
+
+  resize_preview_window ( m_img_width, m_img_height );
+  clear_image ( );
+
+  if ( ! m_cache.extract ( m_img_rect, m_img_org,
+			   m_img_width, m_img_height, g_prev_max_x * 3 ) )
+    return false;
+
+  m_is_prev = 1;
+  invalidate_rows ( 0, m_img_height );
+
+  m_on_preview = false;
+
+  auto_exposure ( );
+  update_img ( );
+  change_max_disp_area ( m_allocate_width, m_allocate_height );
+  m_allocate_width = 0;
+  m_allocate_height = 0;
+
+  return true;
+}
+
+/*------------------------------------------------------------*/
+// Identifies the device, document source and film type a stored
+// preview was taken with.  The frontend has no access to firmware
+// revisions, so the device's resolution and maximum scan area stand
+// in for them.
+std::string
+preview_window::store_key (void) const
+{
+  scan_manager * scan_mgr = g_view_manager->get_scan_manager ();
+  const settings & set = g_view_manager->get_settings ();
+  const char * name = scan_mgr->get_device_name ();
+  char buf [ 128 ];
+
+  ::sprintf ( buf, ":%ld:%d:%d:%.4fx%.4f",
+	      scan_mgr->get_max_resolution (),
+	      scan_mgr->get_scan_source (), scan_mgr->get_film_type (),
+	      set.max_area [ 0 ], set.max_area [ 1 ] );
+
+  return std::string ( name ? name : "" ) + buf;
+}
+
+/*------------------------------------------------------------*/
+// Shows the preview stored by an earlier session, if any, together
+// with its auto exposure results.  A new preview replaces it.
+void
+preview_window::load_stored_preview (void)
+{
+  preview_store	store ( store_key ( ) );
+  marquee	* marq = & g_view_manager->get_marquee ( );
+  long		width, height;
+
+  if ( ! store.open ( g_prev_max_x, g_prev_max_y, m_img_rect,
+		      & width, & height ) )
+    return;
+
+  alloc_img_org ( );
+  store.load ( m_img_org, g_prev_max_x * 3, marq );
+
+  m_img_width	= width;
+  m_img_height	= height;
+  m_is_prev	= 1;
+
+  m_cache.store ( m_img_org, width, height, g_prev_max_x * 3, m_img_rect );
+
+  invalidate_rows ( 0, height );
+
+  ::g_view_manager->sensitive ( );
+  ::g_view_manager->update_lut ( );
+  update_img ( );
+}
+
 /*--------------------------------------------------------------*/
 gint preview_window::expose_event ( GtkWidget * widget,
 				    GdkEventExpose * event )
 {
-  widget = widget;
-  event = event;
-
-  draw_marquee ( );
-
-  return FALSE;
+  GdkRectangle	area = event->area;
+
+  // The preview image lives in m_img, which doubles as the client
+  // side surface for the widget.  Exposed areas, including the ones
+  // queued by present_rows(), are copied over in a single call.
+  if ( area.x + area.width > g_prev_max_x )
+    area.width = g_prev_max_x - area.x;
+  if ( area.y + area.height > g_prev_max_y )
+    area.height = g_prev_max_y - area.y;
+
+  if ( m_img && 0 < area.width && 0 < area.height )
+    ::gdk_draw_rgb_image ( widget->window, widget->style->black_gc,
+			   area.x, area.y, area.width, area.height,
+			   GDK_RGB_DITHER_NONE,
+			   m_img + area.y * g_prev_max_x * 3 + area.x * 3,
+			   g_prev_max_x * 3 );
+
+  draw_marquee ( & event->area );
+
+  return TRUE;
 }
 
 /*--------------------------------------------------------------*/
@@ -493,10 +811,6 @@ gint preview_window::event ( GtkWidget * widget, GdkEvent * event )
   switch ( event->type )
     {
     case GDK_EXPOSE:
-      if ( m_gc )
-	{
-	  draw_marquee ( );
-	}
       ret = FALSE;
       break;
 
@@ -552,8 +866,10 @@ GtkWidget * preview_window::create_darea ( GtkWidget * parent )
   ::gtk_frame_set_shadow_type ( GTK_FRAME ( frame ), GTK_SHADOW_IN );
   ::gtk_container_border_width ( GTK_CONTAINER ( frame ), 3 );
   
-  m_prev = ::gtk_preview_new ( GTK_PREVIEW_COLOR );
-  ::gtk_preview_set_expand ( GTK_PREVIEW ( m_prev ), TRUE );
+#ifndef HAVE_GTK_2
+  ::gdk_rgb_init ( );
+#endif
+  m_prev = ::gtk_drawing_area_new ( );
 
   // set size of preview window
   get_preview_resolution ( );
@@ -567,8 +883,8 @@ GtkWidget * preview_window::create_darea ( GtkWidget * parent )
   // signals
   ::gtk_signal_connect ( GTK_OBJECT ( m_prev ), "event",
 			 GTK_SIGNAL_FUNC ( ::event ), 0 );
-  ::gtk_signal_connect_after ( GTK_OBJECT ( m_prev ), "expose_event",
-			       GTK_SIGNAL_FUNC ( ::expose_event ), 0 );
+  ::gtk_signal_connect ( GTK_OBJECT ( m_prev ), "expose_event",
+			 GTK_SIGNAL_FUNC ( ::expose_event ), 0 );
   ::gtk_signal_connect_after ( GTK_OBJECT ( m_prev ), "size_allocate",
 			       GTK_SIGNAL_FUNC ( ::size_allocate ), 0 );
 
@@ -644,6 +960,8 @@ void preview_window::resize_preview_window ( long width, long height )
       m_img_org = new unsigned char [ g_prev_max_x * g_prev_max_y * 3 ];
     }
 
+  invalidate_rows ( 0, g_prev_max_y );
+
   m_client_rect.left	= 0;
   m_client_rect.top	= 0;
   m_client_rect.right	= m_img_width - 1;
@@ -752,6 +1070,56 @@ void preview_window::change_max_disp_area ( long width, long height )
   update_img ( );
 }
 
+/*------------------------------------------------------------*/
+// Allocates the buffer for raw preview data on first use.
+// resize_preview_window() keeps it sized from then on.
+void preview_window::alloc_img_org ( void )
+{
+  if ( m_img_org )
+    return;
+
+  m_img_org = new unsigned char [ g_prev_max_x * g_prev_max_y * 3 ];
+
+  if ( m_img_org == 0 )
+    throw pisa_error ( PISA_ERR_OUTOFMEMORY );
+}
+
+/*------------------------------------------------------------*/
+// Puts a marquee around the documents found on the preview, plus a
+// margin, so that the final scan only transfers that area.  Marquees
+// made by the user are left alone.
+void preview_window::crop_to_document ( void )
+{
+  pisa_image_info	info;
+  _rectL		r;
+  _pointL		pt_lt, pt_rb;
+  long			margin;
+
+  if ( ! g_view_manager->crops_to_document ( )
+       || 1 < g_view_manager->get_marquee_size ( ) )
+    return;
+
+  info.m_img		= m_img_org;
+  info.m_width		= m_img_width;
+  info.m_height		= m_img_height;
+  info.m_rowbytes	= g_prev_max_x * 3;
+
+  if ( ! iscan::find_document ( info, r ) )
+    return;
+
+  margin = ( long ) ( g_crop_margin * m_img_width
+		      / ( m_img_rect.right - m_img_rect.left ) + 0.5 );
+
+  pt_lt.x = ( r.left   - margin < 0 ? 0 : r.left - margin );
+  pt_lt.y = ( r.top    - margin < 0 ? 0 : r.top  - margin );
+  pt_rb.x = ( m_client_rect.right  < r.right  + margin
+	      ? m_client_rect.right  : r.right  + margin );
+  pt_rb.y = ( m_client_rect.bottom < r.bottom + margin
+	      ? m_client_rect.bottom : r.bottom + margin );
+
+  create_marquee ( pt_lt, pt_rb );
+}
+
 /*------------------------------------------------------------*/
 void preview_window::clear_image ( void )
 {
@@ -759,28 +1127,41 @@ void preview_window::clear_image ( void )
 
   m_is_prev = 0;
 
-  ::memset ( m_img, 0xff, m_img_width * 3 );
-  ::memset ( m_img + ( m_img_width * 3 ),
-	     0xC4,
-	     ( g_prev_max_x - m_img_width ) * 3 );  
+  invalidate_rows ( 0, g_prev_max_y );
 
-  for ( i = 0; i < m_img_height; i++ )
-    ::gtk_preview_draw_row ( GTK_PREVIEW ( m_prev ), m_img,
-  			     0, i, g_prev_max_x );
+  for ( i = 0; i < g_prev_max_y; i++ )
+    {
+      unsigned char * row = m_img + i * g_prev_max_x * 3;
 
-  ::memset ( m_img, 0xC4, g_prev_max_x * 3 );
+      if ( i < m_img_height )
+	{
+	  ::memset ( row, 0xff, m_img_width * 3 );
+	  ::memset ( row + m_img_width * 3, 0xC4,
+		     ( g_prev_max_x - m_img_width ) * 3 );
+	}
+      else
+	::memset ( row, 0xC4, g_prev_max_x * 3 );
+    }
 
-  for ( ; i < g_prev_max_y; i++ )
-    ::gtk_preview_draw_row ( GTK_PREVIEW ( m_prev ), m_img,
-			     0, i, g_prev_max_x );
+  present_rows ( 0, g_prev_max_y );
+}
 
-  ::gtk_widget_draw ( m_prev, 0 );
-  ::gdk_flush ( );
+/*------------------------------------------------------------*/
+// Marks rows [top, bottom) of the preview surface for redrawing.
+// Requests are merged by the toolkit and handed to expose_event()
+// once per frame.
+void preview_window::present_rows ( long top, long bottom )
+{
+  if ( bottom <= top )
+    return;
+
+  ::gtk_widget_queue_draw_area ( m_prev, 0, top,
+				 g_prev_max_x, bottom - top );
 }
 
 
 /*--------------------------------------------------------------*/
-void preview_window::draw_marquee ( void )
+void preview_window::draw_marquee ( GdkRectangle * clip )
 {
   long		i, marq_num;
   _pointL	pt_lefttop, pt_rightbottom;
@@ -798,26 +1179,31 @@ void preview_window::draw_marquee ( void )
   if ( marq_num < 2 || m_on_preview )
     return;
 
+  // the marquees are inverted, so only touch what was just repainted
+  if ( clip )
+    ::gdk_gc_set_clip_rectangle ( m_gc, clip );
+
   for ( i = 1; i < marq_num; i++ )
     {
       get_marquee_point ( i, & pt_lefttop, & pt_rightbottom );
 
       draw_rect ( pt_lefttop, pt_rightbottom );
     }
+
+  if ( clip )
+    ::gdk_gc_set_clip_rectangle ( m_gc, 0 );
 }
 
 /*--------------------------------------------------------------*/
 void
 preview_window::reset_settings (bool zooming)
 {
-  long		i, n, m, marq_num;
+  long		i, n, marq_num;
   marquee	* marq;
   gamma_correction * gamma_cls;
-  scan_manager	* scan_mgr;
 
   gamma_cls = g_view_manager->get_gamma_correction ();
 
-  scan_mgr = g_view_manager->get_scan_manager ();
   marq_num = g_view_manager->get_marquee_size ();
 
   if (!zooming)
@@ -844,10 +1230,8 @@ preview_window::reset_settings (bool zooming)
 	  marq->shadow		= DEFSHADOW;
 	  marq->threshold	= DEFTHRESHOLD;
 	  
-	  for ( n = 0; n < 4; n++ )
-	    for ( m = 0; m < 256; m++ )
-	      marq->gamma_table [ n ] [ m ] = m;
-	  
+	  marq->reset_gamma_table ( );
+
 	  marq->graybalance	= DEFGRAYBALANCE;
 	  marq->saturation	= DEFSATURATION;
 	}
@@ -859,10 +1243,7 @@ preview_window::reset_settings (bool zooming)
 	  marq->grayl [ n ]		= 0.0;
 	}
       
-      iscan::build_LUT (scan_mgr->get_scan_source (),
-                        scan_mgr->get_film_type (),
-                        g_view_manager->get_settings (),
-                        *marq, !scan_mgr->has_zoom ());
+      g_view_manager->update_lut (*marq);
     }
 }
 
@@ -1469,7 +1850,7 @@ int preview_window::create_marquee ( const _pointL & pt_lt, const _pointL & pt_r
 int preview_window::delete_marquee ( void )
 {
   long		num_marq;
-  int		i, j;
+  int		i;
   marquee	* cur_marq, * whole_marq;
 
   num_marq = g_view_manager->get_marquee_size ();
@@ -1486,9 +1867,8 @@ int preview_window::delete_marquee ( void )
   whole_marq->shadow		= cur_marq->shadow;
   whole_marq->threshold		= cur_marq->threshold;
 
-  for ( i = 0; i < 4; i++ )
-    for ( j = 0; j < 256; j++ )
-      whole_marq->gamma_table [ i ] [ j ] = cur_marq->gamma_table [ i ] [ j ];
+  ::memcpy ( whole_marq->gamma_table, cur_marq->gamma_table,
+	     sizeof ( whole_marq->gamma_table ) );
 
   whole_marq->graybalance	= cur_marq->graybalance;
   whole_marq->saturation	= cur_marq->saturation;
@@ -34,12 +34,15 @@
 #include <gtk/gtk.h>
 #include "pisa_enums.h"
 #include "pisa_structs.h"
+#include "pisa_settings.h"
+#include "pisa_scan_tool.h"
+#include "pisa_preview_cache.h"
 
 class preview_window
 {
  public:
 
-  preview_window ( ) { m_gc = NULL; }
+  preview_window ( ) { m_gc = NULL; m_update_id = 0; }
   
   // operation
   int	init ( void );
@@ -53,6 +56,9 @@ class preview_window
   int	auto_exposure ( void );
 
   int	update_img ( bool left = false );
+  void	queue_update ( void );
+  void	load_stored_preview ( void );
+  gint	flush_update ( void );
 
   void	start_preview (void);
   void start_zoom (void);
@@ -72,13 +78,23 @@ class preview_window
   void  change_max_scan_area ( long width, long height );
   void	change_max_disp_area ( long width, long height );
   void	clear_image ( void );
+  void	alloc_img_org ( void );
+  void	crop_to_document ( void );
+  void	present_rows ( long top, long bottom );
+
+  bool	prepare_tables ( const settings & set, const marquee & marq );
+  void	invalidate_rows ( long top, long bottom );
+  void	render_rows ( long top, long bottom );
+  void	expose_rows ( long rows );
 
   void modify_max_val ( void );
 
-  void draw_marquee ( void );
+  void draw_marquee ( GdkRectangle * clip = 0 );
 
   // preview, zoom
   void start_preview (bool zooming);
+  bool zoom_from_cache (void);
+  std::string store_key (void) const;
   void reset_settings (bool zooming);
   int set_preview_param (bool zooming);
   void revert_resolution ( void );
@@ -131,6 +147,24 @@ class preview_window
 
   GdkGC			* m_gc;
 
+  // state of the last rendering pass, see update_img()
+  preview_tables	m_tables;
+  bool			m_tables_valid;
+  gamma_struct		m_key_lut;
+  long			m_key_saturation;
+  double		m_key_coef [ 9 ];
+  char			m_key_pixeltype;
+  char			m_key_dropout;
+  char			m_key_halftone;
+  long			m_key_threshold;
+  long			m_key_usm;
+  long			m_dirty_top;
+  long			m_dirty_bottom;
+  guint			m_update_id;
+
+  // raw data of earlier acquisitions, used to serve zooms
+  preview_cache		m_cache;
+
   int			m_cursor_state;
   GdkCursor		* m_cursor [ 11 ];
 
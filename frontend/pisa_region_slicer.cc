@@ -0,0 +1,262 @@
+/* pisa_region_slicer.cc
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+/*------------------------------------------------------------*/
+#include <string.h>
+
+/*------------------------------------------------------------*/
+#include "pisa_region_slicer.h"
+#include "pisa_enums.h"
+#include "pisa_error.h"
+#include "page-spool.hh"
+
+namespace iscan
+{
+
+/*------------------------------------------------------------*/
+class region_slicer::region
+{
+public:
+  region ( int left, int top, int width, int height,
+	   int out_width, int out_height, int channels,
+	   const unsigned char * lut );
+
+  void	add ( int row, const unsigned char * line );
+  void	finish ( void );
+
+  int			m_out_width;
+  int			m_out_height;
+  page_spool		m_spool;
+
+private:
+  void	emit ( void );
+
+  int			m_left;
+  int			m_top;
+  int			m_width;
+  int			m_height;
+  int			m_channels;
+  unsigned char		m_lut [ 256 ];
+
+  // output column of each input column and the number of input
+  // columns that end up in each output column
+  std::vector < int >			m_column;
+  std::vector < int >			m_count;
+
+  std::vector < unsigned long >		m_sum;
+  std::vector < unsigned char >		m_line;
+  int			m_out_row;
+  int			m_rows;
+};
+
+/*------------------------------------------------------------*/
+region_slicer::region::region ( int left, int top, int width, int height,
+				int out_width, int out_height, int channels,
+				const unsigned char * lut )
+  : m_out_width ( out_width ), m_out_height ( out_height ),
+    m_left ( left ), m_top ( top ), m_width ( width ), m_height ( height ),
+    m_channels ( channels ), m_column ( width ), m_count ( out_width, 0 ),
+    m_sum ( out_width * channels, 0 ), m_line ( out_width * channels ),
+    m_out_row ( 0 ), m_rows ( 0 )
+{
+  ::memcpy ( m_lut, lut, sizeof ( m_lut ) );
+
+  for ( int x = 0; x < width; x++ )
+    {
+      m_column [ x ] = ( int ) ( ( long long ) x * out_width / width );
+      m_count [ m_column [ x ] ]++;
+    }
+
+  m_spool.open ( out_width, out_height, 8, 3 == channels ? RGB : gray );
+}
+
+/*------------------------------------------------------------*/
+void region_slicer::region::add ( int row, const unsigned char * line )
+{
+  if ( row < m_top || m_top + m_height <= row )
+    return;
+
+  const unsigned char * p = line + m_left * m_channels;
+  int x, c;
+
+  if ( m_out_width == m_width && m_out_height == m_height )
+    {
+      for ( x = 0; x < m_width * m_channels; x++ )
+	m_line [ x ] = m_lut [ p [ x ] ];
+      m_spool.write ( ( const page_spool::byte_type * ) & m_line [ 0 ],
+		      m_line.size ( ) );
+      return;
+    }
+
+  int out_row = ( int ) ( ( long long ) ( row - m_top ) * m_out_height
+			  / m_height );
+
+  if ( out_row != m_out_row && 0 < m_rows )
+    emit ( );
+  m_out_row = out_row;
+
+  for ( x = 0; x < m_width; x++, p += m_channels )
+    {
+      unsigned long * sum = & m_sum [ m_column [ x ] * m_channels ];
+
+      for ( c = 0; c < m_channels; c++ )
+	sum [ c ] += m_lut [ p [ c ] ];
+    }
+  m_rows++;
+}
+
+/*------------------------------------------------------------*/
+void region_slicer::region::finish ( void )
+{
+  if ( 0 < m_rows )
+    emit ( );
+}
+
+/*------------------------------------------------------------*/
+void region_slicer::region::emit ( void )
+{
+  for ( int x = 0; x < m_out_width; x++ )
+    {
+      unsigned long n = ( unsigned long ) m_count [ x ] * m_rows;
+
+      for ( int c = 0; c < m_channels; c++ )
+	{
+	  int i = x * m_channels + c;
+
+	  m_line [ i ] = ( m_sum [ i ] + n / 2 ) / n;
+	  m_sum [ i ] = 0;
+	}
+    }
+  m_rows = 0;
+
+  m_spool.write ( ( const page_spool::byte_type * ) & m_line [ 0 ],
+		  m_line.size ( ) );
+}
+
+/*------------------------------------------------------------*/
+region_slicer::region_slicer ( void )
+  : m_width ( 0 ), m_height ( 0 ), m_channels ( 0 ), m_row ( 0 )
+{
+}
+
+/*------------------------------------------------------------*/
+region_slicer::~region_slicer ( void )
+{
+  clear ( );
+}
+
+/*------------------------------------------------------------*/
+void region_slicer::begin ( int width, int height, int pixel_type )
+{
+  clear ( );
+
+  if ( PISA_PT_RGB == pixel_type )
+    m_channels = 3;
+  else if ( PISA_PT_GRAY == pixel_type )
+    m_channels = 1;
+  else
+    throw pisa_error ( PISA_ERR_PARAMETER );
+
+  m_width	= width;
+  m_height	= height;
+  m_row		= 0;
+}
+
+/*------------------------------------------------------------*/
+void region_slicer::add_region ( int left, int top, int width, int height,
+				 int out_width, int out_height,
+				 const unsigned char * lut )
+{
+  // the scan may come out a little smaller than asked for
+  if ( left < 0 ) left = 0;
+  if ( top  < 0 ) top  = 0;
+  if ( m_width  < left + width  ) width  = m_width  - left;
+  if ( m_height < top  + height ) height = m_height - top;
+
+  if ( width  < out_width  ) out_width  = width;
+  if ( height < out_height ) out_height = height;
+
+  if ( out_width <= 0 || out_height <= 0 )
+    return;
+
+  try
+    {
+      m_regions.push_back ( 0 );
+      m_regions.back ( ) = new region ( left, top, width, height,
+					out_width, out_height,
+					m_channels, lut );
+    }
+  catch ( std::exception & oops )
+    {
+      m_regions.pop_back ( );
+      throw pisa_error ( PISA_ERR_OUTOFMEMORY );
+    }
+}
+
+/*------------------------------------------------------------*/
+void region_slicer::write ( const unsigned char * rows, int num_rows )
+{
+  for ( int i = 0; i < num_rows; i++, rows += m_width * m_channels, m_row++ )
+    for ( size_t k = 0; k < m_regions.size ( ); k++ )
+      m_regions [ k ]->add ( m_row, rows );
+}
+
+/*------------------------------------------------------------*/
+bool region_slicer::commit ( imgstream & is )
+{
+  bool data = false;
+
+  for ( size_t k = 0; k < m_regions.size ( ); k++ )
+    {
+      region & r = * m_regions [ k ];
+
+      r.finish ( );
+
+      if ( data )
+	{
+	  is.flush ( );
+	  is.next ( );
+	}
+      is.size ( r.m_out_width, r.m_out_height );
+      is.depth ( 8 );
+      is.colour ( 3 == m_channels ? RGB : gray );
+      r.m_spool.replay ( is );
+      data = true;
+    }
+  clear ( );
+
+  return data;
+}
+
+/*------------------------------------------------------------*/
+void region_slicer::clear ( void )
+{
+  for ( size_t k = 0; k < m_regions.size ( ); k++ )
+    delete m_regions [ k ];
+  m_regions.clear ( );
+}
+
+} // namespace iscan
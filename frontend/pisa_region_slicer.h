@@ -0,0 +1,80 @@
+/* pisa_region_slicer.h
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+#ifndef ___PISA_REGION_SLICER_H
+#define ___PISA_REGION_SLICER_H
+
+#include <vector>
+
+#include "imgstream.hh"
+
+namespace iscan
+{
+
+  /* Splits a single scan of the area covering several marquees into
+     one image per marquee.  Each region is cut out of the rows as
+     they come in from the scanner, run through its own tone curve,
+     scaled down to its own resolution and spooled to a temporary
+     file.  Regions overlap in time, so the images can only be passed
+     on to an image stream, one after the other, once the scan is
+     complete.
+
+     Regions are given in pixels of the scan.  Their output size may
+     not exceed their size in the scan; smaller sizes are obtained by
+     averaging all the pixels that map onto an output pixel.
+   */
+  class region_slicer
+  {
+  public:
+    region_slicer ( void );
+    ~region_slicer ( void );
+
+    void	begin ( int width, int height, int pixel_type );
+    void	add_region ( int left, int top, int width, int height,
+			     int out_width, int out_height,
+			     const unsigned char * lut );
+    void	write ( const unsigned char * rows, int num_rows );
+    bool	commit ( imgstream & is );
+    void	clear ( void );
+
+  private:
+    class region;
+
+    std::vector < region * >	m_regions;
+
+    int			m_width;
+    int			m_height;
+    int			m_channels;
+    int			m_row;
+
+  private:			// undefined to prevent copying
+    region_slicer ( const region_slicer & );
+    region_slicer & operator= ( const region_slicer & );
+  };
+
+} // namespace iscan
+
+#endif // ___PISA_REGION_SLICER_H
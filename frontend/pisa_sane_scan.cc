@@ -127,7 +127,7 @@ sane_scan::has_dfd (void) const
 
   try {
     id = get_option_id ("double-feed-detection-sensitivity");
-    sod = sane_get_option_descriptor (m_hdevice, id);
+    sod = get_option_desc (id);
     return (sod && !(SANE_CAP_INACTIVE & sod->cap));
   }
   catch (pisa_error& e) {
@@ -142,7 +142,7 @@ sane_scan::set_dfd (long idx)
   const SANE_Option_Descriptor *sod = NULL;
   int id = get_option_id ("double-feed-detection-sensitivity");
 
-  sod = sane_get_option_descriptor (m_hdevice, id);
+  sod = get_option_desc (id);
   if (!sod
       || SANE_CAP_INACTIVE & sod->cap
       || SANE_TYPE_STRING != sod->type
@@ -175,6 +175,12 @@ sane_scan::get_film_type (void) const
   return _film;
 }
 
+const char *
+sane_scan::get_device_name (void) const
+{
+  return name;
+}
+
 void
 sane_scan::clear_button_status (void)
 {
@@ -192,6 +198,8 @@ sane_scan::init (void)
   name = 0;
   max_resolution = -1;
 
+  clear_option_index ();
+
   _source = PISA_OP_NONE;
   _film   = PISA_FT_REFLECT;
 
@@ -229,6 +237,8 @@ sane_scan::open_device (char *name)
   close_device ();
   m_hdevice = device;
 
+  build_option_index ();
+
   get_scanner_info (device_name);
 
   if (device_name != name)
@@ -242,6 +252,7 @@ sane_scan::close_device (void)
     sane_close (m_hdevice);
 
   m_hdevice = 0;
+  clear_option_index ();
 }
 
 void
@@ -312,14 +323,14 @@ sane_scan::get_current_max_size (double *width, double *height)
   const SANE_Option_Descriptor *opt_desc = NULL;
 
   opt_id = get_option_id (SANE_NAME_SCAN_BR_X);
-  opt_desc = sane_get_option_descriptor (m_hdevice, opt_id);
+  opt_desc = get_option_desc (opt_id);
   if (!opt_desc || SANE_CONSTRAINT_RANGE != opt_desc->constraint_type)
     throw pisa_error (PISA_STATUS_UNSUPPORTED);
   
   max_x = opt_desc->constraint.range->max;
 
   opt_id = get_option_id (SANE_NAME_SCAN_BR_Y);
-  opt_desc = sane_get_option_descriptor (m_hdevice, opt_id);
+  opt_desc = get_option_desc (opt_id);
   if (!opt_desc || SANE_CONSTRAINT_RANGE != opt_desc->constraint_type)
     throw pisa_error (PISA_STATUS_UNSUPPORTED);
   
@@ -475,7 +486,7 @@ sane_scan::get_max_resolution (SANE_String_Const option_name,
   int opt_id = get_option_id (option_name);
 
   const SANE_Option_Descriptor
-    *opt_desc = sane_get_option_descriptor (m_hdevice, opt_id);
+    *opt_desc = get_option_desc (opt_id);
 
   if (!opt_desc || SANE_TYPE_INT != opt_desc->type)
     throw pisa_error (PISA_STATUS_UNSUPPORTED);
@@ -537,7 +548,7 @@ sane_scan::get_resolution (SANE_String_Const scan_direction,
   {				// initialize resolution table
     int opt_id = get_option_id (scan_direction);
     const SANE_Option_Descriptor *opt_desc
-      = sane_get_option_descriptor (m_hdevice, opt_id);
+      = get_option_desc (opt_id);
 
     if (opt_desc && SANE_CONSTRAINT_RANGE == opt_desc->constraint_type)
       {
@@ -598,7 +609,7 @@ sane_scan::get_scanner_info (const char *dev_name)
     }
   support_option = 0;
   opt_id = get_option_id (SANE_NAME_SCAN_SOURCE);
-  opt_desc = sane_get_option_descriptor (m_hdevice, opt_id);
+  opt_desc = get_option_desc (opt_id);
 
   if (opt_desc->type != SANE_TYPE_STRING ||
        opt_desc->constraint_type != SANE_CONSTRAINT_STRING_LIST)
@@ -687,47 +698,58 @@ sane_scan::finish_acquire (bool eject)
 int
 sane_scan::is_activate (const char *option_name) const
 {
-  const SANE_Option_Descriptor	* opt_desc;
-  SANE_Int			num_dev_options;
-  SANE_Status			status;
-  int				i;
-  int				ret;
-
-  ret = 0;
-  status = sane_control_option (m_hdevice, 0,
-				SANE_ACTION_GET_VALUE,
-				&num_dev_options,
-				0);
+  if (!m_option_index_valid)
+    build_option_index ();
 
-  if (status != SANE_STATUS_GOOD)
-    throw pisa_error (status, *this);
+  std::map<std::string, int>::const_iterator it
+    = m_option_index.find (option_name);
 
-  for (i = 0; i < num_dev_options; i++)
-    {
-      opt_desc = sane_get_option_descriptor (m_hdevice, i);
+  if (m_option_index.end () == it)
+    return 0;
 
-      if (opt_desc->name && strcmp (opt_desc->name, option_name) == 0)
-	{
-	  if (SANE_OPTION_IS_ACTIVE (opt_desc->cap))
-	    {
-	      ret = 1;
-	      break;
-	    }
-	  else
-	    break;
-	}
-    }
+  const SANE_Option_Descriptor *opt_desc = m_option_desc[it->second];
 
-  return ret;
+  return (opt_desc && SANE_OPTION_IS_ACTIVE (opt_desc->cap)) ? 1 : 0;
 }
 
 int
 sane_scan::get_option_id (const char *option_name) const
 {
-  const SANE_Option_Descriptor	* opt_desc;
-  SANE_Int			num_dev_options;
-  SANE_Status			status;
-  int				i;
+  if (!m_option_index_valid)
+    build_option_index ();
+
+  std::map<std::string, int>::const_iterator it
+    = m_option_index.find (option_name);
+
+  if (m_option_index.end () == it)
+    throw pisa_error (PISA_ERR_UNSUPPORT);
+
+  return it->second;
+}
+
+const SANE_Option_Descriptor *
+sane_scan::get_option_desc (int option_id) const
+{
+  if (!m_option_index_valid)
+    build_option_index ();
+
+  if (option_id < 0 || int (m_option_desc.size ()) <= option_id)
+    return 0;
+
+  return m_option_desc[option_id];
+}
+
+// Fetches all option descriptors once and indexes them by name.  The
+// descriptors stay valid until the backend says it reloaded them,
+// which set_value() watches for.
+void
+sane_scan::build_option_index (void) const
+{
+  SANE_Int	num_dev_options;
+  SANE_Status	status;
+  int		i;
+
+  clear_option_index ();
 
   status = sane_control_option (m_hdevice, 0,
 				SANE_ACTION_GET_VALUE,
@@ -737,15 +759,29 @@ sane_scan::get_option_id (const char *option_name) const
   if (status != SANE_STATUS_GOOD)
     throw pisa_error (status, *this);
 
+  m_option_desc.resize (num_dev_options);
   for (i = 0; i < num_dev_options; i++)
     {
-      opt_desc = sane_get_option_descriptor (m_hdevice, i);
+      const SANE_Option_Descriptor *opt_desc
+	= sane_get_option_descriptor (m_hdevice, i);
+
+      m_option_desc[i] = opt_desc;
 
-      if (opt_desc->name && strcmp (opt_desc->name, option_name) == 0)
-	return i;	// found
+      // the first occurrence wins, as with the linear search it replaces
+      if (opt_desc && opt_desc->name
+	  && m_option_index.end () == m_option_index.find (opt_desc->name))
+	m_option_index[opt_desc->name] = i;
     }
 
-  throw pisa_error (PISA_ERR_UNSUPPORT);
+  m_option_index_valid = true;
+}
+
+void
+sane_scan::clear_option_index (void) const
+{
+  m_option_index.clear ();
+  m_option_desc.clear ();
+  m_option_index_valid = false;
 }
 
 void
@@ -756,11 +792,15 @@ sane_scan::set_value (const char * option_name, const void * value)
 
   option_id = get_option_id (option_name);
 
+  SANE_Int info = 0;
   status = sane_control_option (m_hdevice,
 				option_id,
 				SANE_ACTION_SET_VALUE,
                                 const_cast<void *>(value),
-				0);
+				&info);
+
+  if (info & SANE_INFO_RELOAD_OPTIONS)
+    clear_option_index ();
 
   if (status != SANE_STATUS_GOOD)
     throw pisa_error (status, *this);
@@ -807,7 +847,7 @@ sane_scan::get_range (const char *option_name,
       throw pisa_error (PISA_ERR_CONNECT);
     }
   opt_id = get_option_id (option_name);
-  opt_desc = sane_get_option_descriptor (m_hdevice, opt_id);
+  opt_desc = get_option_desc (opt_id);
   if (!opt_desc
       || SANE_CONSTRAINT_RANGE != opt_desc->constraint_type)
     {
@@ -41,6 +41,10 @@ extern "C" {
 }
 #endif
 
+#include <map>
+#include <string>
+#include <vector>
+
 enum br_method_val
 {
   br_iscan,
@@ -70,6 +74,7 @@ public:
 
   char get_scan_source (void) const;
   char get_film_type (void) const;
+  const char *get_device_name (void) const;
 
   void clear_button_status (void);
 
@@ -140,6 +145,7 @@ protected:
   long	get_resolution (SANE_String_Const direction, int min_res) const;
   long	get_max_resolution (const char *option_name, long cutoff = -1) const;
   int	get_option_id (const char *option_name) const;
+  const SANE_Option_Descriptor *get_option_desc (int option_id) const;
 
   void	set_value (const char *option_name, const void *value);
 
@@ -156,6 +162,9 @@ protected:
   void	set_threshold (long threshold);
 
 private:
+  void	build_option_index (void) const;
+  void	clear_option_index (void) const;
+
   SANE_Handle		m_hdevice;
   SANE_Parameters	m_sane_para;
   long			m_rows;
@@ -166,6 +175,12 @@ private:
 
   char _source;
   char _film;
+
+  // option lookup by name, built on first use after the device is
+  // opened and dropped whenever the backend reloads its options
+  mutable bool					m_option_index_valid;
+  mutable std::map<std::string, int>		m_option_index;
+  mutable std::vector<const SANE_Option_Descriptor *>	m_option_desc;
 };
 
 
@@ -953,7 +953,6 @@ scan_manager::set_scan_parameters (const settings& set, const marquee& marq)
   return err;
 }
 
-#include "pisa_view_manager.h"
 pisa_error_id
 scan_manager::set_scan_parameters (const settings& set, const marquee& marq,
 				   int resolution)
@@ -237,15 +237,19 @@ scan_selector::widget() const
   return (m_dbox ? m_dbox : m_hbox);
 }
 
+// Rebuilds the menu from a device list as returned by
+// sane_get_devices(), which is called when none is given.
 void
-scan_selector::update()
+scan_selector::update( const SANE_Device **device )
 {
-  const SANE_Device **device;
-  SANE_Status status;
-  status = sane_get_devices ( &device, m_local_only );
+  if (!device)
+    {
+      SANE_Status status;
+      status = sane_get_devices ( &device, m_local_only );
 
-  if (SANE_STATUS_GOOD != status)
-    throw pisa_error( status );
+      if (SANE_STATUS_GOOD != status)
+	throw pisa_error( status );
+    }
 
   // prepare a new menu
   GtkWidget *menu = gtk_menu_new();
@@ -384,11 +388,11 @@ scan_selector::select()
 }
 
 char *
-scan_selector::get_device( bool rewrite )
+scan_selector::get_device( bool rewrite, const SANE_Device **device )
 {
   if (m_dbox && !rewrite)
     {
-      update();
+      update( device );
       if (1 < g_slist_length( _items ))
 	{
 	  show();
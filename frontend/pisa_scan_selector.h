@@ -44,10 +44,11 @@ public:
 
   GtkWidget * widget() const;
 
-  void update();
+  void update( const SANE_Device **device = 0 );
   void cancel();
   void select();
-  char * get_device( bool rewrite = false );
+  char * get_device( bool rewrite = false,
+		     const SANE_Device **device = 0 );
 
 private:
 
@@ -37,6 +37,163 @@
 #include "pisa_error.h"
 #include "pisa_default_val.h"
 
+/*------------------------------------------------------------*/
+int build_preview_tables ( preview_tables * tbl,
+			   const gamma_struct * lut,
+			   char pixeltype,
+			   int saturation,
+			   const double * color_profile,
+			   unsigned char do_clr )
+{
+  int		i, v;
+  double	color_corr [ 9 ];
+  int		color [ 9 ];
+  int		weight [ 3 ];
+  const unsigned char * chan [ 3 ];
+
+  chan [ 0 ] = lut->gamma_r;
+  chan [ 1 ] = lut->gamma_g;
+  chan [ 2 ] = lut->gamma_b;
+
+  tbl->pixeltype = pixeltype;
+
+  for ( i = 0; i < 3; i++ )
+    ::memcpy ( tbl->lut [ i ], chan [ i ], 256 );
+
+  switch ( pixeltype )
+    {
+    case PISA_PT_RGB:
+      // same fixed point coefficients as tool_matrix()
+      generate_color_coef ( color_corr, color_profile, saturation );
+      for ( i = 0; i < 9; i++ )
+	color [ i ] = ( int ) ( color_corr [ i ] * ( 1 << 10 ) );
+
+      for ( i = 0; i < 9; i++ )
+	for ( v = 0; v < 256; v++ )
+	  tbl->mat [ i ] [ v ] = color [ i ] * chan [ i % 3 ] [ v ];
+      break;
+
+    case PISA_PT_GRAY:
+      // weights are scaled by ten, matching dropout()
+      weight [ 0 ] = weight [ 1 ] = weight [ 2 ] = 0;
+      switch ( do_clr )
+	{
+	case PISA_DO_NONE:
+	  weight [ 0 ] = 2;
+	  weight [ 1 ] = 6;
+	  weight [ 2 ] = 2;
+	  break;
+	case PISA_DO_RED:
+	  weight [ 0 ] = 10;
+	  break;
+	case PISA_DO_GREEN:
+	  weight [ 1 ] = 10;
+	  break;
+	case PISA_DO_BLUE:
+	  weight [ 2 ] = 10;
+	  break;
+	}
+
+      for ( i = 0; i < 3; i++ )
+	for ( v = 0; v < 256; v++ )
+	  tbl->mat [ i ] [ v ] = weight [ i ] * chan [ i ] [ v ];
+      break;
+
+    case PISA_PT_BW:
+      break;
+
+    default:
+      return PISA_ERR_PARAMETER;
+    }
+
+  return PISA_ERR_SUCCESS;
+}
+
+/*------------------------------------------------------------*/
+/* Copies rows [top, bottom) from src to dst while applying the LUT
+   and, depending on the pixel type, the colour matrix or the gray
+   conversion.  The result is identical to running tool_lut() and
+   then tool_matrix() or build_gray() on a copy of the image.  For
+   B/W only the LUT is applied; callers still need build_bw().
+ */
+int tool_preview ( pisa_image_info * dst,
+		   const pisa_image_info * src,
+		   const preview_tables * tbl,
+		   long top,
+		   long bottom )
+{
+  long		i, j;
+  const int	max = 0xff << 10;
+  const int	* m0 = tbl->mat [ 0 ], * m1 = tbl->mat [ 1 ];
+  const int	* m2 = tbl->mat [ 2 ], * m3 = tbl->mat [ 3 ];
+  const int	* m4 = tbl->mat [ 4 ], * m5 = tbl->mat [ 5 ];
+  const int	* m6 = tbl->mat [ 6 ], * m7 = tbl->mat [ 7 ];
+  const int	* m8 = tbl->mat [ 8 ];
+  const unsigned char * lr = tbl->lut [ 0 ];
+  const unsigned char * lg = tbl->lut [ 1 ];
+  const unsigned char * lb = tbl->lut [ 2 ];
+
+  if ( top < 0 )
+    top = 0;
+  if ( bottom > src->m_height )
+    bottom = src->m_height;
+
+  for ( i = top; i < bottom; i++ )
+    {
+      const unsigned char * in = src->m_img + i * src->m_rowbytes;
+      unsigned char * out = dst->m_img + i * dst->m_rowbytes;
+
+      switch ( tbl->pixeltype )
+	{
+	case PISA_PT_RGB:
+	  for ( j = 0; j < src->m_width; j++ )
+	    {
+	      int r = in [ 0 ], g = in [ 1 ], b = in [ 2 ];
+	      int red = m0 [ r ] + m1 [ g ] + m2 [ b ];
+	      int grn = m3 [ r ] + m4 [ g ] + m5 [ b ];
+	      int blu = m6 [ r ] + m7 [ g ] + m8 [ b ];
+
+	      if ( red < 0 ) red = 0; else if ( red > max ) red = max;
+	      if ( grn < 0 ) grn = 0; else if ( grn > max ) grn = max;
+	      if ( blu < 0 ) blu = 0; else if ( blu > max ) blu = max;
+
+	      out [ 0 ] = red >> 10;
+	      out [ 1 ] = grn >> 10;
+	      out [ 2 ] = blu >> 10;
+	      in  += 3;
+	      out += 3;
+	    }
+	  break;
+
+	case PISA_PT_GRAY:
+	  for ( j = 0; j < src->m_width; j++ )
+	    {
+	      unsigned char val = ( m0 [ in [ 0 ] ]
+				    + m1 [ in [ 1 ] ]
+				    + m2 [ in [ 2 ] ] ) / 10;
+	      out [ 0 ] = out [ 1 ] = out [ 2 ] = val;
+	      in  += 3;
+	      out += 3;
+	    }
+	  break;
+
+	default:
+	  for ( j = 0; j < src->m_width; j++ )
+	    {
+	      out [ 0 ] = lr [ in [ 0 ] ];
+	      out [ 1 ] = lg [ in [ 1 ] ];
+	      out [ 2 ] = lb [ in [ 2 ] ];
+	      in  += 3;
+	      out += 3;
+	    }
+	  break;
+	}
+    }
+
+  return PISA_ERR_SUCCESS;
+}
+
+
 /*------------------------------------------------------------*/
 static int build_lineart ( pisa_image_info * info,
 			   unsigned char do_clr,
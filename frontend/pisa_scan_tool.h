@@ -58,6 +58,31 @@ int build_bw ( pisa_image_info * info,
 	       unsigned char halftone,
 	       long threshold );
 
+/*------------------------------------------------------------*/
+/* Tables for the single pass preview kernel.  The gamma LUT is
+   folded into the colour matrix (RGB) or the dropout weights (gray)
+   so that every output sample is the sum of three table lookups.
+ */
+typedef struct _preview_tables
+{
+  char		pixeltype;
+  int		mat [ 9 ] [ 256 ];
+  unsigned char	lut [ 3 ] [ 256 ];
+} preview_tables;
+
+int build_preview_tables ( preview_tables * tbl,
+			   const gamma_struct * lut,
+			   char pixeltype,
+			   int saturation,
+			   const double * color_profile,
+			   unsigned char do_clr );
+
+int tool_preview ( pisa_image_info * dst,
+		   const pisa_image_info * src,
+		   const preview_tables * tbl,
+		   long top,
+		   long bottom );
+
 #endif // ___EPS_LIVE_PREVIEW_H
 
 
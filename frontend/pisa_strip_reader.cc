@@ -0,0 +1,265 @@
+/* pisa_strip_reader.cc
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+/*------------------------------------------------------------*/
+#include <errno.h>
+#include <sys/time.h>
+
+/*------------------------------------------------------------*/
+#include "pisa_strip_reader.h"
+
+/*------------------------------------------------------------*/
+strip_reader::strip_reader ( scan_manager * sm, int row_bytes, int stride,
+			     int height, int strip_rows )
+{
+  int i;
+
+  m_scan_mgr	= sm;
+  m_row_bytes	= row_bytes;
+  m_stride	= stride;
+  m_height	= height;
+  m_strip_rows	= ( 0 < strip_rows ) ? strip_rows : 1;
+
+  m_head	= 0;
+  m_full	= 0;
+  m_rows_read	= 0;
+  m_cancel	= false;
+  m_done	= false;
+  m_error	= 0;
+  m_running	= false;
+
+  for ( i = 0; i < 2; i++ )
+    {
+      m_rows [ i ] = 0;
+      m_buf [ i ] = new unsigned char [ m_strip_rows * m_stride ];
+      if ( m_buf [ i ] == 0 )
+	{
+	  if ( i )
+	    delete [ ] m_buf [ 0 ];
+	  throw pisa_error ( PISA_ERR_OUTOFMEMORY );
+	}
+    }
+
+  ::pthread_mutex_init ( & m_mutex, 0 );
+  ::pthread_cond_init ( & m_cond, 0 );
+}
+
+/*------------------------------------------------------------*/
+strip_reader::~strip_reader ( void )
+{
+  if ( m_running )
+    {
+      cancel ( );
+      ::pthread_join ( m_thread, 0 );
+    }
+
+  delete m_error;
+  delete [ ] m_buf [ 0 ];
+  delete [ ] m_buf [ 1 ];
+
+  ::pthread_cond_destroy ( & m_cond );
+  ::pthread_mutex_destroy ( & m_mutex );
+}
+
+/*------------------------------------------------------------*/
+void strip_reader::start ( void )
+{
+  if ( 0 != ::pthread_create ( & m_thread, 0, run, this ) )
+    throw pisa_error ( PISA_ERR_OUTOFMEMORY );
+
+  m_running = true;
+}
+
+/*------------------------------------------------------------*/
+unsigned char * strip_reader::get_strip ( int * rows, long usec )
+{
+  struct timeval	now;
+  struct timespec	until;
+  unsigned char		* strip = 0;
+
+  ::gettimeofday ( & now, 0 );
+  usec += now.tv_usec;
+  until.tv_sec	= now.tv_sec + usec / 1000000;
+  until.tv_nsec	= ( usec % 1000000 ) * 1000;
+
+  ::pthread_mutex_lock ( & m_mutex );
+
+  while ( 0 == m_full && ! m_done )
+    {
+      if ( ETIMEDOUT == ::pthread_cond_timedwait ( & m_cond, & m_mutex,
+						   & until ) )
+	break;
+    }
+
+  if ( 0 < m_full )
+    {
+      strip	= m_buf [ m_head ];
+      * rows	= m_rows [ m_head ];
+    }
+
+  ::pthread_mutex_unlock ( & m_mutex );
+
+  return strip;
+}
+
+/*------------------------------------------------------------*/
+void strip_reader::release_strip ( void )
+{
+  ::pthread_mutex_lock ( & m_mutex );
+
+  m_head = 1 - m_head;
+  m_full--;
+  ::pthread_cond_broadcast ( & m_cond );
+
+  ::pthread_mutex_unlock ( & m_mutex );
+}
+
+/*------------------------------------------------------------*/
+// True once the reading thread has stopped and every strip it
+// filled has been released.
+bool strip_reader::is_finished ( void )
+{
+  bool finished;
+
+  ::pthread_mutex_lock ( & m_mutex );
+  finished = m_done && 0 == m_full;
+  ::pthread_mutex_unlock ( & m_mutex );
+
+  return finished;
+}
+
+/*------------------------------------------------------------*/
+int strip_reader::get_rows_read ( void )
+{
+  int rows;
+
+  ::pthread_mutex_lock ( & m_mutex );
+  rows = m_rows_read;
+  ::pthread_mutex_unlock ( & m_mutex );
+
+  return rows;
+}
+
+/*------------------------------------------------------------*/
+// The cancellation is passed to the scan_manager with the next row
+// that is acquired, just as a row by row reader would do.
+void strip_reader::cancel ( void )
+{
+  ::pthread_mutex_lock ( & m_mutex );
+  m_cancel = true;
+  ::pthread_cond_broadcast ( & m_cond );
+  ::pthread_mutex_unlock ( & m_mutex );
+}
+
+/*------------------------------------------------------------*/
+void strip_reader::finish ( void )
+{
+  if ( m_running )
+    {
+      ::pthread_join ( m_thread, 0 );
+      m_running = false;
+    }
+
+  if ( m_error )
+    {
+      pisa_error err = * m_error;
+
+      delete m_error;
+      m_error = 0;
+
+      throw err;
+    }
+}
+
+/*------------------------------------------------------------*/
+void * strip_reader::run ( void * self )
+{
+  static_cast< strip_reader * > ( self )->produce ( );
+
+  return 0;
+}
+
+/*------------------------------------------------------------*/
+void strip_reader::produce ( void )
+{
+  int		row, tail, rows, i;
+  bool		cancel = false;
+
+  try
+    {
+      for ( row = 0; row < m_height && ! cancel; row += rows )
+	{
+	  ::pthread_mutex_lock ( & m_mutex );
+	  // when cancelled, tail may still be in use but the first row
+	  // below passes the cancellation on without writing anything
+	  while ( 2 == m_full && ! m_cancel )
+	    ::pthread_cond_wait ( & m_cond, & m_mutex );
+	  tail = ( m_head + m_full ) % 2;
+	  ::pthread_mutex_unlock ( & m_mutex );
+
+	  rows = m_height - row;
+	  if ( m_strip_rows < rows )
+	    rows = m_strip_rows;
+
+	  for ( i = 0; i < rows && ! cancel; i++ )
+	    {
+	      ::pthread_mutex_lock ( & m_mutex );
+	      cancel = m_cancel;
+	      ::pthread_mutex_unlock ( & m_mutex );
+
+	      m_scan_mgr->acquire_image ( m_buf [ tail ] + i * m_stride,
+					  m_row_bytes, 1, cancel );
+
+	      if ( ! cancel )
+		{
+		  ::pthread_mutex_lock ( & m_mutex );
+		  m_rows_read++;
+		  ::pthread_mutex_unlock ( & m_mutex );
+		}
+	    }
+
+	  if ( cancel )
+	    break;
+
+	  ::pthread_mutex_lock ( & m_mutex );
+	  m_rows [ tail ] = rows;
+	  m_full++;
+	  ::pthread_cond_broadcast ( & m_cond );
+	  ::pthread_mutex_unlock ( & m_mutex );
+	}
+    }
+  catch ( pisa_error & err )
+    {
+      ::pthread_mutex_lock ( & m_mutex );
+      m_error = new pisa_error ( err );
+      ::pthread_mutex_unlock ( & m_mutex );
+    }
+
+  ::pthread_mutex_lock ( & m_mutex );
+  m_done = true;
+  ::pthread_cond_broadcast ( & m_cond );
+  ::pthread_mutex_unlock ( & m_mutex );
+}
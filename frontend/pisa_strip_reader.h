@@ -0,0 +1,94 @@
+/* pisa_strip_reader.h
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+*/
+
+#ifndef ___PISA_STRIP_READER_H
+#define ___PISA_STRIP_READER_H
+
+#include <pthread.h>
+
+#include "pisa_scan_manager.h"
+
+/*------------------------------------------------------------*/
+/* Acquires an image from a scan_manager on a separate thread, in
+   strips of several rows, so that the GUI thread only has to hand
+   finished strips on and keep itself responsive.  Two strips are
+   used in turn: one is being filled while the other is consumed.
+
+   Rows are acquired with row_bytes bytes each and placed stride
+   bytes apart, so a consumer can expand them in place.  Errors
+   thrown by the scan_manager are passed on by finish().  Nothing
+   but the scan_manager given is touched on the reading thread.
+ */
+class strip_reader
+{
+ public:
+
+  strip_reader ( scan_manager * sm, int row_bytes, int stride,
+		 int height, int strip_rows );
+  ~strip_reader ( void );
+
+  void	start ( void );
+
+  // Returns the next full strip and its number of rows, waiting for
+  // at most usec microseconds.  Returns 0 if none became available.
+  unsigned char *	get_strip ( int * rows, long usec );
+  void	release_strip ( void );
+
+  bool	is_finished ( void );
+  int	get_rows_read ( void );
+
+  void	cancel ( void );
+  void	finish ( void );
+
+ private:
+
+  static void *	run ( void * self );
+  void	produce ( void );
+
+  scan_manager	* m_scan_mgr;
+
+  int		m_row_bytes;
+  int		m_stride;
+  int		m_height;
+  int		m_strip_rows;
+
+  unsigned char	* m_buf [ 2 ];
+  int		m_rows [ 2 ];
+  int		m_head;
+  int		m_full;
+
+  int		m_rows_read;
+  bool		m_cancel;
+  bool		m_done;
+  pisa_error	* m_error;
+
+  bool		m_running;
+  pthread_t	m_thread;
+  pthread_mutex_t m_mutex;
+  pthread_cond_t  m_cond;
+};
+
+#endif // ___PISA_STRIP_READER_H
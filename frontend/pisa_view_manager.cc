@@ -43,6 +43,8 @@
 #include <locale.h>
 #include <libgen.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 /*------------------------------------------------------------*/
 #include "pisa_view_manager.h"
@@ -51,6 +53,7 @@
 #include "pisa_scan_tool.h"
 #include "pisa_default_val.h"
 #include "pisa_gimp.h"
+#include "pisa_strip_reader.h"
 #include "pisa_aleart_dialog.h"
 #include "pisa_change_unit.h"
 #include "pisa_preference.h"
@@ -141,6 +144,11 @@ void view_manager::init ( void )
   m_filsel_cls		= 0;
   m_scansel_cls		= 0;
 
+  m_blank_threshold	= 0.0;
+  m_reduce_colours	= 0;
+  m_crop_to_document	= 0;
+  m_scan_regions	= 0;
+
   // open scanner
   m_scanmanager_cls = new scan_manager;
 
@@ -161,19 +169,17 @@ void view_manager::init ( void )
   else
     m_set.destination	= PISA_DE_FILE;
 
+  // The configuration dialog and file selector are created when
+  // they are first needed.
   m_main_cls	= new main_window;
   m_prev_cls	= new preview_window;
   m_imgctrl_cls	= new image_controls;
   m_gamma_cls	= new gamma_correction;
-  m_config_cls	= new config_window;
-  m_filsel_cls	= new file_selector;
 
   if ( ! m_main_cls ||
        ! m_prev_cls ||
        ! m_imgctrl_cls ||
-       ! m_gamma_cls ||
-       ! m_config_cls ||
-       ! m_filsel_cls )
+       ! m_gamma_cls )
     {
       destroy ( );
       throw ( PISA_ERR_OUTOFMEMORY );
@@ -184,8 +190,6 @@ void view_manager::init ( void )
   m_main_cls->init ( );
   m_prev_cls->init ( );
   m_gamma_cls->init ( );
-  m_config_cls->init ( );
-  m_filsel_cls->init ( );
 
   load_preference ( );
 
@@ -269,6 +273,7 @@ GtkWidget * view_manager::create_window ( pisa_window_id id )
     {
     case ID_WINDOW_MAIN:
       ret = m_main_cls->create_window ( 0 );
+      m_prev_cls->load_stored_preview ( );
       break;
 
     case ID_WINDOW_PREV:
@@ -276,7 +281,7 @@ GtkWidget * view_manager::create_window ( pisa_window_id id )
       break;
 
     case ID_WINDOW_CONFIG:
-      ret = m_config_cls->create_window ( m_main_cls->get_widget ( ) );
+      ret = get_config_window ( )->create_window ( m_main_cls->get_widget ( ) );
       break;
     }
 
@@ -298,7 +303,7 @@ int view_manager::close_window ( pisa_window_id id, int destroy_flag )
       break;
 
     case ID_WINDOW_CONFIG:
-      m_config_cls->close_window ( destroy_flag );
+      get_config_window ( )->close_window ( destroy_flag );
       break;
 
     default:
@@ -336,7 +341,7 @@ void * view_manager::get_window_cls ( pisa_window_id id )
       break;
 
     case ID_WINDOW_CONFIG:
-      ret = m_config_cls;
+      ret = get_config_window ( );
       break;
     }
 
@@ -367,14 +372,53 @@ view_manager::needs_duplex_rotation (void) const
   if (!m_scanmanager_cls->using_duplex ())
     return false;
 
+  // without a file selector, assume its default binding
+  bool left_edge = (!m_filsel_cls
+                    || m_filsel_cls->has_left_edge_binding ());
+
   if (!m_scanmanager_cls->adf_duplex_direction_matches ())
     {                           // double pass ADF
-      return  m_filsel_cls->has_left_edge_binding ();
+      return  left_edge;
     }
   else
     {                           // single pass ADF
-      return !m_filsel_cls->has_left_edge_binding ();
+      return !left_edge;
+    }
+}
+
+/*------------------------------------------------------------*/
+config_window * view_manager::get_config_window ( void )
+{
+  if ( ! m_config_cls )
+    {
+      m_config_cls = new config_window;
+      if ( ! m_config_cls )
+	throw pisa_error ( PISA_ERR_OUTOFMEMORY );
+
+      m_config_cls->init ( );
+      ::strcpy ( m_config_cls->m_cmd, m_print_cmd.c_str ( ) );
+    }
+
+  return m_config_cls;
+}
+
+/*------------------------------------------------------------*/
+file_selector * view_manager::get_file_selector ( void )
+{
+  if ( ! m_filsel_cls )
+    {
+      m_filsel_cls = new file_selector;
+      if ( ! m_filsel_cls )
+	throw pisa_error ( PISA_ERR_OUTOFMEMORY );
     }
+
+  return m_filsel_cls;
+}
+
+/*------------------------------------------------------------*/
+const char * view_manager::get_print_cmd ( void ) const
+{
+  return m_config_cls ? m_config_cls->m_cmd : m_print_cmd.c_str ( );
 }
 
 /*------------------------------------------------------------*/
@@ -401,7 +445,7 @@ void view_manager::start_scan ( void )
     {
     case PISA_DE_FILE:
       {
-        m_filsel_cls->init ();
+        get_file_selector ()->init ();
 #ifndef HAVE_GTK_2
         m_filsel_cls->create_window (m_main_cls->get_widget (), m_set.option,
                                      m_set.enable_start_button,
@@ -409,8 +453,7 @@ void view_manager::start_scan ( void )
 #else
         GtkWidget *w = m_main_cls->get_widget ();
         m_filsel_cls->create_window (GTK_WINDOW (gtk_widget_get_parent (w)), w,
-                                     (m_scanmanager_cls->using_adf ()
-                                      || m_set.enable_start_button),
+                                     is_multi_image (),
                                      m_scanmanager_cls->using_duplex (),
                                      _image_format.c_str ());
 #endif /* HAVE_GTK_2 */
@@ -490,9 +533,8 @@ view_manager::update_lut (long index)
 int
 view_manager::update_lut (marquee& m)
 {
-  iscan::build_LUT (m_scanmanager_cls->get_scan_source (),
-                    m_scanmanager_cls->get_film_type (),
-                    m_set, m, !m_scanmanager_cls->has_zoom ());
+  m.lut = m_lut_cache.lookup (m_scanmanager_cls->get_film_type (),
+                             m_set.imgtype.pixeltype, m);
 
   return PISA_ERR_SUCCESS;
 }
@@ -540,13 +582,131 @@ char * view_manager::get_device_name() const
   return m_scansel_cls->get_device( true );
 }
 
+/*------------------------------------------------------------*/
+// Looking for devices and opening one can take several seconds, for
+// instance while the backend probes the network or loads firmware.
+// Such calls are made on a separate thread while this one keeps the
+// GUI responsive.  Nothing but SANE is used on that thread.
+typedef struct
+{
+  void		( * func ) ( void * );
+  void		* arg;
+  pisa_error	* err;
+  bool		done;
+  pthread_mutex_t mutex;
+} background_task;
+
+static void * run_task ( void * data )
+{
+  background_task * task = static_cast< background_task * > ( data );
+
+  try
+    {
+      task->func ( task->arg );
+    }
+  catch ( pisa_error & err )
+    {
+      task->err = new pisa_error ( err );
+    }
+
+  ::pthread_mutex_lock ( & task->mutex );
+  task->done = true;
+  ::pthread_mutex_unlock ( & task->mutex );
+
+  return 0;
+}
+
+static void run_in_background ( void ( * func ) ( void * ), void * arg )
+{
+  background_task	task;
+  pthread_t		thread;
+  bool			done = false;
+
+  task.func	= func;
+  task.arg	= arg;
+  task.err	= 0;
+  task.done	= false;
+  ::pthread_mutex_init ( & task.mutex, 0 );
+
+  if ( 0 != ::pthread_create ( & thread, 0, run_task, & task ) )
+    {
+      ::pthread_mutex_destroy ( & task.mutex );
+      func ( arg );		// do it the slow way
+      return;
+    }
+
+  while ( ! done )
+    {
+      while ( ::gtk_events_pending ( ) )
+	::gtk_main_iteration ( );
+      ::usleep ( 20000 );
+
+      ::pthread_mutex_lock ( & task.mutex );
+      done = task.done;
+      ::pthread_mutex_unlock ( & task.mutex );
+    }
+
+  ::pthread_join ( thread, 0 );
+  ::pthread_mutex_destroy ( & task.mutex );
+
+  if ( task.err )
+    {
+      pisa_error err = * task.err;
+
+      delete task.err;
+      throw err;
+    }
+}
+
+/*------------------------------------------------------------*/
+static void find_devices ( void * arg )
+{
+  const SANE_Device *** devices =
+    static_cast< const SANE_Device *** > ( arg );
+  SANE_Status status;
+
+  sane_init ( 0, 0 );
+
+  status = sane_get_devices ( devices, SANE_FALSE );
+  if ( SANE_STATUS_GOOD != status )
+    throw pisa_error ( status );
+}
+
+/*------------------------------------------------------------*/
+typedef struct
+{
+  scan_manager	* scan_mgr;
+  char		* name;
+} open_task;
+
+static void open_scanner ( void * arg )
+{
+  open_task * task = static_cast< open_task * > ( arg );
+
+  task->scan_mgr->open_device ( task->name );
+}
+
 /*------------------------------------------------------------*/
 void view_manager::open_device ( void )
 {
-  sane_init( 0, 0 );
+  const SANE_Device	** devices = 0;
+  progress_window	feedback;
+  open_task		task;
+
+  feedback.set_text ( _("Looking for scanners...") );
+  feedback.show ( );
+
+  run_in_background ( find_devices, & devices );
+
   if (!m_scansel_cls)
     m_scansel_cls = new scan_selector( true );	// dialog box
-  m_scanmanager_cls->open_device ( m_scansel_cls->get_device() );
+
+  task.scan_mgr	= m_scanmanager_cls;
+  task.name	= m_scansel_cls->get_device ( false, devices );
+
+  feedback.set_text ( _("Opening the scanner...") );
+
+  run_in_background ( open_scanner, & task );
 }
 
 /*------------------------------------------------------------*/
@@ -561,11 +721,19 @@ void view_manager::load_preference ( void )
   char pref_path [ 256 ];
   char pips_path [ 1024 ] = "lpr";
   char image_format [ 1024 ] = "PNG";
+  double blank_threshold = 0.0;
+  int reduce_colours = 0;
+  int crop_to_document = 0;
+  int scan_regions = 0;
 
   cfg_struct cfg [ ] =
   {
     { "IMG", CFG_STRING, image_format },
-    { "PIPS", CFG_STRING, pips_path }
+    { "PIPS", CFG_STRING, pips_path },
+    { "BLANK", CFG_DOUBLE, & blank_threshold },
+    { "REDUCE", CFG_BOOL, & reduce_colours },
+    { "CROP", CFG_BOOL, & crop_to_document },
+    { "REGIONS", CFG_BOOL, & scan_regions }
   };
 
   ::strcpy ( pref_path, ::getenv ( "HOME" ) );
@@ -574,8 +742,14 @@ void view_manager::load_preference ( void )
 
   ::get_cfg ( pref_path, cfg, sizeof ( cfg ) / sizeof ( cfg [ 0 ] ) );
 
-  ::strcpy ( m_config_cls->m_cmd, pips_path );
+  m_print_cmd = pips_path;
+  if ( m_config_cls )
+    ::strcpy ( m_config_cls->m_cmd, pips_path );
   _image_format = image_format;
+  m_blank_threshold = blank_threshold;
+  m_reduce_colours = reduce_colours;
+  m_crop_to_document = crop_to_document;
+  m_scan_regions = scan_regions;
 }
 
 /*------------------------------------------------------------*/
@@ -587,14 +761,18 @@ void view_manager::save_preference ( void )
   cfg_struct cfg [ ] =
   {
     { "IMG", CFG_STRING, const_cast<char*> (_image_format.c_str ()) },
-    { "PIPS", CFG_STRING, pips_path }
+    { "PIPS", CFG_STRING, pips_path },
+    { "BLANK", CFG_DOUBLE, & m_blank_threshold },
+    { "REDUCE", CFG_BOOL, & m_reduce_colours },
+    { "CROP", CFG_BOOL, & m_crop_to_document },
+    { "REGIONS", CFG_BOOL, & m_scan_regions }
   };
 
   ::strcpy ( pref_path, ::getenv ( "HOME" ) );
   ::strcat ( pref_path, "/" );
   ::strcat ( pref_path, PREFERENCE );
 
-  ::strcpy ( pips_path, m_config_cls->m_cmd );
+  ::strcpy ( pips_path, get_print_cmd ( ) );
 
   ::set_cfg ( pref_path, cfg, sizeof ( cfg ) / sizeof ( cfg [ 0 ] ) );
 }
@@ -640,7 +818,9 @@ view_manager::init_img_info (void)
 int
 view_manager::init_scan_param (void)
 {
-  marquee marq = get_marquee (m_set.get_marquee_size ( ) - 1);
+  marquee marq = (scans_regions ()
+                  ? region_union ()
+                  : get_marquee (m_set.get_marquee_size ( ) - 1));
 
   pisa_error_id err = m_scanmanager_cls->set_scan_parameters (m_set, marq);
 
@@ -674,7 +854,8 @@ view_manager::do_scan (iscan::imgstream& is, const iscan::file_opener& fo,
   static int status;
 
   if (first_time_around) status = 0;
-  if (!m_filsel_cls->multi_page_mode ()) status |= SCAN_SINGLE;
+  if (!m_filsel_cls || !m_filsel_cls->multi_page_mode ())
+    status |= SCAN_SINGLE;
   if (wait_for_button ()) status |= SCAN_BUTTON | SCAN_NEXT;
   if (m_scanmanager_cls->using_adf ()) status |= SCAN_ADF | SCAN_NEXT;
 
@@ -875,30 +1056,48 @@ view_manager::scan_gimp (int *cancel, bool first_time_around)
 	  throw pisa_error ( PISA_ERR_OUTOFMEMORY );
 	}
 
-      for (int i = 0; i < height; i++)
-	{
-	  m_scanmanager_cls->acquire_image ( gimp_cls.get_next_buf ( ),
-					     rowbytes,
-					     1,
-					     *cancel );
+      // Rows are read on a separate thread while this one hands
+      // finished strips to GIMP and keeps the GUI alive.
+      strip_reader reader (m_scanmanager_cls, rowbytes,
+			   gimp_cls.get_rowstride (), height,
+			   gimp_cls.get_strip_rows ());
+      reader.start ();
 
-	  if ( i == 0 )
-	    _feedback->set_text (progress_window::SCANNING);
+      bool scanning = false;
+      while (!reader.is_finished ())
+	{
+	  int rows;
+	  unsigned char *strip = reader.get_strip (&rows, 50000);
 
-	  if (*cancel)
+	  if (strip)
 	    {
-	      error = true;
-	      break;
+	      if (!*cancel)
+		gimp_cls.set_strip (strip, rows);
+	      reader.release_strip ();
 	    }
 
-	  _feedback->set_progress (i, height);
-	  *cancel = _feedback->is_cancelled ();
+	  int done = reader.get_rows_read ();
+	  if (!scanning && 0 < done)
+	    {
+	      _feedback->set_text (progress_window::SCANNING);
+	      scanning = true;
+	    }
+	  _feedback->set_progress (done, height);
 
-	  gimp_cls.set_image_rect ( );
+	  if (!*cancel && _feedback->is_cancelled ())
+	    {
+	      *cancel = 1;
+	      reader.cancel ();
+	    }
 
 	  while ( ::gtk_events_pending ( ) )
 	    ::gtk_main_iteration ( );
 	}
+      reader.finish ();
+
+      if (*cancel)
+	error = true;
+
       m_scanmanager_cls->acquire_image (0, 1, 1, *cancel);
       _feedback->set_progress (height, height);
 
@@ -992,12 +1191,32 @@ view_manager::scan_file (iscan::imgstream& is, int *status,
 	  throw pisa_error (PISA_ERR_PARAMETER);
 	}
 
+      // Pages from the ADF pass through the page filter so that blank
+      // separator sheets and backs can be dropped.  The filter also
+      // stores pages with fewer colours if so requested.
+      double blank_threshold = ((*status & SCAN_ADF)
+                                ? m_blank_threshold : 0.0);
+      int reduce_to = m_set.imgtype.pixeltype;
+      if (m_reduce_colours)
+        reduce_to = iscan::page_filter::reduced_type
+          (m_filsel_cls ? m_filsel_cls->get_type () : iscan::NO_FORMAT);
+      bool slice = scans_regions ();
+      bool filter = (!slice
+                     && (0.0 < blank_threshold
+                         || reduce_to < m_set.imgtype.pixeltype));
+
       try
         {
           is.size (width, height);
           is.depth (PISA_PT_BW == m_set.imgtype.pixeltype ? 1 : 8);
           is.colour (cs);
           is.resolution (m_set.resolution, m_set.resolution);
+
+          if (slice)
+            slice_regions (width, height);
+          if (filter)
+            m_page_filter.begin (width, height, m_set.imgtype.pixeltype,
+                                 blank_threshold, reduce_to);
         }
       catch (pisa_error& oops)
 	{
@@ -1028,8 +1247,15 @@ view_manager::scan_file (iscan::imgstream& is, int *status,
             {
               try
                 {
-                  is.write ((const char *)img, rowbytes);
-                  *status |= SCAN_DATA;
+                  if (slice)
+                    m_region_slicer.write (img, 1);
+                  else if (filter)
+                    m_page_filter.write (img, 1);
+                  else
+                    {
+                      is.write ((const char *)img, rowbytes);
+                      *status |= SCAN_DATA;
+                    }
                 }
               catch (std::exception& oops)
                 {               // map to old API and rethrow
@@ -1055,6 +1281,20 @@ view_manager::scan_file (iscan::imgstream& is, int *status,
 
       m_scanmanager_cls->acquire_image (0, 1, 1, *status & SCAN_CANCEL);
       _feedback->set_progress (height, height);
+
+      if ((slice || filter) && !(*status & SCAN_CANCEL))
+        {
+          try
+            {
+              if (slice ? m_region_slicer.commit (is)
+                  : m_page_filter.commit (is))
+                *status |= SCAN_DATA;
+            }
+          catch (std::exception& oops)
+            {                   // map to old API and rethrow
+              throw (pisa_error (PISA_ERR_OUTOFMEMORY));
+            }
+        }
     }
   catch (pisa_error& oops)
     {
@@ -1062,6 +1302,7 @@ view_manager::scan_file (iscan::imgstream& is, int *status,
       *status |= dialog_reply (oops);
     }
 
+  m_region_slicer.clear ();
   m_scanmanager_cls->release_memory ();
 
   while (::gtk_events_pending())
@@ -1076,7 +1317,7 @@ view_manager::print (const std::string& filename) const
   if (PISA_DE_PRINTER == m_set.destination)
     {
       char cmd[1024];           // FIXME: buffer overflow!
-      sprintf (cmd, "%s %s", m_config_cls->m_cmd, filename.c_str ());
+      sprintf (cmd, "%s %s", get_print_cmd (), filename.c_str ());
       system (cmd);             // FIXME: check cmd exit status
 
       while (gtk_events_pending ()) gtk_main_iteration ();
@@ -1088,7 +1329,106 @@ view_manager::print (const std::string& filename) const
 bool
 view_manager::is_multi_image (void) const
 {
-  return (m_scanmanager_cls->using_adf () || m_set.enable_start_button);
+  return (m_scanmanager_cls->using_adf () || m_set.enable_start_button
+          || scans_regions ());
+}
+
+// Photos laid out side by side on the flatbed each get a marquee of
+// their own.  Rather than scanning every marquee separately, we scan
+// the area covering all of them once and cut the images out of that.
+// This only works for settings that apply to the scan as a whole.
+// Tone curves and scaling can be done per region after the fact.
+
+bool
+view_manager::scans_regions (void) const
+{
+  if (!m_scan_regions
+      || PISA_DE_FILE != m_set.destination
+      || PISA_PT_BW == m_set.imgtype.pixeltype
+      || m_scanmanager_cls->using_adf ()
+      || m_set.enable_start_button)
+    return false;
+
+  // the first marquee covers the whole document area
+  long size = m_set.get_marquee_size ();
+  if (size < 3)
+    return false;
+
+  const marquee& first = m_set.get_marquee (1);
+  for (long i = 2; i < size; ++i)
+    {
+      const marquee& m = m_set.get_marquee (i);
+
+      if (m.saturation != first.saturation
+          || m.brightness != first.brightness
+          || m.contrast != first.contrast
+          || m.focus != first.focus)
+        return false;
+    }
+  return true;
+}
+
+marquee
+view_manager::region_union (void) const
+{
+  long size = m_set.get_marquee_size ();
+  marquee u = m_set.get_marquee (size - 1);
+
+  double left = u.offset.x, right  = u.offset.x + u.area.x;
+  double top  = u.offset.y, bottom = u.offset.y + u.area.y;
+
+  for (long i = 1; i < size; ++i)
+    {
+      const marquee& m = m_set.get_marquee (i);
+
+      if (m.offset.x < left) left = m.offset.x;
+      if (m.offset.y < top ) top  = m.offset.y;
+      if (right  < m.offset.x + m.area.x) right  = m.offset.x + m.area.x;
+      if (bottom < m.offset.y + m.area.y) bottom = m.offset.y + m.area.y;
+      if (u.scale < m.scale) u.scale = m.scale;
+    }
+  u.offset.x = left;
+  u.offset.y = top;
+  u.area.x = right - left;
+  u.area.y = bottom - top;
+
+  // the tone curves are applied per region by the slicer
+  for (int i = 0; i < 256; ++i)
+    {
+      u.lut.gamma_r[i] = i;
+      u.lut.gamma_g[i] = i;
+      u.lut.gamma_b[i] = i;
+    }
+  return u;
+}
+
+void
+view_manager::slice_regions (int width, int height)
+{
+  marquee u = region_union ();
+
+  // use the size of the scan as obtained, it may differ slightly
+  // from what was asked for
+  double x_res = width  / u.area.x;
+  double y_res = height / u.area.y;
+
+  m_region_slicer.begin (width, height, m_set.imgtype.pixeltype);
+
+  for (long i = 1; i < m_set.get_marquee_size (); ++i)
+    {
+      const marquee& m = m_set.get_marquee (i);
+
+      int left = (int) ((m.offset.x - u.offset.x) * x_res + 0.5);
+      int top  = (int) ((m.offset.y - u.offset.y) * y_res + 0.5);
+      int w    = (int) (m.area.x * x_res + 0.5);
+      int h    = (int) (m.area.y * y_res + 0.5);
+
+      // the scanner only applies the red table, even to colour
+      m_region_slicer.add_region (left, top, w, h,
+                                  (w * m.scale + u.scale / 2) / u.scale,
+                                  (h * m.scale + u.scale / 2) / u.scale,
+                                  m.lut.gamma_r);
+    }
 }
 
 bool
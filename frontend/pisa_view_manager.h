@@ -44,6 +44,9 @@
 #include "pisa_progress_window.h"
 #include "pisa_image_controls.h"
 #include "pisa_gamma_correction.h"
+#include "pisa_exposure.h"
+#include "pisa_page_filter.h"
+#include "pisa_region_slicer.h"
 #include "pisa_configuration.h"
 #include "pisa_error.h"
 #include "pisa_scan_selector.h"
@@ -98,6 +101,8 @@ class view_manager
 
   long     get_marquee_size () const;
 
+  bool	crops_to_document ( void ) const { return m_crop_to_document; }
+
   void set_destination (long destination);
   void set_resolution (long resolution);
   void set_image_type (const imagetype *type);
@@ -117,6 +122,10 @@ class view_manager
   void	load_preference ( void );
   void	save_preference ( void );
 
+  config_window *	get_config_window ( void );
+  file_selector *	get_file_selector ( void );
+  const char *	get_print_cmd ( void ) const;
+
   int init_img_info (void);
 
   int	init_scan_param (void);
@@ -133,12 +142,30 @@ class view_manager
 
   void print (const std::string& filename) const;
   bool is_multi_image (void) const;
+  bool scans_regions (void) const;
+  marquee region_union (void) const;
+  void slice_regions (int width, int height);
   bool wait_for_button (void) const;
   bool needs_duplex_rotation (void) const;
 
   // attribute
   settings	m_set;
 
+  iscan::lut_cache	m_lut_cache;
+  iscan::page_filter	m_page_filter;
+  iscan::region_slicer	m_region_slicer;
+
+  // ink coverage, in percent, up to which ADF pages count as blank
+  // and are dropped, zero disables
+  double		m_blank_threshold;
+  // non-zero to store pages with fewer colours when that loses nothing
+  int			m_reduce_colours;
+  // non-zero to limit the scan area to the documents found on the
+  // preview
+  int			m_crop_to_document;
+  // non-zero to scan all marquees in a single pass, one image each
+  int			m_scan_regions;
+
   scan_manager		* m_scanmanager_cls;
 
   main_window		* m_main_cls;
@@ -152,6 +179,7 @@ class view_manager
   progress_window *_feedback;
 
   std::string _image_format;
+  std::string m_print_cmd;
 };
 
 extern view_manager	* g_view_manager;
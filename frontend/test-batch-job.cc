@@ -0,0 +1,104 @@
+/* test-batch-job.cc -- checks job file parsing of iscan-batch
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sstream>
+
+#include "batch-job.h"
+
+using std::string;
+using std::vector;
+
+static int failures = 0;
+
+#define check(cond)                                             \
+  do {                                                          \
+    if (!(cond))                                                \
+      {                                                         \
+        fprintf (stderr, "%s:%d: check failed: %s\n",           \
+                 __FILE__, __LINE__, #cond);                    \
+        ++failures;                                             \
+      }                                                         \
+  } while (0)
+
+static bool
+parse (const char *text, vector<job>& jobs, long& lineno, string& opt)
+{
+  std::istringstream in (text);
+  job defaults;
+
+  defaults.format = "pdf";
+  return read_jobs (in, defaults, jobs, lineno, opt);
+}
+
+int
+main (void)
+{
+  vector<job> jobs;
+  long lineno;
+  string opt;
+
+  // hash marks in an output name number the pages, they are no comment
+  check (parse ("# numbered pages\n"
+               "--output=scan-###.pdf --pages=3  # three at most\n"
+               "   # indented comment --mode=lineart\n"
+               "\n"
+               "--output=#.png --format=png\t#--resolution=600\n"
+               "--mode=gray-document --output=a#b.pdf#\n",
+               jobs, lineno, opt));
+  check (6 == lineno);
+  check (3 == jobs.size ());
+  if (3 == jobs.size ())
+    {
+      check ("scan-###.pdf" == jobs[0].output);
+      check ("pdf" == jobs[0].format);
+      check (3 == jobs[0].pages);
+      check ("color-photo" == jobs[0].mode);
+
+      check ("#.png" == jobs[1].output);
+      check ("png" == jobs[1].format);
+      check (300 == jobs[1].resolution);
+
+      check ("a#b.pdf#" == jobs[2].output);
+      check ("gray-document" == jobs[2].mode);
+    }
+
+  // invalid options are reported with their line
+  jobs.clear ();
+  check (!parse ("--output=ok.pdf\n"
+                "--output=bad.pdf --colour=red\n",
+                jobs, lineno, opt));
+  check (2 == lineno);
+  check ("--colour=red" == opt);
+
+  return (failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,402 @@
+/* test-exposure.cc -- checks exposure settings and lookup tables
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "pisa_default_val.h"
+#include "pisa_enums.h"
+#include "pisa_exposure.h"
+
+using std::vector;
+
+static int failures = 0;
+
+#define check(cond)                                             \
+  do {                                                          \
+    if (!(cond))                                                \
+      {                                                         \
+        fprintf (stderr, "%s:%d: check failed: %s\n",           \
+                 __FILE__, __LINE__, #cond);                    \
+        ++failures;                                             \
+      }                                                         \
+  } while (0)
+
+#define check_range(lo, value, hi)                              \
+  do {                                                          \
+    check ((lo) <= (value));                                    \
+    check ((value) <= (hi));                                    \
+  } while (0)
+
+static const int width = 100;
+static const int height = 100;
+
+// Lays out pixel values in a width x height image, passing each
+// pixel's rank, in 0..1, to a function that gives its channels.
+static void
+fill (vector<unsigned char>& img, int channels,
+      void (*level) (double t, unsigned char *p))
+{
+  const int n = width * height;
+
+  img.resize (n * channels);
+  for (int i = 0; i < n; ++i)
+    level ((i + 0.5) / n, &img[i * channels]);
+}
+
+static void
+expose (vector<unsigned char>& img, int channels, int option, int film,
+        bool is_photo, marquee& m)
+{
+  pisa_image_info info;
+  _rectL r;
+
+  info.m_img = &img[0];
+  info.m_width = width;
+  info.m_height = height;
+  info.m_rowbytes = width * channels;
+  info.m_bits_per_pixel = 8 * channels;
+
+  // anything sticking out of the image is ignored
+  r.left = -5;
+  r.top = 0;
+  r.right = width + 5;
+  r.bottom = height;
+
+  iscan::auto_expose (option, film, info, r, m, is_photo, false);
+}
+
+// A dark, neutral scene from 30 to 199, with most pixels in the
+// shadows.  Its median lies a quarter of the way up.
+static void
+photo_level (double t, unsigned char *p)
+{
+  p[0] = p[1] = p[2] = (unsigned char) (30 + 170 * t * t);
+}
+
+// White paper with a little noise and 8% of black text.
+static void
+document_level (double t, unsigned char *p)
+{
+  if (t < 0.08)
+    p[0] = (unsigned char) (20 + 250 * t);
+  else
+    p[0] = (unsigned char) (230 + 10 * (t - 0.08) / 0.92);
+}
+
+// A colour negative of a neutral scene.  The orange mask shows up as
+// the brightest level of each channel and the dyes respond with a
+// different contrast each.
+static const int mask[3] = { 230, 160, 110 };
+static const double contrast[3] = { 1.0, 1.3, 0.8 };
+
+static void
+negative_level (double t, unsigned char *p)
+{
+  for (int c = 0; c < 3; ++c)
+    p[c] = (unsigned char) (mask[c] * (1 - 0.7 * pow (t, contrast[c])));
+}
+
+static void
+check_photo (void)
+{
+  vector<unsigned char> img;
+  marquee m;
+
+  fill (img, 3, photo_level);
+  expose (img, 3, PISA_OP_FLATBED, PISA_FT_REFLECT, true, m);
+
+  check_range (30, m.shadow, 31);
+  check_range (198, m.highlight, 199);
+  // a median at a quarter wants a gamma of sqrt (2)
+  check_range (138, m.gamma, 144);
+  check (0 == m.graybalance);
+
+  for (int c = 0; c < 3; ++c)
+    {
+      check (m.grayl[c] == m.grayl[0]);
+      check (1.0 == m.film_gamma[c]);
+      check (0.0 == m.film_yp[c]);
+    }
+
+  // the same scene as a document keeps its midtones
+  expose (img, 3, PISA_OP_FLATBED, PISA_FT_REFLECT, false, m);
+  check (100 == m.gamma);
+}
+
+static void
+check_document (void)
+{
+  vector<unsigned char> img;
+  marquee m;
+
+  fill (img, 1, document_level);
+  expose (img, 1, PISA_OP_FLATBED, PISA_FT_REFLECT, false, m);
+
+  // 1% of the pixels are clipped to black, 2% to white
+  check_range (21, m.shadow, 23);
+  check_range (239, m.highlight, 240);
+  check (100 == m.gamma);
+  for (int c = 0; c < 3; ++c)
+    check (m.grayl[c] == m.highlight);
+
+  // a dark page without contrast is left alone, the levels would be
+  // no further apart than MINHIGHLIGHT - 40
+  vector<unsigned char> flat (width * height, 40);
+  m.gamma = 150;
+  expose (flat, 1, PISA_OP_FLATBED, PISA_FT_REFLECT, true, m);
+  check (DEFSHADOW == m.shadow);
+  check (DEFHIGHLIGHT == m.highlight);
+  check (100 == m.gamma);
+}
+
+static void
+check_negative (void)
+{
+  vector<unsigned char> img;
+  marquee m;
+
+  fill (img, 3, negative_level);
+  expose (img, 3, PISA_OP_TPU, PISA_FT_NEGA, true, m);
+
+  // the mask becomes black, each channel's median mid-gray
+  for (int c = 0; c < 3; ++c)
+    {
+      check (fabs (m.film_yp[c] - (1 - mask[c] / 255.0)) < 0.01);
+      check_range (0.25, m.film_gamma[c], 4.0);
+    }
+  check (m.film_gamma[2] < m.film_gamma[0]);
+  check (m.film_gamma[0] < m.film_gamma[1]);
+
+  // the inverted scene tops out at 70% of full scale and its median
+  // is already close to mid-gray
+  check_range (0, m.shadow, 2);
+  check_range (175, m.highlight, 195);
+  check_range (90, m.gamma, 120);
+
+  // only transparency units scan film
+  expose (img, 3, PISA_OP_FLATBED, PISA_FT_NEGA, true, m);
+  for (int c = 0; c < 3; ++c)
+    {
+      check (1.0 == m.film_gamma[c]);
+      check (0.0 == m.film_yp[c]);
+    }
+}
+
+// Settings that leave every pixel alone.
+static void
+neutral (marquee& m)
+{
+  m.gamma = 100;
+  m.highlight = 255;
+  m.shadow = 0;
+  m.graybalance = 0;
+  m.reset_gamma_table ();
+  for (int c = 0; c < 3; ++c)
+    {
+      m.film_gamma[c] = 1.0;
+      m.film_yp[c] = 0.0;
+      m.grayl[c] = 255.0;
+    }
+}
+
+static bool
+is_identity (const gamma_struct& lut)
+{
+  for (int v = 0; v < 256; ++v)
+    if (v != lut.gamma_r[v] || v != lut.gamma_g[v] || v != lut.gamma_b[v])
+      return false;
+  return true;
+}
+
+// Shadow and highlight stretch the levels in between to full scale,
+// then the gamma bends them.
+static int
+levels (int v, int shadow, int highlight, int gamma)
+{
+  double x = (v - shadow) / (double) (highlight - shadow);
+
+  if (x <= 0.0) return 0;
+  if (1.0 <= x) return 255;
+  return (int) (255 * pow (x, 100.0 / gamma) + 0.5);
+}
+
+static void
+check_build_lut (void)
+{
+  marquee m;
+  gamma_struct lut;
+  int v;
+
+  neutral (m);
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+  check (is_identity (lut));
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_GRAY, m, lut);
+  check (is_identity (lut));
+
+  m.shadow = 20;
+  m.highlight = 220;
+  m.gamma = 200;
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+  for (v = 0; v < 256; ++v)
+    {
+      int e = levels (v, 20, 220, 200);
+
+      check (e == lut.gamma_r[v]);
+      check (e == lut.gamma_g[v]);
+      check (e == lut.gamma_b[v]);
+    }
+  check (0 == lut.gamma_r[20] && 255 == lut.gamma_r[220]);
+  check (255 * sqrt (0.5) - 1 < lut.gamma_r[120]
+         && lut.gamma_r[120] < 255 * sqrt (0.5) + 1);
+
+  // the master curve comes before the channel curves
+  for (v = 0; v < 256; ++v)
+    {
+      m.gamma_table[0][v] = 255 - v;
+      m.gamma_table[1][v] = v / 2;
+    }
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+  for (v = 0; v < 256; ++v)
+    {
+      int e = levels (v, 20, 220, 200);
+
+      check ((255 - e) / 2 == lut.gamma_r[v]);
+      check (255 - e == lut.gamma_g[v]);
+      check (255 - e == lut.gamma_b[v]);
+    }
+
+  // gray uses the master curve only, for all channels
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_GRAY, m, lut);
+  for (v = 0; v < 256; ++v)
+    {
+      int e = levels (v, 20, 220, 200);
+
+      check (255 - e == lut.gamma_r[v]);
+    }
+  check (0 == memcmp (lut.gamma_r, lut.gamma_g, 256));
+  check (0 == memcmp (lut.gamma_r, lut.gamma_b, 256));
+
+  // full gray balance lifts each channel's neutral level to the
+  // average of the three before the levels are applied
+  neutral (m);
+  m.graybalance = 100;
+  m.grayl[0] = 180;
+  m.grayl[1] = 210;
+  m.grayl[2] = 240;
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+  check (210 == lut.gamma_r[180]);
+  check (210 == lut.gamma_g[210]);
+  check (210 == lut.gamma_b[240]);
+  m.shadow = 10;
+  m.highlight = 230;
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+  check (levels (210, 10, 230, 100) == lut.gamma_r[180]);
+  check (levels (210, 10, 230, 100) == lut.gamma_b[240]);
+
+  // negative film is inverted first, its mask going to black
+  neutral (m);
+  m.film_yp[0] = 1 - 200 / 255.0;
+  iscan::build_LUT (PISA_FT_NEGA, PISA_PT_RGB, m, lut);
+  check (0 == lut.gamma_r[200] && 0 == lut.gamma_r[255]);
+  check (255 == lut.gamma_r[0]);
+  check (lut.gamma_r[150] > lut.gamma_r[160]);
+  check (255 == lut.gamma_g[0] && 0 == lut.gamma_g[255]);
+}
+
+static void
+check_lut_cache (void)
+{
+  iscan::lut_cache cache;
+  const gamma_struct *entry[9];
+  marquee m;
+  gamma_struct lut;
+  int i;
+
+  neutral (m);
+  entry[0] = &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m);
+  check (is_identity (*entry[0]));
+
+  // equal settings hit, different ones do not
+  check (entry[0] == &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m));
+  check (entry[0] != &cache.lookup (PISA_FT_REFLECT, PISA_PT_GRAY, m));
+  m.gamma_table[2][128] = 0;
+  check (entry[0] != &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m));
+  m.gamma_table[2][128] = 128;
+  check (entry[0] == &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m));
+
+  // fill the cache with tables for gamma 100 to 107
+  cache = iscan::lut_cache ();
+  for (i = 0; i < 8; ++i)
+    {
+      m.gamma = 100 + i;
+      entry[i] = &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m);
+      iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+      check (0 == memcmp (&lut, entry[i], sizeof (lut)));
+    }
+  for (i = 1; i < 8; ++i)
+    check (entry[i] != entry[i - 1]);
+
+  // using gamma 100 again makes 101 the least recently used
+  m.gamma = 100;
+  check (entry[0] == &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m));
+
+  m.gamma = 108;
+  entry[8] = &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m);
+  check (entry[1] == entry[8]);
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+  check (0 == memcmp (&lut, entry[8], sizeof (lut)));
+
+  // gamma 100 survived, 101 is built again in place of 102
+  m.gamma = 100;
+  check (entry[0] == &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m));
+  m.gamma = 101;
+  check (entry[2] == &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m));
+  iscan::build_LUT (PISA_FT_REFLECT, PISA_PT_RGB, m, lut);
+  check (0 == memcmp (&lut, entry[2], sizeof (lut)));
+  m.gamma = 103;
+  check (entry[3] == &cache.lookup (PISA_FT_REFLECT, PISA_PT_RGB, m));
+}
+
+int
+main (void)
+{
+  check_photo ();
+  check_document ();
+  check_negative ();
+  check_build_lut ();
+  check_lut_cache ();
+
+  return (failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,584 @@
+/* test-page-filter.cc -- checks blank page detection and colour reduction
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "pisa_enums.h"
+#include "pisa_page_filter.h"
+#include "tiffstream.hh"
+
+using std::string;
+using std::vector;
+
+using iscan::imgstream;
+using iscan::page_filter;
+
+typedef vector<unsigned char> page;
+
+static int failures = 0;
+
+#define check(cond)                                             \
+  do {                                                          \
+    if (!(cond))                                                \
+      {                                                         \
+        fprintf (stderr, "%s:%d: check failed: %s\n",           \
+                 __FILE__, __LINE__, #cond);                    \
+        ++failures;                                             \
+      }                                                         \
+  } while (0)
+
+// Collects whatever the page filter passes on to an image stream.
+class capture : public imgstream
+{
+public:
+  capture (void) : skipped (0) {}
+
+  imgstream& write (const byte_type *data, size_type n)
+  {
+    bytes.insert (bytes.end (), data, data + n);
+    return *this;
+  }
+
+  void skip_page (void)
+  {
+    ++skipped;
+  }
+
+  iscan::colour_space space (void) const { return _cspc; }
+  size_type bits (void) const { return _bits; }
+
+  string bytes;
+  int skipped;
+};
+
+static int
+row_bytes (int width, int pixel_type)
+{
+  if (PISA_PT_BW == pixel_type) return (width + 7) / 8;
+  if (PISA_PT_RGB == pixel_type) return 3 * width;
+  return width;
+}
+
+// Passes a page through the filter the way the scan loop does, a
+// few rows at a time.
+static bool
+run (page_filter& filter, imgstream& is, const page& img,
+     int width, int height, int pixel_type,
+     double threshold, int reduce_to)
+{
+  int rowbytes = row_bytes (width, pixel_type);
+
+  filter.begin (width, height, pixel_type, threshold, reduce_to);
+  for (int y = 0; y < height; y += 3)
+    {
+      int rows = (height - y < 3 ? height - y : 3);
+      filter.write (&img[y * rowbytes], rows);
+    }
+  return filter.commit (is);
+}
+
+static void
+set_bit (page& img, int width, int x, int y)
+{
+  img[y * ((width + 7) / 8) + x / 8] |= 0x80 >> (x % 8);
+}
+
+static void
+check_gray_pages (void)
+{
+  const int width = 200, height = 100;
+  page_filter filter;
+  page img (width * height, 235);
+  int x, y;
+
+  // a scanner shadow along the left edge is outside the inspected area
+  for (y = 0; y < height; ++y)
+    for (x = 0; x < 5; ++x)
+      img[y * width + x] = 10;
+
+  {
+    capture is;
+    check (!run (filter, is, img, width, height, PISA_PT_GRAY, 0.5,
+                 PISA_PT_GRAY));
+    check (filter.is_blank ());
+    check (1 == is.skipped);
+    check (is.bytes.empty ());
+  }
+
+  {                             // detection is off without a threshold
+    capture is;
+    check (run (filter, is, img, width, height, PISA_PT_GRAY, 0.0,
+                PISA_PT_GRAY));
+    check (!filter.is_blank ());
+    check (0 == is.skipped);
+    check (string (img.begin (), img.end ()) == is.bytes);
+  }
+
+  // 200 ink pixels out of the 180 x 90 inspected ones is about 1.2%
+  for (y = 45; y < 55; ++y)
+    for (x = 90; x < 110; ++x)
+      img[y * width + x] = 20;
+
+  {
+    capture is;
+    check (run (filter, is, img, width, height, PISA_PT_GRAY, 0.5,
+                PISA_PT_GRAY));
+    check (!filter.is_blank ());
+    check (0 == is.skipped);
+    check (string (img.begin (), img.end ()) == is.bytes);
+  }
+
+  {
+    capture is;
+    check (!run (filter, is, img, width, height, PISA_PT_GRAY, 2.0,
+                 PISA_PT_GRAY));
+    check (1 == is.skipped);
+  }
+}
+
+static void
+check_bw_pages (void)
+{
+  // inspected are columns 5 to 94 and rows 2 to 37, 3240 pixels
+  const int width = 100, height = 40;
+  page_filter filter;
+  page img (height * ((width + 7) / 8), 0);
+  int x, y;
+
+  // black borders along the sheet edges do not count
+  for (y = 0; y < height; ++y)
+    for (x = 0; x < 5; ++x)
+      {
+        set_bit (img, width, x, y);
+        set_bit (img, width, width - 1 - x, y);
+      }
+  for (x = 0; x < width; ++x)
+    {
+      set_bit (img, width, x, 0);
+      set_bit (img, width, x, height - 1);
+    }
+
+  // 10 ink pixels, about 0.3%
+  for (x = 40; x < 50; ++x)
+    set_bit (img, width, x, 20);
+
+  {
+    capture is;
+    check (!run (filter, is, img, width, height, PISA_PT_BW, 0.5,
+                 PISA_PT_BW));
+    check (filter.is_blank ());
+    check (1 == is.skipped);
+    check (is.bytes.empty ());
+  }
+
+  // 60 ink pixels, about 1.9%, right on the inspected area's corners
+  for (x = 5; x < 30; ++x)
+    set_bit (img, width, x, 2);
+  for (x = 70; x < 95; ++x)
+    set_bit (img, width, x, 37);
+
+  {
+    capture is;
+    check (run (filter, is, img, width, height, PISA_PT_BW, 0.5,
+                PISA_PT_BW));
+    check (!filter.is_blank ());
+    check (0 == is.skipped);
+    check (string (img.begin (), img.end ()) == is.bytes);
+  }
+}
+
+static void
+set_rgb (page& img, int width, int x, int y, int r, int g, int b)
+{
+  unsigned char *p = &img[3 * (y * width + x)];
+
+  p[0] = r;
+  p[1] = g;
+  p[2] = b;
+}
+
+// Text in black on light gray paper, scanned in colour.  The first
+// row is outside the inspected area and has pixels that are used to
+// check the conversion.
+static page
+text_page (int width, int height)
+{
+  page img (3 * width * height, 230);
+
+  for (int y = 10; y < height - 10; y += 6)
+    for (int x = 20; x < width - 20; ++x)
+      if (x % 7 < 4)
+        for (int dy = 0; dy < 2; ++dy)
+          set_rgb (img, width, x, y + dy, 20, 20, 20);
+
+  for (int x = 0; x < 8; ++x)
+    set_rgb (img, width, x, 0, 20, 20, 20);
+  set_rgb (img, width,  8, 0, 124, 124, 124);
+  set_rgb (img, width,  9, 0, 126, 126, 126);
+  set_rgb (img, width, 16, 0, 255,   0,   0);
+  set_rgb (img, width, 17, 0,   0, 255,   0);
+  set_rgb (img, width, 18, 0,   0,   0, 255);
+  set_rgb (img, width, 19, 0, 200, 100,  50);
+
+  return img;
+}
+
+static void
+check_reduction (void)
+{
+  const int width = 64, height = 48;
+  page_filter filter;
+  page img = text_page (width, height);
+
+  check (PISA_PT_GRAY == page_filter::reduced_type (iscan::JPG));
+  check (PISA_PT_BW == page_filter::reduced_type (iscan::PNM));
+  check (PISA_PT_BW == page_filter::reduced_type (iscan::PDF));
+  check (PISA_PT_BW == page_filter::reduced_type (iscan::TIF));
+  check (PISA_PT_BW == page_filter::reduced_type (iscan::NO_FORMAT));
+
+  {                             // text goes to black and white
+    capture is;
+
+    is.colour (iscan::RGB);
+    is.depth (8);
+    check (run (filter, is, img, width, height, PISA_PT_RGB, 0.0,
+                PISA_PT_BW));
+    check (PISA_PT_BW == filter.classify ());
+    check (iscan::mono == is.space ());
+    check (1 == is.bits ());
+    check ((size_t) height * ((width + 7) / 8) == is.bytes.size ());
+    if (2 < is.bytes.size ())
+      {
+        // ink is black, the threshold lies halfway ink and paper and
+        // colour is compared by its luma
+        check ('\xff' == is.bytes[0]);
+        check ('\x80' == is.bytes[1]);
+        check ('\xb0' == is.bytes[2]);
+      }
+  }
+
+  {                             // unless the file format has no use for it
+    capture is;
+
+    is.colour (iscan::RGB);
+    is.depth (8);
+    check (run (filter, is, img, width, height, PISA_PT_RGB, 0.0,
+                page_filter::reduced_type (iscan::JPG)));
+    check (iscan::gray == is.space ());
+    check (8 == is.bits ());
+    check ((size_t) height * width == is.bytes.size ());
+    if (20 < is.bytes.size ())
+      {
+        const unsigned char *p = (const unsigned char *) is.bytes.data ();
+
+        check (20 == p[0]);
+        check (230 == p[10]);
+        // ITU-R BT.601 luma
+        check (76 == p[16]);
+        check (149 == p[17]);
+        check (28 == p[18]);
+        check (124 == p[19]);
+      }
+  }
+
+  // a few coloured marks keep the page in colour
+  for (int y = 20; y < 28; ++y)
+    for (int x = 20; x < 28; ++x)
+      set_rgb (img, width, x, y, 200, 30, 30);
+
+  {
+    capture is;
+
+    is.colour (iscan::RGB);
+    is.depth (8);
+    check (run (filter, is, img, width, height, PISA_PT_RGB, 0.0,
+                PISA_PT_BW));
+    check (PISA_PT_RGB == filter.classify ());
+    check (iscan::RGB == is.space ());
+    check (8 == is.bits ());
+    check (string (img.begin (), img.end ()) == is.bytes);
+  }
+
+  // a gray photo has too many midtones for black and white
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      {
+        int v = 4 * x;
+        set_rgb (img, width, x, y, v, v, v);
+      }
+
+  {
+    capture is;
+
+    is.colour (iscan::RGB);
+    is.depth (8);
+    check (run (filter, is, img, width, height, PISA_PT_RGB, 0.0,
+                PISA_PT_BW));
+    check (PISA_PT_GRAY == filter.classify ());
+    check (iscan::gray == is.space ());
+    check (8 == is.bits ());
+    check ((size_t) height * width == is.bytes.size ());
+    if (3 < is.bytes.size ())
+      {
+        const unsigned char *p = (const unsigned char *) is.bytes.data ();
+
+        check (0 == p[0] && 4 == p[1] && 8 == p[2] && 12 == p[3]);
+      }
+  }
+}
+
+static bool
+read_pgm (const string& name, int width, int height, page& img)
+{
+  FILE *fp = fopen (name.c_str (), "rb");
+  int w, h, max;
+  bool ok;
+
+  if (!fp) return false;
+  ok = (3 == fscanf (fp, "P5 %d %d %d", &w, &h, &max)
+        && w == width && h == height && 255 == max
+        && '\n' == fgetc (fp));
+  if (ok)
+    {
+      img.resize (width * height);
+      ok = (img.size () == fread (&img[0], 1, img.size (), fp));
+    }
+  fclose (fp);
+  return ok;
+}
+
+// A dropped back page still counts for duplex parity, so the page
+// after it is a front page and must not be rotated.
+static void
+check_skipped_back_page (void)
+{
+  const int width = 16, height = 8;
+  page_filter filter;
+  page img (width * height), rotated (width * height), blank (width * height,
+                                                              240);
+  char dir[] = "test-page-filter.XXXXXX";
+
+  for (int i = 0; i < width * height; ++i)
+    {
+      img[i] = 2 * i;
+      rotated[width * height - 1 - i] = img[i];
+    }
+
+  if (!mkdtemp (dir))
+    {
+      perror ("mkdtemp");
+      ++failures;
+      return;
+    }
+
+  {
+    iscan::file_opener opener (string (dir) + "/page-#.pnm", 1);
+    imgstream *is = iscan::create_imgstream (opener, iscan::PNM, true);
+    const page *pages[] = { &img, &blank, &img, &img };
+
+    for (size_t i = 0; i < sizeof (pages) / sizeof (*pages); ++i)
+      {
+        is->next ();
+        is->size (width, height);
+        is->depth (8);
+        is->colour (iscan::gray);
+        is->resolution (300, 300);
+        if (run (filter, *is, *pages[i], width, height, PISA_PT_GRAY, 0.5,
+                 PISA_PT_GRAY))
+          is->flush ();
+      }
+    delete is;
+  }
+
+  const char *names[] = { "/page-1.pnm", "/page-2.pnm", "/page-3.pnm" };
+  const page *expect[] = { &img, &img, &rotated };
+  page out;
+
+  for (int i = 0; i < 3; ++i)
+    {
+      string name = string (dir) + names[i];
+
+      check (read_pgm (name, width, height, out));
+      check (*expect[i] == out);
+      remove (name.c_str ());
+    }
+  check (0 == rmdir (dir));
+}
+
+// Reads an unsigned integer of size bytes at pos in a TIFF file.
+static unsigned long
+tiff_int (const string& tiff, size_t pos, int size)
+{
+  bool big = ('M' == tiff[0]);
+  unsigned long value = 0;
+
+  if (tiff.size () < pos + size) return 0;
+  for (int i = 0; i < size; ++i)
+    {
+      unsigned char c = tiff[big ? pos + i : pos + size - 1 - i];
+      value = (value << 8) | c;
+    }
+  return value;
+}
+
+// Returns the (first) value of a SHORT or LONG tag in the directory
+// at ifd, or zero when there is no such tag.
+static unsigned long
+tiff_tag (const string& tiff, size_t ifd, int tag)
+{
+  unsigned long entries = tiff_int (tiff, ifd, 2);
+
+  for (size_t pos = ifd + 2; 0 < entries--; pos += 12)
+    {
+      int type = tiff_int (tiff, pos + 2, 2);
+      int size = (3 == type ? 2 : 4);
+
+      if (tag != (int) tiff_int (tiff, pos, 2)) continue;
+      if (3 != type && 4 != type) return 0;
+
+      if (4 < size * tiff_int (tiff, pos + 4, 4))
+        return tiff_int (tiff, tiff_int (tiff, pos + 8, 4), size);
+      return tiff_int (tiff, pos + 8, size);
+    }
+  return 0;
+}
+
+static size_t
+tiff_next (const string& tiff, size_t ifd)
+{
+  return tiff_int (tiff, ifd + 2 + 12 * tiff_int (tiff, ifd, 2), 4);
+}
+
+// Each page of a multi-page TIFF file gets the tags for the colour
+// space and depth it was reduced to.
+static void
+check_tiff_tags (void)
+{
+  if (!iscan::tiffstream::is_usable ())
+    {
+      fprintf (stderr, "libtiff not usable, skipping TIFF checks\n");
+      return;
+    }
+
+  const int width = 64, height = 48;
+  page_filter filter;
+  page text = text_page (width, height), colour = text, photo = text;
+  char dir[] = "test-page-filter.XXXXXX";
+
+  for (int y = 20; y < 28; ++y)
+    for (int x = 20; x < 28; ++x)
+      set_rgb (colour, width, x, y, 200, 30, 30);
+  for (int y = 0; y < height; ++y)
+    for (int x = 0; x < width; ++x)
+      set_rgb (photo, width, x, y, 4 * x, 4 * x, 4 * x);
+
+  if (!mkdtemp (dir))
+    {
+      perror ("mkdtemp");
+      ++failures;
+      return;
+    }
+  string name = string (dir) + "/pages.tif";
+
+  {
+    iscan::file_opener opener (name);
+    imgstream *is = iscan::create_imgstream (opener, iscan::TIF);
+    const page *pages[] = { &colour, &text, &photo, &colour };
+
+    for (size_t i = 0; i < sizeof (pages) / sizeof (*pages); ++i)
+      {
+        is->next ();
+        is->size (width, height);
+        is->depth (8);
+        is->colour (iscan::RGB);
+        is->resolution (300, 300);
+        if (run (filter, *is, *pages[i], width, height, PISA_PT_RGB, 0.0,
+                 PISA_PT_BW))
+          is->flush ();
+      }
+    delete is;
+  }
+
+  string tiff;
+  FILE *fp = fopen (name.c_str (), "rb");
+  if (fp)
+    {
+      char buf[4096];
+      size_t n;
+
+      while (0 < (n = fread (buf, 1, sizeof (buf), fp)))
+        tiff.append (buf, n);
+      fclose (fp);
+    }
+  check (8 < tiff.size ());
+
+  // samples per pixel, bits per sample and photometric interpretation
+  const unsigned long expect[][3] = {
+    { 3, 8, 2 },                // RGB
+    { 1, 1, 0 },                // min-is-white
+    { 1, 8, 1 },                // min-is-black
+    { 3, 8, 2 },
+  };
+  size_t ifd = tiff_int (tiff, 4, 4);
+
+  for (int i = 0; i < 4; ++i)
+    {
+      check (0 != ifd);
+      if (!ifd) break;
+      check (width  == (int) tiff_tag (tiff, ifd, 256));
+      check (height == (int) tiff_tag (tiff, ifd, 257));
+      check (expect[i][0] == tiff_tag (tiff, ifd, 277));
+      check (expect[i][1] == tiff_tag (tiff, ifd, 258));
+      check (expect[i][2] == tiff_tag (tiff, ifd, 262));
+      ifd = tiff_next (tiff, ifd);
+    }
+  check (0 == ifd);
+
+  remove (name.c_str ());
+  check (0 == rmdir (dir));
+}
+
+int
+main (void)
+{
+  check_gray_pages ();
+  check_bw_pages ();
+  check_reduction ();
+  check_skipped_back_page ();
+  check_tiff_tags ();
+
+  return (failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,216 @@
+/* test-region-slicer.cc -- checks cutting and scaling of scan regions
+   Copyright (C) 2009  SEIKO EPSON CORPORATION
+
+   This file is part of the `iscan' program.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+   As a special exception, the copyright holders give permission
+   to link the code of this program with the esmod library and
+   distribute linked combinations including the two.  You must obey
+   the GNU General Public License in all respects for all of the
+   code used other then esmod.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "pisa_enums.h"
+#include "pisa_region_slicer.h"
+
+using std::string;
+using std::vector;
+
+using iscan::imgstream;
+using iscan::region_slicer;
+
+static int failures = 0;
+
+#define check(cond)                                             \
+  do {                                                          \
+    if (!(cond))                                                \
+      {                                                         \
+        fprintf (stderr, "%s:%d: check failed: %s\n",           \
+                 __FILE__, __LINE__, #cond);                    \
+        ++failures;                                             \
+      }                                                         \
+  } while (0)
+
+struct image
+{
+  size_t width;
+  size_t height;
+  iscan::colour_space space;
+  string bytes;
+};
+
+// Collects the images the slicer passes on, one per region.
+class capture : public imgstream
+{
+public:
+  capture (void) : images (1) {}
+
+  imgstream& write (const byte_type *data, size_type n)
+  {
+    images.back ().bytes.append (data, n);
+    return *this;
+  }
+
+  void next (void)
+  {
+    images.push_back (image ());
+  }
+
+  basic_imgstream& size (size_type h_sz, size_type v_sz)
+  {
+    images.back ().width  = h_sz;
+    images.back ().height = v_sz;
+    return *this;
+  }
+
+  basic_imgstream& colour (iscan::colour_space space)
+  {
+    images.back ().space = space;
+    return *this;
+  }
+
+  vector<image> images;
+};
+
+struct area
+{
+  int left, top, width, height;
+  int out_width, out_height;
+};
+
+// Averages the pixels of a region of the scan the obvious way.
+static string
+reference (const vector<unsigned char>& scan, int scan_width, int channels,
+           const area& a, const unsigned char *lut)
+{
+  string out;
+
+  for (int y = 0; y < a.out_height; ++y)
+    for (int x = 0; x < a.out_width; ++x)
+      for (int c = 0; c < channels; ++c)
+        {
+          unsigned long sum = 0, n = 0;
+
+          for (int sy = 0; sy < a.height; ++sy)
+            for (int sx = 0; sx < a.width; ++sx)
+              if (sy * a.out_height / a.height == y
+                  && sx * a.out_width / a.width == x)
+                {
+                  int i = ((a.top + sy) * scan_width + a.left + sx);
+                  sum += lut[scan[i * channels + c]];
+                  ++n;
+                }
+          out += (char) ((sum + n / 2) / n);
+        }
+  return out;
+}
+
+static void
+check_regions (int pixel_type)
+{
+  const int width = 120, height = 80;
+  const int channels = (PISA_PT_RGB == pixel_type ? 3 : 1);
+  vector<unsigned char> scan (width * height * channels);
+  unsigned char identity[256], negative[256];
+  int x, y;
+
+  // a gradient has a different value for each block of pixels that
+  // is averaged, whatever the scale
+  for (y = 0; y < height; ++y)
+    for (x = 0; x < width; ++x)
+      {
+        unsigned char *p = &scan[(y * width + x) * channels];
+
+        p[0] = x + y;
+        if (3 == channels)
+          {
+            p[1] = 2 * x;
+            p[2] = 3 * y;
+          }
+      }
+  for (x = 0; x < 256; ++x)
+    {
+      identity[x] = x;
+      negative[x] = 255 - x;
+    }
+
+  // two overlapping regions at half and a fifth of the scan size, and
+  // one at full size with its own tone curve
+  const area areas[] = {
+    { 10, 10, 60, 40, 30, 20 },
+    { 40, 20, 70, 50, 14, 10 },
+    { 50, 30, 12,  6, 12,  6 },
+  };
+  const unsigned char *luts[] = { identity, identity, negative };
+  const int count = sizeof (areas) / sizeof (*areas);
+
+  region_slicer slicer;
+  capture is;
+
+  slicer.begin (width, height, pixel_type);
+  for (int k = 0; k < count; ++k)
+    slicer.add_region (areas[k].left, areas[k].top,
+                       areas[k].width, areas[k].height,
+                       areas[k].out_width, areas[k].out_height, luts[k]);
+
+  // rows come in a few at a time, not lined up with the regions
+  for (y = 0; y < height; y += 7)
+    slicer.write (&scan[y * width * channels], (height - y < 7
+                                                ? height - y : 7));
+  check (slicer.commit (is));
+
+  check (count == (int) is.images.size ());
+  for (int k = 0; k < count && k < (int) is.images.size (); ++k)
+    {
+      const image& img = is.images[k];
+
+      check (areas[k].out_width  == (int) img.width);
+      check (areas[k].out_height == (int) img.height);
+      check ((3 == channels ? iscan::RGB : iscan::gray) == img.space);
+      check ((size_t) (img.width * img.height * channels)
+             == img.bytes.size ());
+      check (reference (scan, width, channels, areas[k], luts[k])
+             == img.bytes);
+    }
+
+  // the first output pixel averages a 2 x 2 and a 5 x 5 block
+  if (2 <= is.images.size ()
+      && !is.images[0].bytes.empty () && !is.images[1].bytes.empty ())
+    {
+      check (10 + 10 + 1 == (unsigned char) is.images[0].bytes[0]);
+      check (40 + 20 + 4 == (unsigned char) is.images[1].bytes[0]);
+    }
+}
+
+int
+main (void)
+{
+  check_regions (PISA_PT_GRAY);
+  check_regions (PISA_PT_RGB);
+
+  return (failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
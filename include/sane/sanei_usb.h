@@ -334,6 +334,41 @@ extern SANE_Status sanei_usb_reset (SANE_Int dn);
 extern SANE_Status
 sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size);
 
+/** Keep bulk transfer reads in flight.
+ *
+ * Queues urbs asynchronous bulk-in transfers of size bytes each, so
+ * that data can be received whenever the device has some rather than
+ * only during a call to sanei_usb_read_bulk().  sanei_usb_read_bulk()
+ * hands out the received data in order and requeues transfers once
+ * their data has been read.  The size should be a multiple of the
+ * endpoint's maximum packet size.
+ *
+ * This suits devices that stream data on their own.  A transfer only
+ * completes when it is full or the device ends it with a short packet,
+ * so devices that wait for the host before sending more may stall
+ * when a reply does not fill the transfer exactly.
+ *
+ * Passing zero urbs goes back to synchronous reads.  Data that was
+ * received but not read yet is discarded.  Only available with
+ * libusb-1.0.
+ *
+ * No backend in this tree calls this yet.  The epkowa backend's ESC/I
+ * protocol waits for the host after every reply, which is exactly the
+ * case that may stall.
+ *
+ * @param dn device number
+ * @param urbs number of transfers to keep in flight
+ * @param size size of each transfer
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_UNSUPPORTED - if read-ahead is not available
+ * - SANE_STATUS_IO_ERROR - if the transfers could not be queued
+ * - SANE_STATUS_INVAL - on every other error
+ */
+extern SANE_Status
+sanei_usb_set_read_ahead (SANE_Int dn, SANE_Int urbs, size_t size);
+
 /** Initiate a bulk transfer write.
  *
  * Write up to size bytes from buffer to the device. After the write size
@@ -44,21 +44,22 @@ namespace iscan
 {
   imgstream::imgstream (file_opener& opener, file_format format,
                         bool match_direction)
-    : _page (0), _match_direction (match_direction),
-      _opener (&opener), _format (format), _configured (false)
+    : _page (0), _match_direction (match_direction), _skipped (0),
+      _spool (NULL), _opener (&opener), _format (format), _configured (false)
   {
     _stream = create_stream ();
   }
 
   imgstream::imgstream (void)
-    : _page (0), _match_direction (false), _opener (NULL), _format (NO_FORMAT),
-      _stream (NULL), _configured (false)
+    : _page (0), _match_direction (false), _skipped (0), _spool (NULL),
+      _opener (NULL), _format (NO_FORMAT), _stream (NULL), _configured (false)
   {
   }
 
   imgstream::~imgstream (void)
   {
     delete _stream;
+    delete _spool;
   }
 
   imgstream&
@@ -73,9 +74,18 @@ namespace iscan
         _stream->colour (_cspc);
         _stream->depth (_bits);
         _configured = true;
+
+        if (_match_direction && is_back (_page) && PDF != _format)
+          {
+            if (!_spool) _spool = new page_spool ();
+            _spool->open (_h_sz, _v_sz, _bits, _cspc);
+          }
       }
 
-    _stream->write (data, n);
+    if (_spool && _spool->is_open ())
+      _spool->write (data, n);
+    else
+      _stream->write (data, n);
 
     return *this;
   }
@@ -83,7 +93,10 @@ namespace iscan
   imgstream&
   imgstream::flush (void)
   {
-    if (_stream) _stream->flush ();
+    if (!_stream) return *this;
+
+    if (_spool && _spool->is_open ()) _spool->rotate_180 (*_stream);
+    _stream->flush ();
     return *this;
   }
 
@@ -92,6 +105,7 @@ namespace iscan
   {
     if (!_configured) return;
 
+    if (_spool && _spool->is_open ()) _spool->rotate_180 (*_stream);
     delete _stream;
     _configured = false;
 
@@ -101,10 +115,21 @@ namespace iscan
     if (_match_direction) _stream->rotate_180 (is_back (_page));
   }
 
+  //! Accounts for a page that will not be written.
+  /*! The stream stays on the current page but is told which side of
+      the sheet it now corresponds to.
+   */
+  void
+  imgstream::skip_page (void)
+  {
+    ++_skipped;
+    if (_stream && _match_direction) _stream->rotate_180 (is_back (_page));
+  }
+
   bool
   imgstream::is_back (unsigned long page)
   {
-    return 0 == (page+1)%2;
+    return 0 == (page+_skipped+1)%2;
   }
 
   bool
@@ -133,7 +158,8 @@ namespace iscan
     if (opener.is_collating ())
       {
         if (PDF == format) return new pdfstream (opener, match_direction);
-        if (TIF == format) return new tiffstream (opener, opener.name ());
+        if (TIF == format) return new tiffstream (opener, opener.name (),
+                                                 match_direction);
       }
     
     return new imgstream (opener, format, match_direction);
@@ -39,6 +39,7 @@
 
 #include "basic-imgstream.hh"
 #include "file-opener.hh"
+#include "page-spool.hh"
 
 
 namespace iscan
@@ -68,6 +69,7 @@ namespace iscan
     virtual imgstream& flush (void);
 
     virtual void next (void);
+    virtual void skip_page (void);
 
     static bool is_usable (void);
 
@@ -80,6 +82,10 @@ namespace iscan
     unsigned long _page;
     bool _match_direction; // when true, match front and back
                            // orientation for duplex scans
+    unsigned long _skipped; // pages dropped before they were written,
+                            // these still count for duplex parity
+    page_spool *_spool;    // holds back pages for formats that can
+                           // not be told to rotate while writing
 
   private:
     basic_imgstream * create_stream (void);
@@ -0,0 +1,275 @@
+//  page-spool.cc -- buffers a page for re-emission in reverse order
+//  Copyright (C) 2009  SEIKO EPSON CORPORATION
+//
+//  This file is part of the 'iscan' program.
+//
+//  The 'iscan' program is free-ish software.
+//  You can redistribute it and/or modify it under the terms of the GNU
+//  General Public License as published by the Free Software Foundation;
+//  either version 2 of the License or at your option any later version.
+//
+//  This program is distributed in the hope that it will be useful, but
+//  WITHOUT ANY WARRANTY;  without even the implied warranty of FITNESS
+//  FOR A PARTICULAR PURPOSE or MERCHANTABILITY.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a verbatim copy of the GNU General Public
+//  License along with this program; if not, write to:
+//
+//      Free Software Foundation, Inc.
+//      59 Temple Place, Suite 330
+//      Boston, MA  02111-1307  USA
+//
+//  As a special exception, the copyright holders give permission
+//  to link the code of this program with the esmod library and
+//  distribute linked combinations including the two.  You must obey
+//  the GNU General Public License in all respects for all of the
+//  code used other than esmod.
+
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "page-spool.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace iscan
+{
+  //! Smallest amount of file space to set aside at a time.
+  static const size_t min_reserve = 1024 * 1024;
+
+  //! Creates an unlinked temporary file and returns its descriptor.
+  static int
+  tempfile (void)
+  {
+    const char *dirs[] = {
+      getenv ("TMPDIR"),
+#ifdef P_tmpdir
+      P_tmpdir,                 // C library default
+#endif
+      "/tmp",                   // last resort
+    };
+
+    for (size_t i = 0; i < sizeof (dirs) / sizeof (*dirs); ++i)
+      {
+        if (!dirs[i]) continue;
+
+        std::string ts = std::string (dirs[i]) + "/" PACKAGE_TARNAME "XXXXXX";
+        char *tc = new char [ts.length () + 1];
+
+        ts.copy (tc, ts.length ());
+        tc[ts.length ()] = '\0';
+
+        int fd = mkstemp (tc);
+        if (0 <= fd) unlink (tc);
+        delete [] tc;
+
+        if (0 <= fd) return fd;
+      }
+    return -1;
+  }
+
+  //! Bit reversed values for all bytes, for use with 1-bit images.
+  static const basic_imgstream::byte_type *
+  reversed_bits (void)
+  {
+    static basic_imgstream::byte_type table[256];
+    static bool initialised = false;
+
+    if (!initialised)
+      {
+        for (int i = 0; i < 256; ++i)
+          {
+            int r = 0;
+            for (int b = 0; b < 8; ++b)
+              if (i & (1 << b)) r |= 0x80 >> b;
+            table[i] = r;
+          }
+        initialised = true;
+      }
+    return table;
+  }
+
+  page_spool::page_spool (void)
+    : _fd (-1), _map (NULL), _capacity (0), _used (0),
+      _h_sz (0), _bits (0), _pixel_bytes (0), _row_bytes (0), _open (false)
+  {
+  }
+
+  page_spool::~page_spool (void)
+  {
+    if (_map) munmap (_map, _capacity);
+    if (0 <= _fd) ::close (_fd);
+  }
+
+  void
+  page_spool::open (size_type h_sz, size_type v_sz, size_type bits,
+                    colour_space cspc)
+  {
+    size_type channels = 1;
+    if (RGB       == cspc) channels = 3;
+    if (RGB_alpha == cspc) channels = 4;
+
+    _h_sz        = h_sz;
+    _bits        = bits;
+    _pixel_bytes = (bits * channels) / 8;
+    _row_bytes   = (h_sz * bits * channels + 7) / 8;
+
+    if (1 != bits && 0 != bits % 8)
+      throw std::logic_error ("unsupported bit depth");
+    if (1 == bits && 1 != channels)
+      throw std::logic_error ("unsupported colour space");
+
+    if (0 > _fd) _fd = tempfile ();
+    if (0 > _fd) throw std::runtime_error ("cannot create page spool");
+
+    _used = 0;
+    reserve (_row_bytes * v_sz);
+    _open = true;
+  }
+
+  bool
+  page_spool::is_open (void) const
+  {
+    return _open;
+  }
+
+  //! Discards the spooled page, if any.
+  void
+  page_spool::close (void)
+  {
+    _open = false;
+    _used = 0;
+  }
+
+  void
+  page_spool::write (const byte_type *data, size_type n)
+  {
+    if (!data || 0 == n) return;
+
+    reserve (_used + n);
+    memcpy (_map + _used, data, n);
+    _used += n;
+  }
+
+  void
+  page_spool::replay (basic_imgstream& out)
+  {
+    _open = false;
+    if (0 == _row_bytes) return;
+
+    size_type rows = _used / _row_bytes;
+    _used = 0;
+
+    for (size_type i = 0; i < rows; ++i)
+      {
+        out.write (_map + i * _row_bytes, _row_bytes);
+      }
+  }
+
+  void
+  page_spool::rotate_180 (basic_imgstream& out)
+  {
+    _open = false;
+    if (0 == _row_bytes) return;
+
+    size_type rows = _used / _row_bytes;
+    byte_type *row = new byte_type [_row_bytes];
+
+    try
+      {
+        while (0 < rows--)
+          {
+            reverse (row, _map + rows * _row_bytes);
+            out.write (row, _row_bytes);
+          }
+      }
+    catch (...)
+      {
+        delete [] row;
+        _used = 0;
+        throw;
+      }
+    delete [] row;
+    _used = 0;
+  }
+
+  //! Makes sure at least \a n bytes fit in the spool.
+  void
+  page_spool::reserve (size_type n)
+  {
+    if (n <= _capacity) return;
+
+    size_type capacity = (2 * _capacity > n ? 2 * _capacity : n);
+    if (capacity < min_reserve) capacity = min_reserve;
+
+    if (0 != ftruncate (_fd, capacity))
+      throw std::runtime_error ("cannot grow page spool");
+
+    void *map = mmap (NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      _fd, 0);
+    if (MAP_FAILED == map)
+      throw std::runtime_error ("cannot map page spool");
+
+    if (_map) munmap (_map, _capacity);
+    _map      = static_cast< byte_type * > (map);
+    _capacity = capacity;
+  }
+
+  //! Puts the pixels of row \a src in reverse order in \a dst.
+  void
+  page_spool::reverse (byte_type *dst, const byte_type *src) const
+  {
+    const byte_type *end = src + _row_bytes;
+
+    if (1 == _bits)
+      {
+        // Reversing the bytes and their bits moves the padding at the
+        // end of the row to its start.  Shift it back while copying.
+        const byte_type *table = reversed_bits ();
+        unsigned int pad = _row_bytes * 8 - _h_sz;
+        unsigned char b = table[(unsigned char) *--end];
+
+        for (size_type i = 0; i < _row_bytes; ++i)
+          {
+            unsigned char n = (i + 1 < _row_bytes
+                               ? table[(unsigned char) *--end] : 0);
+            dst[i] = (0 == pad ? b : (b << pad) | (n >> (8 - pad)));
+            b = n;
+          }
+      }
+    else if (1 == _pixel_bytes)
+      {
+        while (src != end) *dst++ = *--end;
+      }
+    else if (3 == _pixel_bytes)
+      {
+        while (src != end)
+          {
+            end -= 3;
+            dst[0] = end[0];
+            dst[1] = end[1];
+            dst[2] = end[2];
+            dst += 3;
+          }
+      }
+    else
+      {
+        while (src != end)
+          {
+            end -= _pixel_bytes;
+            memcpy (dst, end, _pixel_bytes);
+            dst += _pixel_bytes;
+          }
+      }
+  }
+
+} // namespace iscan
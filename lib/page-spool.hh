@@ -0,0 +1,94 @@
+//  page-spool.hh -- buffers a page for re-emission in reverse order
+//  Copyright (C) 2009  SEIKO EPSON CORPORATION
+//
+//  This file is part of the 'iscan' program.
+//
+//  The 'iscan' program is free-ish software.
+//  You can redistribute it and/or modify it under the terms of the GNU
+//  General Public License as published by the Free Software Foundation;
+//  either version 2 of the License or at your option any later version.
+//
+//  This program is distributed in the hope that it will be useful, but
+//  WITHOUT ANY WARRANTY;  without even the implied warranty of FITNESS
+//  FOR A PARTICULAR PURPOSE or MERCHANTABILITY.
+//  See the GNU General Public License for more details.
+//
+//  You should have received a verbatim copy of the GNU General Public
+//  License along with this program; if not, write to:
+//
+//      Free Software Foundation, Inc.
+//      59 Temple Place, Suite 330
+//      Boston, MA  02111-1307  USA
+//
+//  As a special exception, the copyright holders give permission
+//  to link the code of this program with the esmod library and
+//  distribute linked combinations including the two.  You must obey
+//  the GNU General Public License in all respects for all of the
+//  code used other than esmod.
+
+
+
+#ifndef iscan_page_spool_hh_included
+#define iscan_page_spool_hh_included
+
+#ifndef __cplusplus
+#error "This is a C++ header file; use a C++ compiler to compile it."
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "basic-imgstream.hh"
+
+namespace iscan
+{
+  //! Holds on to a page so it can be emitted later.
+  /*! Image data is collected in a memory mapped, unlinked temporary
+      file so that even large, high resolution pages do not need to
+      fit in RAM.  Once the page is complete, replay() passes the rows
+      on to an image stream as they were written and rotate_180() does
+      so bottom-up with the pixels of each row in reverse order.  The
+      temporary file is reused for later pages.
+   */
+  class page_spool
+  {
+  public:
+    typedef basic_imgstream::byte_type byte_type;
+    typedef basic_imgstream::size_type size_type;
+
+    page_spool (void);
+    ~page_spool (void);
+
+    void open (size_type h_sz, size_type v_sz, size_type bits,
+               colour_space cspc);
+    bool is_open (void) const;
+    void close (void);
+
+    void write (const byte_type *data, size_type n);
+    void replay (basic_imgstream& out);
+    void rotate_180 (basic_imgstream& out);
+
+  private:
+    void reserve (size_type n);
+    void reverse (byte_type *dst, const byte_type *src) const;
+
+    int        _fd;
+    byte_type *_map;
+    size_type  _capacity;
+    size_type  _used;
+
+    size_type  _h_sz;
+    size_type  _bits;
+    size_type  _pixel_bytes;
+    size_type  _row_bytes;
+    bool       _open;
+
+  private:                        // undefined to prevent copying
+    page_spool (const page_spool&);
+    page_spool& operator= (const page_spool&);
+  };
+
+} // namespace iscan
+
+#endif /* iscan_page_spool_hh_included */
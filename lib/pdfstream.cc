@@ -120,6 +120,16 @@ pdfstream::next ()
   _rotate_180 = _match_direction && is_back (_page);
 }
 
+void
+pdfstream::skip_page ()
+{
+  imgstream::skip_page ();
+  if (0 == _row)
+    {
+      _rotate_180 = _match_direction && is_back (_page);
+    }
+}
+
 imgstream&
 pdfstream::write (const byte_type *line, size_type n)
 {
@@ -284,6 +294,8 @@ pdfstream::write_image_object (pdf::dictionary& image, std::string name)
     }
   else
     {
+      delete _g3;               // pages may differ in colour space
+      _g3 = NULL;
       _do_jpeg = iscan::jpegstream::is_usable ();
     }
   image.insert ("ColorSpace", pdf::primitive (dev));
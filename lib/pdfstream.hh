@@ -90,6 +90,7 @@ public:
   virtual imgstream& write (const byte_type *line, size_type n);
 
   virtual void next ();
+  virtual void skip_page ();
   virtual void rotate_180 (bool yes);
 
 private:
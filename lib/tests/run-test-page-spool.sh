@@ -0,0 +1,46 @@
+#! /bin/sh
+#  run-test-page-spool.sh --  unit test for page_spool class
+#  Copyright (C) 2011  SEIKO EPSON CORPORATION
+#
+#  License: GPLv2+
+#  Authors: AVASYS CORPORATION
+#
+#  This file is part of the "Image Scan!" test suite.
+#
+#  The "Image Scan!" test suite is free software.
+#  You can redistribute it and/or modify it under the terms of the GNU
+#  General Public License as published by the Free Software Foundation;
+#  either version 2 of the License or at your option any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#  You ought to have received a copy of the GNU General Public License
+#  along with this package.  If not, see <http://www.gnu.org/licenses/>.
+
+if ! test -x ./test-page-spool; then
+    echo "FAIL: ./test-page-spool not found, run make first"
+    exit 1
+fi
+
+# `make check` normally sets $srcdir
+SRCDIR=${srcdir:=.}
+TEST_RESULT=PASS
+for input in \
+    "$SRCDIR/even-width.pbm" \
+    "$SRCDIR/even-width.pgm" \
+    "$SRCDIR/even-width.ppm" \
+    "$SRCDIR/odd-width.pbm" \
+    "$SRCDIR/odd-width.pgm" \
+    "$SRCDIR/odd-width.ppm" \
+    ; do
+    if ! ./test-page-spool "$input"; then
+        echo "FAIL: ./test-page-spool $input"
+        TEST_RESULT=FAIL
+    fi
+done
+
+test "PASS" = "$TEST_RESULT"
+exit $?
@@ -0,0 +1,137 @@
+/*  test-page-spool.cc -- unit test for the page_spool class
+ *  Copyright (C) 2011  SEIKO EPSON CORPORATION
+ *
+ *  License: AVASYS PUBLIC LICENSE
+ *  Author : AVASYS CORPORATION
+ *
+ *  This file is part of Image Scan! for Linux.
+ *  It is distributed under the terms of the AVASYS PUBLIC LICENSE.
+ *
+ *  You should have received a verbatim copy of the AVASYS PUBLIC
+ *  LICENSE along with the software.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "page-spool.hh"
+#include "pnm.h"
+
+//! Collects the rows that are written to it.
+class capture : public iscan::basic_imgstream
+{
+public:
+  capture& write (const byte_type *line, size_type n)
+  {
+    rows.push_back (std::string (line, n));
+    return *this;
+  }
+
+  std::vector< std::string > rows;
+};
+
+//! Returns the value of pixel \a x in \a row, or of one of its samples.
+static int
+sample (const unsigned char *row, int x, int depth, int channels, int c)
+{
+  if (1 == depth) return (row[x / 8] >> (7 - x % 8)) & 1;
+  return row[channels * x + c];
+}
+
+int main (int argc, char *argv[])
+{
+  using iscan::page_spool;
+
+  if (argc != 2)
+  {
+    std::cerr << "usage: ./test-page-spool input.pnm"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  pnm *img = read_pnm (argv[1]);
+  if (!img)
+    return EXIT_FAILURE;
+
+  iscan::colour_space space;
+  int channels = 1;
+  if (1 == img->format)
+  {
+    space = iscan::RGB;
+    channels = 3;
+  }
+  else if (0 == img->format && 1 == img->depth)
+    space = iscan::mono;
+  else if (0 == img->format)
+    space = iscan::grey;
+  else
+    return EXIT_FAILURE;
+
+  page_spool spool;
+  capture plain;
+  capture rotated;
+
+  const unsigned char *buf = (const unsigned char *) img->buffer;
+  int l;
+
+  spool.open (img->pixels_per_line, img->lines, img->depth, space);
+  for (l=0; l<img->lines; ++l)
+    spool.write ((const char *) buf + l * img->bytes_per_line,
+                 img->bytes_per_line);
+  spool.replay (plain);
+
+  spool.open (img->pixels_per_line, img->lines, img->depth, space);
+  for (l=0; l<img->lines; ++l)
+    spool.write ((const char *) buf + l * img->bytes_per_line,
+                 img->bytes_per_line);
+  spool.rotate_180 (rotated);
+
+  if (img->lines != (int) plain.rows.size ()
+      || img->lines != (int) rotated.rows.size ())
+  {
+    std::cerr << argv[1] << ": row count mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Compare pixel by pixel with the rotation done the obvious way.
+  // Padding bits at the end of 1-bit rows carry no pixels.
+  int errors = 0;
+  for (l=0; l<img->lines; ++l)
+  {
+    const unsigned char *src = buf + l * img->bytes_per_line;
+    const unsigned char *ref = buf + (img->lines - 1 - l) * img->bytes_per_line;
+    const unsigned char *out = (const unsigned char *) rotated.rows[l].data ();
+
+    if (plain.rows[l] != std::string ((const char *) src, img->bytes_per_line))
+      ++errors;
+    if (img->bytes_per_line != (int) rotated.rows[l].size ())
+    {
+      ++errors;
+      continue;
+    }
+
+    for (int x=0; x<img->pixels_per_line; ++x)
+    {
+      int rx = img->pixels_per_line - 1 - x;
+      for (int c=0; c<channels; ++c)
+        if (sample (out, x, img->depth, channels, c)
+            != sample (ref, rx, img->depth, channels, c))
+          ++errors;
+    }
+  }
+
+  free (img->buffer);
+  free (img);
+
+  if (errors)
+  {
+    std::cerr << argv[1] << ": " << errors << " mismatches" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
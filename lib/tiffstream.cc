@@ -44,10 +44,11 @@ namespace iscan
   static void handle_warning (const char *module, const char *fmt, va_list ap);
 
 
-  tiffstream::tiffstream (FILE *fp, const string& name)
+  tiffstream::tiffstream (FILE *fp, const string& name, bool match_direction)
     : _stream (fp)
   {
     if (!_stream) throw std::invalid_argument ("invalid file handle");
+    _match_direction = match_direction;
     init (name);                // handles HAVE_TIFFIO_H only stuff
   }
 
@@ -64,9 +65,17 @@ namespace iscan
   {
     if (!line || 0 == n) return *this;
 
-    if (0 == _page)
+    if (_need_tags)             // first data for the page
       {
         set_tags ();
+        _need_tags = false;
+        spool_back_page ();
+      }
+
+    if (_spool && _spool->is_open ())
+      {
+        _spool->write (line, n);
+        return *this;
       }
 
 #if HAVE_TIFFIO_H
@@ -79,9 +88,18 @@ namespace iscan
     return *this;
   }
 
+  imgstream&
+  tiffstream::flush (void)
+  {
+    if (_spool && _spool->is_open ()) _spool->rotate_180 (*this);
+    return *this;
+  }
+
   void
   tiffstream::next (void)
   {
+    if (_spool && _spool->is_open ()) _spool->rotate_180 (*this);
+
 #if HAVE_TIFFIO_H
     if (0 == _row) return;
 #endif
@@ -93,9 +111,14 @@ namespace iscan
           {
             throw std::runtime_error ("failure writing TIFF directory");
           }
+        _row = 0;
 #endif
       }
-    set_tags ();
+
+    // The tags are set when the page's first data comes in, so they
+    // reflect any changes in size, colour space or depth made after
+    // this call.
+    _need_tags = true;
   }
 
   bool
@@ -217,6 +240,23 @@ namespace iscan
     return;
   }
 
+  //! Diverts the current page to the spool when it needs rotation.
+  void
+  tiffstream::spool_back_page (void)
+  {
+    if (!_match_direction) return;
+
+    if (is_back (_page - 1))
+      {
+        if (!_spool) _spool = new page_spool ();
+        if (!_spool->is_open ()) _spool->open (_h_sz, _v_sz, _bits, _cspc);
+      }
+    else if (_spool)
+      {
+        _spool->close ();
+      }
+  }
+
   void
   tiffstream::check_consistency (void) const
   {
@@ -238,6 +278,8 @@ namespace iscan
         throw std::runtime_error (lib->message);
       }
 
+    _need_tags = true;
+
 #if HAVE_TIFFIO_H
     _row = 0;
     // libtiff uses 'b' to signal big-endian, not binary as fopen()!
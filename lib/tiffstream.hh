@@ -55,10 +55,11 @@ namespace iscan
     typedef basic_imgstream::byte_type byte_type;
     typedef basic_imgstream::size_type size_type;
 
-    tiffstream (FILE *fp, const string& name);
+    tiffstream (FILE *fp, const string& name, bool match_direction = false);
     virtual ~tiffstream (void);
 
     virtual imgstream& write (const byte_type *line, size_type n);
+    virtual imgstream& flush (void);
 
     virtual void next (void);
 
@@ -66,11 +67,13 @@ namespace iscan
 
   private:
     void set_tags (void);
+    void spool_back_page (void);
     void check_consistency (void) const;
 
     void init (const string& name);
 
     FILE *_stream;
+    bool  _need_tags;
 
     static bool validate (lt_dlhandle h);
     struct tiff_lib_handle
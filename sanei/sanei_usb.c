@@ -73,6 +73,7 @@
 
 #ifdef HAVE_LIBUSB_1_0
 #include <libusb.h>
+#include "sanei_usb_read_ahead.h"
 #endif /* HAVE_LIBUSB_1_0 */
 
 #ifdef HAVE_USBCALLS
@@ -152,6 +153,9 @@ typedef struct
 #ifdef HAVE_LIBUSB_1_0
   libusb_device *lu_device;
   libusb_device_handle *lu_handle;
+  sanei_usb_read_ahead *read_ahead;
+  SANE_Int read_ahead_urbs;
+  size_t read_ahead_size;
 #endif /* HAVE_LIBUSB_1_0 */
 #if defined (__linux__) && (defined(HAVE_LIBUSB) || defined(HAVE_LIBUSB_1_0))
 #if defined (USB_MAXINTERFACES)
@@ -2295,6 +2299,10 @@ sanei_usb_close (SANE_Int dn)
     }
 #elif defined(HAVE_LIBUSB_1_0)
     {
+      sanei_usb_read_ahead_free (devices[dn].read_ahead);
+      devices[dn].read_ahead = NULL;
+      devices[dn].read_ahead_urbs = 0;
+
 #ifndef __macos_x__             /* assuming this is what is used on
                                    Mac OS X, haven't checked */
       /* Should only be done in case of a stall */
@@ -2369,6 +2377,10 @@ sanei_usb_clear_halt (SANE_Int dn)
       return SANE_STATUS_INVAL;
     }
 
+  /* transfers in flight would be lost anyway */
+  sanei_usb_read_ahead_free (devices[dn].read_ahead);
+  devices[dn].read_ahead = NULL;
+
   ret = libusb_clear_halt (devices[dn].lu_handle, devices[dn].bulk_in_ep);
   if (ret){
     DBG (1, "sanei_usb_clear_halt: BULK_IN ret=%d\n", ret);
@@ -2380,6 +2392,10 @@ sanei_usb_clear_halt (SANE_Int dn)
     DBG (1, "sanei_usb_clear_halt: BULK_OUT ret=%d\n", ret);
     return SANE_STATUS_INVAL;
   }
+
+  if (devices[dn].read_ahead_urbs)
+    sanei_usb_set_read_ahead (dn, devices[dn].read_ahead_urbs,
+                              devices[dn].read_ahead_size);
 #else /* not HAVE_LIBUSB && not HAVE_LIBUSB_1_0 */
   DBG (1, "sanei_usb_clear_halt: libusb support missing\n");
 #endif /* HAVE_LIBUSB || HAVE_LIBUSB_1_0 */
@@ -2402,11 +2418,18 @@ sanei_usb_reset (SANE_Int dn)
 #elif defined(HAVE_LIBUSB_1_0)
   int ret;
 
+  sanei_usb_read_ahead_free (devices[dn].read_ahead);
+  devices[dn].read_ahead = NULL;
+
   ret = libusb_reset_device (devices[dn].lu_handle);
   if (ret){
     DBG (1, "sanei_usb_reset: ret=%d\n", ret);
     return SANE_STATUS_INVAL;
   }
+
+  if (devices[dn].read_ahead_urbs)
+    sanei_usb_set_read_ahead (dn, devices[dn].read_ahead_urbs,
+                              devices[dn].read_ahead_size);
   
 #else /* not HAVE_LIBUSB && not HAVE_LIBUSB_1_0 */
   DBG (1, "sanei_usb_reset: libusb support missing\n");
@@ -2415,6 +2438,60 @@ sanei_usb_reset (SANE_Int dn)
   return SANE_STATUS_GOOD;
 }
 
+SANE_Status
+sanei_usb_set_read_ahead (SANE_Int dn, SANE_Int urbs, size_t size)
+{
+  if (dn >= device_number || dn < 0)
+    {
+      DBG (1, "sanei_usb_set_read_ahead: dn >= device number || dn < 0\n");
+      return SANE_STATUS_INVAL;
+    }
+
+#ifdef HAVE_LIBUSB_1_0
+  if (devices[dn].method != sanei_usb_method_libusb)
+    {
+      DBG (3, "sanei_usb_set_read_ahead: not supported for access method "
+           "%d\n", devices[dn].method);
+      return SANE_STATUS_UNSUPPORTED;
+    }
+  if (!devices[dn].bulk_in_ep)
+    {
+      DBG (1, "sanei_usb_set_read_ahead: can't read without a bulk-in "
+           "endpoint\n");
+      return SANE_STATUS_INVAL;
+    }
+
+  sanei_usb_read_ahead_free (devices[dn].read_ahead);
+  devices[dn].read_ahead = NULL;
+  devices[dn].read_ahead_urbs = urbs;
+  devices[dn].read_ahead_size = size;
+
+  if (0 >= urbs)
+    {
+      devices[dn].read_ahead_urbs = 0;
+      DBG (5, "sanei_usb_set_read_ahead: disabled for device %d\n", dn);
+      return SANE_STATUS_GOOD;
+    }
+
+  devices[dn].read_ahead
+    = sanei_usb_read_ahead_new (sanei_usb_ctx, devices[dn].lu_handle,
+                                devices[dn].bulk_in_ep, urbs, size);
+  if (!devices[dn].read_ahead)
+    {
+      DBG (1, "sanei_usb_set_read_ahead: failed to queue %d transfers of "
+           "%lu bytes\n", urbs, (unsigned long) size);
+      devices[dn].read_ahead_urbs = 0;
+      return SANE_STATUS_IO_ERROR;
+    }
+  DBG (5, "sanei_usb_set_read_ahead: %d transfers of %lu bytes in flight "
+       "for device %d\n", urbs, (unsigned long) size, dn);
+  return SANE_STATUS_GOOD;
+#else /* not HAVE_LIBUSB_1_0 */
+  DBG (3, "sanei_usb_set_read_ahead: libusb-1.0 support missing\n");
+  return SANE_STATUS_UNSUPPORTED;
+#endif /* not HAVE_LIBUSB_1_0 */
+}
+
 SANE_Status
 sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
 {
@@ -2435,6 +2512,25 @@ sanei_usb_read_bulk (SANE_Int dn, SANE_Byte * buffer, size_t * size)
       return SANE_STATUS_INVAL;
     }
 
+#ifdef HAVE_LIBUSB_1_0
+  if (devices[dn].read_ahead)
+    {
+      SANE_Status status;
+      size_t wanted = *size;
+
+      status = sanei_usb_read_ahead_read (devices[dn].read_ahead,
+                                          buffer, size, libusb_timeout);
+      if (SANE_STATUS_GOOD != status)
+        DBG (1, "sanei_usb_read_bulk: read ahead failed: status %d\n",
+             status);
+      else if (debug_level > 10)
+        print_buffer (buffer, *size);
+      DBG (5, "sanei_usb_read_bulk: wanted %lu bytes, got %lu bytes\n",
+           (unsigned long) wanted, (unsigned long) *size);
+      return status;
+    }
+#endif /* HAVE_LIBUSB_1_0 */
+
   do
     {
       ++tries;
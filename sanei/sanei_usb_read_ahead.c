@@ -0,0 +1,278 @@
+/* sane - Scanner Access Now Easy.
+   Copyright (C) 2009 SEIKO EPSON CORPORATION
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+
+   This file keeps asynchronous bulk reads in flight for sanei_usb.  */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef HAVE_LIBUSB_1_0
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "sanei_usb_read_ahead.h"
+
+typedef struct
+{
+  struct libusb_transfer *xfer;
+  int done;			/* set by the completion callback */
+  size_t offset;		/* bytes handed out so far */
+}
+urb_type;
+
+struct sanei_usb_read_ahead
+{
+  libusb_context *ctx;
+  libusb_device_handle *handle;
+  unsigned char ep;
+  int count;
+  int head;			/* oldest transfer, next to be read */
+  urb_type *urb;
+};
+
+static void
+read_ahead_callback (struct libusb_transfer *xfer)
+{
+  ((urb_type *) xfer->user_data)->done = 1;
+}
+
+static int
+submit (urb_type * u)
+{
+  int ret;
+
+  u->done = 0;
+  u->offset = 0;
+  ret = libusb_submit_transfer (u->xfer);
+  if (0 > ret)
+    {
+      /* make the failure show up when this transfer is read */
+      u->xfer->status = LIBUSB_TRANSFER_ERROR;
+      u->done = 1;
+    }
+  return ret;
+}
+
+/* Hand the transfer at the head back to the device and move on.  */
+static void
+advance (sanei_usb_read_ahead * ra)
+{
+  urb_type *u = &ra->urb[ra->head];
+
+  if (LIBUSB_TRANSFER_NO_DEVICE != u->xfer->status)
+    submit (u);
+  ra->head = (ra->head + 1) % ra->count;
+}
+
+/* Handle events until u completes or timeout milliseconds have
+   passed, zero meaning no limit.  Returns zero on time out.  */
+static int
+wait_for (sanei_usb_read_ahead * ra, urb_type * u, unsigned int timeout)
+{
+  struct timeval deadline, now, tv;
+
+  gettimeofday (&deadline, NULL);
+  deadline.tv_sec += timeout / 1000;
+  deadline.tv_usec += (timeout % 1000) * 1000;
+  if (deadline.tv_usec >= 1000000)
+    {
+      deadline.tv_sec += 1;
+      deadline.tv_usec -= 1000000;
+    }
+
+  while (!u->done)
+    {
+      if (timeout)
+	{
+	  gettimeofday (&now, NULL);
+	  if (!timercmp (&now, &deadline, <))
+	    return 0;
+	  timersub (&deadline, &now, &tv);
+	}
+      else
+	{
+	  tv.tv_sec = 1;
+	  tv.tv_usec = 0;
+	}
+      if (0 > libusb_handle_events_timeout (ra->ctx, &tv))
+	return 0;
+    }
+  return 1;
+}
+
+sanei_usb_read_ahead *
+sanei_usb_read_ahead_new (libusb_context * ctx, libusb_device_handle * handle,
+			  unsigned char ep, int urbs, size_t size)
+{
+  sanei_usb_read_ahead *ra;
+  int i;
+
+  if (0 >= urbs || 0 == size)
+    return NULL;
+
+  ra = calloc (1, sizeof (*ra));
+  if (!ra)
+    return NULL;
+
+  ra->ctx = ctx;
+  ra->handle = handle;
+  ra->ep = ep;
+  ra->urb = calloc (urbs, sizeof (*ra->urb));
+  if (!ra->urb)
+    {
+      free (ra);
+      return NULL;
+    }
+
+  for (i = 0; i < urbs; ++i)
+    {
+      urb_type *u = &ra->urb[i];
+      unsigned char *buf = malloc (size);
+
+      u->xfer = (buf ? libusb_alloc_transfer (0) : NULL);
+      if (!u->xfer)
+	{
+	  free (buf);
+	  sanei_usb_read_ahead_free (ra);
+	  return NULL;
+	}
+      libusb_fill_bulk_transfer (u->xfer, handle, ep, buf, (int) size,
+				 read_ahead_callback, u, 0);
+      u->done = 1;		/* not in flight */
+      ra->count = i + 1;
+    }
+
+  for (i = 0; i < ra->count; ++i)
+    {
+      if (0 > submit (&ra->urb[i]))
+	{
+	  sanei_usb_read_ahead_free (ra);
+	  return NULL;
+	}
+    }
+  return ra;
+}
+
+void
+sanei_usb_read_ahead_free (sanei_usb_read_ahead * ra)
+{
+  int i;
+  int stuck = 0;
+
+  if (!ra)
+    return;
+
+  for (i = 0; i < ra->count; ++i)
+    if (!ra->urb[i].done)
+      libusb_cancel_transfer (ra->urb[i].xfer);
+
+  for (i = 0; i < ra->count; ++i)
+    {
+      urb_type *u = &ra->urb[i];
+
+      /* libusb calls back for every cancelled transfer but a transfer
+         that is still in flight must not be freed */
+      if (!wait_for (ra, u, 5 * 1000))
+	{
+	  ++stuck;
+	  continue;
+	}
+
+      free (u->xfer->buffer);
+      libusb_free_transfer (u->xfer);
+    }
+
+  /* A transfer that never came back may still complete later and its
+     callback writes into ra->urb.  Leak the lot rather than have it
+     scribble over freed memory.  */
+  if (stuck)
+    return;
+
+  free (ra->urb);
+  free (ra);
+}
+
+SANE_Status
+sanei_usb_read_ahead_read (sanei_usb_read_ahead * ra, SANE_Byte * buffer,
+			   size_t * size, unsigned int timeout)
+{
+  urb_type *u = &ra->urb[ra->head];
+  struct libusb_transfer *xfer = u->xfer;
+  size_t n;
+
+  if (!wait_for (ra, u, timeout))
+    {
+      *size = 0;
+      return SANE_STATUS_IO_ERROR;
+    }
+
+  if (LIBUSB_TRANSFER_COMPLETED != xfer->status)
+    {
+      if (LIBUSB_TRANSFER_STALL == xfer->status)
+	libusb_clear_halt (ra->handle, ra->ep);
+      advance (ra);
+      *size = 0;
+      return SANE_STATUS_IO_ERROR;
+    }
+
+  if (0 == xfer->actual_length)
+    {
+      advance (ra);
+      *size = 0;
+      return SANE_STATUS_EOF;
+    }
+
+  n = xfer->actual_length - u->offset;
+  if (n > *size)
+    n = *size;
+  memcpy (buffer, xfer->buffer + u->offset, n);
+  u->offset += n;
+  *size = n;
+
+  if (u->offset == (size_t) xfer->actual_length)
+    advance (ra);
+
+  return SANE_STATUS_GOOD;
+}
+
+#endif /* HAVE_LIBUSB_1_0 */
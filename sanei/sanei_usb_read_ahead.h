@@ -0,0 +1,104 @@
+/* sane - Scanner Access Now Easy.
+   Copyright (C) 2009 SEIKO EPSON CORPORATION
+   This file is part of the SANE package.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston,
+   MA 02111-1307, USA.
+
+   As a special exception, the authors of SANE give permission for
+   additional uses of the libraries contained in this release of SANE.
+
+   The exception is that, if you link a SANE library with other files
+   to produce an executable, this does not by itself cause the
+   resulting executable to be covered by the GNU General Public
+   License.  Your use of that executable is in no way restricted on
+   account of linking the SANE library code into it.
+
+   This exception does not, however, invalidate any other reasons why
+   the executable file might be covered by the GNU General Public
+   License.
+
+   If you submit changes to SANE to the maintainers to be included in
+   a subsequent release, you agree by submitting the changes that
+   those changes may be distributed with this exception intact.
+
+   If you write modifications of your own for SANE, it is your choice
+   whether to permit this exception to apply to your modifications.
+   If you do not wish that, delete this exception notice.
+*/
+
+/** @file sanei_usb_read_ahead.h
+ * Asynchronous bulk-in read-ahead for sanei_usb (libusb-1.0 only).
+ *
+ * A read-ahead keeps a number of bulk-in transfers queued on an
+ * endpoint so that the host controller can move data whenever the
+ * device has some, rather than only while a synchronous read is in
+ * progress.  Received data is handed out in order by
+ * sanei_usb_read_ahead_read(), which has the same semantics as
+ * sanei_usb_read_bulk().
+ *
+ * This is internal to sanei_usb.  Use sanei_usb_set_read_ahead().
+ */
+
+#ifndef sanei_usb_read_ahead_h
+#define sanei_usb_read_ahead_h
+
+#include <stddef.h>
+#include <libusb.h>
+#include <sane/sane.h>
+
+typedef struct sanei_usb_read_ahead sanei_usb_read_ahead;
+
+/** Create a read-ahead and submit its transfers.
+ *
+ * @param ctx libusb context used to handle events
+ * @param handle device handle
+ * @param ep bulk-in endpoint address
+ * @param urbs number of transfers to keep in flight
+ * @param size size of each transfer, a multiple of the endpoint's
+ *        maximum packet size
+ *
+ * @return the read-ahead or NULL if it could not be set up
+ */
+extern sanei_usb_read_ahead *
+sanei_usb_read_ahead_new (libusb_context *ctx, libusb_device_handle *handle,
+			  unsigned char ep, int urbs, size_t size);
+
+/** Cancel all transfers in flight and release the read-ahead.
+ *
+ * Data that has been received but not read yet is discarded.  Waits
+ * up to five seconds for each cancelled transfer to call back.  If a
+ * transfer still has not come back by then, its memory and that of
+ * the read-ahead are leaked because libusb may still complete it.
+ */
+extern void sanei_usb_read_ahead_free (sanei_usb_read_ahead *ra);
+
+/** Read up to size bytes of data received by the read-ahead.
+ *
+ * Waits up to timeout milliseconds for the oldest transfer to
+ * complete.  The data of a single transfer may be handed out over
+ * several calls but a call never returns data from more than one
+ * transfer, just like a synchronous bulk read.
+ *
+ * @return
+ * - SANE_STATUS_GOOD - on success
+ * - SANE_STATUS_EOF - if a zero length transfer was received
+ * - SANE_STATUS_IO_ERROR - on time out or transfer errors
+ */
+extern SANE_Status
+sanei_usb_read_ahead_read (sanei_usb_read_ahead *ra, SANE_Byte *buffer,
+			   size_t *size, unsigned int timeout);
+
+#endif /* sanei_usb_read_ahead_h */